@@ -9,6 +9,7 @@
  * license.
  */
 
+#include <config.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -18,61 +19,480 @@
 #include "privileges.h"
 #include "user-list.h"
 
+/* Milliseconds to wait for ~/.dmrc if there is no cached copy */
+#define DEFAULT_DMRC_TIMEOUT 2000
+
+/* Maximum number of home directories to access at once */
+#define MAX_WORKERS 4
+
+typedef struct
+{
+    gint ref_count;
+
+    /* User to access as */
+    gchar *username;
+    uid_t uid;
+    gid_t gid;
+
+    /* Location of ~/.dmrc and the cached copy */
+    gchar *path;
+    gchar *cache_path;
+
+    /* TRUE if writing, otherwise reading */
+    gboolean write;
+
+    /* Milliseconds after which access is considered slow */
+    gint timeout;
+
+    /* Write serial of the user when the read was started */
+    guint write_serial;
+
+    /* TRUE when the read is complete and the data read, if any */
+    gboolean done;
+    gchar *data;
+
+    /* TRUE if a caller has given up waiting for this read */
+    gboolean timed_out;
+
+    /* Asynchronous loads waiting for this read to complete */
+    GList *tasks;
+} DmrcRequest;
+
+typedef struct
+{
+    /* Read of ~/.dmrc in progress */
+    DmrcRequest *read;
+
+    /* Data to write to ~/.dmrc and TRUE if a worker is writing it */
+    gchar *write_data;
+    gboolean writing;
+
+    /* Incremented for each write so older reads don't replace the cache */
+    guint write_serial;
+} DmrcUser;
+
+/* Protects the following and the contents of requests */
+static GMutex dmrc_lock;
+static GCond dmrc_cond;
+static GThreadPool *dmrc_pool = NULL;
+static GHashTable *dmrc_users = NULL;
+
+/* Held while writing the cache so an older copy can't replace a newer one.
+ * Taken before dmrc_lock if both are needed */
+static GMutex cache_lock;
+
+static DmrcRequest *
+dmrc_request_ref (DmrcRequest *request)
+{
+    g_atomic_int_inc (&request->ref_count);
+    return request;
+}
+
+static void
+dmrc_request_unref (DmrcRequest *request)
+{
+    if (!g_atomic_int_dec_and_test (&request->ref_count))
+        return;
+
+    g_free (request->username);
+    g_free (request->path);
+    g_free (request->cache_path);
+    g_free (request->data);
+    g_list_free_full (request->tasks, g_object_unref);
+    g_free (request);
+}
+
+static void
+dmrc_user_free (gpointer data)
+{
+    DmrcUser *dmrc_user = data;
+    g_free (dmrc_user->write_data);
+    g_free (dmrc_user);
+}
+
+/* Call with dmrc_lock held */
+static DmrcUser *
+get_dmrc_user (const gchar *username)
+{
+    if (!dmrc_users)
+        dmrc_users = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, dmrc_user_free);
+
+    DmrcUser *dmrc_user = g_hash_table_lookup (dmrc_users, username);
+    if (!dmrc_user)
+    {
+        dmrc_user = g_malloc0 (sizeof (DmrcUser));
+        g_hash_table_insert (dmrc_users, g_strdup (username), dmrc_user);
+    }
+
+    return dmrc_user;
+}
+
+static gchar *
+get_cache_path (CommonUser *user)
+{
+    g_autofree gchar *filename = g_strdup_printf ("%s.dmrc", common_user_get_name (user));
+    g_autofree gchar *cache_dir = config_get_string (config_get_instance (), "LightDM", "cache-directory");
+    return g_build_filename (cache_dir, "dmrc", filename, NULL);
+}
+
+static void
+write_cache (const gchar *cache_path, const gchar *data, gsize length)
+{
+    g_autofree gchar *dmrc_cache_dir = g_path_get_dirname (cache_path);
+    if (g_mkdir_with_parents (dmrc_cache_dir, 0700) < 0)
+        g_warning ("Failed to make DMRC cache directory %s: %s", dmrc_cache_dir, strerror (errno));
+
+    g_file_set_contents (cache_path, data, length, NULL);
+}
+
+/* Home directories are accessed from a worker thread if the permissions can
+ * be changed for just that thread */
+static gboolean
+use_workers (void)
+{
+#ifdef HAVE_SETFSUID
+    return TRUE;
+#else
+    return geteuid () != 0;
+#endif
+}
+
+/* Guard against privilege escalation through symlinks, etc. */
+static gboolean
+become_user (uid_t uid, gid_t gid)
+{
+    if (geteuid () != 0)
+        return FALSE;
+
+#ifdef HAVE_SETFSUID
+    privileges_drop_thread (uid, gid);
+#else
+    privileges_drop (uid, gid);
+#endif
+
+    return TRUE;
+}
+
+static void
+become_root (void)
+{
+#ifdef HAVE_SETFSUID
+    privileges_reclaim_thread ();
+#else
+    privileges_reclaim ();
+#endif
+}
+
+static void
+record_time (DmrcRequest *request, gint64 start_time)
+{
+    gint64 time = g_get_monotonic_time () - start_time;
+
+    if (time > request->timeout * G_TIME_SPAN_MILLISECOND)
+        g_warning ("Accessing %s took %" G_GINT64_FORMAT "ms", request->path, time / 1000);
+    else
+        g_debug ("Accessed %s in %" G_GINT64_FORMAT "ms", request->path, time / 1000);
+}
+
+static GKeyFile *
+make_key_file (const gchar *data)
+{
+    GKeyFile *dmrc_file = g_key_file_new ();
+    if (data)
+        g_key_file_load_from_data (dmrc_file, data, -1, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    return dmrc_file;
+}
+
+/* Keep the cached copy up to date, unless it has been written since */
+static void
+refresh_cache (DmrcRequest *request, const gchar *data, gsize length)
+{
+    g_autoptr(GMutexLocker) cache_locker = g_mutex_locker_new (&cache_lock);
+
+    g_mutex_lock (&dmrc_lock);
+    DmrcUser *dmrc_user = get_dmrc_user (request->username);
+    gboolean is_current = !dmrc_user->writing && dmrc_user->write_serial == request->write_serial;
+    g_mutex_unlock (&dmrc_lock);
+    if (!is_current)
+        return;
+
+    g_autofree gchar *cache_data = NULL;
+    if (!g_file_get_contents (request->cache_path, &cache_data, NULL, NULL) || strcmp (cache_data, data) != 0)
+        write_cache (request->cache_path, data, length);
+}
+
+static void
+read_dmrc (DmrcRequest *request)
+{
+    gint64 start_time = g_get_monotonic_time ();
+    gboolean changed_user = become_user (request->uid, request->gid);
+    g_autofree gchar *data = NULL;
+    gsize length = 0;
+    g_file_get_contents (request->path, &data, &length, NULL);
+    if (changed_user)
+        become_root ();
+    record_time (request, start_time);
+
+    g_mutex_lock (&dmrc_lock);
+
+    DmrcUser *dmrc_user = get_dmrc_user (request->username);
+    if (dmrc_user->read == request)
+    {
+        dmrc_user->read = NULL;
+        dmrc_request_unref (request);
+    }
+
+    request->data = g_strdup (data);
+    request->done = TRUE;
+    GList *tasks = g_steal_pointer (&request->tasks);
+    g_cond_broadcast (&dmrc_cond);
+
+    g_mutex_unlock (&dmrc_lock);
+
+    for (GList *link = tasks; link; link = link->next)
+        g_task_return_pointer (link->data, make_key_file (data), (GDestroyNotify) g_key_file_unref);
+    g_list_free_full (tasks, g_object_unref);
+
+    if (data)
+        refresh_cache (request, data, length);
+}
+
+static void
+write_dmrc (DmrcRequest *request)
+{
+    /* Write the latest data until there are no more changes */
+    while (TRUE)
+    {
+        g_mutex_lock (&dmrc_lock);
+        DmrcUser *dmrc_user = get_dmrc_user (request->username);
+        g_autofree gchar *data = g_steal_pointer (&dmrc_user->write_data);
+        if (!data)
+            dmrc_user->writing = FALSE;
+        g_mutex_unlock (&dmrc_lock);
+
+        if (!data)
+            return;
+
+        gint64 start_time = g_get_monotonic_time ();
+        gboolean changed_user = become_user (request->uid, request->gid);
+        g_debug ("Writing %s", request->path);
+        g_file_set_contents (request->path, data, -1, NULL);
+        if (changed_user)
+            become_root ();
+        record_time (request, start_time);
+    }
+}
+
+static void
+dmrc_worker (gpointer data, gpointer user_data)
+{
+    DmrcRequest *request = data;
+
+    if (request->write)
+        write_dmrc (request);
+    else
+        read_dmrc (request);
+
+    dmrc_request_unref (request);
+}
+
+static gint
+get_timeout (void)
+{
+    if (config_has_key (config_get_instance (), "LightDM", "dmrc-timeout"))
+        return MAX (config_get_integer (config_get_instance (), "LightDM", "dmrc-timeout"), 0);
+    return DEFAULT_DMRC_TIMEOUT;
+}
+
+static DmrcRequest *
+make_request (CommonUser *user, gboolean write)
+{
+    DmrcRequest *request = g_malloc0 (sizeof (DmrcRequest));
+    request->ref_count = 1;
+    request->username = g_strdup (common_user_get_name (user));
+    request->uid = common_user_get_uid (user);
+    request->gid = common_user_get_gid (user);
+    request->path = g_build_filename (common_user_get_home_directory (user), ".dmrc", NULL);
+    request->cache_path = get_cache_path (user);
+    request->write = write;
+    request->timeout = get_timeout ();
+
+    return request;
+}
+
+/* Call with dmrc_lock held */
+static void
+queue_request (DmrcRequest *request)
+{
+    if (!dmrc_pool)
+        dmrc_pool = g_thread_pool_new (dmrc_worker, NULL, MAX_WORKERS, FALSE, NULL);
+    g_thread_pool_push (dmrc_pool, request, NULL);
+}
+
+/* Start reading ~/.dmrc on a worker, call with dmrc_lock held */
+static DmrcRequest *
+start_read (CommonUser *user)
+{
+    /* Only have one read for each user at a time */
+    DmrcUser *dmrc_user = get_dmrc_user (common_user_get_name (user));
+    DmrcRequest *request = dmrc_user->read;
+    if (!request)
+    {
+        request = make_request (user, FALSE);
+        request->write_serial = dmrc_user->write_serial;
+        dmrc_user->read = dmrc_request_ref (request);
+        queue_request (dmrc_request_ref (request));
+    }
+    else
+        dmrc_request_ref (request);
+
+    return request;
+}
+
+/* Read ~/.dmrc on a worker, waiting for it if wait is TRUE */
+static gchar *
+read_home_dmrc (CommonUser *user, gboolean wait)
+{
+    g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&dmrc_lock);
+
+    DmrcRequest *request = start_read (user);
+
+    /* Don't wait again for a home directory that has already stalled */
+    gint64 end_time = g_get_monotonic_time () + request->timeout * G_TIME_SPAN_MILLISECOND;
+    while (wait && !request->done && !request->timed_out)
+    {
+        if (!g_cond_wait_until (&dmrc_cond, &dmrc_lock, end_time))
+        {
+            g_warning ("Timed out reading %s, using defaults", request->path);
+            request->timed_out = TRUE;
+        }
+    }
+
+    gchar *data = g_strdup (request->data);
+    dmrc_request_unref (request);
+
+    return data;
+}
+
 GKeyFile *
 dmrc_load (CommonUser *user)
 {
     g_autoptr(GKeyFile) dmrc_file = g_key_file_new ();
 
-    /* Load from the user directory, if this fails (e.g. the user directory
-     * is not yet mounted) then load from the cache */
-    g_autofree gchar *path = g_build_filename (common_user_get_home_directory (user), ".dmrc", NULL);
-
-    /* Guard against privilege escalation through symlinks, etc. */
-    gboolean drop_privileges = geteuid () == 0;
-    if (drop_privileges)
-        privileges_drop (common_user_get_uid (user), common_user_get_gid (user));
-    gboolean have_dmrc = g_key_file_load_from_file (dmrc_file, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
-    if (drop_privileges)
-        privileges_reclaim ();
+    g_autofree gchar *cache_path = get_cache_path (user);
 
-    /* If no ~/.dmrc, then load from the cache */
-    if (!have_dmrc)
+    if (!use_workers ())
     {
-        g_autofree gchar *filename = g_strdup_printf ("%s.dmrc", common_user_get_name (user));
-        g_autofree gchar *cache_dir = config_get_string (config_get_instance (), "LightDM", "cache-directory");
-        g_autofree gchar *cache_path = g_build_filename (cache_dir, "dmrc", filename, NULL);
+        /* Load from the user directory, if this fails (e.g. the user directory
+         * is not yet mounted) then load from the cache */
+        g_autofree gchar *path = g_build_filename (common_user_get_home_directory (user), ".dmrc", NULL);
 
-        g_key_file_load_from_file (dmrc_file, cache_path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+        gboolean changed_user = become_user (common_user_get_uid (user), common_user_get_gid (user));
+        gboolean have_dmrc = g_key_file_load_from_file (dmrc_file, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+        if (changed_user)
+            become_root ();
+
+        /* If no ~/.dmrc, then load from the cache */
+        if (!have_dmrc)
+            g_key_file_load_from_file (dmrc_file, cache_path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+        return g_steal_pointer (&dmrc_file);
     }
 
+    /* Use the cached copy immediately and refresh it from ~/.dmrc in the
+     * background.  Otherwise wait a limited time for ~/.dmrc, which may be on
+     * a slow or unavailable network file system */
+    gboolean have_cache = g_key_file_load_from_file (dmrc_file, cache_path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    g_autofree gchar *data = read_home_dmrc (user, !have_cache);
+    if (!have_cache && data)
+        g_key_file_load_from_data (dmrc_file, data, -1, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
     return g_steal_pointer (&dmrc_file);
 }
 
+/* Load without blocking.  If there is no cached copy this completes once
+ * ~/.dmrc has been read, however long that takes */
+void
+dmrc_load_async (CommonUser *user, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+    g_autoptr(GTask) task = g_task_new (NULL, cancellable, callback, user_data);
+
+    if (!use_workers ())
+    {
+        g_task_return_pointer (task, dmrc_load (user), (GDestroyNotify) g_key_file_unref);
+        return;
+    }
+
+    /* Use the cached copy and refresh it from ~/.dmrc in the background */
+    g_autoptr(GKeyFile) dmrc_file = g_key_file_new ();
+    g_autofree gchar *cache_path = get_cache_path (user);
+    if (g_key_file_load_from_file (dmrc_file, cache_path, G_KEY_FILE_KEEP_COMMENTS, NULL))
+    {
+        g_free (read_home_dmrc (user, FALSE));
+        g_task_return_pointer (task, g_steal_pointer (&dmrc_file), (GDestroyNotify) g_key_file_unref);
+        return;
+    }
+
+    g_mutex_lock (&dmrc_lock);
+    DmrcRequest *request = start_read (user);
+    gboolean done = request->done;
+    g_autofree gchar *data = g_strdup (request->data);
+    if (!done)
+        request->tasks = g_list_append (request->tasks, g_object_ref (task));
+    g_mutex_unlock (&dmrc_lock);
+    dmrc_request_unref (request);
+
+    if (done)
+        g_task_return_pointer (task, make_key_file (data), (GDestroyNotify) g_key_file_unref);
+}
+
+GKeyFile *
+dmrc_load_finish (GAsyncResult *result, GError **error)
+{
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 void
 dmrc_save (GKeyFile *dmrc_file, CommonUser *user)
 {
     gsize length;
     g_autofree gchar *data = g_key_file_to_data (dmrc_file, &length, NULL);
 
-    /* Update the users .dmrc */
-    g_autofree gchar *path = g_build_filename (common_user_get_home_directory (user), ".dmrc", NULL);
+    if (!use_workers ())
+    {
+        /* Update the users .dmrc */
+        g_autofree gchar *path = g_build_filename (common_user_get_home_directory (user), ".dmrc", NULL);
 
-    /* Guard against privilege escalation through symlinks, etc. */
-    gboolean drop_privileges = geteuid () == 0;
-    if (drop_privileges)
-        privileges_drop (common_user_get_uid (user), common_user_get_gid (user));
-    g_debug ("Writing %s", path);
-    g_file_set_contents (path, data, length, NULL);
-    if (drop_privileges)
-        privileges_reclaim ();
+        gboolean changed_user = become_user (common_user_get_uid (user), common_user_get_gid (user));
+        g_debug ("Writing %s", path);
+        g_file_set_contents (path, data, length, NULL);
+        if (changed_user)
+            become_root ();
 
-    /* Update the .dmrc cache */
-    g_autofree gchar *cache_dir = config_get_string (config_get_instance (), "LightDM", "cache-directory");
-    g_autofree gchar *dmrc_cache_dir = g_build_filename (cache_dir, "dmrc", NULL);
-    if (g_mkdir_with_parents (dmrc_cache_dir, 0700) < 0)
-        g_warning ("Failed to make DMRC cache directory %s: %s", dmrc_cache_dir, strerror (errno));
+        /* Update the .dmrc cache */
+        g_autofree gchar *cache_path = get_cache_path (user);
+        write_cache (cache_path, data, length);
 
-    g_autofree gchar *filename = g_strdup_printf ("%s.dmrc", common_user_get_name (user));
-    g_autofree gchar *cache_path = g_build_filename (dmrc_cache_dir, filename, NULL);
-    g_file_set_contents (cache_path, data, length, NULL);
+        return;
+    }
+
+    g_autoptr(GMutexLocker) cache_locker = g_mutex_locker_new (&cache_lock);
+
+    /* Write the users .dmrc in the background, only writing the latest data
+     * if it changes again before it is written */
+    g_mutex_lock (&dmrc_lock);
+    DmrcUser *dmrc_user = get_dmrc_user (common_user_get_name (user));
+    dmrc_user->write_serial++;
+    g_free (dmrc_user->write_data);
+    dmrc_user->write_data = g_strdup (data);
+    if (!dmrc_user->writing)
+    {
+        dmrc_user->writing = TRUE;
+        queue_request (make_request (user, TRUE));
+    }
+    g_mutex_unlock (&dmrc_lock);
+
+    /* Update the .dmrc cache, which is used until the users .dmrc is written */
+    g_autofree gchar *cache_path = get_cache_path (user);
+    write_cache (cache_path, data, length);
 }
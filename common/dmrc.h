@@ -12,13 +12,17 @@
 #ifndef DMRC_H_
 #define DMRC_H_
 
-#include <glib.h>
+#include <gio/gio.h>
 #include "user-list.h"
 
 G_BEGIN_DECLS
 
 GKeyFile *dmrc_load (CommonUser *user);
 
+void dmrc_load_async (CommonUser *user, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+GKeyFile *dmrc_load_finish (GAsyncResult *result, GError **error);
+
 void dmrc_save (GKeyFile *dmrc_file, CommonUser *user);
 
 G_END_DECLS
@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+#include <string.h>
+
+#include "greeter-protocol.h"
+
+/* The encoders and decoders for each message are generated from the
+ * message definitions in greeter-protocol.h.  Writers compute the exact
+ * size of a message before writing it, so a message is always written in
+ * one piece into the buffer.  Readers check every length against the end
+ * of the message and fail rather than reading past it. */
+
+typedef struct
+{
+    const guint8 *data;
+    const guint8 *end;
+    gboolean failed;
+} Reader;
+
+static guint8 *
+put_int (guint8 *data, guint32 value)
+{
+    data[0] = value >> 24;
+    data[1] = (value >> 16) & 0xFF;
+    data[2] = (value >> 8) & 0xFF;
+    data[3] = value & 0xFF;
+    return data + 4;
+}
+
+static guint8 *
+put_data (guint8 *data, gconstpointer value, gsize length)
+{
+    data = put_int (data, length);
+    if (length > 0)
+        memcpy (data, value, length);
+    return data + length;
+}
+
+static guint8 *
+put_string (guint8 *data, const gchar *value)
+{
+    return put_data (data, value, value ? strlen (value) : 0);
+}
+
+static guint32
+get_int (const guint8 *data)
+{
+    return (guint32) data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+static gsize
+string_size (const gchar *value)
+{
+    return 4 + (value ? strlen (value) : 0);
+}
+
+static gsize
+strings_size (const gchar * const *values)
+{
+    gsize size = 4;
+    for (int i = 0; values && values[i]; i++)
+        size += string_size (values[i]);
+    return size;
+}
+
+static guint8 *
+put_strings (guint8 *data, const gchar * const *values)
+{
+    data = put_int (data, values ? g_strv_length ((gchar **) values) : 0);
+    for (int i = 0; values && values[i]; i++)
+        data = put_string (data, values[i]);
+    return data;
+}
+
+static gsize
+pairs_size (GHashTable *values)
+{
+    gsize size = 0;
+    if (!values)
+        return size;
+
+    GHashTableIter iter;
+    g_hash_table_iter_init (&iter, values);
+    gpointer key, value;
+    while (g_hash_table_iter_next (&iter, &key, &value))
+        size += string_size (key) + string_size (value);
+
+    return size;
+}
+
+static guint8 *
+put_pairs (guint8 *data, GHashTable *values)
+{
+    if (!values)
+        return data;
+
+    GHashTableIter iter;
+    g_hash_table_iter_init (&iter, values);
+    gpointer key, value;
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        data = put_string (data, key);
+        data = put_string (data, value);
+    }
+
+    return data;
+}
+
+static gsize
+prompts_size (const GreeterProtocolPrompt *prompts, gsize n_prompts)
+{
+    gsize size = 4;
+    for (gsize i = 0; i < n_prompts; i++)
+        size += 4 + string_size (prompts[i].text);
+    return size;
+}
+
+static guint8 *
+put_prompts (guint8 *data, const GreeterProtocolPrompt *prompts, gsize n_prompts)
+{
+    data = put_int (data, n_prompts);
+    for (gsize i = 0; i < n_prompts; i++)
+    {
+        data = put_int (data, prompts[i].style);
+        data = put_string (data, prompts[i].text);
+    }
+    return data;
+}
+
+static gboolean
+read_int (Reader *reader, guint32 *value)
+{
+    if (reader->failed || reader->end - reader->data < 4)
+    {
+        reader->failed = TRUE;
+        return FALSE;
+    }
+
+    *value = get_int (reader->data);
+    reader->data += 4;
+
+    return TRUE;
+}
+
+static void
+read_optional_int (Reader *reader, guint32 *value)
+{
+    if (reader->data == reader->end)
+        *value = 0;
+    else
+        read_int (reader, value);
+}
+
+static gboolean
+read_data (Reader *reader, const guint8 **value, gsize *length)
+{
+    guint32 data_length;
+    if (!read_int (reader, &data_length))
+        return FALSE;
+    if (reader->end - reader->data < data_length)
+    {
+        reader->failed = TRUE;
+        return FALSE;
+    }
+
+    *value = reader->data;
+    *length = data_length;
+    reader->data += data_length;
+
+    return TRUE;
+}
+
+static gchar *
+read_string (Reader *reader)
+{
+    const guint8 *data;
+    gsize length;
+    if (!read_data (reader, &data, &length))
+        return NULL;
+    return g_strndup ((const gchar *) data, length);
+}
+
+static void
+read_strings (Reader *reader, GreeterProtocolStrings *value)
+{
+    guint32 length;
+    if (!read_int (reader, &length))
+        return;
+
+    /* Check the strings are all there, they are copied out later */
+    value->data = reader->data;
+    for (guint32 i = 0; i < length; i++)
+    {
+        const guint8 *data;
+        gsize data_length;
+        if (!read_data (reader, &data, &data_length))
+            return;
+    }
+    value->length = length;
+}
+
+static gboolean
+read_pair (Reader *reader, GHashTable *values)
+{
+    g_autofree gchar *name = read_string (reader);
+    g_autofree gchar *value = read_string (reader);
+    if (reader->failed)
+        return FALSE;
+
+    g_hash_table_insert (values, g_steal_pointer (&name), g_steal_pointer (&value));
+
+    return TRUE;
+}
+
+static void
+read_pairs (Reader *reader, GHashTable **values)
+{
+    *values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    guint32 length;
+    if (!read_int (reader, &length))
+        return;
+    for (guint32 i = 0; i < length; i++)
+        if (!read_pair (reader, *values))
+            return;
+}
+
+static void
+read_trailing_pairs (Reader *reader, GHashTable **values)
+{
+    *values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    while (reader->data < reader->end)
+        if (!read_pair (reader, *values))
+            return;
+}
+
+static void
+read_prompts (Reader *reader, const GreeterProtocolPrompt **prompts, gsize *n_prompts)
+{
+    guint32 length;
+    if (!read_int (reader, &length))
+        return;
+
+    /* Each prompt is at least eight bytes, so don't trust larger lengths */
+    if (length > (reader->end - reader->data) / 8)
+    {
+        reader->failed = TRUE;
+        return;
+    }
+
+    GreeterProtocolPrompt *values = g_new0 (GreeterProtocolPrompt, length);
+    *prompts = values;
+    for (guint32 i = 0; i < length; i++)
+    {
+        if (!read_int (reader, &values[i].style))
+            return;
+        values[i].text = read_string (reader);
+        if (!values[i].text)
+            return;
+        (*n_prompts)++;
+    }
+}
+
+static void
+clear_prompts (const GreeterProtocolPrompt **prompts, gsize *n_prompts)
+{
+    for (gsize i = 0; i < *n_prompts; i++)
+        g_free ((gchar *) (*prompts)[i].text);
+    g_free ((GreeterProtocolPrompt *) *prompts);
+    *prompts = NULL;
+    *n_prompts = 0;
+}
+
+#define SIZE(kind, name) SIZE_##kind (name)
+#define SIZE_INT(name) size += 4;
+#define SIZE_OPTIONAL_INT(name) size += 4;
+#define SIZE_STRING(name) size += string_size (message->name);
+#define SIZE_DATA(name) size += 4 + message->name##_length;
+#define SIZE_STRINGS(name) size += strings_size (message->name.values);
+#define SIZE_PAIRS(name) size += 4 + pairs_size (message->name);
+#define SIZE_TRAILING_PAIRS(name) size += pairs_size (message->name);
+#define SIZE_PROMPTS(name) size += prompts_size (message->name, message->n_##name);
+
+#define PUT(kind, name) PUT_##kind (name)
+#define PUT_INT(name) data = put_int (data, message->name);
+#define PUT_OPTIONAL_INT(name) data = put_int (data, message->name);
+#define PUT_STRING(name) data = put_string (data, message->name);
+#define PUT_DATA(name) data = put_data (data, message->name, message->name##_length);
+#define PUT_STRINGS(name) data = put_strings (data, message->name.values);
+#define PUT_PAIRS(name) data = put_int (data, message->name ? g_hash_table_size (message->name) : 0); data = put_pairs (data, message->name);
+#define PUT_TRAILING_PAIRS(name) data = put_pairs (data, message->name);
+#define PUT_PROMPTS(name) data = put_prompts (data, message->name, message->n_##name);
+
+#define READ(kind, name) READ_##kind (name)
+#define READ_INT(name) read_int (&reader, &message->name);
+#define READ_OPTIONAL_INT(name) read_optional_int (&reader, &message->name);
+#define READ_STRING(name) message->name = read_string (&reader);
+#define READ_DATA(name) read_data (&reader, &message->name, &message->name##_length);
+#define READ_STRINGS(name) read_strings (&reader, &message->name);
+#define READ_PAIRS(name) read_pairs (&reader, &message->name);
+#define READ_TRAILING_PAIRS(name) read_trailing_pairs (&reader, &message->name);
+#define READ_PROMPTS(name) read_prompts (&reader, &message->name, &message->n_##name);
+
+#define CLEAR(kind, name) CLEAR_##kind (name)
+#define CLEAR_INT(name)
+#define CLEAR_OPTIONAL_INT(name)
+#define CLEAR_STRING(name) g_free ((gchar *) message->name); message->name = NULL;
+#define CLEAR_DATA(name)
+#define CLEAR_STRINGS(name)
+#define CLEAR_PAIRS(name) g_clear_pointer (&message->name, g_hash_table_unref);
+#define CLEAR_TRAILING_PAIRS(name) g_clear_pointer (&message->name, g_hash_table_unref);
+#define CLEAR_PROMPTS(name) clear_prompts (&message->name, &message->n_##name);
+
+#define DEFINE_SIZE(id, value, name, TypeName, fields) \
+    static gsize \
+    name##_size (const GreeterProtocol##TypeName *message) \
+    { \
+        gsize size = 0; \
+        fields \
+        return size; \
+    }
+
+/* The buffer is grown once by the exact size of the message, then written */
+#define DEFINE_WRITE(id, value, name, TypeName, fields) \
+    void \
+    greeter_protocol_write_##name (GByteArray *buffer, const GreeterProtocol##TypeName *message) \
+    { \
+        gsize size = name##_size (message); \
+        g_return_if_fail (size <= G_MAXUINT32); \
+        gsize offset = buffer->len; \
+        g_byte_array_set_size (buffer, offset + GREETER_PROTOCOL_HEADER_SIZE + size); \
+        guint8 *data = buffer->data + offset; \
+        data = put_int (data, id); \
+        data = put_int (data, size); \
+        fields \
+    }
+
+#define DEFINE_CLEAR(id, value, name, TypeName, fields) \
+    void \
+    greeter_protocol_##name##_clear (GreeterProtocol##TypeName *message) \
+    { \
+        fields \
+    }
+
+#define DEFINE_READ(id, value, name, TypeName, fields) \
+    gboolean \
+    greeter_protocol_read_##name (const guint8 *data, gsize length, GreeterProtocol##TypeName *message) \
+    { \
+        Reader reader = { data, data + length, FALSE }; \
+        memset (message, 0, sizeof (GreeterProtocol##TypeName)); \
+        message->length = length; \
+        fields \
+        if (reader.failed) \
+        { \
+            greeter_protocol_##name##_clear (message); \
+            return FALSE; \
+        } \
+        return TRUE; \
+    }
+
+GREETER_PROTOCOL_GREETER_MESSAGES (DEFINE_SIZE, SIZE)
+GREETER_PROTOCOL_SERVER_MESSAGES (DEFINE_SIZE, SIZE)
+GREETER_PROTOCOL_GREETER_MESSAGES (DEFINE_WRITE, PUT)
+GREETER_PROTOCOL_SERVER_MESSAGES (DEFINE_WRITE, PUT)
+GREETER_PROTOCOL_GREETER_MESSAGES (DEFINE_CLEAR, CLEAR)
+GREETER_PROTOCOL_SERVER_MESSAGES (DEFINE_CLEAR, CLEAR)
+GREETER_PROTOCOL_GREETER_MESSAGES (DEFINE_READ, READ)
+GREETER_PROTOCOL_SERVER_MESSAGES (DEFINE_READ, READ)
+
+gboolean
+greeter_protocol_read_header (const guint8 *data, gsize length, guint32 *id, gsize *message_length)
+{
+    if (length < GREETER_PROTOCOL_HEADER_SIZE)
+        return FALSE;
+
+    guint32 payload_length = get_int (data + 4);
+    if (payload_length > G_MAXSIZE - GREETER_PROTOCOL_HEADER_SIZE)
+        return FALSE;
+
+    *id = get_int (data);
+    *message_length = GREETER_PROTOCOL_HEADER_SIZE + payload_length;
+
+    return TRUE;
+}
+
+gchar **
+greeter_protocol_strings_dup (const GreeterProtocolStrings *strings, GreeterProtocolAllocFunc alloc_fn)
+{
+    gchar **values = g_malloc (sizeof (gchar *) * (strings->length + 1));
+
+    const guint8 *data = strings->data;
+    for (guint32 i = 0; i < strings->length; i++)
+    {
+        guint32 length = get_int (data);
+        data += 4;
+        values[i] = alloc_fn (length + 1);
+        memcpy (values[i], data, length);
+        values[i][length] = '\0';
+        data += length;
+    }
+    values[strings->length] = NULL;
+
+    return values;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+#ifndef GREETER_PROTOCOL_H_
+#define GREETER_PROTOCOL_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Messages are a header of two 32 bit big endian integers, the message ID
+ * and the payload length, followed by the payload.  Strings and data are
+ * sent as a 32 bit length followed by the bytes. */
+#define GREETER_PROTOCOL_HEADER_SIZE 8
+
+/* The messages in the protocol and their fields.
+ *
+ * Each message is MESSAGE (ID, value, name, TypeName, fields) where the
+ * fields are FIELD (kind, name).  Field kinds are:
+ *
+ * INT: An unsigned 32 bit integer.
+ * OPTIONAL_INT: An integer that older peers may not send, read as 0 if missing.
+ * STRING: A string, sent as an empty string if %NULL.
+ * DATA: A block of bytes.
+ * STRINGS: An array of strings, read without copying so secrets can be
+ *          copied into secure memory with greeter_protocol_strings_dup ().
+ * PAIRS: A count and that many name/value string pairs.
+ * TRAILING_PAIRS: Name/value string pairs until the end of the message.
+ * PROMPTS: A count and that many style/text pairs.
+ *
+ * New fields can be added to the end of a message, they are ignored by
+ * older peers.  Add new messages to the end of the list so the IDs don't
+ * change. */
+
+/* Messages from the greeter to the server */
+#define GREETER_PROTOCOL_GREETER_MESSAGES(MESSAGE, FIELD) \
+    MESSAGE (GREETER_MESSAGE_CONNECT, 0, connect, Connect, \
+             FIELD (STRING, version) \
+             FIELD (OPTIONAL_INT, resettable) \
+             FIELD (OPTIONAL_INT, api_version) \
+             FIELD (OPTIONAL_INT, capabilities)) \
+    MESSAGE (GREETER_MESSAGE_AUTHENTICATE, 1, authenticate, Authenticate, \
+             FIELD (INT, sequence_number) \
+             FIELD (STRING, username)) \
+    MESSAGE (GREETER_MESSAGE_AUTHENTICATE_AS_GUEST, 2, authenticate_as_guest, AuthenticateAsGuest, \
+             FIELD (INT, sequence_number)) \
+    MESSAGE (GREETER_MESSAGE_CONTINUE_AUTHENTICATION, 3, continue_authentication, ContinueAuthentication, \
+             FIELD (STRINGS, secrets)) \
+    MESSAGE (GREETER_MESSAGE_START_SESSION, 4, start_session, StartSession, \
+             FIELD (STRING, session)) \
+    MESSAGE (GREETER_MESSAGE_CANCEL_AUTHENTICATION, 5, cancel_authentication, CancelAuthentication, ) \
+    MESSAGE (GREETER_MESSAGE_SET_LANGUAGE, 6, set_language, SetLanguage, \
+             FIELD (STRING, language)) \
+    MESSAGE (GREETER_MESSAGE_AUTHENTICATE_REMOTE, 7, authenticate_remote, AuthenticateRemote, \
+             FIELD (INT, sequence_number) \
+             FIELD (STRING, session) \
+             FIELD (STRING, username)) \
+    MESSAGE (GREETER_MESSAGE_ENSURE_SHARED_DIR, 8, ensure_shared_dir, EnsureSharedDir, \
+             FIELD (STRING, username)) \
+    MESSAGE (GREETER_MESSAGE_GET_USER_IMAGE, 9, get_user_image, GetUserImage, \
+             FIELD (STRING, username) \
+             FIELD (INT, background)) \
+    MESSAGE (GREETER_MESSAGE_AUTHENTICATE_AUTOLOGIN, 10, authenticate_autologin, AuthenticateAutologin, \
+             FIELD (INT, sequence_number))
+
+/* Messages from the server to the greeter */
+#define GREETER_PROTOCOL_SERVER_MESSAGES(MESSAGE, FIELD) \
+    MESSAGE (SERVER_MESSAGE_CONNECTED, 0, connected, Connected, \
+             FIELD (STRING, version) \
+             FIELD (TRAILING_PAIRS, hints)) \
+    MESSAGE (SERVER_MESSAGE_PROMPT_AUTHENTICATION, 1, prompt_authentication, PromptAuthentication, \
+             FIELD (INT, sequence_number) \
+             FIELD (STRING, username) \
+             FIELD (PROMPTS, prompts)) \
+    MESSAGE (SERVER_MESSAGE_END_AUTHENTICATION, 2, end_authentication, EndAuthentication, \
+             FIELD (INT, sequence_number) \
+             FIELD (STRING, username) \
+             FIELD (INT, result)) \
+    MESSAGE (SERVER_MESSAGE_SESSION_RESULT, 3, session_result, SessionResult, \
+             FIELD (INT, result)) \
+    MESSAGE (SERVER_MESSAGE_SHARED_DIR_RESULT, 4, shared_dir_result, SharedDirResult, \
+             FIELD (STRING, dir)) \
+    MESSAGE (SERVER_MESSAGE_IDLE, 5, idle, Idle, ) \
+    MESSAGE (SERVER_MESSAGE_RESET, 6, reset, Reset, \
+             FIELD (TRAILING_PAIRS, hints)) \
+    MESSAGE (SERVER_MESSAGE_CONNECTED_V2, 7, connected_v2, ConnectedV2, \
+             FIELD (INT, api_version) \
+             FIELD (STRING, version) \
+             FIELD (PAIRS, hints)) \
+    MESSAGE (SERVER_MESSAGE_USER_IMAGE_RESULT, 8, user_image_result, UserImageResult, \
+             FIELD (STRING, username) \
+             FIELD (INT, background) \
+             FIELD (INT, has_fd)) \
+    MESSAGE (SERVER_MESSAGE_USER_UPDATED, 9, user_updated, UserUpdated, \
+             FIELD (DATA, properties)) \
+    MESSAGE (SERVER_MESSAGE_USER_REMOVED, 10, user_removed, UserRemoved, \
+             FIELD (STRING, username)) \
+    MESSAGE (SERVER_MESSAGE_USERS_UPDATED, 11, users_updated, UsersUpdated, \
+             FIELD (INT, complete))
+
+/* Optional features a greeter asks for in the capabilities of GREETER_MESSAGE_CONNECT */
+#define GREETER_CAPABILITY_USER_LIST (1 << 0) /* Send the users as SERVER_MESSAGE_USER_UPDATED */
+
+/* Strings written from @values, or read without copying them out of the message */
+typedef struct
+{
+    const gchar * const *values;
+    const guint8 *data;
+    guint32 length;
+} GreeterProtocolStrings;
+
+typedef struct
+{
+    guint32 style;
+    const gchar *text;
+} GreeterProtocolPrompt;
+
+typedef gpointer (*GreeterProtocolAllocFunc) (gsize n_bytes);
+
+#define GREETER_PROTOCOL_ENUM_VALUE(id, value, name, TypeName, fields) id = value,
+
+typedef enum
+{
+    GREETER_PROTOCOL_GREETER_MESSAGES (GREETER_PROTOCOL_ENUM_VALUE, )
+} GreeterMessage;
+
+typedef enum
+{
+    GREETER_PROTOCOL_SERVER_MESSAGES (GREETER_PROTOCOL_ENUM_VALUE, )
+} ServerMessage;
+
+#undef GREETER_PROTOCOL_ENUM_VALUE
+
+/* Each message has a structure with a member for each field.  The same
+ * structure is filled in to write a message and is filled in when one is
+ * read.  Values that are read are owned by the structure and freed with
+ * greeter_protocol_<name>_clear (), apart from DATA and STRINGS which point
+ * into the message. */
+#define GREETER_PROTOCOL_MEMBER(kind, name) GREETER_PROTOCOL_MEMBER_##kind (name)
+#define GREETER_PROTOCOL_MEMBER_INT(name) guint32 name;
+#define GREETER_PROTOCOL_MEMBER_OPTIONAL_INT(name) guint32 name;
+#define GREETER_PROTOCOL_MEMBER_STRING(name) const gchar *name;
+#define GREETER_PROTOCOL_MEMBER_DATA(name) const guint8 *name; gsize name##_length;
+#define GREETER_PROTOCOL_MEMBER_STRINGS(name) GreeterProtocolStrings name;
+#define GREETER_PROTOCOL_MEMBER_PAIRS(name) GHashTable *name;
+#define GREETER_PROTOCOL_MEMBER_TRAILING_PAIRS(name) GHashTable *name;
+#define GREETER_PROTOCOL_MEMBER_PROMPTS(name) const GreeterProtocolPrompt *name; gsize n_##name;
+
+/* The length of the payload that was read is kept as a first member, so
+ * messages without fields still have a valid structure */
+#define GREETER_PROTOCOL_DECLARE(id, value, name, TypeName, fields) \
+    typedef struct \
+    { \
+        gsize length; \
+        fields \
+    } GreeterProtocol##TypeName; \
+    void greeter_protocol_write_##name (GByteArray *buffer, const GreeterProtocol##TypeName *message); \
+    gboolean greeter_protocol_read_##name (const guint8 *data, gsize length, GreeterProtocol##TypeName *message); \
+    void greeter_protocol_##name##_clear (GreeterProtocol##TypeName *message); \
+    G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (GreeterProtocol##TypeName, greeter_protocol_##name##_clear)
+
+GREETER_PROTOCOL_GREETER_MESSAGES (GREETER_PROTOCOL_DECLARE, GREETER_PROTOCOL_MEMBER)
+GREETER_PROTOCOL_SERVER_MESSAGES (GREETER_PROTOCOL_DECLARE, GREETER_PROTOCOL_MEMBER)
+
+#undef GREETER_PROTOCOL_DECLARE
+
+gboolean greeter_protocol_read_header (const guint8 *data, gsize length, guint32 *id, gsize *message_length);
+
+gchar **greeter_protocol_strings_dup (const GreeterProtocolStrings *strings, GreeterProtocolAllocFunc alloc_fn);
+
+G_END_DECLS
+
+#endif /* GREETER_PROTOCOL_H_ */
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "greeter-trace.h"
+#include "greeter-protocol.h"
+
+struct GreeterTraceWriter
+{
+    FILE *file;
+};
+
+static guint8 *
+put_int (guint8 *data, guint32 value)
+{
+    data[0] = value >> 24;
+    data[1] = (value >> 16) & 0xFF;
+    data[2] = (value >> 8) & 0xFF;
+    data[3] = value & 0xFF;
+    return data + 4;
+}
+
+static guint32
+get_int (const guint8 *data)
+{
+    return (guint32) data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+/**
+ * greeter_trace_writer_new:
+ * @path: File to write the trace to
+ * @error: (allow-none): A #GError or %NULL
+ *
+ * Start a new trace in a new file.  Fails if @path already exists, or is a
+ * link, so a trace can't be redirected to another file.  The file is only
+ * readable by its owner as the trace contains user names.
+ *
+ * Return value: A new trace writer or %NULL on error
+ **/
+GreeterTraceWriter *
+greeter_trace_writer_new (const gchar *path, GError **error)
+{
+    int fd = g_open (path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        int errsv = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv), "Failed to open %s: %s", path, g_strerror (errsv));
+        return NULL;
+    }
+
+    FILE *file = fdopen (fd, "w");
+    if (!file)
+    {
+        int errsv = errno;
+        close (fd);
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv), "Failed to open %s: %s", path, g_strerror (errsv));
+        return NULL;
+    }
+
+    guint8 header[GREETER_TRACE_HEADER_SIZE];
+    memcpy (header, GREETER_TRACE_MAGIC, 8);
+    put_int (header + 8, GREETER_TRACE_VERSION);
+    fwrite (header, 1, sizeof (header), file);
+
+    GreeterTraceWriter *writer = g_malloc0 (sizeof (GreeterTraceWriter));
+    writer->file = file;
+
+    return writer;
+}
+
+/* Replace the responses to PAM with the same number of empty responses */
+static GByteArray *
+redact_continue_authentication (const guint8 *message, gsize message_length)
+{
+    g_auto(GreeterProtocolContinueAuthentication) request = { 0 };
+    if (!greeter_protocol_read_continue_authentication (message + GREETER_PROTOCOL_HEADER_SIZE,
+                                                        message_length - GREETER_PROTOCOL_HEADER_SIZE,
+                                                        &request))
+        return NULL;
+
+    g_autofree const gchar **secrets = g_malloc0 (sizeof (gchar *) * (request.secrets.length + 1));
+    for (guint32 i = 0; i < request.secrets.length; i++)
+        secrets[i] = "";
+
+    GByteArray *redacted = g_byte_array_new ();
+    GreeterProtocolContinueAuthentication response = { 0 };
+    response.secrets.values = secrets;
+    greeter_protocol_write_continue_authentication (redacted, &response);
+
+    return redacted;
+}
+
+/**
+ * greeter_trace_writer_add:
+ * @writer: A #GreeterTraceWriter
+ * @direction: Which way the message was sent
+ * @timestamp: Monotonic time the message was sent or received, from g_get_monotonic_time()
+ * @message: The message including its header
+ * @message_length: Length of @message in bytes
+ *
+ * Add a message to the trace.  Responses to authentication prompts are
+ * written as empty strings so passwords are never recorded.
+ **/
+void
+greeter_trace_writer_add (GreeterTraceWriter *writer, GreeterTraceDirection direction, gint64 timestamp, const guint8 *message, gsize message_length)
+{
+    g_return_if_fail (writer != NULL);
+    g_return_if_fail (message_length >= GREETER_PROTOCOL_HEADER_SIZE);
+
+    g_autoptr(GByteArray) redacted = NULL;
+    if (direction == GREETER_TRACE_FROM_GREETER && get_int (message) == GREETER_MESSAGE_CONTINUE_AUTHENTICATION)
+    {
+        redacted = redact_continue_authentication (message, message_length);
+
+        /* Don't risk recording something that couldn't be decoded */
+        if (!redacted)
+            return;
+
+        message = redacted->data;
+        message_length = redacted->len;
+    }
+
+    guint8 header[GREETER_TRACE_RECORD_HEADER_SIZE];
+    guint8 *data = put_int (header, direction);
+    data = put_int (data, (guint64) timestamp >> 32);
+    put_int (data, (guint64) timestamp & 0xFFFFFFFF);
+    fwrite (header, 1, sizeof (header), writer->file);
+    fwrite (message, 1, message_length, writer->file);
+}
+
+void
+greeter_trace_writer_free (GreeterTraceWriter *writer)
+{
+    if (!writer)
+        return;
+
+    fclose (writer->file);
+    g_free (writer);
+}
+
+/**
+ * greeter_trace_read_header:
+ * @data: Contents of a trace file
+ * @length: Length of @data in bytes
+ * @offset: (out): Location to write the offset of the first record
+ *
+ * Check @data is a trace this version can read.
+ *
+ * Return value: %TRUE if @data is a trace
+ **/
+gboolean
+greeter_trace_read_header (const guint8 *data, gsize length, gsize *offset)
+{
+    if (length < GREETER_TRACE_HEADER_SIZE)
+        return FALSE;
+    if (memcmp (data, GREETER_TRACE_MAGIC, 8) != 0)
+        return FALSE;
+    if (get_int (data + 8) != GREETER_TRACE_VERSION)
+        return FALSE;
+
+    *offset = GREETER_TRACE_HEADER_SIZE;
+    return TRUE;
+}
+
+/**
+ * greeter_trace_read_record:
+ * @data: Contents of a trace file
+ * @length: Length of @data in bytes
+ * @offset: Offset of the record to read, updated to the offset of the next record
+ * @record: (out): Location to write the record, the message points into @data
+ *
+ * Read the next message from a trace.
+ *
+ * Return value: %TRUE if a complete record was read
+ **/
+gboolean
+greeter_trace_read_record (const guint8 *data, gsize length, gsize *offset, GreeterTraceRecord *record)
+{
+    if (*offset > length || length - *offset < GREETER_TRACE_RECORD_HEADER_SIZE)
+        return FALSE;
+
+    const guint8 *header = data + *offset;
+    const guint8 *message = header + GREETER_TRACE_RECORD_HEADER_SIZE;
+    gsize available = length - *offset - GREETER_TRACE_RECORD_HEADER_SIZE;
+
+    guint32 id;
+    gsize message_length;
+    if (!greeter_protocol_read_header (message, available, &id, &message_length) || message_length > available)
+        return FALSE;
+
+    record->direction = get_int (header);
+    record->timestamp = (gint64) ((guint64) get_int (header + 4) << 32 | get_int (header + 8));
+    record->id = id;
+    record->message = message;
+    record->message_length = message_length;
+    *offset += GREETER_TRACE_RECORD_HEADER_SIZE + message_length;
+
+    return TRUE;
+}
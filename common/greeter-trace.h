@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+#ifndef GREETER_TRACE_H_
+#define GREETER_TRACE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A trace is a recording of the messages between a greeter and the server.
+ * It starts with the magic "LDMTRACE" and a 32 bit version, followed by a
+ * record for each message: a 32 bit direction, a 64 bit monotonic timestamp
+ * in microseconds and then the message including its header.  Integers are
+ * big endian, like the protocol. */
+#define GREETER_TRACE_MAGIC "LDMTRACE"
+#define GREETER_TRACE_VERSION 1
+#define GREETER_TRACE_HEADER_SIZE 12
+#define GREETER_TRACE_RECORD_HEADER_SIZE 12
+
+typedef enum
+{
+    GREETER_TRACE_FROM_GREETER = 0,
+    GREETER_TRACE_TO_GREETER = 1,
+} GreeterTraceDirection;
+
+typedef struct
+{
+    GreeterTraceDirection direction;
+    gint64 timestamp;
+    guint32 id;
+    const guint8 *message;
+    gsize message_length;
+} GreeterTraceRecord;
+
+typedef struct GreeterTraceWriter GreeterTraceWriter;
+
+GreeterTraceWriter *greeter_trace_writer_new (const gchar *path, GError **error);
+
+void greeter_trace_writer_add (GreeterTraceWriter *writer, GreeterTraceDirection direction, gint64 timestamp, const guint8 *message, gsize message_length);
+
+void greeter_trace_writer_free (GreeterTraceWriter *writer);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GreeterTraceWriter, greeter_trace_writer_free)
+
+gboolean greeter_trace_read_header (const guint8 *data, gsize length, gsize *offset);
+
+gboolean greeter_trace_read_record (const guint8 *data, gsize length, gsize *offset, GreeterTraceRecord *record);
+
+G_END_DECLS
+
+#endif /* GREETER_TRACE_H_ */
@@ -9,12 +9,15 @@
  * license.
  */
 
-/* for setres*id() */
+/* for setres*id() and setfs*id() */
 #define _GNU_SOURCE
 
 #include <config.h>
 #include <glib.h>
 #include <unistd.h>
+#ifdef HAVE_SETFSUID
+#include <sys/fsuid.h>
+#endif
 #include "privileges.h"
 
 void
@@ -50,3 +53,20 @@ privileges_reclaim (void)
     g_assert (setegid (0) == 0);
 #endif
 }
+
+#ifdef HAVE_SETFSUID
+/* Only changes the permissions used for file access by the calling thread */
+void
+privileges_drop_thread (uid_t uid, gid_t gid)
+{
+    setfsgid (gid);
+    setfsuid (uid);
+}
+
+void
+privileges_reclaim_thread (void)
+{
+    setfsuid (0);
+    setfsgid (0);
+}
+#endif
@@ -18,4 +18,10 @@ void privileges_drop (uid_t uid, gid_t gid);
 
 void privileges_reclaim (void);
 
+#ifdef HAVE_SETFSUID
+void privileges_drop_thread (uid_t uid, gid_t gid);
+
+void privileges_reclaim_thread (void);
+#endif
+
 #endif /* PRIVILEGES_H_ */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "user-image-index.h"
+
+/* The index maps the path of each user image to the path of a copy of it in
+ * the cache directory.  It is stored as a serialized a{ss} GVariant. */
+
+#define INDEX_TYPE G_VARIANT_TYPE ("a{ss}")
+
+struct UserImageIndex
+{
+    /* Cached copies keyed by image path */
+    GHashTable *images;
+};
+
+/* Write a file readable by greeters, replacing any existing file at once */
+gboolean
+user_image_index_write_file (const gchar *path, const gchar *data, gsize length, GError **error)
+{
+    g_autofree gchar *tmp_path = g_strdup_printf ("%s.new", path);
+    int fd = g_open (tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        int errsv = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                     "Failed to open %s: %s", tmp_path, g_strerror (errsv));
+        return FALSE;
+    }
+
+    /* Umask may have restricted the mode, greeters need to be able to read this */
+    fchmod (fd, 0644);
+
+    gsize n_written = 0;
+    while (n_written < length)
+    {
+        ssize_t n = write (fd, data + n_written, length - n_written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            int errsv = errno;
+            g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                         "Failed to write %s: %s", tmp_path, g_strerror (errsv));
+            close (fd);
+            g_unlink (tmp_path);
+            return FALSE;
+        }
+        n_written += n;
+    }
+    close (fd);
+
+    if (g_rename (tmp_path, path) < 0)
+    {
+        int errsv = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                     "Failed to rename %s: %s", tmp_path, g_strerror (errsv));
+        g_unlink (tmp_path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+user_image_index_write (const gchar *path, GHashTable *images, GError **error)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init (&builder, INDEX_TYPE);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init (&iter, images);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+        g_variant_builder_add (&builder, "{ss}", key, value);
+    g_autoptr(GVariant) index = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+    return user_image_index_write_file (path, g_variant_get_data (index), g_variant_get_size (index), error);
+}
+
+UserImageIndex *
+user_image_index_open (const gchar *path)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GMappedFile) file = g_mapped_file_new (path, FALSE, &error);
+    if (!file)
+    {
+        if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_warning ("Failed to open user image index %s: %s", path, error->message);
+        return NULL;
+    }
+
+    g_autoptr(GBytes) data = g_mapped_file_get_bytes (file);
+    g_autoptr(GVariant) index = g_variant_ref_sink (g_variant_new_from_bytes (INDEX_TYPE, data, FALSE));
+
+    UserImageIndex *image_index = g_malloc0 (sizeof (UserImageIndex));
+    image_index->images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    GVariantIter iter;
+    g_variant_iter_init (&iter, index);
+    gchar *image, *cached_image;
+    while (g_variant_iter_next (&iter, "{ss}", &image, &cached_image))
+        g_hash_table_insert (image_index->images, image, cached_image);
+
+    return image_index;
+}
+
+const gchar *
+user_image_index_lookup (UserImageIndex *index, const gchar *image)
+{
+    g_return_val_if_fail (index != NULL, NULL);
+
+    if (!image)
+        return NULL;
+
+    return g_hash_table_lookup (index->images, image);
+}
+
+void
+user_image_index_free (UserImageIndex *index)
+{
+    if (!index)
+        return;
+
+    g_hash_table_unref (index->images);
+    g_free (index);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef USER_IMAGE_INDEX_H_
+#define USER_IMAGE_INDEX_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct UserImageIndex UserImageIndex;
+
+gboolean user_image_index_write_file (const gchar *path, const gchar *data, gsize length, GError **error);
+
+gboolean user_image_index_write (const gchar *path, GHashTable *images, GError **error);
+
+UserImageIndex *user_image_index_open (const gchar *path);
+
+const gchar *user_image_index_lookup (UserImageIndex *index, const gchar *image);
+
+void user_image_index_free (UserImageIndex *index);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UserImageIndex, user_image_index_free)
+
+G_END_DECLS
+
+#endif /* USER_IMAGE_INDEX_H_ */
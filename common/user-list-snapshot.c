@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "user-list-snapshot.h"
+
+/* The snapshot is only read on the machine that wrote it, so it is stored in
+ * native byte order.  It consists of a header, an array of user entries and a
+ * block of nul terminated strings the entries refer to by offset. */
+
+#define PASSWD_FILE "/etc/passwd"
+
+#define SNAPSHOT_MAGIC   "LDMUSERS"
+#define SNAPSHOT_VERSION 1
+
+/* Offset used for strings that are not set */
+#define NO_STRING G_MAXUINT32
+
+#define FLAG_LOGGED_IN (1 << 0)
+#define FLAG_HAVE_IMAGE (1 << 1)
+
+typedef struct
+{
+    gchar magic[8];
+    guint32 version;
+    guint32 n_users;
+    guint64 generation;
+
+    /* State of the password file when written */
+    gint64 passwd_mtime;
+    guint64 passwd_size;
+    guint64 passwd_inode;
+
+    guint32 strings_length;
+    guint32 reserved;
+} SnapshotHeader;
+
+typedef struct
+{
+    guint32 name;
+    guint32 path;
+    guint32 real_name;
+    guint32 home_directory;
+    guint32 image;
+    guint32 session;
+    guint32 uid;
+    guint32 flags;
+} SnapshotEntry;
+
+struct UserListSnapshot
+{
+    GMappedFile *file;
+    const SnapshotHeader *header;
+    const SnapshotEntry *entries;
+    const gchar *strings;
+};
+
+static guint32
+add_string (GByteArray *strings, const gchar *value)
+{
+    if (!value)
+        return NO_STRING;
+
+    guint32 offset = strings->len;
+    g_byte_array_append (strings, (const guint8 *) value, strlen (value) + 1);
+    return offset;
+}
+
+/* Write to a temporary file and rename so readers never see a partial snapshot */
+gboolean
+user_list_snapshot_write (const gchar *path, GList *users, GHashTable *logged_in_users, guint64 generation, GError **error)
+{
+    SnapshotHeader header;
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.generation = generation;
+    common_user_list_get_passwd_stamp (&header.passwd_mtime, &header.passwd_size, &header.passwd_inode);
+
+    g_autoptr(GArray) entries = g_array_new (FALSE, TRUE, sizeof (SnapshotEntry));
+    g_autoptr(GByteArray) strings = g_byte_array_new ();
+    for (GList *link = users; link; link = link->next)
+    {
+        CommonUser *user = link->data;
+        SnapshotEntry entry;
+
+        entry.name = add_string (strings, common_user_get_name (user));
+        entry.path = add_string (strings, common_user_get_path (user));
+        entry.real_name = add_string (strings, common_user_get_real_name (user));
+        entry.home_directory = add_string (strings, common_user_get_home_directory (user));
+        entry.uid = common_user_get_uid (user);
+        entry.flags = 0;
+
+        /* Only write what is already known, the reader will look up the rest */
+        entry.image = NO_STRING;
+        if (common_user_get_image_is_loaded (user))
+        {
+            entry.image = add_string (strings, common_user_get_image (user));
+            entry.flags |= FLAG_HAVE_IMAGE;
+        }
+        entry.session = NO_STRING;
+        if (common_user_get_session_is_loaded (user))
+            entry.session = add_string (strings, common_user_get_session (user));
+        if (logged_in_users && g_hash_table_contains (logged_in_users, common_user_get_name (user)))
+            entry.flags |= FLAG_LOGGED_IN;
+        g_array_append_val (entries, entry);
+    }
+    header.n_users = entries->len;
+    header.strings_length = strings->len;
+
+    g_autofree gchar *tmp_path = g_strdup_printf ("%s.new", path);
+    int fd = g_open (tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        int errsv = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                     "Failed to open %s: %s", tmp_path, g_strerror (errsv));
+        return FALSE;
+    }
+
+    /* Umask may have restricted the mode, greeters need to be able to read this */
+    fchmod (fd, 0644);
+
+    struct
+    {
+        const void *data;
+        gsize length;
+    } blocks[] =
+    {
+        { &header, sizeof (header) },
+        { entries->data, entries->len * sizeof (SnapshotEntry) },
+        { strings->data, strings->len }
+    };
+    for (gsize i = 0; i < G_N_ELEMENTS (blocks); i++)
+    {
+        const guint8 *data = blocks[i].data;
+        gsize n_written = 0;
+        while (n_written < blocks[i].length)
+        {
+            ssize_t n = write (fd, data + n_written, blocks[i].length - n_written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+            {
+                int errsv = errno;
+                g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                             "Failed to write %s: %s", tmp_path, g_strerror (errsv));
+                close (fd);
+                g_unlink (tmp_path);
+                return FALSE;
+            }
+            n_written += n;
+        }
+    }
+    close (fd);
+
+    if (g_rename (tmp_path, path) != 0)
+    {
+        int errsv = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                     "Failed to rename %s to %s: %s", tmp_path, path, g_strerror (errsv));
+        g_unlink (tmp_path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+check_string (UserListSnapshot *snapshot, guint32 offset)
+{
+    return offset == NO_STRING || offset < snapshot->header->strings_length;
+}
+
+static UserListSnapshot *
+map_snapshot (const gchar *path)
+{
+    g_autoptr(GError) error = NULL;
+    GMappedFile *file = g_mapped_file_new (path, FALSE, &error);
+    if (!file)
+    {
+        if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_warning ("Failed to map user list snapshot %s: %s", path, error->message);
+        return NULL;
+    }
+
+    UserListSnapshot *snapshot = g_malloc0 (sizeof (UserListSnapshot));
+    snapshot->file = file;
+
+    /* Check the snapshot is complete and consistent before trusting any offsets in it */
+    gsize length = g_mapped_file_get_length (file);
+    const gchar *data = g_mapped_file_get_contents (file);
+    if (length < sizeof (SnapshotHeader))
+    {
+        user_list_snapshot_free (snapshot);
+        return NULL;
+    }
+    snapshot->header = (const SnapshotHeader *) data;
+    if (memcmp (snapshot->header->magic, SNAPSHOT_MAGIC, sizeof (snapshot->header->magic)) != 0 ||
+        snapshot->header->version != SNAPSHOT_VERSION ||
+        snapshot->header->n_users > (length - sizeof (SnapshotHeader)) / sizeof (SnapshotEntry) ||
+        length != sizeof (SnapshotHeader) + (gsize) snapshot->header->n_users * sizeof (SnapshotEntry) + snapshot->header->strings_length ||
+        (snapshot->header->strings_length > 0 && data[length - 1] != '\0'))
+    {
+        g_debug ("Ignoring invalid user list snapshot %s", path);
+        user_list_snapshot_free (snapshot);
+        return NULL;
+    }
+    snapshot->entries = (const SnapshotEntry *) (data + sizeof (SnapshotHeader));
+    snapshot->strings = data + sizeof (SnapshotHeader) + snapshot->header->n_users * sizeof (SnapshotEntry);
+
+    for (guint32 i = 0; i < snapshot->header->n_users; i++)
+    {
+        const SnapshotEntry *entry = &snapshot->entries[i];
+        if (entry->name == NO_STRING ||
+            !check_string (snapshot, entry->name) ||
+            !check_string (snapshot, entry->path) ||
+            !check_string (snapshot, entry->real_name) ||
+            !check_string (snapshot, entry->home_directory) ||
+            !check_string (snapshot, entry->image) ||
+            !check_string (snapshot, entry->session))
+        {
+            g_debug ("Ignoring invalid user list snapshot %s", path);
+            user_list_snapshot_free (snapshot);
+            return NULL;
+        }
+    }
+
+    return snapshot;
+}
+
+guint64
+user_list_snapshot_read_generation (const gchar *path)
+{
+    UserListSnapshot *snapshot = map_snapshot (path);
+    if (!snapshot)
+        return 0;
+
+    guint64 generation = snapshot->header->generation;
+    user_list_snapshot_free (snapshot);
+
+    return generation;
+}
+
+/* Open a snapshot, returning NULL if it is missing, invalid or out of date.
+ * If @generation is non-zero the snapshot must have been written with it. */
+UserListSnapshot *
+user_list_snapshot_open (const gchar *path, guint64 generation)
+{
+    UserListSnapshot *snapshot = map_snapshot (path);
+    if (!snapshot)
+        return NULL;
+
+    gint64 passwd_mtime;
+    guint64 passwd_size, passwd_inode;
+    common_user_list_get_passwd_stamp (&passwd_mtime, &passwd_size, &passwd_inode);
+    if (snapshot->header->passwd_mtime != passwd_mtime ||
+        snapshot->header->passwd_size != passwd_size ||
+        snapshot->header->passwd_inode != passwd_inode)
+    {
+        g_debug ("Ignoring user list snapshot %s, %s has changed", path, PASSWD_FILE);
+        user_list_snapshot_free (snapshot);
+        return NULL;
+    }
+
+    if (generation != 0 && snapshot->header->generation != generation)
+    {
+        g_debug ("Ignoring user list snapshot %s, generation %" G_GUINT64_FORMAT " is not %" G_GUINT64_FORMAT, path, snapshot->header->generation, generation);
+        user_list_snapshot_free (snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+guint
+user_list_snapshot_get_length (UserListSnapshot *snapshot)
+{
+    return snapshot->header->n_users;
+}
+
+static const gchar *
+get_string (UserListSnapshot *snapshot, guint32 offset)
+{
+    if (offset == NO_STRING)
+        return NULL;
+    return snapshot->strings + offset;
+}
+
+const gchar *
+user_list_snapshot_get_name (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, NULL);
+    return get_string (snapshot, snapshot->entries[index].name);
+}
+
+const gchar *
+user_list_snapshot_get_path (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, NULL);
+    return get_string (snapshot, snapshot->entries[index].path);
+}
+
+const gchar *
+user_list_snapshot_get_real_name (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, NULL);
+    return get_string (snapshot, snapshot->entries[index].real_name);
+}
+
+const gchar *
+user_list_snapshot_get_home_directory (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, NULL);
+    return get_string (snapshot, snapshot->entries[index].home_directory);
+}
+
+const gchar *
+user_list_snapshot_get_image (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, NULL);
+    return get_string (snapshot, snapshot->entries[index].image);
+}
+
+const gchar *
+user_list_snapshot_get_session (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, NULL);
+    return get_string (snapshot, snapshot->entries[index].session);
+}
+
+gboolean
+user_list_snapshot_get_has_image (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, FALSE);
+    return (snapshot->entries[index].flags & FLAG_HAVE_IMAGE) != 0;
+}
+
+uid_t
+user_list_snapshot_get_uid (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, 0);
+    return snapshot->entries[index].uid;
+}
+
+gboolean
+user_list_snapshot_get_logged_in (UserListSnapshot *snapshot, guint index)
+{
+    g_return_val_if_fail (index < snapshot->header->n_users, FALSE);
+    return (snapshot->entries[index].flags & FLAG_LOGGED_IN) != 0;
+}
+
+void
+user_list_snapshot_free (UserListSnapshot *snapshot)
+{
+    if (!snapshot)
+        return;
+
+    g_mapped_file_unref (snapshot->file);
+    g_free (snapshot);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef USER_LIST_SNAPSHOT_H_
+#define USER_LIST_SNAPSHOT_H_
+
+#include <glib.h>
+#include "user-list.h"
+
+G_BEGIN_DECLS
+
+typedef struct UserListSnapshot UserListSnapshot;
+
+gboolean user_list_snapshot_write (const gchar *path, GList *users, GHashTable *logged_in_users, guint64 generation, GError **error);
+
+guint64 user_list_snapshot_read_generation (const gchar *path);
+
+UserListSnapshot *user_list_snapshot_open (const gchar *path, guint64 generation);
+
+guint user_list_snapshot_get_length (UserListSnapshot *snapshot);
+
+const gchar *user_list_snapshot_get_name (UserListSnapshot *snapshot, guint index);
+
+const gchar *user_list_snapshot_get_path (UserListSnapshot *snapshot, guint index);
+
+const gchar *user_list_snapshot_get_real_name (UserListSnapshot *snapshot, guint index);
+
+const gchar *user_list_snapshot_get_home_directory (UserListSnapshot *snapshot, guint index);
+
+const gchar *user_list_snapshot_get_image (UserListSnapshot *snapshot, guint index);
+
+gboolean user_list_snapshot_get_has_image (UserListSnapshot *snapshot, guint index);
+
+const gchar *user_list_snapshot_get_session (UserListSnapshot *snapshot, guint index);
+
+uid_t user_list_snapshot_get_uid (UserListSnapshot *snapshot, guint index);
+
+gboolean user_list_snapshot_get_logged_in (UserListSnapshot *snapshot, guint index);
+
+void user_list_snapshot_free (UserListSnapshot *snapshot);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UserListSnapshot, user_list_snapshot_free)
+
+G_END_DECLS
+
+#endif /* USER_LIST_SNAPSHOT_H_ */
@@ -15,12 +15,14 @@
 
 #include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 #include <pwd.h>
 #include <gio/gio.h>
 
 #include "dmrc.h"
 #include "user-list.h"
+#include "user-list-snapshot.h"
 
 enum
 {
@@ -53,6 +55,8 @@ enum
     USER_ADDED,
     USER_CHANGED,
     USER_REMOVED,
+    USERS_CHANGED,
+    LOADED,
     LAST_LIST_SIGNAL
 };
 static guint list_signals[LAST_LIST_SIGNAL] = { 0 };
@@ -81,14 +85,81 @@ typedef struct
     /* File monitor for password file */
     GFileMonitor *passwd_monitor;
 
+    /* Time in milliseconds to collect password file changes before reloading */
+    guint reload_delay;
+
+    /* Timeout to reload the password file */
+    guint reload_timeout;
+
+    /* State of the password file when last loaded */
+    gint64 passwd_mtime;
+    guint64 passwd_size;
+    guint64 passwd_inode;
+
+    /* Number of password file changes that caused a reload or were skipped */
+    guint n_reloads;
+    guint n_skipped_reloads;
+
+    /* Changes being collected for the next users-changed signal, newest first */
+    gint changes_depth;
+    GList *added_users;
+    GList *removed_users;
+    GList *changed_users;
+
+    /* Context signals and file monitors are dispatched in */
+    GMainContext *context;
+
+    /* TRUE if loading users */
+    gboolean loading;
+
+    /* TRUE if waiting for the list of users */
+    gboolean listing;
+
     /* TRUE if have scanned users */
     gboolean have_users;
 
-    /* List of users */
-    GList *users;
+    /* TRUE if the users are provided by the daemon instead of being loaded */
+    gboolean from_daemon;
+
+    /* Context the load is running in */
+    GMainContext *load_context;
+
+    /* Cancellable for outstanding D-Bus calls */
+    GCancellable *cancellable;
+
+    /* AccountsService paths waiting to be loaded */
+    GQueue *pending_paths;
+
+    /* AccountsService paths currently being loaded */
+    GHashTable *loading_paths;
+
+    /* Users sorted by display name */
+    GPtrArray *users;
+
+    /* Users indexed by name and by AccountsService path */
+    GHashTable *users_by_name;
+    GHashTable *users_by_path;
+
+    /* List returned by common_user_list_get_users (), built on demand */
+    GList *users_list;
 
     /* List of sessions */
     GList *sessions;
+
+    /* TRUE once all sessions have been loaded */
+    gboolean have_sessions;
+
+    /* TRUE while waiting for the list of sessions */
+    gboolean listing_sessions;
+
+    /* TRUE if blocking until the sessions are loaded */
+    gboolean waiting_for_sessions;
+
+    /* Session paths currently being loaded */
+    GHashTable *loading_sessions;
+
+    /* Cancellable for session requests */
+    GCancellable *sessions_cancellable;
 } CommonUserListPrivate;
 
 typedef struct
@@ -96,6 +167,16 @@ typedef struct
     /* TRUE if have loaded the DMRC file */
     gboolean loaded_dmrc;
 
+    /* TRUE if have looked for the user image */
+    gboolean loaded_image;
+
+    /* TRUE if have loaded the display manager properties from accounts service */
+    gboolean loaded_extra;
+
+    /* TRUE if loading the DMRC file or image in the background */
+    gboolean loading_dmrc;
+    gboolean loading_image;
+
     /* Bus we are listening for accounts service on */
     GDBusConnection *bus;
 
@@ -143,6 +224,26 @@ typedef struct
 
     /* TRUE if this user is locked */
     gboolean is_locked;
+
+    /* Password database entry this user was last resolved from */
+    gchar *passwd_entry;
+
+    /* TRUE if this user was read from a snapshot and not yet checked */
+    gboolean from_snapshot;
+
+    /* Logged in state recorded in the snapshot */
+    gboolean snapshot_logged_in;
+
+    /* Properties from the snapshot, to check if they have changed */
+    gchar *snapshot_state;
+
+    /* Keys this user is indexed under in the user list, kept so the user can
+     * be removed after being renamed */
+    gchar *index_name;
+    gchar *index_path;
+
+    /* Display name this user was sorted by when placed in the user list */
+    gchar *sort_key;
 } CommonUserPrivate;
 
 typedef struct
@@ -166,6 +267,12 @@ G_DEFINE_TYPE (CommonSession, common_session, G_TYPE_OBJECT)
 #define PASSWD_FILE      "/etc/passwd"
 #define USER_CONFIG_FILE "/etc/lightdm/users.conf"
 
+/* Maximum number of AccountsService users to request at once */
+#define USER_LOAD_WINDOW 16
+
+/* Default time in milliseconds to collect password file changes */
+#define DEFAULT_RELOAD_DELAY 200
+
 static CommonUserList *singleton = NULL;
 
 /**
@@ -194,14 +301,10 @@ get_user_by_name (CommonUserList *user_list, const gchar *username)
 {
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
-    for (GList *link = priv->users; link; link = link->next)
-    {
-        CommonUser *user = link->data;
-        if (g_strcmp0 (common_user_get_name (user), username) == 0)
-            return user;
-    }
+    if (!username)
+        return NULL;
 
-    return NULL;
+    return g_hash_table_lookup (priv->users_by_name, username);
 }
 
 static CommonUser *
@@ -209,15 +312,10 @@ get_user_by_path (CommonUserList *user_list, const gchar *path)
 {
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
-    for (GList *link = priv->users; link; link = link->next)
-    {
-        CommonUser *user = link->data;
-        CommonUserPrivate *user_priv = common_user_get_instance_private (user);
-        if (g_strcmp0 (user_priv->path, path) == 0)
-            return user;
-    }
+    if (!path)
+        return NULL;
 
-    return NULL;
+    return g_hash_table_lookup (priv->users_by_path, path);
 }
 
 static gint
@@ -227,16 +325,168 @@ compare_user (gconstpointer a, gconstpointer b)
     return g_strcmp0 (common_user_get_display_name (user_a), common_user_get_display_name (user_b));
 }
 
+static gint
+compare_user_ptr (gconstpointer a, gconstpointer b)
+{
+    return compare_user (*((CommonUser **) a), *((CommonUser **) b));
+}
+
+static const gchar *
+get_sort_key (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+    return priv->sort_key;
+}
+
+/* Record the position a user is being placed in the list by.  The list stays
+ * ordered by these keys even if a display name changes before the user is moved */
+static void
+update_sort_key (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+    const gchar *display_name = common_user_get_display_name (user);
+
+    if (g_strcmp0 (priv->sort_key, display_name) == 0)
+        return;
+    g_free (priv->sort_key);
+    priv->sort_key = g_strdup (display_name);
+}
+
+/* Set the keys for users added to the list in display order, sorting them if they weren't */
+static void
+update_sort_keys (GPtrArray *users)
+{
+    gboolean sorted = TRUE;
+    for (guint i = 0; i < users->len; i++)
+    {
+        CommonUser *user = g_ptr_array_index (users, i);
+        update_sort_key (user);
+        if (i > 0 && g_strcmp0 (get_sort_key (g_ptr_array_index (users, i - 1)), get_sort_key (user)) > 0)
+            sorted = FALSE;
+    }
+
+    if (!sorted)
+        g_ptr_array_sort (users, compare_user_ptr);
+}
+
+/* Find the first position in the list with a sort key not less than @key */
+static guint
+find_sort_position (CommonUserList *user_list, const gchar *key)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    guint start = 0, end = priv->users->len;
+    while (start < end)
+    {
+        guint middle = start + (end - start) / 2;
+        if (g_strcmp0 (get_sort_key (g_ptr_array_index (priv->users, middle)), key) < 0)
+            start = middle + 1;
+        else
+            end = middle;
+    }
+
+    return start;
+}
+
+/* Find the position of a user in the list or -1 if not in the list */
+static gint
+find_user_position (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    const gchar *key = get_sort_key (user);
+
+    if (!key)
+        return -1;
+
+    /* Users with the same display name are next to each other */
+    for (guint i = find_sort_position (user_list, key); i < priv->users->len; i++)
+    {
+        CommonUser *u = g_ptr_array_index (priv->users, i);
+        if (u == user)
+            return i;
+        if (g_strcmp0 (get_sort_key (u), key) != 0)
+            break;
+    }
+
+    return -1;
+}
+
+static void
+index_user (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+
+    g_free (user_priv->index_name);
+    user_priv->index_name = g_strdup (user_priv->name);
+    if (user_priv->index_name)
+        g_hash_table_insert (priv->users_by_name, g_strdup (user_priv->index_name), user);
+    g_free (user_priv->index_path);
+    user_priv->index_path = g_strdup (user_priv->path);
+    if (user_priv->index_path)
+        g_hash_table_insert (priv->users_by_path, g_strdup (user_priv->index_path), user);
+}
+
+static void
+unindex_user (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+
+    /* Another user may have been indexed with the same name since */
+    if (user_priv->index_name && g_hash_table_lookup (priv->users_by_name, user_priv->index_name) == user)
+        g_hash_table_remove (priv->users_by_name, user_priv->index_name);
+    g_clear_pointer (&user_priv->index_name, g_free);
+    if (user_priv->index_path && g_hash_table_lookup (priv->users_by_path, user_priv->index_path) == user)
+        g_hash_table_remove (priv->users_by_path, user_priv->index_path);
+    g_clear_pointer (&user_priv->index_path, g_free);
+}
+
+/* Add a user in sorted order, the list takes the reference */
+static void
+insert_user (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    update_sort_key (user);
+    g_ptr_array_insert (priv->users, find_sort_position (user_list, get_sort_key (user)), user);
+
+    index_user (user_list, user);
+    g_clear_pointer (&priv->users_list, g_list_free);
+}
+
+/* Remove a user from the list, the caller takes the reference */
+static void
+remove_user (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    gint position = find_user_position (user_list, user);
+    if (position >= 0)
+        g_ptr_array_remove_index (priv->users, position);
+
+    unindex_user (user_list, user);
+    g_clear_pointer (&priv->users_list, g_list_free);
+}
+
+static gchar *get_passwd_image (const gchar *home_directory);
+static void recheck_image_async (CommonUser *user);
+
 static gboolean
-update_passwd_user (CommonUser *user, const gchar *real_name, const gchar *home_directory, const gchar *shell, const gchar *image)
+update_passwd_user (CommonUser *user, const gchar *real_name, const gchar *home_directory, const gchar *shell)
 {
     CommonUserPrivate *priv = common_user_get_instance_private (user);
 
+    /* Only check the image if it has been used */
+    g_autofree gchar *image = NULL;
+    if (priv->loaded_image)
+        image = get_passwd_image (home_directory);
+
     /* Skip if already set to this */
-    if (g_strcmp0 (common_user_get_real_name (user), real_name) == 0 &&
-        g_strcmp0 (common_user_get_home_directory (user), home_directory) == 0 &&
-        g_strcmp0 (common_user_get_shell (user), shell) == 0 &&
-        g_strcmp0 (common_user_get_image (user), image) == 0)
+    if (g_strcmp0 (priv->real_name, real_name) == 0 &&
+        g_strcmp0 (priv->home_directory, home_directory) == 0 &&
+        g_strcmp0 (priv->shell, shell) == 0 &&
+        g_strcmp0 (priv->image, image) == 0)
         return FALSE;
 
     g_free (priv->real_name);
@@ -246,7 +496,7 @@ update_passwd_user (CommonUser *user, const gchar *real_name, const gchar *home_
     g_free (priv->shell);
     priv->shell = g_strdup (shell);
     g_free (priv->image);
-    priv->image = g_strdup (image);
+    priv->image = g_steal_pointer (&image);
 
     return TRUE;
 }
@@ -259,8 +509,12 @@ get_logged_in_cb (CommonUser *user, CommonUserList *user_list)
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
     CommonUserPrivate *user_priv = common_user_get_instance_private (user);
 
+    /* Use the snapshot until the user has been checked */
+    if (user_priv->from_snapshot)
+        return user_priv->snapshot_logged_in;
+
     // Lazily decide to load/listen to sessions
-    if (priv->session_added_signal == 0)
+    if (!priv->have_sessions)
         load_sessions (user_list);
 
     const gchar *username = user_priv->name;
@@ -274,32 +528,122 @@ get_logged_in_cb (CommonUser *user, CommonUserList *user_list)
     return FALSE;
 }
 
+/* Collect changes into a single users-changed signal until end_changes() */
+static void
+begin_changes (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    priv->changes_depth++;
+}
+
+static void
+end_changes (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    priv->changes_depth--;
+    if (priv->changes_depth > 0)
+        return;
+
+    GList *added = g_list_reverse (g_steal_pointer (&priv->added_users));
+    GList *removed = g_list_reverse (g_steal_pointer (&priv->removed_users));
+    GList *all_changed = g_list_reverse (g_steal_pointer (&priv->changed_users));
+
+    /* Only report users as changed once, and not if also added or removed */
+    g_autoptr(GHashTable) seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+    for (GList *link = added; link; link = link->next)
+        g_hash_table_add (seen, link->data);
+    for (GList *link = removed; link; link = link->next)
+        g_hash_table_add (seen, link->data);
+    GList *changed = NULL;
+    for (GList *link = all_changed; link; link = link->next)
+    {
+        if (g_hash_table_contains (seen, link->data))
+            continue;
+        g_hash_table_add (seen, link->data);
+        changed = g_list_prepend (changed, link->data);
+    }
+    changed = g_list_reverse (changed);
+
+    if (added || removed || changed)
+        g_signal_emit (user_list, list_signals[USERS_CHANGED], 0, added, removed, changed);
+
+    g_list_free_full (added, g_object_unref);
+    g_list_free_full (removed, g_object_unref);
+    g_list_free (changed);
+    g_list_free_full (all_changed, g_object_unref);
+}
+
+static void
+add_change (CommonUserList *user_list, GList **changes, CommonUser *user)
+{
+    begin_changes (user_list);
+    *changes = g_list_prepend (*changes, g_object_ref (user));
+    end_changes (user_list);
+}
+
+static void
+notify_user_added (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    g_signal_emit (user_list, list_signals[USER_ADDED], 0, user);
+    add_change (user_list, &priv->added_users, user);
+}
+
+static void
+notify_user_removed (CommonUserList *user_list, CommonUser *user)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    g_signal_emit (user_list, list_signals[USER_REMOVED], 0, user);
+    add_change (user_list, &priv->removed_users, user);
+}
+
 static void
 user_changed_cb (CommonUser *user, CommonUserList *user_list)
 {
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    /* Update the index if the user has been renamed */
+    const gchar *name = common_user_get_name (user);
+    if (name && g_hash_table_lookup (priv->users_by_name, name) != user)
+    {
+        unindex_user (user_list, user);
+        index_user (user_list, user);
+    }
+
     g_signal_emit (user_list, list_signals[USER_CHANGED], 0, user);
+    add_change (user_list, &priv->changed_users, user);
 }
 
-static CommonUser *
-make_passwd_user (CommonUserList *user_list, struct passwd *entry)
+/* Text that changes if any field of a password entry we use changes */
+static gchar *
+get_passwd_entry (struct passwd *entry)
 {
-    CommonUser *user = g_object_new (COMMON_TYPE_USER, NULL);
-    CommonUserPrivate *priv = common_user_get_instance_private (user);
-
-    g_signal_connect (user, "get-logged-in", G_CALLBACK (get_logged_in_cb), user_list);
+    return g_strdup_printf ("%s:%d:%d:%s:%s:%s",
+                            entry->pw_name, entry->pw_uid, entry->pw_gid,
+                            entry->pw_gecos ? entry->pw_gecos : "",
+                            entry->pw_dir ? entry->pw_dir : "",
+                            entry->pw_shell ? entry->pw_shell : "");
+}
 
+static gchar *
+get_passwd_real_name (struct passwd *entry)
+{
     g_auto(GStrv) tokens = g_strsplit (entry->pw_gecos, ",", -1);
-    gchar *real_name;
     if (tokens[0] != NULL && tokens[0][0] != '\0')
-        real_name = g_strdup (tokens[0]);
+        return g_strdup (tokens[0]);
     else
-        real_name = g_strdup ("");
+        return g_strdup ("");
+}
 
-    gchar *image = g_build_filename (entry->pw_dir, ".face", NULL);
+static gchar *
+get_passwd_image (const gchar *home_directory)
+{
+    gchar *image = g_build_filename (home_directory, ".face", NULL);
     if (!g_file_test (image, G_FILE_TEST_EXISTS))
     {
         g_free (image);
-        image = g_build_filename (entry->pw_dir, ".face.icon", NULL);
+        image = g_build_filename (home_directory, ".face.icon", NULL);
         if (!g_file_test (image, G_FILE_TEST_EXISTS))
         {
             g_free (image);
@@ -307,22 +651,53 @@ make_passwd_user (CommonUserList *user_list, struct passwd *entry)
         }
     }
 
+    return image;
+}
+
+static CommonUser *
+make_passwd_user (CommonUserList *user_list, struct passwd *entry)
+{
+    CommonUser *user = g_object_new (COMMON_TYPE_USER, NULL);
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    g_signal_connect (user, "get-logged-in", G_CALLBACK (get_logged_in_cb), user_list);
+
     priv->name = g_strdup (entry->pw_name);
-    priv->real_name = real_name;
+    priv->real_name = get_passwd_real_name (entry);
     priv->home_directory = g_strdup (entry->pw_dir);
     priv->shell = g_strdup (entry->pw_shell);
-    priv->image = image;
     priv->uid = entry->pw_uid;
     priv->gid = entry->pw_gid;
+    priv->passwd_entry = get_passwd_entry (entry);
 
     return user;
 }
 
+/* Get values that change whenever the passwd file is replaced or modified */
+void
+common_user_list_get_passwd_stamp (gint64 *mtime, guint64 *size, guint64 *inode)
+{
+    struct stat buf;
+    if (stat (PASSWD_FILE, &buf) != 0)
+    {
+        *mtime = 0;
+        *size = 0;
+        *inode = 0;
+        return;
+    }
+
+    *mtime = (gint64) buf.st_mtim.tv_sec * G_USEC_PER_SEC + buf.st_mtim.tv_nsec / 1000;
+    *size = buf.st_size;
+    *inode = buf.st_ino;
+}
+
 static void
 load_passwd_file (CommonUserList *user_list, gboolean emit_add_signal)
 {
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
+    common_user_list_get_passwd_stamp (&priv->passwd_mtime, &priv->passwd_size, &priv->passwd_inode);
+
     g_debug ("Loading user config from %s", USER_CONFIG_FILE);
 
     g_autoptr(GKeyFile) config = g_key_file_new ();
@@ -345,9 +720,17 @@ load_passwd_file (CommonUserList *user_list, gboolean emit_add_signal)
         hidden_shells_list = g_strdup ("/bin/false /usr/sbin/nologin");
     g_auto(GStrv) hidden_shells = g_strsplit (hidden_shells_list, " ", -1);
 
+    priv->reload_delay = DEFAULT_RELOAD_DELAY;
+    if (g_key_file_has_key (config, "UserList", "reload-delay", NULL))
+        priv->reload_delay = MAX (g_key_file_get_integer (config, "UserList", "reload-delay", NULL), 0);
+
     setpwent ();
 
-    GList *users = NULL, *new_users = NULL, *changed_users = NULL;
+    /* Build the new list in a single pass, reusing the existing users */
+    GPtrArray *users = g_ptr_array_new ();
+    GHashTable *users_by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    g_autoptr(GHashTable) new_users = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_autoptr(GHashTable) changed_users = g_hash_table_new (g_direct_hash, g_direct_equal);
     while (TRUE)
     {
         errno = 0;
@@ -374,29 +757,41 @@ load_passwd_file (CommonUserList *user_list, gboolean emit_add_signal)
         if (hidden_users[i])
             continue;
 
-        CommonUser *user = make_passwd_user (user_list, entry);
+        /* Ignore duplicate entries, the first one is used */
+        if (g_hash_table_contains (users_by_name, entry->pw_name))
+            continue;
 
-        /* Update existing users if have them */
-        GList *link;
-        for (link = priv->users; link; link = link->next)
+        /* Update existing users if their entry has changed, otherwise just
+         * recheck the image as that can change without the entry changing */
+        CommonUser *user = get_user_by_name (user_list, entry->pw_name);
+        if (user)
         {
-            CommonUser *info = link->data;
-            if (strcmp (common_user_get_name (info), common_user_get_name (user)) == 0)
+            CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+            g_autofree gchar *passwd_entry = get_passwd_entry (entry);
+            if (g_strcmp0 (user_priv->passwd_entry, passwd_entry) != 0)
             {
-                if (update_passwd_user (info, common_user_get_real_name (user), common_user_get_home_directory (user), common_user_get_shell (user), common_user_get_image (user)))
-                    changed_users = g_list_insert_sorted (changed_users, info, compare_user);
-                g_object_unref (user);
-                user = info;
-                break;
+                g_autofree gchar *real_name = get_passwd_real_name (entry);
+                if (update_passwd_user (user, real_name, entry->pw_dir, entry->pw_shell))
+                    g_hash_table_add (changed_users, user);
+                g_free (user_priv->passwd_entry);
+                user_priv->passwd_entry = g_steal_pointer (&passwd_entry);
             }
+            else
+                recheck_image_async (user);
+            g_object_ref (user);
         }
-        if (!link)
+        else
         {
-            /* Only notify once we have loaded the user list */
-            if (priv->have_users)
-                new_users = g_list_insert_sorted (new_users, user, compare_user);
+            user = make_passwd_user (user_list, entry);
+            g_hash_table_add (new_users, user);
         }
-        users = g_list_insert_sorted (users, user, compare_user);
+
+        CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+        g_free (user_priv->index_name);
+        user_priv->index_name = g_strdup (entry->pw_name);
+
+        g_ptr_array_add (users, user);
+        g_hash_table_insert (users_by_name, g_strdup (entry->pw_name), user);
     }
 
     if (errno != 0)
@@ -404,59 +799,129 @@ load_passwd_file (CommonUserList *user_list, gboolean emit_add_signal)
 
     endpwent ();
 
+    update_sort_keys (users);
+
     /* Use new user list */
-    GList *old_users = priv->users;
+    g_autoptr(GPtrArray) old_users = priv->users;
     priv->users = users;
+    g_hash_table_unref (priv->users_by_name);
+    priv->users_by_name = users_by_name;
+    g_clear_pointer (&priv->users_list, g_list_free);
 
-    /* Notify of changes */
-    for (GList *link = new_users; link; link = link->next)
+    /* Notify of changes, reporting them together at the end */
+    begin_changes (user_list);
+    for (guint i = 0; i < priv->users->len; i++)
     {
-        CommonUser *info = link->data;
+        CommonUser *info = g_ptr_array_index (priv->users, i);
+        if (!g_hash_table_contains (new_users, info))
+            continue;
+
         g_debug ("User %s added", common_user_get_name (info));
         g_signal_connect (info, USER_SIGNAL_CHANGED, G_CALLBACK (user_changed_cb), user_list);
         if (emit_add_signal)
-            g_signal_emit (user_list, list_signals[USER_ADDED], 0, info);
+            notify_user_added (user_list, info);
     }
-    g_list_free (new_users);
-    for (GList *link = changed_users; link; link = link->next)
+    for (guint i = 0; i < priv->users->len; i++)
     {
-        CommonUser *info = link->data;
+        CommonUser *info = g_ptr_array_index (priv->users, i);
+        if (!g_hash_table_contains (changed_users, info))
+            continue;
+
         g_debug ("User %s changed", common_user_get_name (info));
         g_signal_emit (info, user_signals[CHANGED], 0);
     }
-    g_list_free (changed_users);
-    for (GList *link = old_users; link; link = link->next)
+    for (guint i = 0; i < old_users->len; i++)
     {
-        /* See if this user is in the current list */
-        GList *new_link;
-        for (new_link = priv->users; new_link; new_link = new_link->next)
-        {
-            if (new_link->data == link->data)
-                break;
-        }
+        CommonUser *info = g_ptr_array_index (old_users, i);
 
-        if (!new_link)
+        /* See if this user is in the current list */
+        if (get_user_by_name (user_list, common_user_get_name (info)) != info)
         {
-            CommonUser *info = link->data;
             g_debug ("User %s removed", common_user_get_name (info));
-            g_signal_emit (user_list, list_signals[USER_REMOVED], 0, info);
-            g_object_unref (info);
+            g_signal_handlers_disconnect_by_func (info, user_changed_cb, user_list);
+            notify_user_removed (user_list, info);
         }
+        g_object_unref (info);
+    }
+    end_changes (user_list);
+}
+
+static gboolean
+passwd_reload_cb (gpointer data)
+{
+    CommonUserList *user_list = data;
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    priv->reload_timeout = 0;
+
+    /* Skip if the file was rewritten with the same content */
+    gint64 mtime;
+    guint64 size, inode;
+    common_user_list_get_passwd_stamp (&mtime, &size, &inode);
+    if (mtime == priv->passwd_mtime && size == priv->passwd_size && inode == priv->passwd_inode)
+    {
+        priv->n_skipped_reloads++;
+        g_debug ("%s unchanged, not reloading user list (%u reloads, %u skipped)", PASSWD_FILE, priv->n_reloads, priv->n_skipped_reloads);
+        return G_SOURCE_REMOVE;
     }
-    g_list_free (old_users);
+
+    priv->n_reloads++;
+    g_debug ("%s changed, reloading user list (%u reloads, %u skipped)", PASSWD_FILE, priv->n_reloads, priv->n_skipped_reloads);
+    load_passwd_file (user_list, TRUE);
+
+    return G_SOURCE_REMOVE;
 }
 
 static void
 passwd_changed_cb (GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, CommonUserList *user_list)
 {
-    if (event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+        return;
+
+    /* Collect changes that occur close together into one reload */
+    if (priv->reload_timeout)
     {
-        g_debug ("%s changed, reloading user list", g_file_get_path (file));
-        load_passwd_file (user_list, TRUE);
+        priv->n_skipped_reloads++;
+        return;
     }
+
+    GSource *source = g_timeout_source_new (priv->reload_delay);
+    g_source_set_callback (source, passwd_reload_cb, user_list, NULL);
+    priv->reload_timeout = g_source_attach (source, priv->context);
+    g_source_unref (source);
 }
 
-static gboolean load_accounts_user (CommonUser *user);
+typedef void (*AccountsUserLoadedFunc)(CommonUser *user, gboolean is_login_user, gpointer data);
+
+typedef struct
+{
+    CommonUser *user;
+
+    /* Cancellable for this load */
+    GCancellable *cancellable;
+
+    /* Function to call when loaded */
+    AccountsUserLoadedFunc callback;
+    gpointer callback_data;
+
+    /* Number of replies still to come */
+    gint n_pending;
+
+    /* Properties received */
+    GVariant *result;
+    GVariant *extra_result;
+} AccountsUserLoad;
+
+static void load_accounts_user (CommonUser *user, GCancellable *cancellable, AccountsUserLoadedFunc callback, gpointer callback_data);
+
+static void
+accounts_user_reloaded_cb (CommonUser *user, gboolean is_login_user, gpointer data)
+{
+    if (is_login_user)
+        g_signal_emit (user, user_signals[CHANGED], 0);
+}
 
 static void
 accounts_user_changed_cb (GDBusConnection *connection,
@@ -474,42 +939,48 @@ accounts_user_changed_cb (GDBusConnection *connection,
      * might cause us to log when properties change we don't use. LP: #1376357
      */
     /*g_debug ("User %s changed", priv->path);*/
-    if (load_accounts_user (user))
-        g_signal_emit (user, user_signals[CHANGED], 0);
+    load_accounts_user (user, NULL, accounts_user_reloaded_cb, NULL);
 }
 
-static gboolean
-load_accounts_user (CommonUser *user)
+/* Properties fetched on demand from org.freedesktop.DisplayManager.AccountsService */
+static void
+update_accounts_user_extra (CommonUser *user, GVariant *extra_result)
 {
     CommonUserPrivate *priv = common_user_get_instance_private (user);
 
-    /* Get the properties for this user */
-    if (!priv->changed_signal)
-        priv->changed_signal = g_dbus_connection_signal_subscribe (priv->bus,
-                                                                   "org.freedesktop.Accounts",
-                                                                   "org.freedesktop.Accounts.User",
-                                                                   "Changed",
-                                                                   priv->path,
-                                                                   NULL,
-                                                                   G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                   accounts_user_changed_cb,
-                                                                   user,
-                                                                   NULL);
+    g_autoptr(GVariantIter) extra_iter = NULL;
+    const gchar *name;
+    GVariant *value;
+    g_variant_get (extra_result, "(a{sv})", &extra_iter);
+    while (g_variant_iter_loop (extra_iter, "{&sv}", &name, &value))
+    {
+        if (strcmp (name, "BackgroundFile") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+        {
+            g_free (priv->background);
+            priv->background = g_variant_dup_string (value, NULL);
+            if (strcmp (priv->background, "") == 0)
+                g_clear_pointer (&priv->background, g_free);
+        }
+        else if (strcmp (name, "HasMessages") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+            priv->has_messages = g_variant_get_boolean (value);
+        else if (strcmp (name, "KeyboardLayouts") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
+        {
+            g_strfreev (priv->layouts);
+            priv->layouts = g_variant_dup_strv (value, NULL);
+            if (!priv->layouts)
+            {
+                priv->layouts = g_malloc (sizeof (gchar *) * 1);
+                priv->layouts[0] = NULL;
+            }
+        }
+    }
+}
+
+static gboolean
+update_accounts_user (CommonUser *user, GVariant *result, GVariant *extra_result)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
 
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GVariant) result = g_dbus_connection_call_sync (priv->bus,
-                                                              "org.freedesktop.Accounts",
-                                                              priv->path,
-                                                              "org.freedesktop.DBus.Properties",
-                                                              "GetAll",
-                                                              g_variant_new ("(s)", "org.freedesktop.Accounts.User"),
-                                                              G_VARIANT_TYPE ("(a{sv})"),
-                                                              G_DBUS_CALL_FLAGS_NONE,
-                                                              -1,
-                                                              NULL,
-                                                              &error);
-    if (error)
-        g_warning ("Error updating user %s: %s", priv->path, error->message);
     if (!result)
         return FALSE;
 
@@ -555,6 +1026,7 @@ load_accounts_user (CommonUser *user)
             priv->image = g_variant_dup_string (value, NULL);
             if (strcmp (priv->image, "") == 0)
                 g_clear_pointer (&priv->image, g_free);
+            priv->loaded_image = TRUE;
         }
         else if (strcmp (name, "XSession") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
         {
@@ -567,71 +1039,244 @@ load_accounts_user (CommonUser *user)
             priv->is_locked = g_variant_get_boolean (value);
     }
 
-    g_autoptr(GVariant) extra_result = g_dbus_connection_call_sync (priv->bus,
-                                                                    "org.freedesktop.Accounts",
-                                                                    priv->path,
-                                                                    "org.freedesktop.DBus.Properties",
-                                                                    "GetAll",
-                                                                    g_variant_new ("(s)", "org.freedesktop.DisplayManager.AccountsService"),
-                                                                    G_VARIANT_TYPE ("(a{sv})"),
-                                                                    G_DBUS_CALL_FLAGS_NONE,
-                                                                    -1,
-                                                                    NULL,
-                                                                    &error);
-    if (error)
-        g_warning ("Error updating user %s: %s", priv->path, error->message);
-    if (extra_result) {
-        g_autoptr(GVariantIter) extra_iter = NULL;
+    if (extra_result)
+        update_accounts_user_extra (user, extra_result);
 
-        g_variant_get (extra_result, "(a{sv})", &extra_iter);
-        while (g_variant_iter_loop (extra_iter, "{&sv}", &name, &value))
+    return !system_account;
+}
+
+static void
+accounts_user_load_complete (AccountsUserLoad *load)
+{
+    load->n_pending--;
+    if (load->n_pending > 0)
+        return;
+
+    if (!g_cancellable_is_cancelled (load->cancellable))
+    {
+        gboolean is_login_user = update_accounts_user (load->user, load->result, load->extra_result);
+        load->callback (load->user, is_login_user, load->callback_data);
+    }
+
+    g_object_unref (load->user);
+    g_clear_object (&load->cancellable);
+    g_clear_pointer (&load->result, g_variant_unref);
+    g_clear_pointer (&load->extra_result, g_variant_unref);
+    g_free (load);
+}
+
+static void
+accounts_user_properties_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    AccountsUserLoad *load = data;
+    CommonUserPrivate *priv = common_user_get_instance_private (load->user);
+
+    g_autoptr(GError) error = NULL;
+    load->result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), result, &error);
+    if (error && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("Error updating user %s: %s", priv->path, error->message);
+
+    accounts_user_load_complete (load);
+}
+
+static void
+accounts_user_extra_properties_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    AccountsUserLoad *load = data;
+    CommonUserPrivate *priv = common_user_get_instance_private (load->user);
+
+    g_autoptr(GError) error = NULL;
+    load->extra_result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), result, &error);
+    if (error && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("Error updating user %s: %s", priv->path, error->message);
+
+    accounts_user_load_complete (load);
+}
+
+/* Request the properties for this user.  The display manager properties are
+   only requested if they have been used, both interfaces are requested at once */
+static void
+load_accounts_user (CommonUser *user, GCancellable *cancellable, AccountsUserLoadedFunc callback, gpointer callback_data)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    AccountsUserLoad *load = g_malloc0 (sizeof (AccountsUserLoad));
+    load->user = g_object_ref (user);
+    load->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+    load->callback = callback;
+    load->callback_data = callback_data;
+    load->n_pending = priv->loaded_extra ? 2 : 1;
+
+    g_dbus_connection_call (priv->bus,
+                            "org.freedesktop.Accounts",
+                            priv->path,
+                            "org.freedesktop.DBus.Properties",
+                            "GetAll",
+                            g_variant_new ("(s)", "org.freedesktop.Accounts.User"),
+                            G_VARIANT_TYPE ("(a{sv})"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            cancellable,
+                            accounts_user_properties_cb,
+                            load);
+    if (!priv->loaded_extra)
+        return;
+    g_dbus_connection_call (priv->bus,
+                            "org.freedesktop.Accounts",
+                            priv->path,
+                            "org.freedesktop.DBus.Properties",
+                            "GetAll",
+                            g_variant_new ("(s)", "org.freedesktop.DisplayManager.AccountsService"),
+                            G_VARIANT_TYPE ("(a{sv})"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            cancellable,
+                            accounts_user_extra_properties_cb,
+                            load);
+}
+
+/* Subscribe to signals in the context the list was created in, so they are
+   not lost in the private context used while loading synchronously */
+static guint
+subscribe_signal (CommonUserList *user_list, const gchar *interface_name, const gchar *member, const gchar *object_path,
+                  GDBusSignalCallback callback, gpointer user_data)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    const gchar *sender = g_str_has_prefix (interface_name, "org.freedesktop.Accounts") ? "org.freedesktop.Accounts" : "org.freedesktop.DisplayManager";
+    g_main_context_push_thread_default (priv->context);
+    guint id = g_dbus_connection_signal_subscribe (priv->bus,
+                                                   sender,
+                                                   interface_name,
+                                                   member,
+                                                   object_path,
+                                                   NULL,
+                                                   G_DBUS_SIGNAL_FLAGS_NONE,
+                                                   callback,
+                                                   user_data,
+                                                   NULL);
+    g_main_context_pop_thread_default (priv->context);
+
+    return id;
+}
+
+static void load_next_users (CommonUserList *user_list);
+
+static void
+accounts_user_loaded_cb (CommonUser *user, gboolean is_login_user, gpointer data)
+{
+    CommonUserList *user_list = data;
+    CommonUserListPrivate *list_priv = common_user_list_get_instance_private (user_list);
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    /* Ignore users deleted while loading */
+    if (!g_hash_table_remove (list_priv->loading_paths, priv->path))
+        is_login_user = FALSE;
+
+    if (is_login_user)
+    {
+        g_debug ("User %s added", priv->path);
+        insert_user (user_list, g_object_ref (user));
+
+        /* The first users loaded are only announced with ::loaded */
+        if (list_priv->have_users)
+            notify_user_added (user_list, user);
+    }
+    else
+        g_signal_handlers_disconnect_by_func (user, user_changed_cb, user_list);
+
+    load_next_users (user_list);
+}
+
+static gchar *
+get_snapshot_state (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+    return g_strjoin ("\n",
+                      priv->name ? priv->name : "",
+                      priv->real_name ? priv->real_name : "",
+                      priv->home_directory ? priv->home_directory : "",
+                      priv->image ? priv->image : "",
+                      priv->session ? priv->session : "",
+                      NULL);
+}
+
+static void
+accounts_user_reconciled_cb (CommonUser *user, gboolean is_login_user, gpointer data)
+{
+    CommonUserList *user_list = data;
+    CommonUserListPrivate *list_priv = common_user_list_get_instance_private (user_list);
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    /* Ignore users deleted while loading */
+    if (!g_hash_table_remove (list_priv->loading_paths, priv->path))
+    {
+        load_next_users (user_list);
+        return;
+    }
+
+    priv->from_snapshot = FALSE;
+    g_autofree gchar *snapshot_state = g_steal_pointer (&priv->snapshot_state);
+
+    if (is_login_user)
+    {
+        g_autofree gchar *state = get_snapshot_state (user);
+        if (priv->snapshot_logged_in || strcmp (state, snapshot_state) != 0)
         {
-            if (strcmp (name, "BackgroundFile") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
-            {
-                g_free (priv->background);
-                priv->background = g_variant_dup_string (value, NULL);
-                if (strcmp (priv->background, "") == 0)
-                    g_clear_pointer (&priv->background, g_free);
-            }
-            else if (strcmp (name, "HasMessages") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
-                priv->has_messages = g_variant_get_boolean (value);
-            else if (strcmp (name, "KeyboardLayouts") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
-            {
-                g_strfreev (priv->layouts);
-                priv->layouts = g_variant_dup_strv (value, NULL);
-                if (!priv->layouts)
-                {
-                    priv->layouts = g_malloc (sizeof (gchar *) * 1);
-                    priv->layouts[0] = NULL;
-                }
-            }
+            /* Move the user if their display name changed */
+            remove_user (user_list, user);
+            insert_user (user_list, user);
+
+            g_debug ("User %s changed", priv->path);
+            g_signal_emit (user, user_signals[CHANGED], 0);
         }
     }
+    else
+    {
+        g_debug ("User %s removed", priv->path);
+        remove_user (user_list, user);
+        g_signal_handlers_disconnect_by_func (user, user_changed_cb, user_list);
+        notify_user_removed (user_list, user);
+        g_object_unref (user);
+    }
 
-    return !system_account;
+    load_next_users (user_list);
 }
 
 static void
-add_accounts_user (CommonUserList *user_list, const gchar *path, gboolean emit_signal)
+add_accounts_user (CommonUserList *user_list, const gchar *path)
 {
     CommonUserListPrivate *list_priv = common_user_list_get_instance_private (user_list);
 
-    CommonUser *user = g_object_new (COMMON_TYPE_USER, NULL);
+    /* Skip if already loading this user */
+    if (g_hash_table_contains (list_priv->loading_paths, path))
+        return;
+
+    /* Check users read from a snapshot are still current */
+    CommonUser *existing_user = get_user_by_path (user_list, path);
+    if (existing_user)
+    {
+        CommonUserPrivate *priv = common_user_get_instance_private (existing_user);
+        if (priv->from_snapshot)
+        {
+            priv->snapshot_state = get_snapshot_state (existing_user);
+            g_hash_table_add (list_priv->loading_paths, g_strdup (path));
+            load_accounts_user (existing_user, list_priv->cancellable, accounts_user_reconciled_cb, user_list);
+        }
+        return;
+    }
+
+    g_autoptr(CommonUser) user = g_object_new (COMMON_TYPE_USER, NULL);
     CommonUserPrivate *priv = common_user_get_instance_private (user);
 
-    g_debug ("User %s added", path);
     priv->bus = g_object_ref (list_priv->bus);
     priv->path = g_strdup (path);
+    priv->changed_signal = subscribe_signal (user_list, "org.freedesktop.Accounts.User", "Changed", path, accounts_user_changed_cb, user);
     g_signal_connect (user, USER_SIGNAL_CHANGED, G_CALLBACK (user_changed_cb), user_list);
     g_signal_connect (user, "get-logged-in", G_CALLBACK (get_logged_in_cb), user_list);
-    if (load_accounts_user (user))
-    {
-        list_priv->users = g_list_insert_sorted (list_priv->users, user, compare_user);
-        if (emit_signal)
-            g_signal_emit (user_list, list_signals[USER_ADDED], 0, user);
-    }
-    else
-        g_object_unref (user);
+
+    g_hash_table_add (list_priv->loading_paths, g_strdup (path));
+    load_accounts_user (user, list_priv->cancellable, accounts_user_loaded_cb, user_list);
 }
 
 static void
@@ -644,6 +1289,7 @@ accounts_user_added_cb (GDBusConnection *connection,
                         gpointer data)
 {
     CommonUserList *user_list = data;
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
     if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(o)")))
     {
@@ -654,10 +1300,14 @@ accounts_user_added_cb (GDBusConnection *connection,
     const gchar *path;
     g_variant_get (parameters, "(&o)", &path);
 
-    /* Add user if we haven't got them */
-    CommonUser *user = get_user_by_path (user_list, path);
-    if (!user)
-        add_accounts_user (user_list, path, TRUE);
+    /* Queue the user if still loading the list, otherwise add them if we haven't got them */
+    if (priv->loading)
+    {
+        g_queue_push_tail (priv->pending_paths, g_strdup (path));
+        load_next_users (user_list);
+    }
+    else
+        add_accounts_user (user_list, path);
 }
 
 static void
@@ -681,56 +1331,147 @@ accounts_user_deleted_cb (GDBusConnection *connection,
     const gchar *path;
     g_variant_get (parameters, "(&o)", &path);
 
+    /* Drop user if still waiting to load them */
+    if (priv->pending_paths)
+    {
+        GList *link = g_queue_find_custom (priv->pending_paths, path, (GCompareFunc) g_strcmp0);
+        if (link)
+        {
+            g_free (link->data);
+            g_queue_delete_link (priv->pending_paths, link);
+        }
+    }
+    g_hash_table_remove (priv->loading_paths, path);
+
     /* Delete user if we know of them */
     CommonUser *user = get_user_by_path (user_list, path);
     if (user)
     {
         g_debug ("User %s deleted", path);
-        priv->users = g_list_remove (priv->users, user);
+        remove_user (user_list, user);
+        g_signal_handlers_disconnect_by_func (user, user_changed_cb, user_list);
 
-        g_signal_emit (user_list, list_signals[USER_REMOVED], 0, user);
+        notify_user_removed (user_list, user);
 
         g_object_unref (user);
     }
 }
 
 static CommonSession *
-load_session (CommonUserList *user_list, const gchar *path)
+find_session (CommonUserList *user_list, const gchar *path)
 {
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GVariant) result = g_dbus_connection_call_sync (priv->bus,
-                                                              "org.freedesktop.DisplayManager",
-                                                              path,
-                                                              "org.freedesktop.DBus.Properties",
-                                                              "Get",
-                                                              g_variant_new ("(ss)", "org.freedesktop.DisplayManager.Session", "UserName"),
-                                                              G_VARIANT_TYPE ("(v)"),
-                                                              G_DBUS_CALL_FLAGS_NONE,
-                                                              -1,
-                                                              NULL,
-                                                              &error);
-    if (error)
-        g_warning ("Error getting UserName from org.freedesktop.DisplayManager.Session: %s", error->message);
-    if (!result)
-        return NULL;
+    for (GList *link = priv->sessions; link; link = link->next)
+    {
+        CommonSession *session = link->data;
+        if (strcmp (session->path, path) == 0)
+            return session;
+    }
 
-    g_autoptr(GVariant) username = NULL;
-    g_variant_get (result, "(v)", &username);
-    if (!g_variant_is_of_type (username, G_VARIANT_TYPE_STRING))
-        return NULL;
+    return NULL;
+}
 
-    const gchar *name;
-    g_variant_get (username, "&s", &name);
+static void
+add_session (CommonUserList *user_list, const gchar *path, const gchar *username)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    g_hash_table_remove (priv->loading_sessions, path);
+    if (find_session (user_list, path))
+        return;
 
-    g_debug ("Loaded session %s (%s)", path, name);
+    g_debug ("Loaded session %s (%s)", path, username);
     CommonSession *session = g_object_new (common_session_get_type (), NULL);
-    session->username = g_strdup (name);
+    session->username = g_strdup (username);
     session->path = g_strdup (path);
     priv->sessions = g_list_append (priv->sessions, session);
 
-    return session;
+    /* Users already asked for have been told they are not logged in */
+    CommonUser *user = get_user_by_name (user_list, username);
+    if (user && !priv->waiting_for_sessions)
+        g_signal_emit (user, user_signals[CHANGED], 0);
+}
+
+static void
+check_sessions_loaded (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (priv->listing_sessions || g_hash_table_size (priv->loading_sessions) > 0)
+        return;
+
+    if (!priv->have_sessions)
+        g_debug ("Loaded %u sessions", g_list_length (priv->sessions));
+    priv->have_sessions = TRUE;
+}
+
+typedef struct
+{
+    CommonUserList *user_list;
+    gchar *path;
+} SessionLoad;
+
+static void
+session_properties_cb (GObject *object, GAsyncResult *res, gpointer data)
+{
+    g_autofree SessionLoad *load = data;
+    g_autofree gchar *path = load->path;
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), res, &error);
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+    CommonUserList *user_list = load->user_list;
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    /* Ignore sessions removed while loading */
+    if (!g_hash_table_contains (priv->loading_sessions, path))
+        return;
+
+    const gchar *username = NULL;
+    g_autoptr(GVariant) properties = NULL;
+    if (error)
+        g_warning ("Error getting properties from org.freedesktop.DisplayManager.Session: %s", error->message);
+    else
+    {
+        properties = g_variant_get_child_value (result, 0);
+        g_variant_lookup (properties, "UserName", "&s", &username);
+    }
+
+    if (username)
+        add_session (user_list, path, username);
+    else
+        g_hash_table_remove (priv->loading_sessions, path);
+    check_sessions_loaded (user_list);
+}
+
+/* Requests are answered in the thread-default context */
+static void
+load_session (CommonUserList *user_list, const gchar *path)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (find_session (user_list, path) || g_hash_table_contains (priv->loading_sessions, path))
+        return;
+    g_hash_table_add (priv->loading_sessions, g_strdup (path));
+
+    SessionLoad *load = g_malloc0 (sizeof (SessionLoad));
+    load->user_list = user_list;
+    load->path = g_strdup (path);
+    g_dbus_connection_call (priv->bus,
+                            "org.freedesktop.DisplayManager",
+                            path,
+                            "org.freedesktop.DBus.Properties",
+                            "GetAll",
+                            g_variant_new ("(s)", "org.freedesktop.DisplayManager.Session"),
+                            G_VARIANT_TYPE ("(a{sv})"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            priv->sessions_cancellable,
+                            session_properties_cb,
+                            load);
 }
 
 static void
@@ -743,6 +1484,7 @@ session_added_cb (GDBusConnection *connection,
                   gpointer data)
 {
     CommonUserList *user_list = data;
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
     if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(o)")))
     {
@@ -750,15 +1492,12 @@ session_added_cb (GDBusConnection *connection,
         return;
     }
 
+    /* Request the user name without blocking */
     const gchar *path;
     g_variant_get (parameters, "(&o)", &path);
-    CommonSession *session = load_session (user_list, path);
-    if (!session)
-        return;
-
-    CommonUser *user = get_user_by_name (user_list, session->username);
-    if (user)
-        g_signal_emit (user, user_signals[CHANGED], 0);
+    g_main_context_push_thread_default (priv->context);
+    load_session (user_list, path);
+    g_main_context_pop_thread_default (priv->context);
 }
 
 static void
@@ -782,70 +1521,43 @@ session_removed_cb (GDBusConnection *connection,
     const gchar *path;
     g_variant_get (parameters, "(&o)", &path);
 
-    for (GList *link = priv->sessions; link; link = link->next)
+    if (g_hash_table_remove (priv->loading_sessions, path))
+        check_sessions_loaded (user_list);
+
+    CommonSession *session = find_session (user_list, path);
+    if (session)
     {
-        CommonSession *session = link->data;
-        if (strcmp (session->path, path) == 0)
-        {
-            g_debug ("Session %s removed", path);
-            priv->sessions = g_list_delete_link (priv->sessions, link);
-            CommonUser *user = get_user_by_name (user_list, session->username);
-            if (user)
-                g_signal_emit (user, user_signals[CHANGED], 0);
-            g_object_unref (session);
-            break;
-        }
+        g_debug ("Session %s removed", path);
+        priv->sessions = g_list_remove (priv->sessions, session);
+        CommonUser *user = get_user_by_name (user_list, session->username);
+        if (user)
+            g_signal_emit (user, user_signals[CHANGED], 0);
+        g_object_unref (session);
     }
 }
 
 static void
-load_sessions (CommonUserList *user_list)
+session_list_cb (GObject *object, GAsyncResult *res, gpointer data)
 {
-    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), res, &error);
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
 
-    priv->session_added_signal = g_dbus_connection_signal_subscribe (priv->bus,
-                                                                     "org.freedesktop.DisplayManager",
-                                                                     "org.freedesktop.DisplayManager",
-                                                                     "SessionAdded",
-                                                                     "/org/freedesktop/DisplayManager",
-                                                                     NULL,
-                                                                     G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                     session_added_cb,
-                                                                     user_list,
-                                                                     NULL);
-    priv->session_removed_signal = g_dbus_connection_signal_subscribe (priv->bus,
-                                                                       "org.freedesktop.DisplayManager",
-                                                                       "org.freedesktop.DisplayManager",
-                                                                       "SessionRemoved",
-                                                                       "/org/freedesktop/DisplayManager",
-                                                                       NULL,
-                                                                       G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                       session_removed_cb,
-                                                                       user_list,
-                                                                       NULL);
+    CommonUserList *user_list = data;
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GVariant) result = g_dbus_connection_call_sync (priv->bus,
-                                                              "org.freedesktop.DisplayManager",
-                                                              "/org/freedesktop/DisplayManager",
-                                                              "org.freedesktop.DBus.Properties",
-                                                              "Get",
-                                                              g_variant_new ("(ss)", "org.freedesktop.DisplayManager", "Sessions"),
-                                                              G_VARIANT_TYPE ("(v)"),
-                                                              G_DBUS_CALL_FLAGS_NONE,
-                                                              -1,
-                                                              NULL,
-                                                              &error);
     if (error)
         g_warning ("Error getting session list from org.freedesktop.DisplayManager: %s", error->message);
     if (result)
     {
-        if (g_variant_is_of_type (result, G_VARIANT_TYPE ("(v)")))
+        g_autoptr(GVariant) value = NULL;
+        g_variant_get (result, "(v)", &value);
+        if (g_variant_is_of_type (value, G_VARIANT_TYPE ("ao")))
         {
-            g_autoptr(GVariant) value = NULL;
-            g_variant_get (result, "(v)", &value);
-
             g_debug ("Loading sessions from org.freedesktop.DisplayManager");
+
+            /* Request all the sessions at once */
             g_autoptr(GVariantIter) iter = NULL;
             g_variant_get (value, "ao", &iter);
             const gchar *path;
@@ -853,117 +1565,724 @@ load_sessions (CommonUserList *user_list)
                 load_session (user_list, path);
         }
         else
-            g_warning ("Unexpected type from org.freedesktop.DisplayManager.Sessions: %s", g_variant_get_type_string (result));
+            g_warning ("Unexpected type from org.freedesktop.DisplayManager.Sessions: %s", g_variant_get_type_string (value));
     }
+
+    priv->listing_sessions = FALSE;
+    check_sessions_loaded (user_list);
+}
+
+/* Request the list of sessions, answered in the thread-default context */
+static void
+list_sessions (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    priv->listing_sessions = TRUE;
+    g_dbus_connection_call (priv->bus,
+                            "org.freedesktop.DisplayManager",
+                            "/org/freedesktop/DisplayManager",
+                            "org.freedesktop.DBus.Properties",
+                            "Get",
+                            g_variant_new ("(ss)", "org.freedesktop.DisplayManager", "Sessions"),
+                            G_VARIANT_TYPE ("(v)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            priv->sessions_cancellable,
+                            session_list_cb,
+                            user_list);
 }
 
+static void
+start_loading_sessions (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (priv->session_added_signal != 0)
+        return;
+
+    priv->session_added_signal = subscribe_signal (user_list, "org.freedesktop.DisplayManager", "SessionAdded", "/org/freedesktop/DisplayManager",
+                                                   session_added_cb, user_list);
+    priv->session_removed_signal = subscribe_signal (user_list, "org.freedesktop.DisplayManager", "SessionRemoved", "/org/freedesktop/DisplayManager",
+                                                     session_removed_cb, user_list);
+
+    g_main_context_push_thread_default (priv->context);
+    list_sessions (user_list);
+    g_main_context_pop_thread_default (priv->context);
+}
+
+static void
+load_sessions (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    start_loading_sessions (user_list);
+    if (priv->have_sessions)
+        return;
+
+    /* Restart any requests in a private context so we can wait for them
+     * without dispatching other events */
+    g_cancellable_cancel (priv->sessions_cancellable);
+    g_object_unref (priv->sessions_cancellable);
+    priv->sessions_cancellable = g_cancellable_new ();
+    g_hash_table_remove_all (priv->loading_sessions);
+
+    g_autoptr(GMainContext) context = g_main_context_new ();
+    g_main_context_push_thread_default (context);
+    priv->waiting_for_sessions = TRUE;
+    list_sessions (user_list);
+    while (!priv->have_sessions)
+        g_main_context_iteration (context, TRUE);
+    priv->waiting_for_sessions = FALSE;
+    g_main_context_pop_thread_default (context);
+}
+
+static void
+finish_loading (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    /* Remove any users from the snapshot that no longer exist */
+    begin_changes (user_list);
+    for (guint i = priv->users->len; i > 0; i--)
+    {
+        CommonUser *user = g_ptr_array_index (priv->users, i - 1);
+        CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+        if (!user_priv->from_snapshot)
+            continue;
+
+        g_debug ("User %s removed", user_priv->name);
+        remove_user (user_list, user);
+        g_signal_handlers_disconnect_by_func (user, user_changed_cb, user_list);
+        notify_user_removed (user_list, user);
+        g_object_unref (user);
+    }
+    end_changes (user_list);
+
+    priv->loading = FALSE;
+    priv->have_users = TRUE;
+    g_clear_pointer (&priv->pending_paths, g_queue_free);
+    g_clear_pointer (&priv->load_context, g_main_context_unref);
+
+    g_debug ("Loaded %u users", priv->users->len);
+    g_signal_emit (user_list, list_signals[LOADED], 0);
+}
+
+/* Keep up to USER_LOAD_WINDOW users loading at once */
+static void
+load_next_users (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (!priv->loading)
+        return;
+
+    /* Replies need to arrive in the context being iterated for the load */
+    g_main_context_push_thread_default (priv->load_context);
+    while (g_hash_table_size (priv->loading_paths) < USER_LOAD_WINDOW && !g_queue_is_empty (priv->pending_paths))
+    {
+        g_autofree gchar *path = g_queue_pop_head (priv->pending_paths);
+        add_accounts_user (user_list, path);
+    }
+    g_main_context_pop_thread_default (priv->load_context);
+
+    if (!priv->listing && g_hash_table_size (priv->loading_paths) == 0 && g_queue_is_empty (priv->pending_paths))
+        finish_loading (user_list);
+}
+
+static void
+load_passwd_users (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    g_dbus_connection_signal_unsubscribe (priv->bus, priv->user_added_signal);
+    priv->user_added_signal = 0;
+    g_dbus_connection_signal_unsubscribe (priv->bus, priv->user_removed_signal);
+    priv->user_removed_signal = 0;
+
+    /* The first users loaded are only announced with ::loaded */
+    load_passwd_file (user_list, priv->have_users);
+
+    /* Users from the snapshot that are still in the password file are now current */
+    for (guint i = 0; i < priv->users->len; i++)
+    {
+        CommonUser *user = g_ptr_array_index (priv->users, i);
+        CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+        user_priv->from_snapshot = FALSE;
+    }
+
+    /* Watch for changes to user list */
+    g_autoptr(GFile) passwd_file = g_file_new_for_path (PASSWD_FILE);
+    g_autoptr(GError) e = NULL;
+    g_main_context_push_thread_default (priv->context);
+    priv->passwd_monitor = g_file_monitor (passwd_file, G_FILE_MONITOR_NONE, NULL, &e);
+    g_main_context_pop_thread_default (priv->context);
+    if (e)
+        g_warning ("Error monitoring %s: %s", PASSWD_FILE, e->message);
+    else
+        g_signal_connect (priv->passwd_monitor, "changed", G_CALLBACK (passwd_changed_cb), user_list);
+
+    finish_loading (user_list);
+}
+
+static void
+list_cached_users_cb (GObject *object, GAsyncResult *res, gpointer data)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), res, &error);
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+    CommonUserList *user_list = data;
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    priv->listing = FALSE;
+
+    /* Fall back to /etc/passwd if accounts service not available */
+    if (error)
+        g_warning ("Error getting user list from org.freedesktop.Accounts: %s", error->message);
+    if (!result)
+    {
+        load_passwd_users (user_list);
+        return;
+    }
+
+    g_debug ("Loading users from org.freedesktop.Accounts");
+    g_autoptr(GVariantIter) iter = NULL;
+    g_variant_get (result, "(ao)", &iter);
+    const gchar *path;
+    while (g_variant_iter_loop (iter, "&o", &path))
+        g_queue_push_tail (priv->pending_paths, g_strdup (path));
+
+    load_next_users (user_list);
+}
+
+static void
+begin_loading (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    priv->loading = TRUE;
+    priv->listing = TRUE;
+    priv->load_context = g_main_context_ref_thread_default ();
+    priv->pending_paths = g_queue_new ();
+
+    /* Get user list from accounts service and fall back to /etc/passwd if that fails */
+    if (priv->user_added_signal == 0)
+    {
+        priv->user_added_signal = subscribe_signal (user_list, "org.freedesktop.Accounts", "UserAdded", "/org/freedesktop/Accounts", accounts_user_added_cb, user_list);
+        priv->user_removed_signal = subscribe_signal (user_list, "org.freedesktop.Accounts", "UserDeleted", "/org/freedesktop/Accounts", accounts_user_deleted_cb, user_list);
+    }
+
+    g_dbus_connection_call (priv->bus,
+                            "org.freedesktop.Accounts",
+                            "/org/freedesktop/Accounts",
+                            "org.freedesktop.Accounts",
+                            "ListCachedUsers",
+                            g_variant_new ("()"),
+                            G_VARIANT_TYPE ("(ao)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            priv->cancellable,
+                            list_cached_users_cb,
+                            user_list);
+}
+
+static void
+start_loading (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (priv->loading || priv->have_users)
+        return;
+    begin_loading (user_list);
+}
+
+/* Load users, blocking until complete */
 static void
 load_users (CommonUserList *user_list)
 {
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
-    if (priv->have_users)
-        return;
-    priv->have_users = TRUE;
+    if (priv->have_users)
+        return;
+
+    /* Abandon any load in progress, waiting on it would dispatch everything
+       else in the context it was started in */
+    if (priv->loading)
+    {
+        g_debug ("Restarting user load");
+        g_cancellable_cancel (priv->cancellable);
+        g_object_unref (priv->cancellable);
+        priv->cancellable = g_cancellable_new ();
+        g_hash_table_remove_all (priv->loading_paths);
+        g_queue_free_full (priv->pending_paths, g_free);
+        priv->pending_paths = NULL;
+        g_clear_pointer (&priv->load_context, g_main_context_unref);
+        priv->loading = FALSE;
+    }
+
+    /* Run the load in a private context so nothing else is dispatched while we wait */
+    g_autoptr(GMainContext) context = g_main_context_new ();
+    g_main_context_push_thread_default (context);
+    begin_loading (user_list);
+    while (!priv->have_users)
+        g_main_context_iteration (context, TRUE);
+    g_main_context_pop_thread_default (context);
+}
+
+/**
+ * common_user_list_get_length:
+ * @user_list: a #CommonUserList
+ *
+ * Return value: The number of users able to log in
+ **/
+gint
+common_user_list_get_length (CommonUserList *user_list)
+{
+    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), 0);
+
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    load_users (user_list);
+    return priv->users->len;
+}
+
+/**
+ * common_user_list_get_users:
+ * @user_list: A #CommonUserList
+ *
+ * Get a list of users to present to the user.  This list may be a subset of the
+ * available users and may be empty depending on the server configuration.
+ *
+ * Return value: (element-type CommonUser) (transfer none): A list of #CommonUser that should be presented to the user.
+ **/
+GList *
+common_user_list_get_users (CommonUserList *user_list)
+{
+    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), NULL);
+
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    load_users (user_list);
+
+    if (!priv->users_list)
+    {
+        for (guint i = priv->users->len; i > 0; i--)
+            priv->users_list = g_list_prepend (priv->users_list, g_ptr_array_index (priv->users, i - 1));
+    }
+
+    return priv->users_list;
+}
+
+/**
+ * common_user_list_reload:
+ * @user_list: A #CommonUserList
+ *
+ * Reload the user list from the password database.  This has no effect if the
+ * users are provided by AccountsService.
+ **/
+void
+common_user_list_reload (CommonUserList *user_list)
+{
+    g_return_if_fail (COMMON_IS_USER_LIST (user_list));
+
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+    if (!priv->have_users)
+    {
+        load_users (user_list);
+        return;
+    }
+
+    /* The daemon tells us when the users change */
+    if (priv->from_daemon)
+        return;
+
+    if (priv->user_added_signal == 0)
+        load_passwd_file (user_list, TRUE);
+}
+
+/**
+ * common_user_list_start_loading:
+ * @user_list: A #CommonUserList
+ *
+ * Start loading users without blocking.  Users are added as they are loaded
+ * and the ::loaded signal is emitted once the list is complete.
+ **/
+void
+common_user_list_start_loading (CommonUserList *user_list)
+{
+    g_return_if_fail (COMMON_IS_USER_LIST (user_list));
+    start_loading (user_list);
+}
+
+/**
+ * common_user_list_start_loading_sessions:
+ * @user_list: A #CommonUserList
+ *
+ * Start loading which users are logged in without blocking, so
+ * common_user_get_logged_in() doesn't need to wait for them.  Users that turn
+ * out to be logged in emit a changed signal.
+ **/
+void
+common_user_list_start_loading_sessions (CommonUserList *user_list)
+{
+    g_return_if_fail (COMMON_IS_USER_LIST (user_list));
+    start_loading_sessions (user_list);
+}
+
+/**
+ * common_user_list_load_snapshot:
+ * @user_list: A #CommonUserList
+ * @path: Path to a snapshot written by the daemon
+ * @generation: Generation the snapshot must have or 0 to accept any
+ *
+ * Populate the user list from a snapshot so it is immediately available.  The
+ * users are then checked in the background, emitting signals for any that have
+ * been added, changed or removed since the snapshot was written.
+ *
+ * Return value: #TRUE if the snapshot was used.
+ **/
+gboolean
+common_user_list_load_snapshot (CommonUserList *user_list, const gchar *path, guint64 generation)
+{
+    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), FALSE);
+    g_return_val_if_fail (path != NULL, FALSE);
+
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (priv->loading || priv->have_users)
+        return FALSE;
+
+    g_autoptr(UserListSnapshot) snapshot = user_list_snapshot_open (path, generation);
+    if (!snapshot)
+        return FALSE;
+
+    guint length = user_list_snapshot_get_length (snapshot);
+    g_debug ("Loading %u users from snapshot %s", length, path);
+    for (guint i = 0; i < length; i++)
+    {
+        const gchar *name = user_list_snapshot_get_name (snapshot, i);
+        if (get_user_by_name (user_list, name))
+            continue;
+
+        CommonUser *user = g_object_new (COMMON_TYPE_USER, NULL);
+        CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+
+        user_priv->name = g_strdup (name);
+        user_priv->path = g_strdup (user_list_snapshot_get_path (snapshot, i));
+        user_priv->real_name = g_strdup (user_list_snapshot_get_real_name (snapshot, i));
+        user_priv->home_directory = g_strdup (user_list_snapshot_get_home_directory (snapshot, i));
+        user_priv->image = g_strdup (user_list_snapshot_get_image (snapshot, i));
+        user_priv->loaded_image = user_list_snapshot_get_has_image (snapshot, i);
+        user_priv->session = g_strdup (user_list_snapshot_get_session (snapshot, i));
+        user_priv->uid = user_list_snapshot_get_uid (snapshot, i);
+        user_priv->from_snapshot = TRUE;
+        user_priv->snapshot_logged_in = user_list_snapshot_get_logged_in (snapshot, i);
+        if (user_priv->path)
+        {
+            user_priv->bus = g_object_ref (priv->bus);
+            user_priv->changed_signal = subscribe_signal (user_list, "org.freedesktop.Accounts.User", "Changed", user_priv->path, accounts_user_changed_cb, user);
+        }
+        g_signal_connect (user, USER_SIGNAL_CHANGED, G_CALLBACK (user_changed_cb), user_list);
+        g_signal_connect (user, "get-logged-in", G_CALLBACK (get_logged_in_cb), user_list);
+
+        /* Snapshot is written in display order */
+        g_ptr_array_add (priv->users, user);
+        index_user (user_list, user);
+    }
+    update_sort_keys (priv->users);
+    g_clear_pointer (&priv->users_list, g_list_free);
+    priv->have_users = TRUE;
+
+    /* Check the users are still current */
+    begin_loading (user_list);
+
+    return TRUE;
+}
+
+/* Properties sent from the daemon to greeters, does not load anything */
+static GVariant *
+get_user_properties (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    GVariantBuilder builder;
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "name", g_variant_new_string (priv->name ? priv->name : ""));
+    if (priv->path)
+        g_variant_builder_add (&builder, "{sv}", "path", g_variant_new_string (priv->path));
+    if (priv->real_name)
+        g_variant_builder_add (&builder, "{sv}", "real-name", g_variant_new_string (priv->real_name));
+    if (priv->home_directory)
+        g_variant_builder_add (&builder, "{sv}", "home-directory", g_variant_new_string (priv->home_directory));
+    if (priv->shell)
+        g_variant_builder_add (&builder, "{sv}", "shell", g_variant_new_string (priv->shell));
+    if (priv->image)
+        g_variant_builder_add (&builder, "{sv}", "image", g_variant_new_string (priv->image));
+    if (priv->background)
+        g_variant_builder_add (&builder, "{sv}", "background", g_variant_new_string (priv->background));
+    if (priv->language)
+        g_variant_builder_add (&builder, "{sv}", "language", g_variant_new_string (priv->language));
+    g_variant_builder_add (&builder, "{sv}", "layouts", g_variant_new_strv ((const gchar * const *) priv->layouts, -1));
+    if (priv->session)
+        g_variant_builder_add (&builder, "{sv}", "session", g_variant_new_string (priv->session));
+    g_variant_builder_add (&builder, "{sv}", "uid", g_variant_new_uint64 (priv->uid));
+    g_variant_builder_add (&builder, "{sv}", "gid", g_variant_new_uint64 (priv->gid));
+    g_variant_builder_add (&builder, "{sv}", "has-messages", g_variant_new_boolean (priv->has_messages));
+    g_variant_builder_add (&builder, "{sv}", "is-locked", g_variant_new_boolean (priv->is_locked));
+
+    /* Let the receiver know which properties are still to be loaded */
+    g_variant_builder_add (&builder, "{sv}", "loaded-dmrc", g_variant_new_boolean (priv->path != NULL || priv->loaded_dmrc));
+    g_variant_builder_add (&builder, "{sv}", "loaded-image", g_variant_new_boolean (priv->path != NULL || priv->loaded_image));
+    g_variant_builder_add (&builder, "{sv}", "loaded-extra", g_variant_new_boolean (priv->path == NULL || priv->loaded_extra));
+
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void
+set_user_properties (CommonUserList *user_list, CommonUser *user, GVariant *properties)
+{
+    CommonUserListPrivate *list_priv = common_user_list_get_instance_private (user_list);
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    g_clear_pointer (&priv->name, g_free);
+    g_clear_pointer (&priv->path, g_free);
+    g_clear_pointer (&priv->real_name, g_free);
+    g_clear_pointer (&priv->home_directory, g_free);
+    g_clear_pointer (&priv->shell, g_free);
+    g_clear_pointer (&priv->image, g_free);
+    g_clear_pointer (&priv->background, g_free);
+    g_clear_pointer (&priv->language, g_free);
+    g_clear_pointer (&priv->layouts, g_strfreev);
+    g_clear_pointer (&priv->session, g_free);
+
+    g_variant_lookup (properties, "name", "s", &priv->name);
+    g_variant_lookup (properties, "path", "s", &priv->path);
+    g_variant_lookup (properties, "real-name", "s", &priv->real_name);
+    g_variant_lookup (properties, "home-directory", "s", &priv->home_directory);
+    g_variant_lookup (properties, "shell", "s", &priv->shell);
+    g_variant_lookup (properties, "image", "s", &priv->image);
+    g_variant_lookup (properties, "background", "s", &priv->background);
+    g_variant_lookup (properties, "language", "s", &priv->language);
+    if (!g_variant_lookup (properties, "layouts", "^as", &priv->layouts))
+    {
+        priv->layouts = g_malloc (sizeof (gchar *) * 1);
+        priv->layouts[0] = NULL;
+    }
+    g_variant_lookup (properties, "session", "s", &priv->session);
+    g_variant_lookup (properties, "uid", "t", &priv->uid);
+    g_variant_lookup (properties, "gid", "t", &priv->gid);
+    g_variant_lookup (properties, "has-messages", "b", &priv->has_messages);
+    g_variant_lookup (properties, "is-locked", "b", &priv->is_locked);
+
+    /* Anything the daemon hasn't loaded yet is loaded as needed, unless the
+     * daemon sends it first */
+    priv->loaded_dmrc = TRUE;
+    priv->loaded_image = TRUE;
+    priv->loaded_extra = TRUE;
+    g_variant_lookup (properties, "loaded-dmrc", "b", &priv->loaded_dmrc);
+    g_variant_lookup (properties, "loaded-image", "b", &priv->loaded_image);
+    g_variant_lookup (properties, "loaded-extra", "b", &priv->loaded_extra);
+    priv->from_snapshot = FALSE;
+
+    /* Keep the bus so the user can still be modified */
+    if (!priv->bus && list_priv->bus)
+        priv->bus = g_object_ref (list_priv->bus);
+}
+
+/* Stop loading users ourself, the daemon now tells us about changes */
+static void
+stop_loading (CommonUserList *user_list)
+{
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (priv->loading)
+    {
+        g_cancellable_cancel (priv->cancellable);
+        g_object_unref (priv->cancellable);
+        priv->cancellable = g_cancellable_new ();
+        g_hash_table_remove_all (priv->loading_paths);
+        g_clear_pointer (&priv->pending_paths, g_queue_free);
+        g_clear_pointer (&priv->load_context, g_main_context_unref);
+        priv->loading = FALSE;
+        priv->listing = FALSE;
+    }
+
+    if (priv->user_added_signal)
+        g_dbus_connection_signal_unsubscribe (priv->bus, priv->user_added_signal);
+    priv->user_added_signal = 0;
+    if (priv->user_removed_signal)
+        g_dbus_connection_signal_unsubscribe (priv->bus, priv->user_removed_signal);
+    priv->user_removed_signal = 0;
+    if (priv->passwd_monitor)
+        g_signal_handlers_disconnect_by_func (priv->passwd_monitor, passwd_changed_cb, user_list);
+    g_clear_object (&priv->passwd_monitor);
+    if (priv->reload_timeout)
+        g_source_destroy (g_main_context_find_source_by_id (priv->context, priv->reload_timeout));
+    priv->reload_timeout = 0;
+
+    for (guint i = 0; i < priv->users->len; i++)
+    {
+        CommonUser *user = g_ptr_array_index (priv->users, i);
+        CommonUserPrivate *user_priv = common_user_get_instance_private (user);
+        if (user_priv->changed_signal)
+            g_dbus_connection_signal_unsubscribe (user_priv->bus, user_priv->changed_signal);
+        user_priv->changed_signal = 0;
+    }
+}
+
+static void
+remove_daemon_user (CommonUserList *user_list, CommonUser *user)
+{
+    g_debug ("User %s removed", common_user_get_name (user));
+    remove_user (user_list, user);
+    g_signal_handlers_disconnect_by_func (user, user_changed_cb, user_list);
+    notify_user_removed (user_list, user);
+    g_object_unref (user);
+}
+
+/**
+ * common_user_list_update_from_daemon:
+ * @user_list: A #CommonUserList
+ * @users: (element-type GVariant): Properties of users that have been added or changed, from common_user_to_variant()
+ * @removed_names: (allow-none): %NULL terminated array of names of users that have been removed or %NULL
+ * @complete: %TRUE if @users contains every user, and any others should be removed
+ *
+ * Update the user list with users provided by the daemon.  Once called the
+ * list stops loading users itself and only changes from the daemon are used.
+ * Changes are reported in a single ::users-changed signal.
+ **/
+void
+common_user_list_update_from_daemon (CommonUserList *user_list, GPtrArray *users, gchar **removed_names, gboolean complete)
+{
+    g_return_if_fail (COMMON_IS_USER_LIST (user_list));
+    g_return_if_fail (users != NULL);
+
+    CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
+
+    if (!priv->from_daemon)
+    {
+        g_debug ("Using users provided by the daemon");
+        stop_loading (user_list);
+        priv->from_daemon = TRUE;
+    }
 
-    /* Get user list from accounts service and fall back to /etc/passwd if that fails */
-    priv->user_added_signal = g_dbus_connection_signal_subscribe (priv->bus,
-                                                                  "org.freedesktop.Accounts",
-                                                                  "org.freedesktop.Accounts",
-                                                                  "UserAdded",
-                                                                  "/org/freedesktop/Accounts",
-                                                                  NULL,
-                                                                  G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                  accounts_user_added_cb,
-                                                                  user_list,
-                                                                  NULL);
-    priv->user_removed_signal = g_dbus_connection_signal_subscribe (priv->bus,
-                                                                    "org.freedesktop.Accounts",
-                                                                    "org.freedesktop.Accounts",
-                                                                    "UserDeleted",
-                                                                    "/org/freedesktop/Accounts",
-                                                                    NULL,
-                                                                    G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                    accounts_user_deleted_cb,
-                                                                    user_list,
-                                                                    NULL);
+    begin_changes (user_list);
 
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GVariant) result = g_dbus_connection_call_sync (priv->bus,
-                                                              "org.freedesktop.Accounts",
-                                                              "/org/freedesktop/Accounts",
-                                                              "org.freedesktop.Accounts",
-                                                              "ListCachedUsers",
-                                                              g_variant_new ("()"),
-                                                              G_VARIANT_TYPE ("(ao)"),
-                                                              G_DBUS_CALL_FLAGS_NONE,
-                                                              -1,
-                                                              NULL,
-                                                              &error);
-    if (error)
-        g_warning ("Error getting user list from org.freedesktop.Accounts: %s", error->message);
-    if (result)
+    /* Remove users first, so they can be replaced by a new user with the same name */
+    for (int i = 0; removed_names && removed_names[i]; i++)
     {
-        g_debug ("Loading users from org.freedesktop.Accounts");
-        g_autoptr(GVariantIter) iter = NULL;
-        g_variant_get (result, "(ao)", &iter);
-        const gchar *path;
-        while (g_variant_iter_loop (iter, "&o", &path))
-            add_accounts_user (user_list, path, FALSE);
+        CommonUser *user = get_user_by_name (user_list, removed_names[i]);
+        if (user)
+            remove_daemon_user (user_list, user);
     }
-    else
+
+    g_autoptr(GHashTable) names = g_hash_table_new (g_str_hash, g_str_equal);
+    for (guint i = 0; i < users->len; i++)
     {
-        g_dbus_connection_signal_unsubscribe (priv->bus, priv->user_added_signal);
-        priv->user_added_signal = 0;
-        g_dbus_connection_signal_unsubscribe (priv->bus, priv->user_removed_signal);
-        priv->user_removed_signal = 0;
+        GVariant *properties = g_ptr_array_index (users, i);
+        const gchar *name;
+        if (!g_variant_lookup (properties, "name", "&s", &name) || name[0] == '\0')
+            continue;
+        g_hash_table_add (names, (gpointer) name);
+
+        CommonUser *user = get_user_by_name (user_list, name);
+        if (user)
+        {
+            g_autoptr(GVariant) old_properties = get_user_properties (user);
+            if (g_variant_equal (old_properties, properties))
+                continue;
 
-        load_passwd_file (user_list, FALSE);
+            /* Move the user if their display name changed */
+            remove_user (user_list, user);
+            set_user_properties (user_list, user, properties);
+            insert_user (user_list, user);
 
-        /* Watch for changes to user list */
-        g_autoptr(GFile) passwd_file = g_file_new_for_path (PASSWD_FILE);
-        g_autoptr(GError) e = NULL;
-        priv->passwd_monitor = g_file_monitor (passwd_file, G_FILE_MONITOR_NONE, NULL, &e);
-        if (e)
-            g_warning ("Error monitoring %s: %s", PASSWD_FILE, e->message);
+            g_debug ("User %s changed", name);
+            g_signal_emit (user, user_signals[CHANGED], 0);
+        }
         else
-            g_signal_connect (priv->passwd_monitor, "changed", G_CALLBACK (passwd_changed_cb), user_list);
+        {
+            user = g_object_new (COMMON_TYPE_USER, NULL);
+            set_user_properties (user_list, user, properties);
+            g_signal_connect (user, USER_SIGNAL_CHANGED, G_CALLBACK (user_changed_cb), user_list);
+            g_signal_connect (user, "get-logged-in", G_CALLBACK (get_logged_in_cb), user_list);
+
+            g_debug ("User %s added", name);
+            insert_user (user_list, user);
+            notify_user_added (user_list, user);
+        }
+    }
+
+    /* Remove users the daemon no longer has */
+    for (guint i = complete ? priv->users->len : 0; i > 0; i--)
+    {
+        CommonUser *user = g_ptr_array_index (priv->users, i - 1);
+        if (!g_hash_table_contains (names, common_user_get_name (user)))
+            remove_daemon_user (user_list, user);
+    }
+
+    end_changes (user_list);
+
+    if (!priv->have_users)
+    {
+        priv->have_users = TRUE;
+        g_debug ("Loaded %u users from the daemon", priv->users->len);
+        g_signal_emit (user_list, list_signals[LOADED], 0);
+        start_loading_sessions (user_list);
     }
 }
 
 /**
- * common_user_list_get_length:
- * @user_list: a #CommonUserList
+ * common_user_list_get_reload_counts:
+ * @user_list: A #CommonUserList
+ * @n_reloads: (out) (allow-none): Number of times the password file was reloaded after changing
+ * @n_skipped_reloads: (out) (allow-none): Number of password file changes that did not need a reload
  *
- * Return value: The number of users able to log in
+ * Get statistics on how changes to the password file have been handled.
  **/
-gint
-common_user_list_get_length (CommonUserList *user_list)
+void
+common_user_list_get_reload_counts (CommonUserList *user_list, guint *n_reloads, guint *n_skipped_reloads)
 {
-    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), 0);
+    g_return_if_fail (COMMON_IS_USER_LIST (user_list));
 
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
-    load_users (user_list);
-    return g_list_length (priv->users);
+    if (n_reloads)
+        *n_reloads = priv->n_reloads;
+    if (n_skipped_reloads)
+        *n_skipped_reloads = priv->n_skipped_reloads;
 }
 
 /**
- * common_user_list_get_users:
+ * common_user_list_get_is_loaded:
  * @user_list: A #CommonUserList
  *
- * Get a list of users to present to the user.  This list may be a subset of the
- * available users and may be empty depending on the server configuration.
- *
- * Return value: (element-type CommonUser) (transfer none): A list of #CommonUser that should be presented to the user.
+ * Return value: #TRUE if all users have been loaded.
  **/
-GList *
-common_user_list_get_users (CommonUserList *user_list)
+gboolean
+common_user_list_get_is_loaded (CommonUserList *user_list)
 {
-    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), NULL);
+    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), FALSE);
 
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
-    load_users (user_list);
-    return priv->users;
+    return priv->have_users;
+}
+
+/**
+ * common_user_list_get_user_index:
+ * @user_list: A #CommonUserList
+ * @user: A #CommonUser
+ *
+ * Get the position of a user in the list returned by
+ * common_user_list_get_users.  This does not load the users.
+ *
+ * Return value: The index of the user or -1 if not in the list.
+ **/
+gint
+common_user_list_get_user_index (CommonUserList *user_list, CommonUser *user)
+{
+    g_return_val_if_fail (COMMON_IS_USER_LIST (user_list), -1);
+
+    return find_user_position (user_list, user);
 }
 
 /**
@@ -1006,6 +2325,14 @@ common_user_list_init (CommonUserList *user_list)
     CommonUserListPrivate *priv = common_user_list_get_instance_private (user_list);
 
     priv->bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+    priv->context = g_main_context_ref_thread_default ();
+    priv->cancellable = g_cancellable_new ();
+    priv->loading_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->sessions_cancellable = g_cancellable_new ();
+    priv->loading_sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->users = g_ptr_array_new ();
+    priv->users_by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->users_by_path = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
@@ -1042,8 +2369,25 @@ common_user_list_finalize (GObject *object)
     CommonUserList *self = COMMON_USER_LIST (object);
     CommonUserListPrivate *priv = common_user_list_get_instance_private (self);
 
+    /* Stop any outstanding loads */
+    g_cancellable_cancel (priv->cancellable);
+    g_object_unref (priv->cancellable);
+    g_hash_table_unref (priv->loading_paths);
+    if (priv->pending_paths)
+        g_queue_free_full (priv->pending_paths, g_free);
+    if (priv->load_context)
+        g_main_context_unref (priv->load_context);
+    g_cancellable_cancel (priv->sessions_cancellable);
+    g_object_unref (priv->sessions_cancellable);
+    g_hash_table_unref (priv->loading_sessions);
+
     /* Remove children first, they might access us */
-    g_list_free_full (priv->users, g_object_unref);
+    g_clear_pointer (&priv->users_list, g_list_free);
+    g_hash_table_unref (priv->users_by_name);
+    g_hash_table_unref (priv->users_by_path);
+    for (guint i = 0; i < priv->users->len; i++)
+        g_object_unref (g_ptr_array_index (priv->users, i));
+    g_ptr_array_unref (priv->users);
     g_list_free_full (priv->sessions, g_object_unref);
 
     if (priv->user_added_signal)
@@ -1056,6 +2400,9 @@ common_user_list_finalize (GObject *object)
         g_dbus_connection_signal_unsubscribe (priv->bus, priv->session_removed_signal);
     g_object_unref (priv->bus);
     g_clear_object (&priv->passwd_monitor);
+    if (priv->reload_timeout)
+        g_source_destroy (g_main_context_find_source_by_id (priv->context, priv->reload_timeout));
+    g_main_context_unref (priv->context);
 
     G_OBJECT_CLASS (common_user_list_parent_class)->finalize (object);
 }
@@ -1123,6 +2470,41 @@ common_user_list_class_init (CommonUserListClass *klass)
                       NULL, NULL,
                       NULL,
                       G_TYPE_NONE, 1, COMMON_TYPE_USER);
+
+    /**
+     * CommonUserList::users-changed:
+     * @user_list: A #CommonUserList
+     * @added: (element-type CommonUser): The users that have been added.
+     * @removed: (element-type CommonUser): The users that have been removed.
+     * @changed: (element-type CommonUser): The users that have been changed.
+     *
+     * The ::users-changed signal gets emitted after the individual signals
+     * for a change to the list.  All changes from a single reload are
+     * reported in one signal.
+     **/
+    list_signals[USERS_CHANGED] =
+        g_signal_new (USER_LIST_SIGNAL_USERS_CHANGED,
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (CommonUserListClass, users_changed),
+                      NULL, NULL,
+                      NULL,
+                      G_TYPE_NONE, 3, G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_POINTER);
+
+    /**
+     * CommonUserList::loaded:
+     * @user_list: A #CommonUserList
+     *
+     * The ::loaded signal gets emitted once all users have been loaded.
+     **/
+    list_signals[LOADED] =
+        g_signal_new (USER_LIST_SIGNAL_LOADED,
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (CommonUserListClass, loaded),
+                      NULL, NULL,
+                      NULL,
+                      G_TYPE_NONE, 0);
 }
 
 static gboolean
@@ -1164,6 +2546,8 @@ save_string_to_dmrc (CommonUser *user, const gchar *group,
     dmrc_save (dmrc, user);
 }
 
+static void set_dmrc (CommonUser *user, GKeyFile *dmrc);
+
 /* Loads language/layout/session info for user */
 static void
 load_dmrc (CommonUser *user)
@@ -1176,11 +2560,20 @@ load_dmrc (CommonUser *user)
 
     if (priv->loaded_dmrc)
         return;
-    priv->loaded_dmrc = TRUE;
     g_autoptr(GKeyFile) dmrc = dmrc_load (user);
 
     // FIXME: Watch for changes
 
+    set_dmrc (user, dmrc);
+}
+
+static void
+set_dmrc (CommonUser *user, GKeyFile *dmrc)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    priv->loaded_dmrc = TRUE;
+
     /* The Language field contains the locale */
     g_free (priv->language);
     priv->language = g_key_file_get_string (dmrc, "Desktop", "Language", NULL);
@@ -1197,6 +2590,214 @@ load_dmrc (CommonUser *user)
     priv->session = g_key_file_get_string (dmrc, "Desktop", "Session", NULL);
 }
 
+/* Looks for the image in the user's home directory */
+static void
+load_image (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    if (priv->loaded_image)
+        return;
+    priv->loaded_image = TRUE;
+
+    /* Accounts service provides the image with the other user properties */
+    if (priv->path || !priv->home_directory)
+        return;
+
+    priv->image = get_passwd_image (priv->home_directory);
+}
+
+/* Reply in the context the list was created in, not a private context used while loading */
+static GMainContext *
+get_reply_context (void)
+{
+    if (!singleton)
+        return NULL;
+
+    CommonUserListPrivate *list_priv = common_user_list_get_instance_private (singleton);
+    return list_priv->context;
+}
+
+static void
+dmrc_loaded_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    g_autoptr(CommonUser) user = data;
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    priv->loading_dmrc = FALSE;
+    g_autoptr(GKeyFile) dmrc = dmrc_load_finish (result, NULL);
+
+    /* Already loaded if it was needed before this completed */
+    if (priv->loaded_dmrc || !dmrc)
+        return;
+
+    g_autoptr(GVariant) old_properties = get_user_properties (user);
+    set_dmrc (user, dmrc);
+    g_autoptr(GVariant) properties = get_user_properties (user);
+    if (!g_variant_equal (old_properties, properties))
+        g_signal_emit (user, user_signals[CHANGED], 0);
+}
+
+static void
+load_dmrc_async (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    if (priv->path || priv->loaded_dmrc || priv->loading_dmrc)
+        return;
+    priv->loading_dmrc = TRUE;
+
+    GMainContext *context = get_reply_context ();
+    if (context)
+        g_main_context_push_thread_default (context);
+    dmrc_load_async (user, NULL, dmrc_loaded_cb, g_object_ref (user));
+    if (context)
+        g_main_context_pop_thread_default (context);
+}
+
+static void
+find_image_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    g_task_return_pointer (task, get_passwd_image (task_data), g_free);
+}
+
+static void
+image_found_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    CommonUser *user = COMMON_USER (object);
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    priv->loading_image = FALSE;
+    g_autofree gchar *image = g_task_propagate_pointer (G_TASK (result), NULL);
+
+    /* Already loaded if it was needed before this completed */
+    if (priv->loaded_image)
+        return;
+    priv->loaded_image = TRUE;
+
+    g_free (priv->image);
+    priv->image = g_steal_pointer (&image);
+    g_signal_emit (user, user_signals[CHANGED], 0);
+}
+
+static void
+image_rechecked_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    CommonUser *user = COMMON_USER (object);
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    priv->loading_image = FALSE;
+    g_autofree gchar *image = g_task_propagate_pointer (G_TASK (result), NULL);
+
+    if (g_strcmp0 (priv->image, image) == 0)
+        return;
+
+    g_free (priv->image);
+    priv->image = g_steal_pointer (&image);
+    g_signal_emit (user, user_signals[CHANGED], 0);
+}
+
+/* Look for the image in the user's home directory from a thread, as it may be
+ * on a slow network file system */
+static void
+find_image_async (CommonUser *user, GAsyncReadyCallback callback)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    priv->loading_image = TRUE;
+
+    GMainContext *context = get_reply_context ();
+    if (context)
+        g_main_context_push_thread_default (context);
+    g_autoptr(GTask) task = g_task_new (user, NULL, callback, NULL);
+    g_task_set_task_data (task, g_strdup (priv->home_directory), g_free);
+    g_task_run_in_thread (task, find_image_thread);
+    if (context)
+        g_main_context_pop_thread_default (context);
+}
+
+static void
+load_image_async (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    if (priv->loaded_image || priv->loading_image)
+        return;
+
+    if (priv->path || !priv->home_directory)
+    {
+        priv->loaded_image = TRUE;
+        return;
+    }
+
+    find_image_async (user, image_found_cb);
+}
+
+/* Check if an image that has been used has since changed */
+static void
+recheck_image_async (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    if (!priv->loaded_image || priv->loading_image || priv->path || !priv->home_directory)
+        return;
+
+    find_image_async (user, image_rechecked_cb);
+}
+
+static void
+accounts_extra_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    g_autoptr(CommonUser) user = data;
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) extra_result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), result, &error);
+    if (error)
+        g_warning ("Error updating user %s: %s", priv->path, error->message);
+    if (!extra_result)
+        return;
+
+    g_autoptr(GVariant) old_properties = get_user_properties (user);
+    update_accounts_user_extra (user, extra_result);
+    g_autoptr(GVariant) properties = get_user_properties (user);
+    if (!g_variant_equal (old_properties, properties))
+        g_signal_emit (user, user_signals[CHANGED], 0);
+}
+
+/* Loads background/layout/message info for user.  This is requested in the
+ * background and ::changed emitted when it arrives, the defaults are used until then */
+static void
+load_accounts_extra (CommonUser *user)
+{
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+
+    if (!priv->path)
+        return;
+
+    if (priv->loaded_extra)
+        return;
+    priv->loaded_extra = TRUE;
+
+    GMainContext *context = get_reply_context ();
+    if (context)
+        g_main_context_push_thread_default (context);
+    g_dbus_connection_call (priv->bus,
+                            "org.freedesktop.Accounts",
+                            priv->path,
+                            "org.freedesktop.DBus.Properties",
+                            "GetAll",
+                            g_variant_new ("(s)", "org.freedesktop.DisplayManager.AccountsService"),
+                            G_VARIANT_TYPE ("(a{sv})"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL,
+                            accounts_extra_cb,
+                            g_object_ref (user));
+    if (context)
+        g_main_context_pop_thread_default (context);
+}
+
 /**
  * common_user_get_name:
  * @user: A #CommonUser
@@ -1214,6 +2815,23 @@ common_user_get_name (CommonUser *user)
     return priv->name;
 }
 
+/**
+ * common_user_get_path:
+ * @user: A #CommonUser
+ *
+ * Get the AccountsService object path for a user.
+ *
+ * Return value: The object path or #NULL if the user is not from AccountsService
+ **/
+const gchar *
+common_user_get_path (CommonUser *user)
+{
+    g_return_val_if_fail (COMMON_IS_USER (user), NULL);
+
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+    return priv->path;
+}
+
 /**
  * common_user_get_real_name:
  * @user: A #CommonUser
@@ -1299,9 +2917,27 @@ common_user_get_image (CommonUser *user)
     g_return_val_if_fail (COMMON_IS_USER (user), NULL);
 
     CommonUserPrivate *priv = common_user_get_instance_private (user);
+    load_image (user);
     return priv->image;
 }
 
+/**
+ * common_user_get_image_is_loaded:
+ * @user: A #CommonUser
+ *
+ * Check if the image for a user is known without having to look in their home directory.
+ *
+ * Return value: %TRUE if common_user_get_image() will not block.
+ */
+gboolean
+common_user_get_image_is_loaded (CommonUser *user)
+{
+    g_return_val_if_fail (COMMON_IS_USER (user), FALSE);
+
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+    return priv->path != NULL || priv->loaded_image;
+}
+
 /**
  * common_user_get_background:
  * @user: A #CommonUser
@@ -1316,6 +2952,7 @@ common_user_get_background (CommonUser *user)
     g_return_val_if_fail (COMMON_IS_USER (user), NULL);
 
     CommonUserPrivate *priv = common_user_get_instance_private (user);
+    load_accounts_extra (user);
     return priv->background;
 }
 
@@ -1370,6 +3007,7 @@ common_user_get_layout (CommonUser *user)
     g_return_val_if_fail (COMMON_IS_USER (user), NULL);
 
     CommonUserPrivate *priv = common_user_get_instance_private (user);
+    load_accounts_extra (user);
     load_dmrc (user);
     return priv->layouts[0];
 }
@@ -1388,6 +3026,7 @@ common_user_get_layouts (CommonUser *user)
     g_return_val_if_fail (COMMON_IS_USER (user), NULL);
 
     CommonUserPrivate *priv = common_user_get_instance_private (user);
+    load_accounts_extra (user);
     load_dmrc (user);
     return (const gchar * const *) priv->layouts;
 }
@@ -1411,6 +3050,23 @@ common_user_get_session (CommonUser *user)
     return (session && session[0] == 0) ? NULL : session; /* Treat "" as NULL */
 }
 
+/**
+ * common_user_get_session_is_loaded:
+ * @user: A #CommonUser
+ *
+ * Check if the session for a user is known without having to read their .dmrc file.
+ *
+ * Return value: %TRUE if common_user_get_session() will not block.
+ */
+gboolean
+common_user_get_session_is_loaded (CommonUser *user)
+{
+    g_return_val_if_fail (COMMON_IS_USER (user), FALSE);
+
+    CommonUserPrivate *priv = common_user_get_instance_private (user);
+    return priv->path != NULL || priv->loaded_dmrc;
+}
+
 /**
  * common_user_set_session:
  * @user: A #CommonUser
@@ -1462,6 +3118,7 @@ common_user_get_has_messages (CommonUser *user)
     g_return_val_if_fail (COMMON_IS_USER (user), FALSE);
 
     CommonUserPrivate *priv = common_user_get_instance_private (user);
+    load_accounts_extra (user);
     return priv->has_messages;
 }
 
@@ -1524,6 +3181,42 @@ common_user_get_is_locked (CommonUser *user)
     return priv->is_locked;
 }
 
+/**
+ * common_user_to_variant:
+ * @user: A #CommonUser
+ *
+ * Get all the properties of a user, so they can be sent to a greeter and
+ * used with common_user_list_update_from_daemon().  Only properties that
+ * have already been loaded are included, use
+ * common_user_load_in_background() to get the others.
+ *
+ * Return value: (transfer full): A #GVariant dictionary of the user properties.
+ **/
+GVariant *
+common_user_to_variant (CommonUser *user)
+{
+    g_return_val_if_fail (COMMON_IS_USER (user), NULL);
+
+    return get_user_properties (user);
+}
+
+/**
+ * common_user_load_in_background:
+ * @user: A #CommonUser
+ *
+ * Start loading the properties of a user that are not in the user list,
+ * e.g. from ~/.dmrc.  ::changed is emitted as they arrive.
+ **/
+void
+common_user_load_in_background (CommonUser *user)
+{
+    g_return_if_fail (COMMON_IS_USER (user));
+
+    load_accounts_extra (user);
+    load_image_async (user);
+    load_dmrc_async (user);
+}
+
 static void
 common_user_init (CommonUser *user)
 {
@@ -1624,6 +3317,11 @@ common_user_finalize (GObject *object)
     g_clear_pointer (&priv->language, g_free);
     g_clear_pointer (&priv->layouts, g_strfreev);
     g_clear_pointer (&priv->session, g_free);
+    g_clear_pointer (&priv->snapshot_state, g_free);
+    g_clear_pointer (&priv->passwd_entry, g_free);
+    g_clear_pointer (&priv->index_name, g_free);
+    g_clear_pointer (&priv->index_path, g_free);
+    g_clear_pointer (&priv->sort_key, g_free);
 }
 
 static void
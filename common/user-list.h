@@ -35,6 +35,8 @@ G_BEGIN_DECLS
 #define USER_LIST_SIGNAL_USER_ADDED   "user-added"
 #define USER_LIST_SIGNAL_USER_CHANGED "user-changed"
 #define USER_LIST_SIGNAL_USER_REMOVED "user-removed"
+#define USER_LIST_SIGNAL_USERS_CHANGED "users-changed"
+#define USER_LIST_SIGNAL_LOADED       "loaded"
 
 #define USER_SIGNAL_CHANGED "changed"
 
@@ -62,6 +64,8 @@ typedef struct
     void (*user_added)(CommonUserList *user_list, CommonUser *user);
     void (*user_changed)(CommonUserList *user_list, CommonUser *user);
     void (*user_removed)(CommonUserList *user_list, CommonUser *user);
+    void (*users_changed)(CommonUserList *user_list, GList *added, GList *removed, GList *changed);
+    void (*loaded)(CommonUserList *user_list);
 } CommonUserListClass;
 
 GType common_user_list_get_type (void);
@@ -78,8 +82,28 @@ CommonUser *common_user_list_get_user_by_name (CommonUserList *user_list, const
 
 GList *common_user_list_get_users (CommonUserList *user_list);
 
+void common_user_list_reload (CommonUserList *user_list);
+
+void common_user_list_start_loading (CommonUserList *user_list);
+
+void common_user_list_start_loading_sessions (CommonUserList *user_list);
+
+gboolean common_user_list_load_snapshot (CommonUserList *user_list, const gchar *path, guint64 generation);
+
+void common_user_list_update_from_daemon (CommonUserList *user_list, GPtrArray *users, gchar **removed_names, gboolean complete);
+
+gboolean common_user_list_get_is_loaded (CommonUserList *user_list);
+
+void common_user_list_get_reload_counts (CommonUserList *user_list, guint *n_reloads, guint *n_skipped_reloads);
+
+void common_user_list_get_passwd_stamp (gint64 *mtime, guint64 *size, guint64 *inode);
+
+gint common_user_list_get_user_index (CommonUserList *user_list, CommonUser *user);
+
 const gchar *common_user_get_name (CommonUser *user);
 
+const gchar *common_user_get_path (CommonUser *user);
+
 const gchar *common_user_get_real_name (CommonUser *user);
 
 const gchar *common_user_get_display_name (CommonUser *user);
@@ -90,6 +114,8 @@ const gchar *common_user_get_shell (CommonUser *user);
 
 const gchar *common_user_get_image (CommonUser *user);
 
+gboolean common_user_get_image_is_loaded (CommonUser *user);
+
 const gchar *common_user_get_background (CommonUser *user);
 
 const gchar *common_user_get_language (CommonUser *user);
@@ -102,6 +128,8 @@ const gchar * const *common_user_get_layouts (CommonUser *user);
 
 const gchar *common_user_get_session (CommonUser *user);
 
+gboolean common_user_get_session_is_loaded (CommonUser *user);
+
 void common_user_set_session (CommonUser *user, const gchar *session);
 
 gboolean common_user_get_logged_in (CommonUser *user);
@@ -114,6 +142,10 @@ gid_t common_user_get_gid (CommonUser *user);
 
 gboolean common_user_get_is_locked (CommonUser *user);
 
+GVariant *common_user_to_variant (CommonUser *user);
+
+void common_user_load_in_background (CommonUser *user);
+
 G_END_DECLS
 
 #endif /* COMMON_USER_LIST_H_ */
@@ -10,13 +10,20 @@
 
 #include <config.h>
 
+#include <errno.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib-unix.h>
 #include <gio/gio.h>
 #include <gio/gunixsocketaddress.h>
 #include <security/pam_appl.h>
 
 #include "lightdm/greeter.h"
+#include "greeter-protocol.h"
+#include "user-list.h"
 
 /**
  * SECTION:greeter
@@ -25,6 +32,12 @@
  *
  * #LightDMGreeter is an object that manages the connection to the LightDM server and provides common greeter functionality.
  *
+ * The _sync functions block until the daemon replies.  Greeters that need to
+ * keep drawing while the daemon is busy should use the asynchronous versions,
+ * which are driven entirely from the main loop.  Cancelling the #GCancellable
+ * passed to an asynchronous function completes it with %G_IO_ERROR_CANCELLED
+ * and the reply from the daemon is ignored.
+ *
  * An example of a simple greeter:
  * |[
  * int main ()
@@ -124,26 +137,55 @@ typedef struct
     /* TRUE if the daemon can reuse this greeter */
     gboolean resettable;
 
+    /* TRUE if the user list is loaded by the greeter instead of sent by the daemon */
+    gboolean load_users;
+
     /* Socket connection to daemon */
     GSocket *socket;
 
     /* Channel to write to daemon */
     GIOChannel *to_server_channel;
+    guint to_server_watch;
 
     /* Channel to read from daemon */
     GIOChannel *from_server_channel;
     guint from_server_watch;
 
-    /* Data read from the daemon */
+    /* Messages to the daemon not yet written */
+    GByteArray *write_buffer;
+
+    /* Data read from the daemon, reused for every message */
     guint8 *read_buffer;
+    gsize read_buffer_size;
     gsize n_read;
 
+    /* Offset of the first message not yet returned from the read buffer */
+    gsize read_offset;
+
+    /* Number of messages being handled, the read buffer can't move while this is non-zero */
+    guint n_handling;
+
+    /* Read buffers replaced while a message in them was being handled */
+    GList *retired_buffers;
+
+    /* Idle source to handle messages left in the read buffer */
+    guint dispatch_idle;
+
+    /* TRUE if the daemon is connected by a pipe and can't send file descriptors */
+    gboolean from_server_is_pipe;
+
+    /* File descriptors received from the daemon not yet claimed by a message */
+    GArray *received_fds;
+
     gsize n_responses_waiting;
     GList *responses_received;
 
     /* TRUE if have got a connect response */
     gboolean connected;
 
+    /* TRUE if a connect request has been sent and not yet answered */
+    gboolean connecting;
+
     /* Pending connect requests */
     GList *connect_requests;
 
@@ -153,6 +195,13 @@ typedef struct
     /* Pending ensure shared data dir requests */
     GList *ensure_shared_data_dir_requests;
 
+    /* Pending user image requests */
+    GList *user_image_requests;
+
+    /* Users sent by the daemon since the last update */
+    GPtrArray *pending_users;
+    GPtrArray *pending_removed_users;
+
     /* Hints provided by the daemon */
     GHashTable *hints;
 
@@ -164,40 +213,18 @@ typedef struct
     gboolean is_authenticated;
     guint32 authenticate_sequence_number;
     gboolean cancelling_authentication;
+
+    /* Sequence number of an autologin authentication sent before connected, or 0 */
+    guint32 pipelined_autologin_sequence_number;
 } LightDMGreeterPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (LightDMGreeter, lightdm_greeter, G_TYPE_OBJECT)
 
-#define HEADER_SIZE 8
 #define MAX_MESSAGE_LENGTH 1024
-#define API_VERSION 1
-
-/* Messages from the greeter to the server */
-typedef enum
-{
-    GREETER_MESSAGE_CONNECT = 0,
-    GREETER_MESSAGE_AUTHENTICATE,
-    GREETER_MESSAGE_AUTHENTICATE_AS_GUEST,
-    GREETER_MESSAGE_CONTINUE_AUTHENTICATION,
-    GREETER_MESSAGE_START_SESSION,
-    GREETER_MESSAGE_CANCEL_AUTHENTICATION,
-    GREETER_MESSAGE_SET_LANGUAGE,
-    GREETER_MESSAGE_AUTHENTICATE_REMOTE,
-    GREETER_MESSAGE_ENSURE_SHARED_DIR,
-} GreeterMessage;
-
-/* Messages from the server to the greeter */
-typedef enum
-{
-    SERVER_MESSAGE_CONNECTED = 0,
-    SERVER_MESSAGE_PROMPT_AUTHENTICATION,
-    SERVER_MESSAGE_END_AUTHENTICATION,
-    SERVER_MESSAGE_SESSION_RESULT,
-    SERVER_MESSAGE_SHARED_DIR_RESULT,
-    SERVER_MESSAGE_IDLE,
-    SERVER_MESSAGE_RESET,
-    SERVER_MESSAGE_CONNECTED_V2,
-} ServerMessage;
+#define API_VERSION 4
+
+/* Maximum number of file descriptors accepted in one read */
+#define MAX_RECEIVED_FDS 4
 
 /* Request sent to server */
 typedef struct
@@ -205,12 +232,14 @@ typedef struct
     GObject parent_instance;
     LightDMGreeter *greeter;
     GCancellable *cancellable;
+    gulong cancelled_id;
     GAsyncReadyCallback callback;
     gpointer user_data;
     gboolean complete;
     gboolean result;
     GError *error;
     gchar *dir;
+    int fd;
 } Request;
 typedef struct
 {
@@ -222,6 +251,7 @@ static void request_iface_init (GAsyncResultIface *iface);
 G_DEFINE_TYPE_WITH_CODE (Request, request, G_TYPE_OBJECT, G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_RESULT, request_iface_init))
 
 static gboolean from_server_cb (GIOChannel *source, GIOCondition condition, gpointer data);
+static gboolean to_server_cb (GIOChannel *source, GIOCondition condition, gpointer data);
 
 GType
 lightdm_greeter_error_get_type (void)
@@ -310,15 +340,64 @@ lightdm_greeter_set_resettable (LightDMGreeter *greeter, gboolean resettable)
     priv->resettable = resettable;
 }
 
+/**
+ * lightdm_greeter_set_load_users:
+ * @greeter: A #LightDMGreeter
+ * @load_users: Whether #LightDMUserList should load the users itself
+ *
+ * Set whether #LightDMUserList loads the users itself instead of the daemon
+ * sending them to the greeter.  Greeters that don't show users can set this
+ * so the daemon doesn't send them.
+ * This must be called before lightdm_greeter_connect is called.
+ **/
+void
+lightdm_greeter_set_load_users (LightDMGreeter *greeter, gboolean load_users)
+{
+    g_return_if_fail (LIGHTDM_IS_GREETER (greeter));
+
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    g_return_if_fail (!priv->connected);
+    priv->load_users = load_users;
+}
+
+static void request_complete (Request *request);
+
+static gboolean
+request_cancelled_idle_cb (gpointer data)
+{
+    Request *request = data;
+
+    /* The daemon's reply is ignored when it arrives */
+    if (!request->complete)
+    {
+        g_cancellable_set_error_if_cancelled (request->cancellable, &request->error);
+        request_complete (request);
+    }
+    g_object_unref (request);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+request_cancelled_cb (GCancellable *cancellable, gpointer data)
+{
+    /* May be called from another thread, so complete from the main loop */
+    g_idle_add (request_cancelled_idle_cb, g_object_ref (data));
+}
+
 static Request *
 request_new (LightDMGreeter *greeter, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
 {
     Request *request = g_object_new (request_get_type (), NULL);
     request->greeter = greeter;
-    if (cancellable)
-        request->cancellable = g_object_ref (cancellable);
     request->callback = callback;
     request->user_data = user_data;
+    if (cancellable)
+    {
+        request->cancellable = g_object_ref (cancellable);
+        request->cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (request_cancelled_cb), request, NULL);
+    }
 
     return request;
 }
@@ -338,127 +417,47 @@ request_complete (Request *request)
 {
     request->complete = TRUE;
 
-    if (!request->callback)
-        return;
+    if (request->cancelled_id)
+    {
+        g_cancellable_disconnect (request->cancellable, request->cancelled_id);
+        request->cancelled_id = 0;
+    }
 
-    if (request->cancellable && g_cancellable_is_cancelled (request->cancellable))
+    if (!request->callback)
         return;
 
     g_idle_add (request_callback_cb, g_object_ref (request));
 }
 
-static gboolean
-timed_login_cb (gpointer data)
-{
-    LightDMGreeter *greeter = data;
-    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
-
-    priv->autologin_timeout = 0;
-    g_signal_emit (G_OBJECT (greeter), signals[AUTOLOGIN_TIMER_EXPIRED], 0);
-
-    return FALSE;
-}
-
-static guint32
-int_length (void)
+/* Take the request a reply from the daemon is for, or %NULL if there is no
+ * request or it has been cancelled */
+static Request *
+take_request (GList **requests)
 {
-    return 4;
-}
+    Request *request = g_list_nth_data (*requests, 0);
+    if (!request)
+        return NULL;
 
-static gboolean
-write_int (guint8 *buffer, gint buffer_length, guint32 value, gsize *offset, GError **error)
-{
-    if (*offset + 4 >= buffer_length)
+    *requests = g_list_remove (*requests, request);
+    if (request->complete)
     {
-        g_set_error_literal (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
-                             "Not enough buffer space to write integer");
-        return FALSE;
+        g_object_unref (request);
+        return NULL;
     }
-    buffer[*offset] = value >> 24;
-    buffer[*offset+1] = (value >> 16) & 0xFF;
-    buffer[*offset+2] = (value >> 8) & 0xFF;
-    buffer[*offset+3] = value & 0xFF;
-    *offset += 4;
 
-    return TRUE;
+    return request;
 }
 
 static gboolean
-write_string (guint8 *buffer, gint buffer_length, const gchar *value, gsize *offset, GError **error)
-{
-    gint length = 0;
-    if (value)
-        length = strlen (value);
-    if (!write_int (buffer, buffer_length, length, offset, error))
-        return FALSE;
-    if (*offset + length >= buffer_length)
-    {
-        g_set_error (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
-                     "Not enough buffer space to write string of length %d octets", length);
-        return FALSE;
-    }
-    if (value)
-        memcpy (buffer + *offset, value, length);
-    *offset += length;
-
-    return TRUE;
-}
-
-static guint32
-read_int (guint8 *message, gsize message_length, gsize *offset)
-{
-    if (message_length - *offset < int_length ())
-    {
-        g_warning ("Not enough space for int, need %i, got %zi", int_length (), message_length - *offset);
-        return 0;
-    }
-
-    const guint8 *buffer = message + *offset;
-    guint32 value = buffer[0] << 24 | buffer[1] << 16 | buffer[2] << 8 | buffer[3];
-    *offset += int_length ();
-
-    return value;
-}
-
-static gchar *
-read_string (guint8 *message, gsize message_length, gsize *offset)
-{
-    guint32 length = read_int (message, message_length, offset);
-    if (message_length - *offset < length)
-    {
-        g_warning ("Not enough space for string, need %u, got %zu", length, message_length - *offset);
-        return g_strdup ("");
-    }
-
-    gchar *value = g_malloc (sizeof (gchar) * (length + 1));
-    memcpy (value, message + *offset, length);
-    value[length] = '\0';
-    *offset += length;
-
-    return value;
-}
-
-static guint32
-string_length (const gchar *value)
+timed_login_cb (gpointer data)
 {
-    if (value)
-        return int_length () + strlen (value);
-    else
-        return int_length ();
-}
+    LightDMGreeter *greeter = data;
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-static gboolean
-write_header (guint8 *buffer, gint buffer_length, guint32 id, guint32 length, gsize *offset, GError **error)
-{
-    return write_int (buffer, buffer_length, id, offset, error) &&
-           write_int (buffer, buffer_length, length, offset, error);
-}
+    priv->autologin_timeout = 0;
+    g_signal_emit (G_OBJECT (greeter), signals[AUTOLOGIN_TIMER_EXPIRED], 0);
 
-static guint32
-get_message_length (guint8 *message, gsize message_length)
-{
-    gsize offset = 4;
-    return read_int (message, message_length, &offset);
+    return FALSE;
 }
 
 static gboolean
@@ -504,103 +503,182 @@ connect_to_daemon (LightDMGreeter *greeter, GError **error)
         !g_io_channel_set_encoding (priv->from_server_channel, NULL, error))
         return FALSE;
 
+    /* Never block on the daemon, only the _sync functions wait for it */
+    if (!g_unix_set_fd_nonblocking (g_io_channel_unix_get_fd (priv->to_server_channel), TRUE, error) ||
+        !g_unix_set_fd_nonblocking (g_io_channel_unix_get_fd (priv->from_server_channel), TRUE, error))
+        return FALSE;
+
     return TRUE;
 }
 
+/* Write as much of the write buffer as the daemon will take */
 static gboolean
-send_message (LightDMGreeter *greeter, guint8 *message, gsize message_length, GError **error)
+flush_messages (LightDMGreeter *greeter, GError **error)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    if (!connect_to_daemon (greeter, error))
-        return FALSE;
+    int fd = g_io_channel_unix_get_fd (priv->to_server_channel);
+    gsize offset = 0;
+    gboolean result = TRUE;
+    while (offset < priv->write_buffer->len)
+    {
+        ssize_t n_written = write (fd, priv->write_buffer->data + offset, priv->write_buffer->len - offset);
+        if (n_written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            g_set_error (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
+                         "Failed to write to daemon: %s",
+                         g_strerror (errno));
+            result = FALSE;
 
-    /* Double check that we're sending well-formed messages.  If we say we're
-       sending more than we do, we end up DOS'ing lightdm as it waits for the
-       rest.  If we say we're sending less than we do, we confuse the heck out
-       of lightdm, as it starts reading headers from the middle of our
-       messages. */
-    guint32 stated_length = HEADER_SIZE + get_message_length (message, message_length);
-    if (stated_length != message_length)
+            /* Drop the messages, the connection is broken */
+            offset = priv->write_buffer->len;
+            break;
+        }
+        offset += n_written;
+    }
+
+    if (result && offset > 0)
+        g_debug ("Wrote %zu bytes to daemon", offset);
+
+    /* Don't leave responses to prompts lying around */
+    gsize n_remaining = priv->write_buffer->len - offset;
+    memmove (priv->write_buffer->data, priv->write_buffer->data + offset, n_remaining);
+    memset (priv->write_buffer->data + n_remaining, 0, offset);
+    g_byte_array_set_size (priv->write_buffer, n_remaining);
+
+    /* Write the rest when the daemon is ready for it */
+    if (n_remaining > 0 && priv->to_server_watch == 0)
+        priv->to_server_watch = g_io_add_watch (priv->to_server_channel, G_IO_OUT, to_server_cb, greeter);
+    else if (n_remaining == 0 && priv->to_server_watch != 0)
     {
-        g_set_error (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
-                     "Refusing to write malformed packet to daemon: declared size is %u, but actual size is %zu",
-                     stated_length, message_length);
+        g_source_remove (priv->to_server_watch);
+        priv->to_server_watch = 0;
+    }
+
+    return result;
+}
+
+static gboolean
+to_server_cb (GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    LightDMGreeter *greeter = data;
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    priv->to_server_watch = 0;
+
+    g_autoptr(GError) error = NULL;
+    if (!flush_messages (greeter, &error))
+        g_warning ("%s", error->message);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Send the messages encoded in the write buffer, queueing what the daemon
+ * can't take yet */
+static gboolean
+send_message (LightDMGreeter *greeter, GError **error)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    if (!connect_to_daemon (greeter, error))
+    {
+        memset (priv->write_buffer->data, 0, priv->write_buffer->len);
+        g_byte_array_set_size (priv->write_buffer, 0);
         return FALSE;
     }
 
-    gchar *data = (gchar *) message;
-    gsize data_length = message_length;
-    while (data_length > 0)
+    return flush_messages (greeter, error);
+}
+
+/* Block until there is data from the daemon, writing queued messages while waiting */
+static gboolean
+wait_for_daemon (LightDMGreeter *greeter, GError **error)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    struct pollfd fds[2];
+    nfds_t n_fds = 1;
+    fds[0].fd = g_io_channel_unix_get_fd (priv->from_server_channel);
+    fds[0].events = POLLIN;
+    if (priv->write_buffer->len > 0)
     {
-        gsize n_written;
-        g_autoptr(GError) write_error = NULL;
-        GIOStatus status = g_io_channel_write_chars (priv->to_server_channel, data, data_length, &n_written, &write_error);
-        if (write_error)
-            g_set_error (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
-                         "Failed to write to daemon: %s",
-                         write_error->message);
-        if (status == G_IO_STATUS_AGAIN)
-            continue;
-        if (status != G_IO_STATUS_NORMAL)
-            return FALSE;
-        data_length -= n_written;
-        data += n_written;
+        int to_fd = g_io_channel_unix_get_fd (priv->to_server_channel);
+        if (to_fd == fds[0].fd)
+            fds[0].events |= POLLOUT;
+        else
+        {
+            fds[1].fd = to_fd;
+            fds[1].events = POLLOUT;
+            n_fds++;
+        }
     }
 
-    g_debug ("Wrote %zi bytes to daemon", message_length);
-    g_autoptr(GError) flush_error = NULL;
-    if (!g_io_channel_flush (priv->to_server_channel, &flush_error))
+    if (poll (fds, n_fds, -1) < 0 && errno != EINTR)
     {
-        g_set_error (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
-                     "Failed to write to daemon: %s",
-                     flush_error->message);
+        g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errno), g_strerror (errno));
         return FALSE;
     }
 
+    if (priv->write_buffer->len > 0)
+        return flush_messages (greeter, error);
+
     return TRUE;
 }
 
+/* Add hints sent by the daemon */
+static void
+add_hints (LightDMGreeter *greeter, GHashTable *hints, GString *debug_string)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    GHashTableIter iter;
+    g_hash_table_iter_init (&iter, hints);
+    gpointer name, value;
+    while (g_hash_table_iter_next (&iter, &name, &value))
+    {
+        g_hash_table_insert (priv->hints, g_strdup (name), g_strdup (value));
+        g_string_append_printf (debug_string, " %s=%s", (const gchar *) name, (const gchar *) value);
+    }
+}
+
 static void
-handle_connected (LightDMGreeter *greeter, gboolean v2, guint8 *message, gsize message_length, gsize *offset)
+handle_connected (LightDMGreeter *greeter, guint32 api_version, const gchar *version, GHashTable *hints)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
     int timeout;
     Request *request;
 
     g_autoptr(GString) debug_string = g_string_new ("Connected");
-    if (v2)
-    {
-        priv->api_version = read_int (message, message_length, offset);
+    priv->api_version = api_version;
+    if (api_version > 0)
         g_string_append_printf (debug_string, " api=%u", priv->api_version);
-        g_autofree gchar *version = read_string (message, message_length, offset);
-        g_string_append_printf (debug_string, " version=%s", version);
-        guint32 n_env = read_int (message, message_length, offset);
-        for (guint32 i = 0; i < n_env; i++)
-        {
-            gchar *name = read_string (message, message_length, offset);
-            gchar *value = read_string (message, message_length, offset);
-            g_hash_table_insert (priv->hints, name, value);
-            g_string_append_printf (debug_string, " %s=%s", name, value);
-        }
-    }
-    else
+    g_string_append_printf (debug_string, " version=%s", version);
+    add_hints (greeter, hints, debug_string);
+
+    priv->connected = TRUE;
+    priv->connecting = FALSE;
+    g_debug ("%s", debug_string->str);
+
+    /* Daemons before API version 4 ignore autologin requests, so now we have the hints authenticate the way they understand */
+    guint32 autologin_sequence_number = priv->pipelined_autologin_sequence_number;
+    priv->pipelined_autologin_sequence_number = 0;
+    if (api_version < 4 && autologin_sequence_number != 0 &&
+        autologin_sequence_number == priv->authenticate_sequence_number && priv->in_authentication)
     {
-        priv->api_version = 0;
-        g_autofree gchar *version = read_string (message, message_length, offset);
-        g_string_append_printf (debug_string, " version=%s", version);
-        while (*offset < message_length)
+        g_autoptr(GError) error = NULL;
+        if (!lightdm_greeter_authenticate_autologin (greeter, &error))
         {
-            gchar *name = read_string (message, message_length, offset);
-            gchar *value = read_string (message, message_length, offset);
-            g_hash_table_insert (priv->hints, name, value);
-            g_string_append_printf (debug_string, " %s=%s", name, value);
+            g_debug ("Failed to authenticate autologin: %s", error->message);
+            priv->in_authentication = FALSE;
+            priv->is_authenticated = FALSE;
+            g_signal_emit (G_OBJECT (greeter), signals[AUTHENTICATION_COMPLETE], 0);
         }
     }
 
-    priv->connected = TRUE;
-    g_debug ("%s", debug_string->str);
-
     /* Set timeout for default login */
     timeout = lightdm_greeter_get_autologin_timeout_hint (greeter);
     if (timeout)
@@ -610,25 +688,23 @@ handle_connected (LightDMGreeter *greeter, gboolean v2, guint8 *message, gsize m
     }
 
     /* Notify asynchronous caller */
-    request = g_list_nth_data (priv->connect_requests, 0);
+    request = take_request (&priv->connect_requests);
     if (request)
     {
         request->result = TRUE;
         request_complete (request);
-        priv->connect_requests = g_list_remove (priv->connect_requests, request);
         g_object_unref (request);
     }
 }
 
 static void
-handle_prompt_authentication (LightDMGreeter *greeter, guint8 *message, gsize message_length, gsize *offset)
+handle_prompt_authentication (LightDMGreeter *greeter, const GreeterProtocolPromptAuthentication *message)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    guint32 sequence_number = read_int (message, message_length, offset);
-    if (sequence_number != priv->authenticate_sequence_number)
+    if (message->sequence_number != priv->authenticate_sequence_number)
     {
-        g_debug ("Ignoring prompt authentication with invalid sequence number %d", sequence_number);
+        g_debug ("Ignoring prompt authentication with invalid sequence number %d", message->sequence_number);
         return;
     }
 
@@ -639,29 +715,21 @@ handle_prompt_authentication (LightDMGreeter *greeter, guint8 *message, gsize me
     }
 
     /* Update username */
-    g_autofree gchar *username = read_string (message, message_length, offset);
-    if (strcmp (username, "") == 0)
-    {
-        g_free (username);
-        username = NULL;
-    }
     g_free (priv->authentication_user);
-    priv->authentication_user = g_steal_pointer (&username);
+    priv->authentication_user = strcmp (message->username, "") != 0 ? g_strdup (message->username) : NULL;
 
     g_list_free_full (priv->responses_received, g_free);
     priv->responses_received = NULL;
     priv->n_responses_waiting = 0;
 
-    guint32 n_messages = read_int (message, message_length, offset);
-    g_debug ("Prompt user with %d message(s)", n_messages);
+    g_debug ("Prompt user with %zu message(s)", message->n_prompts);
 
-    for (guint32 i = 0; i < n_messages; i++)
+    for (gsize i = 0; i < message->n_prompts; i++)
     {
-        int style = read_int (message, message_length, offset);
-        g_autofree gchar *text = read_string (message, message_length, offset);
+        const gchar *text = message->prompts[i].text;
 
         // FIXME: Should stop on prompts?
-        switch (style)
+        switch (message->prompts[i].style)
         {
         case PAM_PROMPT_ECHO_OFF:
             priv->n_responses_waiting++;
@@ -682,59 +750,44 @@ handle_prompt_authentication (LightDMGreeter *greeter, guint8 *message, gsize me
 }
 
 static void
-handle_end_authentication (LightDMGreeter *greeter, guint8 *message, gsize message_length, gsize *offset)
+handle_end_authentication (LightDMGreeter *greeter, const GreeterProtocolEndAuthentication *message)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    guint32 sequence_number = read_int (message, message_length, offset);
-    if (sequence_number != priv->authenticate_sequence_number)
+    if (message->sequence_number != priv->authenticate_sequence_number)
     {
-        g_debug ("Ignoring end authentication with invalid sequence number %d", sequence_number);
+        g_debug ("Ignoring end authentication with invalid sequence number %d", message->sequence_number);
         return;
     }
 
-    g_autofree gchar *username = read_string (message, message_length, offset);
-    guint32 return_code = read_int (message, message_length, offset);
-
-    g_debug ("Authentication complete for user %s with return code %d", username, return_code);
+    g_debug ("Authentication complete for user %s with return code %d", message->username, message->result);
 
     /* Update username */
-    if (strcmp (username, "") == 0)
-    {
-        g_free (username);
-        username = NULL;
-    }
     g_free (priv->authentication_user);
-    priv->authentication_user = g_steal_pointer (&username);
+    priv->authentication_user = strcmp (message->username, "") != 0 ? g_strdup (message->username) : NULL;
 
     priv->cancelling_authentication = FALSE;
-    priv->is_authenticated = (return_code == 0);
+    priv->is_authenticated = (message->result == 0);
 
     priv->in_authentication = FALSE;
     g_signal_emit (G_OBJECT (greeter), signals[AUTHENTICATION_COMPLETE], 0);
 }
 
 static void
-handle_idle (LightDMGreeter *greeter, guint8 *message, gsize message_length, gsize *offset)
+handle_idle (LightDMGreeter *greeter)
 {
     g_signal_emit (G_OBJECT (greeter), signals[IDLE], 0);
 }
 
 static void
-handle_reset (LightDMGreeter *greeter, guint8 *message, gsize message_length, gsize *offset)
+handle_reset (LightDMGreeter *greeter, const GreeterProtocolReset *message)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
     g_hash_table_remove_all (priv->hints);
 
     g_autoptr(GString) hint_string = g_string_new ("");
-    while (*offset < message_length)
-    {
-        gchar *name = read_string (message, message_length, offset);
-        gchar *value = read_string (message, message_length, offset);
-        g_hash_table_insert (priv->hints, name, value);
-        g_string_append_printf (hint_string, " %s=%s", name, value);
-    }
+    add_hints (greeter, message->hints, hint_string);
 
     g_debug ("Reset%s", hint_string->str);
 
@@ -742,88 +795,366 @@ handle_reset (LightDMGreeter *greeter, guint8 *message, gsize message_length, gs
 }
 
 static void
-handle_session_result (LightDMGreeter *greeter, guint8 *message, gsize message_length, gsize *offset)
+handle_session_result (LightDMGreeter *greeter, const GreeterProtocolSessionResult *message)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
     /* Notify asynchronous caller */
-    Request *request = g_list_nth_data (priv->start_session_requests, 0);
+    Request *request = take_request (&priv->start_session_requests);
     if (request)
     {
-        guint32 return_code = read_int (message, message_length, offset);
-        if (return_code == 0)
+        if (message->result == 0)
             request->result = TRUE;
         else
             request->error = g_error_new (LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_SESSION_FAILED,
-                                          "Session returned error code %d", return_code);
+                                          "Session returned error code %d", message->result);
         request_complete (request);
-        priv->start_session_requests = g_list_remove (priv->start_session_requests, request);
         g_object_unref (request);
     }
 }
 
 static void
-handle_shared_dir_result (LightDMGreeter *greeter, guint8 *message, gsize message_length, gsize *offset)
+handle_shared_dir_result (LightDMGreeter *greeter, const GreeterProtocolSharedDirResult *message)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
     /* Notify asynchronous caller */
-    Request *request = g_list_nth_data (priv->ensure_shared_data_dir_requests, 0);
+    Request *request = take_request (&priv->ensure_shared_data_dir_requests);
     if (request)
     {
-        request->dir = read_string (message, message_length, offset);
         /* Blank data dir means invalid user */
-        if (g_strcmp0 (request->dir, "") == 0)
-        {
-            g_free (request->dir);
-            request->dir = NULL;
+        if (g_strcmp0 (message->dir, "") == 0)
             request->error = g_error_new (LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_INVALID_USER,
                                           "No such user");
+        else
+            request->dir = g_strdup (message->dir);
+        request_complete (request);
+        g_object_unref (request);
+    }
+}
+
+static void
+handle_user_image_result (LightDMGreeter *greeter, const GreeterProtocolUserImageResult *message)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    /* Claim the file descriptor that was sent with this message */
+    int fd = -1;
+    if (message->has_fd)
+    {
+        if (priv->received_fds->len > 0)
+        {
+            fd = g_array_index (priv->received_fds, int, 0);
+            g_array_remove_index (priv->received_fds, 0);
         }
+        else
+            g_warning ("Missing file descriptor for %s of user %s", message->background ? "background" : "image", message->username);
+    }
+
+    /* Notify asynchronous caller */
+    Request *request = take_request (&priv->user_image_requests);
+    if (request)
+    {
+        request->fd = fd;
         request_complete (request);
-        priv->ensure_shared_data_dir_requests = g_list_remove (priv->ensure_shared_data_dir_requests, request);
         g_object_unref (request);
     }
+    else if (fd >= 0)
+        close (fd);
+}
+
+static void
+handle_user_updated (LightDMGreeter *greeter, const GreeterProtocolUserUpdated *message)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    g_autoptr(GBytes) data = g_bytes_new (message->properties, message->properties_length);
+    GVariant *properties = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, data, FALSE));
+    g_ptr_array_add (priv->pending_users, properties);
+}
+
+static void
+handle_user_removed (LightDMGreeter *greeter, const GreeterProtocolUserRemoved *message)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+    g_ptr_array_add (priv->pending_removed_users, g_strdup (message->username));
+}
+
+static void
+handle_users_updated (LightDMGreeter *greeter, const GreeterProtocolUsersUpdated *message)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    gboolean complete = message->complete != 0;
+
+    g_debug ("Daemon updated %u users, removed %u users%s", priv->pending_users->len, priv->pending_removed_users->len, complete ? " (complete list)" : "");
+
+    /* Apply the changes together so they are reported in one signal */
+    g_ptr_array_add (priv->pending_removed_users, NULL);
+    common_user_list_update_from_daemon (common_user_list_get_instance (), priv->pending_users, (gchar **) priv->pending_removed_users->pdata, complete);
+    g_ptr_array_set_size (priv->pending_users, 0);
+    g_ptr_array_set_size (priv->pending_removed_users, 0);
 }
 
 static void
 handle_message (LightDMGreeter *greeter, guint8 *message, gsize message_length)
 {
-    gsize offset = 0;
-    guint32 id = read_int (message, message_length, &offset);
-    read_int (message, message_length, &offset);
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    priv->n_handling++;
+
+    guint32 id;
+    gsize length;
+    greeter_protocol_read_header (message, message_length, &id, &length);
+    const guint8 *payload = message + GREETER_PROTOCOL_HEADER_SIZE;
+    gsize payload_length = message_length - GREETER_PROTOCOL_HEADER_SIZE;
+
+    gboolean valid = TRUE;
     switch (id)
     {
     case SERVER_MESSAGE_CONNECTED:
-        handle_connected (greeter, FALSE, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolConnected) request = { 0 };
+            valid = greeter_protocol_read_connected (payload, payload_length, &request);
+            if (valid)
+                handle_connected (greeter, 0, request.version, request.hints);
+        }
         break;
     case SERVER_MESSAGE_PROMPT_AUTHENTICATION:
-        handle_prompt_authentication (greeter, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolPromptAuthentication) request = { 0 };
+            valid = greeter_protocol_read_prompt_authentication (payload, payload_length, &request);
+            if (valid)
+                handle_prompt_authentication (greeter, &request);
+        }
         break;
     case SERVER_MESSAGE_END_AUTHENTICATION:
-        handle_end_authentication (greeter, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolEndAuthentication) request = { 0 };
+            valid = greeter_protocol_read_end_authentication (payload, payload_length, &request);
+            if (valid)
+                handle_end_authentication (greeter, &request);
+        }
         break;
     case SERVER_MESSAGE_SESSION_RESULT:
-        handle_session_result (greeter, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolSessionResult) request = { 0 };
+            valid = greeter_protocol_read_session_result (payload, payload_length, &request);
+            if (valid)
+                handle_session_result (greeter, &request);
+        }
         break;
     case SERVER_MESSAGE_SHARED_DIR_RESULT:
-        handle_shared_dir_result (greeter, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolSharedDirResult) request = { 0 };
+            valid = greeter_protocol_read_shared_dir_result (payload, payload_length, &request);
+            if (valid)
+                handle_shared_dir_result (greeter, &request);
+        }
         break;
     case SERVER_MESSAGE_IDLE:
-        handle_idle (greeter, message, message_length, &offset);
+        handle_idle (greeter);
         break;
     case SERVER_MESSAGE_RESET:
-        handle_reset (greeter, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolReset) request = { 0 };
+            valid = greeter_protocol_read_reset (payload, payload_length, &request);
+            if (valid)
+                handle_reset (greeter, &request);
+        }
         break;
     case SERVER_MESSAGE_CONNECTED_V2:
-        handle_connected (greeter, TRUE, message, message_length, &offset);
+        {
+            g_auto(GreeterProtocolConnectedV2) request = { 0 };
+            valid = greeter_protocol_read_connected_v2 (payload, payload_length, &request);
+            if (valid)
+                handle_connected (greeter, request.api_version, request.version, request.hints);
+        }
+        break;
+    case SERVER_MESSAGE_USER_IMAGE_RESULT:
+        {
+            g_auto(GreeterProtocolUserImageResult) request = { 0 };
+            valid = greeter_protocol_read_user_image_result (payload, payload_length, &request);
+            if (valid)
+                handle_user_image_result (greeter, &request);
+        }
+        break;
+    case SERVER_MESSAGE_USER_UPDATED:
+        {
+            g_auto(GreeterProtocolUserUpdated) request = { 0 };
+            valid = greeter_protocol_read_user_updated (payload, payload_length, &request);
+            if (valid)
+                handle_user_updated (greeter, &request);
+        }
+        break;
+    case SERVER_MESSAGE_USER_REMOVED:
+        {
+            g_auto(GreeterProtocolUserRemoved) request = { 0 };
+            valid = greeter_protocol_read_user_removed (payload, payload_length, &request);
+            if (valid)
+                handle_user_removed (greeter, &request);
+        }
+        break;
+    case SERVER_MESSAGE_USERS_UPDATED:
+        {
+            g_auto(GreeterProtocolUsersUpdated) request = { 0 };
+            valid = greeter_protocol_read_users_updated (payload, payload_length, &request);
+            if (valid)
+                handle_users_updated (greeter, &request);
+        }
         break;
     default:
         g_warning ("Unknown message from server: %d", id);
         break;
     }
+
+    if (!valid)
+        g_warning ("Ignoring malformed message %d from server", id);
+
+    priv->n_handling--;
+    if (priv->n_handling == 0)
+    {
+        g_list_free_full (priv->retired_buffers, g_free);
+        priv->retired_buffers = NULL;
+    }
+}
+
+/* Read from the daemon, keeping any file descriptors sent with the data */
+static GIOStatus
+read_from_daemon (LightDMGreeter *greeter, guint8 *buffer, gsize buffer_length, gsize *n_read, GError **error)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    int fd = g_io_channel_unix_get_fd (priv->from_server_channel);
+    *n_read = 0;
+
+    struct iovec iov = { buffer, buffer_length };
+    union
+    {
+        struct cmsghdr header;
+        guint8 data[CMSG_SPACE (sizeof (int) * MAX_RECEIVED_FDS)];
+    } control;
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof (control.data);
+
+    ssize_t n;
+    do
+    {
+        if (priv->from_server_is_pipe)
+            n = read (fd, buffer, buffer_length);
+        else
+        {
+            n = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC);
+            if (n < 0 && errno == ENOTSOCK)
+            {
+                priv->from_server_is_pipe = TRUE;
+                n = read (fd, buffer, buffer_length);
+            }
+        }
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0)
+    {
+        if (errno == EAGAIN)
+            return G_IO_STATUS_AGAIN;
+        g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errno), g_strerror (errno));
+        return G_IO_STATUS_ERROR;
+    }
+    if (n == 0)
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED, "Connection closed");
+        return G_IO_STATUS_EOF;
+    }
+
+    if (!priv->from_server_is_pipe)
+    {
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            gsize n_fds = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+            for (gsize i = 0; i < n_fds; i++)
+            {
+                int received_fd;
+                memcpy (&received_fd, CMSG_DATA (cmsg) + i * sizeof (int), sizeof (int));
+                g_array_append_val (priv->received_fds, received_fd);
+            }
+        }
+    }
+
+    *n_read = n;
+    return G_IO_STATUS_NORMAL;
+}
+
+/* Get the next complete message from the read buffer, without reading.
+ * The message is only valid until the next message is read */
+static gboolean
+get_buffered_message (LightDMGreeter *greeter, guint8 **message, gsize *length)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    gsize n_unread = priv->n_read - priv->read_offset;
+    guint32 id;
+    gsize message_length;
+    if (!greeter_protocol_read_header (priv->read_buffer + priv->read_offset, n_unread, &id, &message_length))
+        return FALSE;
+    if (n_unread < message_length)
+        return FALSE;
+
+    *message = priv->read_buffer + priv->read_offset;
+    *length = message_length;
+    priv->read_offset += message_length;
+
+    return TRUE;
+}
+
+/* Make sure the read buffer can hold @length bytes from the first unread message */
+static void
+make_read_space (LightDMGreeter *greeter, gsize length)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    gsize n_unread = priv->n_read - priv->read_offset;
+
+    /* Start from the beginning again once everything has been handled */
+    if (n_unread == 0 && priv->n_handling == 0)
+    {
+        priv->read_offset = 0;
+        priv->n_read = 0;
+    }
+
+    if (priv->read_offset + length <= priv->read_buffer_size)
+        return;
+
+    gsize size = MAX (priv->read_buffer_size, length);
+    if (priv->n_handling > 0)
+    {
+        /* The message being handled is in this buffer, so keep it until it is done */
+        guint8 *buffer = g_malloc (size);
+        memcpy (buffer, priv->read_buffer + priv->read_offset, n_unread);
+        priv->retired_buffers = g_list_prepend (priv->retired_buffers, priv->read_buffer);
+        priv->read_buffer = buffer;
+    }
+    else
+    {
+        memmove (priv->read_buffer, priv->read_buffer + priv->read_offset, n_unread);
+        if (size > priv->read_buffer_size)
+            priv->read_buffer = g_realloc (priv->read_buffer, size);
+    }
+    priv->read_buffer_size = size;
+    priv->read_offset = 0;
+    priv->n_read = n_unread;
 }
 
+static gboolean dispatch_idle_cb (gpointer data);
+
+/* Read the next message from the daemon.  If not blocking only one read is
+ * done and @message is set to %NULL if a complete message was not received.
+ * The message is only valid until the next message is read */
 static gboolean
 recv_message (LightDMGreeter *greeter, gboolean block, guint8 **message, gsize *length, GError **error)
 {
@@ -832,26 +1163,53 @@ recv_message (LightDMGreeter *greeter, gboolean block, guint8 **message, gsize *
     if (!connect_to_daemon (greeter, error))
         return FALSE;
 
-    /* Read the header, or the whole message if we already have that */
-    gsize n_to_read = HEADER_SIZE;
-    if (priv->n_read >= HEADER_SIZE)
-        n_to_read += get_message_length (priv->read_buffer, priv->n_read);
-
-    do
+    gboolean have_read = FALSE;
+    while (TRUE)
     {
+        guint8 *m;
+        gsize l;
+        if (get_buffered_message (greeter, &m, &l))
+        {
+            *message = m;
+            *length = l;
+
+            /* Messages that arrived with this one won't wake the main loop, so handle them from there */
+            if (block && priv->dispatch_idle == 0 && priv->n_read - priv->read_offset >= GREETER_PROTOCOL_HEADER_SIZE)
+                priv->dispatch_idle = g_idle_add (dispatch_idle_cb, greeter);
+
+            return TRUE;
+        }
+
+        /* Stop if haven't got all the data we want */
+        if (have_read && !block)
+        {
+            *message = NULL;
+            *length = 0;
+            return TRUE;
+        }
+
+        /* Read as much as we can, but at least enough for the header or the rest of this message */
+        guint32 id;
+        gsize n_to_read;
+        if (!greeter_protocol_read_header (priv->read_buffer + priv->read_offset, priv->n_read - priv->read_offset, &id, &n_to_read))
+            n_to_read = GREETER_PROTOCOL_HEADER_SIZE;
+        make_read_space (greeter, n_to_read);
+
         gsize n_read;
         g_autoptr(GError) read_error = NULL;
-        GIOStatus status = g_io_channel_read_chars (priv->from_server_channel,
-                                          (gchar *) priv->read_buffer + priv->n_read,
-                                          n_to_read - priv->n_read,
-                                          &n_read,
-                                          &read_error);
+        GIOStatus status = read_from_daemon (greeter,
+                                             priv->read_buffer + priv->n_read,
+                                             priv->read_buffer_size - priv->n_read,
+                                             &n_read,
+                                             &read_error);
+        have_read = TRUE;
         if (status == G_IO_STATUS_AGAIN)
         {
-            if (block)
+            if (!block || wait_for_daemon (greeter, &read_error))
                 continue;
+            status = G_IO_STATUS_ERROR;
         }
-        else if (status != G_IO_STATUS_NORMAL)
+        if (status != G_IO_STATUS_NORMAL)
         {
             g_set_error (error, LIGHTDM_GREETER_ERROR, LIGHTDM_GREETER_ERROR_COMMUNICATION_ERROR,
                          "Failed to read from daemon: %s",
@@ -862,40 +1220,37 @@ recv_message (LightDMGreeter *greeter, gboolean block, guint8 **message, gsize *
         g_debug ("Read %zi bytes from daemon", n_read);
 
         priv->n_read += n_read;
-    } while (priv->n_read < n_to_read && block);
-
-    /* Stop if haven't got all the data we want */
-    if (priv->n_read != n_to_read)
-    {
-        if (message)
-            *message = NULL;
-        if (length)
-            *length = 0;
-        return TRUE;
     }
+}
 
-    /* If have header, rerun for content */
-    if (priv->n_read == HEADER_SIZE)
+/* Handle all the messages that have already been read */
+static void
+dispatch_messages (LightDMGreeter *greeter, guint8 *message, gsize message_length)
+{
+    g_object_ref (greeter);
+    while (message)
     {
-        n_to_read = get_message_length (priv->read_buffer, priv->n_read);
-        if (n_to_read > 0)
-        {
-            priv->read_buffer = g_realloc (priv->read_buffer, HEADER_SIZE + n_to_read);
-            return recv_message (greeter, block, message, length, error);
-        }
+        handle_message (greeter, message, message_length);
+        if (!get_buffered_message (greeter, &message, &message_length))
+            message = NULL;
     }
+    g_object_unref (greeter);
+}
 
-    if (message)
-        *message = priv->read_buffer;
-    else
-        g_free (priv->read_buffer);
-    if (length)
-        *length = priv->n_read;
+static gboolean
+dispatch_idle_cb (gpointer data)
+{
+    LightDMGreeter *greeter = data;
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    priv->read_buffer = g_malloc (priv->n_read);
-    priv->n_read = 0;
+    priv->dispatch_idle = 0;
 
-    return TRUE;
+    guint8 *message;
+    gsize message_length;
+    if (get_buffered_message (greeter, &message, &message_length))
+        dispatch_messages (greeter, message, message_length);
+
+    return G_SOURCE_REMOVE;
 }
 
 static gboolean
@@ -903,8 +1258,8 @@ from_server_cb (GIOChannel *source, GIOCondition condition, gpointer data)
 {
     LightDMGreeter *greeter = data;
 
-    /* Read one message and process it */
-    g_autofree guint8 *message = NULL;
+    /* Read what is available and process every message in it */
+    guint8 *message;
     gsize message_length;
     g_autoptr(GError) error = NULL;
     if (!recv_message (greeter, FALSE, &message, &message_length, &error))
@@ -914,8 +1269,7 @@ from_server_cb (GIOChannel *source, GIOCondition condition, gpointer data)
         return G_SOURCE_REMOVE;
     }
 
-    if (message)
-        handle_message (greeter, message, message_length);
+    dispatch_messages (greeter, message, message_length);
 
     return G_SOURCE_CONTINUE;
 }
@@ -923,41 +1277,63 @@ from_server_cb (GIOChannel *source, GIOCondition condition, gpointer data)
 static gboolean
 send_connect (LightDMGreeter *greeter, gboolean resettable, GError **error)
 {
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
     g_debug ("Connecting to display manager...");
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_CONNECT, string_length (VERSION) + int_length () * 2, &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, VERSION, &offset, error) &&
-           write_int (message, MAX_MESSAGE_LENGTH, resettable ? 1 : 0, &offset, error) &&
-           write_int (message, MAX_MESSAGE_LENGTH, API_VERSION, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolConnect message = { 0 };
+    message.version = VERSION;
+    message.resettable = resettable ? 1 : 0;
+    message.api_version = API_VERSION;
+    message.capabilities = priv->load_users ? 0 : GREETER_CAPABILITY_USER_LIST;
+    greeter_protocol_write_connect (priv->write_buffer, &message);
+    if (!send_message (greeter, error))
+        return FALSE;
+
+    priv->connecting = TRUE;
+    return TRUE;
 }
 
 static gboolean
 send_start_session (LightDMGreeter *greeter, const gchar *session, GError **error)
 {
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
     if (session)
         g_debug ("Starting session %s", session);
     else
         g_debug ("Starting default session");
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_START_SESSION, string_length (session), &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, session, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolStartSession message = { 0 };
+    message.session = session;
+    greeter_protocol_write_start_session (priv->write_buffer, &message);
+    return send_message (greeter, error);
+}
+
+static gboolean
+send_get_user_image (LightDMGreeter *greeter, const gchar *username, gboolean background, GError **error)
+{
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    g_debug ("Getting %s for user %s", background ? "background" : "image", username);
+
+    GreeterProtocolGetUserImage message = { 0 };
+    message.username = username;
+    message.background = background ? 1 : 0;
+    greeter_protocol_write_get_user_image (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 static gboolean
 send_ensure_shared_data_dir (LightDMGreeter *greeter, const gchar *username, GError **error)
 {
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
     g_debug ("Ensuring data directory for user %s", username);
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_ENSURE_SHARED_DIR, string_length (username), &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, username, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolEnsureSharedDir message = { 0 };
+    message.username = username;
+    greeter_protocol_write_ensure_shared_dir (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 /**
@@ -982,7 +1358,8 @@ lightdm_greeter_connect_to_daemon (LightDMGreeter *greeter, GCancellable *cancel
 
     Request *request = request_new (greeter, cancellable, callback, user_data);
     GError *error = NULL;
-    if (send_connect (greeter, priv->resettable, &error))
+    if (!g_cancellable_set_error_if_cancelled (cancellable, &error) &&
+        send_connect (greeter, priv->resettable, &error))
         priv->connect_requests = g_list_append (priv->connect_requests, request);
     else
     {
@@ -1036,7 +1413,7 @@ lightdm_greeter_connect_to_daemon_sync (LightDMGreeter *greeter, GError **error)
     priv->connect_requests = g_list_append (priv->connect_requests, g_object_ref (request));
     do
     {
-        g_autofree guint8 *message = NULL;
+        guint8 *message;
         gsize message_length;
         if (!recv_message (greeter, TRUE, &message, &message_length, error))
             return FALSE;
@@ -1316,6 +1693,10 @@ lightdm_greeter_cancel_autologin (LightDMGreeter *greeter)
  *
  * Starts the authentication procedure for a user.
  *
+ * This can be called as soon as lightdm_greeter_connect_to_daemon() has been
+ * called, the request is sent after the connect request and the first prompt
+ * arrives without waiting for the greeter to be connected.
+ *
  * Return value: #TRUE if authentication request sent.
  **/
 gboolean
@@ -1325,7 +1706,7 @@ lightdm_greeter_authenticate (LightDMGreeter *greeter, const gchar *username, GE
 
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    g_return_val_if_fail (priv->connected, FALSE);
+    g_return_val_if_fail (priv->connected || priv->connecting, FALSE);
 
     priv->cancelling_authentication = FALSE;
     priv->authenticate_sequence_number++;
@@ -1338,12 +1719,11 @@ lightdm_greeter_authenticate (LightDMGreeter *greeter, const gchar *username, GE
     }
 
     g_debug ("Starting authentication for user %s...", username);
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_AUTHENTICATE, int_length () + string_length (username), &offset, error) &&
-           write_int (message, MAX_MESSAGE_LENGTH, priv->authenticate_sequence_number, &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, username, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolAuthenticate message = { 0 };
+    message.sequence_number = priv->authenticate_sequence_number;
+    message.username = username;
+    greeter_protocol_write_authenticate (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 /**
@@ -1353,6 +1733,9 @@ lightdm_greeter_authenticate (LightDMGreeter *greeter, const gchar *username, GE
  *
  * Starts the authentication procedure for the guest user.
  *
+ * Like lightdm_greeter_authenticate(), this can be called before the greeter
+ * is connected.
+ *
  * Return value: #TRUE if authentication request sent.
  **/
 gboolean
@@ -1362,7 +1745,7 @@ lightdm_greeter_authenticate_as_guest (LightDMGreeter *greeter, GError **error)
 
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    g_return_val_if_fail (priv->connected, FALSE);
+    g_return_val_if_fail (priv->connected || priv->connecting, FALSE);
 
     priv->cancelling_authentication = FALSE;
     priv->authenticate_sequence_number++;
@@ -1372,11 +1755,10 @@ lightdm_greeter_authenticate_as_guest (LightDMGreeter *greeter, GError **error)
     priv->authentication_user = NULL;
 
     g_debug ("Starting authentication for guest account...");
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_AUTHENTICATE_AS_GUEST, int_length (), &offset, error) &&
-           write_int (message, MAX_MESSAGE_LENGTH, priv->authenticate_sequence_number, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolAuthenticateAsGuest message = { 0 };
+    message.sequence_number = priv->authenticate_sequence_number;
+    greeter_protocol_write_authenticate_as_guest (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 /**
@@ -1386,11 +1768,37 @@ lightdm_greeter_authenticate_as_guest (LightDMGreeter *greeter, GError **error)
  *
  * Starts the authentication procedure for the automatic login user.
  *
+ * If the greeter is still connecting the daemon picks the user from its
+ * configuration, so authentication starts without waiting for the hints.  If
+ * no automatic login is configured authentication then completes without the
+ * user being authenticated.
+ *
  * Return value: #TRUE if authentication request sent.
  **/
 gboolean
 lightdm_greeter_authenticate_autologin (LightDMGreeter *greeter, GError **error)
 {
+    g_return_val_if_fail (LIGHTDM_IS_GREETER (greeter), FALSE);
+
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    if (!priv->connected && priv->connecting)
+    {
+        priv->cancelling_authentication = FALSE;
+        priv->authenticate_sequence_number++;
+        priv->in_authentication = TRUE;
+        priv->is_authenticated = FALSE;
+        g_free (priv->authentication_user);
+        priv->authentication_user = NULL;
+        priv->pipelined_autologin_sequence_number = priv->authenticate_sequence_number;
+
+        g_debug ("Starting authentication for autologin user...");
+        GreeterProtocolAuthenticateAutologin message = { 0 };
+        message.sequence_number = priv->authenticate_sequence_number;
+        greeter_protocol_write_authenticate_autologin (priv->write_buffer, &message);
+        return send_message (greeter, error);
+    }
+
     const gchar *user = lightdm_greeter_get_autologin_user_hint (greeter);
     if (lightdm_greeter_get_autologin_guest_hint (greeter))
         return lightdm_greeter_authenticate_as_guest (greeter, error);
@@ -1436,13 +1844,12 @@ lightdm_greeter_authenticate_remote (LightDMGreeter *greeter, const gchar *sessi
     else
         g_debug ("Starting authentication for remote session %s...", session);
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_AUTHENTICATE_REMOTE, int_length () + string_length (session) + string_length (username), &offset, error) &&
-           write_int (message, MAX_MESSAGE_LENGTH, priv->authenticate_sequence_number, &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, session, &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, username, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolAuthenticateRemote message = { 0 };
+    message.sequence_number = priv->authenticate_sequence_number;
+    message.session = session;
+    message.username = username;
+    greeter_protocol_write_authenticate_remote (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 /**
@@ -1469,25 +1876,20 @@ lightdm_greeter_respond (LightDMGreeter *greeter, const gchar *response, GError
     priv->n_responses_waiting--;
     priv->responses_received = g_list_append (priv->responses_received, g_strdup (response));
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
     if (priv->n_responses_waiting == 0)
     {
         g_debug ("Providing response to display manager");
 
-        guint32 msg_length = int_length ();
+        const gchar **secrets = g_newa (const gchar *, g_list_length (priv->responses_received) + 1);
+        gsize n_secrets = 0;
         for (GList *iter = priv->responses_received; iter; iter = iter->next)
-            msg_length += string_length ((gchar *)iter->data);
+            secrets[n_secrets++] = iter->data;
+        secrets[n_secrets] = NULL;
 
-        if (!write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_CONTINUE_AUTHENTICATION, msg_length, &offset, error) ||
-            !write_int (message, MAX_MESSAGE_LENGTH, g_list_length (priv->responses_received), &offset, error))
-            return FALSE;
-        for (GList *iter = priv->responses_received; iter; iter = iter->next)
-        {
-            if (!write_string (message, MAX_MESSAGE_LENGTH, (gchar *)iter->data, &offset, error))
-                return FALSE;
-        }
-        if (!send_message (greeter, message, offset, error))
+        GreeterProtocolContinueAuthentication message = { 0 };
+        message.secrets.values = secrets;
+        greeter_protocol_write_continue_authentication (priv->write_buffer, &message);
+        if (!send_message (greeter, error))
             return FALSE;
 
         g_list_free_full (priv->responses_received, g_free);
@@ -1516,10 +1918,9 @@ lightdm_greeter_cancel_authentication (LightDMGreeter *greeter, GError **error)
     g_return_val_if_fail (priv->connected, FALSE);
 
     priv->cancelling_authentication = TRUE;
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_CANCEL_AUTHENTICATION, 0, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolCancelAuthentication message = { 0 };
+    greeter_protocol_write_cancel_authentication (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 /**
@@ -1592,11 +1993,10 @@ lightdm_greeter_set_language (LightDMGreeter *greeter, const gchar *language, GE
 
     g_return_val_if_fail (priv->connected, FALSE);
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    return write_header (message, MAX_MESSAGE_LENGTH, GREETER_MESSAGE_SET_LANGUAGE, string_length (language), &offset, error) &&
-           write_string (message, MAX_MESSAGE_LENGTH, language, &offset, error) &&
-           send_message (greeter, message, offset, error);
+    GreeterProtocolSetLanguage message = { 0 };
+    message.language = language;
+    greeter_protocol_write_set_language (priv->write_buffer, &message);
+    return send_message (greeter, error);
 }
 
 /**
@@ -1621,12 +2021,15 @@ lightdm_greeter_start_session (LightDMGreeter *greeter, const gchar *session, GC
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
     Request *request = request_new (greeter, cancellable, callback, user_data);
-    priv->start_session_requests = g_list_append (priv->start_session_requests, request);
     GError *error = NULL;
-    if (!send_start_session (greeter, session, &error))
+    if (!g_cancellable_set_error_if_cancelled (cancellable, &error) &&
+        send_start_session (greeter, session, &error))
+        priv->start_session_requests = g_list_append (priv->start_session_requests, request);
+    else
     {
         request->error = error;
         request_complete (request);
+        g_object_unref (request);
     }
 }
 
@@ -1678,7 +2081,7 @@ lightdm_greeter_start_session_sync (LightDMGreeter *greeter, const gchar *sessio
     priv->start_session_requests = g_list_append (priv->start_session_requests, g_object_ref (request));
     do
     {
-        g_autofree guint8 *message = NULL;
+        guint8 *message;
         gsize message_length;
         if (!recv_message (greeter, TRUE, &message, &message_length, error))
             return FALSE;
@@ -1715,12 +2118,15 @@ lightdm_greeter_ensure_shared_data_dir (LightDMGreeter *greeter, const gchar *us
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
     Request *request = request_new (greeter, cancellable, callback, user_data);
-    priv->ensure_shared_data_dir_requests = g_list_append (priv->ensure_shared_data_dir_requests, request);
     GError *error = NULL;
-    if (!send_ensure_shared_data_dir (greeter, username, &error))
+    if (!g_cancellable_set_error_if_cancelled (cancellable, &error) &&
+        send_ensure_shared_data_dir (greeter, username, &error))
+        priv->ensure_shared_data_dir_requests = g_list_append (priv->ensure_shared_data_dir_requests, request);
+    else
     {
         request->error = error;
         request_complete (request);
+        g_object_unref (request);
     }
 }
 
@@ -1780,7 +2186,7 @@ lightdm_greeter_ensure_shared_data_dir_sync (LightDMGreeter *greeter, const gcha
     priv->ensure_shared_data_dir_requests = g_list_append (priv->ensure_shared_data_dir_requests, g_object_ref (request));
     do
     {
-        g_autofree guint8 *message = NULL;
+        guint8 *message;
         gsize message_length;
         if (!recv_message (greeter, TRUE, &message, &message_length, error))
             return FALSE;
@@ -1790,12 +2196,129 @@ lightdm_greeter_ensure_shared_data_dir_sync (LightDMGreeter *greeter, const gcha
     return lightdm_greeter_ensure_shared_data_dir_finish (greeter, G_ASYNC_RESULT (request), error);
 }
 
+/**
+ * lightdm_greeter_open_user_image:
+ * @greeter: A #LightDMGreeter
+ * @username: A username
+ * @background: %TRUE to get the background for the user instead of their image
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: (allow-none): A #GAsyncReadyCallback to call when completed or %NULL.
+ * @user_data: (allow-none): data to pass to the @callback or %NULL.
+ *
+ * Get a read-only file descriptor for the image or background of a user.  The
+ * daemon opens its cached copy of the file and passes the descriptor to the
+ * greeter, so the file can be read or mapped without the greeter needing
+ * access to it.
+ **/
+void
+lightdm_greeter_open_user_image (LightDMGreeter *greeter, const gchar *username, gboolean background, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+    g_return_if_fail (LIGHTDM_IS_GREETER (greeter));
+    g_return_if_fail (username != NULL);
+
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    Request *request = request_new (greeter, cancellable, callback, user_data);
+
+    /* Older daemons don't know this request */
+    if (priv->api_version < 2)
+    {
+        request_complete (request);
+        g_object_unref (request);
+        return;
+    }
+
+    GError *error = NULL;
+    if (!g_cancellable_set_error_if_cancelled (cancellable, &error) &&
+        send_get_user_image (greeter, username, background, &error))
+        priv->user_image_requests = g_list_append (priv->user_image_requests, request);
+    else
+    {
+        request->error = error;
+        request_complete (request);
+        g_object_unref (request);
+    }
+}
+
+/**
+ * lightdm_greeter_open_user_image_finish:
+ * @greeter: A #LightDMGreeter
+ * @result: A #GAsyncResult.
+ * @error: return location for a #GError, or %NULL
+ *
+ * Function to call from lightdm_greeter_open_user_image callback.
+ *
+ * Return value: A file descriptor to close with close() or -1 if the daemon has no copy of the image.
+ **/
+gint
+lightdm_greeter_open_user_image_finish (LightDMGreeter *greeter, GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail (LIGHTDM_IS_GREETER (greeter), -1);
+
+    Request *request = REQUEST (result);
+    if (request->error)
+        g_propagate_error (error, g_steal_pointer (&request->error));
+    int fd = request->fd;
+    request->fd = -1;
+    return fd;
+}
+
+/**
+ * lightdm_greeter_open_user_image_sync:
+ * @greeter: A #LightDMGreeter
+ * @username: A username
+ * @background: %TRUE to get the background for the user instead of their image
+ * @error: return location for a #GError, or %NULL
+ *
+ * Get a read-only file descriptor for the image or background of a user.  The
+ * daemon opens its cached copy of the file and passes the descriptor to the
+ * greeter, so the file can be read or mapped without the greeter needing
+ * access to it.
+ *
+ * Return value: A file descriptor to close with close() or -1 if the daemon has no copy of the image.
+ **/
+gint
+lightdm_greeter_open_user_image_sync (LightDMGreeter *greeter, const gchar *username, gboolean background, GError **error)
+{
+    g_return_val_if_fail (LIGHTDM_IS_GREETER (greeter), -1);
+    g_return_val_if_fail (username != NULL, -1);
+
+    LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
+
+    g_return_val_if_fail (priv->connected, -1);
+
+    /* Older daemons don't know this request */
+    if (priv->api_version < 2)
+        return -1;
+
+    /* Read until a response */
+    if (!send_get_user_image (greeter, username, background, error))
+        return -1;
+    g_autoptr(GObject) request = G_OBJECT (request_new (greeter, NULL, NULL, NULL));
+    priv->user_image_requests = g_list_append (priv->user_image_requests, g_object_ref (request));
+    do
+    {
+        guint8 *message;
+        gsize message_length;
+        if (!recv_message (greeter, TRUE, &message, &message_length, error))
+            return -1;
+        handle_message (greeter, message, message_length);
+    } while (!REQUEST (request)->complete);
+
+    return lightdm_greeter_open_user_image_finish (greeter, G_ASYNC_RESULT (request), error);
+}
+
 static void
 lightdm_greeter_init (LightDMGreeter *greeter)
 {
     LightDMGreeterPrivate *priv = lightdm_greeter_get_instance_private (greeter);
 
-    priv->read_buffer = g_malloc (HEADER_SIZE);
+    priv->read_buffer_size = MAX_MESSAGE_LENGTH;
+    priv->read_buffer = g_malloc (priv->read_buffer_size);
+    priv->write_buffer = g_byte_array_sized_new (MAX_MESSAGE_LENGTH);
+    priv->received_fds = g_array_new (FALSE, FALSE, sizeof (int));
+    priv->pending_users = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+    priv->pending_removed_users = g_ptr_array_new_with_free_func (g_free);
     priv->hints = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 }
 
@@ -1882,7 +2405,16 @@ lightdm_greeter_finalize (GObject *object)
     if (priv->from_server_watch)
         g_source_remove (priv->from_server_watch);
     priv->from_server_watch = 0;
+    if (priv->to_server_watch)
+        g_source_remove (priv->to_server_watch);
+    priv->to_server_watch = 0;
+    if (priv->dispatch_idle)
+        g_source_remove (priv->dispatch_idle);
+    priv->dispatch_idle = 0;
     g_clear_pointer (&priv->read_buffer, g_free);
+    g_clear_pointer (&priv->write_buffer, g_byte_array_unref);
+    g_list_free_full (priv->retired_buffers, g_free);
+    priv->retired_buffers = NULL;
     g_list_free_full (priv->responses_received, g_free);
     priv->responses_received = NULL;
     g_list_free_full (priv->connect_requests, g_object_unref);
@@ -1891,6 +2423,13 @@ lightdm_greeter_finalize (GObject *object)
     priv->start_session_requests = NULL;
     g_list_free_full (priv->ensure_shared_data_dir_requests, g_object_unref);
     priv->ensure_shared_data_dir_requests = NULL;
+    g_list_free_full (priv->user_image_requests, g_object_unref);
+    priv->user_image_requests = NULL;
+    for (guint i = 0; i < priv->received_fds->len; i++)
+        close (g_array_index (priv->received_fds, int, i));
+    g_clear_pointer (&priv->received_fds, g_array_unref);
+    g_clear_pointer (&priv->pending_users, g_ptr_array_unref);
+    g_clear_pointer (&priv->pending_removed_users, g_ptr_array_unref);
     g_clear_pointer (&priv->authentication_user, g_free);
     g_hash_table_unref (priv->hints);
     priv->hints = NULL;
@@ -2142,6 +2681,7 @@ lightdm_greeter_class_init (LightDMGreeterClass *klass)
 static void
 request_init (Request *request)
 {
+    request->fd = -1;
 }
 
 static void
@@ -2149,8 +2689,12 @@ request_finalize (GObject *object)
 {
     Request *request = REQUEST (object);
 
+    if (request->cancelled_id)
+        g_cancellable_disconnect (request->cancellable, request->cancelled_id);
     g_clear_object (&request->cancellable);
     g_free (request->dir);
+    if (request->fd >= 0)
+        close (request->fd);
 
     G_OBJECT_CLASS (request_parent_class)->finalize (object);
 }
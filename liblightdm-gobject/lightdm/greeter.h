@@ -124,6 +124,8 @@ LightDMGreeter *lightdm_greeter_new (void);
 
 void lightdm_greeter_set_resettable (LightDMGreeter *greeter, gboolean resettable);
 
+void lightdm_greeter_set_load_users (LightDMGreeter *greeter, gboolean load_users);
+
 void lightdm_greeter_connect_to_daemon (LightDMGreeter *greeter, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
 
 gboolean lightdm_greeter_connect_to_daemon_finish (LightDMGreeter *greeter, GAsyncResult *result, GError **error);
@@ -190,6 +192,12 @@ gchar *lightdm_greeter_ensure_shared_data_dir_finish (LightDMGreeter *greeter, G
 
 gchar *lightdm_greeter_ensure_shared_data_dir_sync (LightDMGreeter *greeter, const gchar *username, GError **error);
 
+void lightdm_greeter_open_user_image (LightDMGreeter *greeter, const gchar *username, gboolean background, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+gint lightdm_greeter_open_user_image_finish (LightDMGreeter *greeter, GAsyncResult *result, GError **error);
+
+gint lightdm_greeter_open_user_image_sync (LightDMGreeter *greeter, const gchar *username, gboolean background, GError **error);
+
 #ifndef LIGHTDM_DISABLE_DEPRECATED
 gboolean lightdm_greeter_connect_sync (LightDMGreeter *greeter, GError **error);
 #endif
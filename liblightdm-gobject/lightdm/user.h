@@ -38,6 +38,8 @@ typedef struct _LightDMUserClass     LightDMUserClass;
 #define LIGHTDM_USER_LIST_SIGNAL_USER_ADDED   "user-added"
 #define LIGHTDM_USER_LIST_SIGNAL_USER_CHANGED "user-changed"
 #define LIGHTDM_USER_LIST_SIGNAL_USER_REMOVED "user-removed"
+#define LIGHTDM_USER_LIST_SIGNAL_USERS_CHANGED "users-changed"
+#define LIGHTDM_USER_LIST_SIGNAL_LOADED       "loaded"
 
 #define LIGHTDM_SIGNAL_USER_CHANGED "changed"
 
@@ -75,10 +77,10 @@ struct _LightDMUserListClass
     void (*user_added)(LightDMUserList *user_list, LightDMUser *user);
     void (*user_changed)(LightDMUserList *user_list, LightDMUser *user);
     void (*user_removed)(LightDMUserList *user_list, LightDMUser *user);
+    void (*loaded)(LightDMUserList *user_list);
+    void (*users_changed)(LightDMUserList *user_list, GList *added, GList *removed, GList *changed);
 
     /* Reserved */
-    void (*reserved1) (void);
-    void (*reserved2) (void);
     void (*reserved3) (void);
     void (*reserved4) (void);
     void (*reserved5) (void);
@@ -110,6 +112,14 @@ LightDMUser *lightdm_user_list_get_user_by_name (LightDMUserList *user_list, con
 
 GList *lightdm_user_list_get_users (LightDMUserList *user_list);
 
+GList *lightdm_user_list_get_range (LightDMUserList *user_list, guint offset, guint count);
+
+GList *lightdm_user_list_find_prefix (LightDMUserList *user_list, const gchar *prefix);
+
+void lightdm_user_list_start_loading (LightDMUserList *user_list);
+
+gboolean lightdm_user_list_get_is_loaded (LightDMUserList *user_list);
+
 const gchar *lightdm_user_get_name (LightDMUser *user);
 
 const gchar *lightdm_user_get_real_name (LightDMUser *user);
@@ -120,8 +130,12 @@ const gchar *lightdm_user_get_home_directory (LightDMUser *user);
 
 const gchar *lightdm_user_get_image (LightDMUser *user);
 
+const gchar *lightdm_user_get_cached_image (LightDMUser *user);
+
 const gchar *lightdm_user_get_background (LightDMUser *user);
 
+const gchar *lightdm_user_get_cached_background (LightDMUser *user);
+
 const gchar *lightdm_user_get_language (LightDMUser *user);
 
 const gchar *lightdm_user_get_layout (LightDMUser *user);
@@ -13,6 +13,10 @@
 
 #include <config.h>
 
+#include <string.h>
+#include <sys/stat.h>
+
+#include "user-image-index.h"
 #include "user-list.h"
 #include "lightdm/user.h"
 
@@ -89,6 +93,8 @@ enum
     USER_ADDED,
     USER_CHANGED,
     USER_REMOVED,
+    USERS_CHANGED,
+    LOADED,
     LAST_LIST_SIGNAL
 };
 static guint list_signals[LAST_LIST_SIGNAL] = { 0 };
@@ -102,15 +108,48 @@ static guint user_signals[LAST_USER_SIGNAL] = { 0 };
 
 typedef struct
 {
+    /* TRUE if listening to the common list */
+    gboolean connected;
+
+    /* TRUE if loading asynchronously */
+    gboolean loading;
+
+    /* TRUE if all users are wrapped */
     gboolean initialized;
 
-    /* Wrapper list, kept locally to preserve transfer-none promises */
+    /* Wrappers in the same order as the common list */
+    GPtrArray *lightdm_users;
+
+    /* Same users as lightdm_users, built when requested and kept locally to preserve transfer-none promises */
     GList *lightdm_list;
+
+    /* Wrappers keyed by the user they wrap */
+    GHashTable *users_by_common;
+
+    /* Users removed since the last users-changed signal, newest first */
+    GList *removed_users;
+
+    /* Names of users sorted for prefix searches, built on first search */
+    GArray *prefix_index;
 } LightDMUserListPrivate;
 
+typedef struct
+{
+    /* Name in normalized form */
+    gchar *key;
+
+    LightDMUser *user;
+} PrefixEntry;
+
 typedef struct
 {
     CommonUser *common_user;
+
+    /* Display name this user is positioned in the list by */
+    gchar *sort_key;
+
+    /* Keys this user is in the prefix index under */
+    GPtrArray *prefix_keys;
 } LightDMUserPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (LightDMUserList, lightdm_user_list, G_TYPE_OBJECT)
@@ -147,22 +186,243 @@ wrap_common_user (CommonUser *user)
     return lightdm_user;
 }
 
+/* Convert text to a form that matches regardless of case and accents */
+static gchar *
+normalize_text (const gchar *text)
+{
+    g_autofree gchar *decomposed = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+    if (!decomposed)
+        return g_strdup ("");
+
+    g_autoptr(GString) stripped = g_string_sized_new (strlen (decomposed));
+    for (const gchar *c = decomposed; *c; c = g_utf8_next_char (c))
+    {
+        gunichar ch = g_utf8_get_char (c);
+        if (!g_unichar_ismark (ch))
+            g_string_append_unichar (stripped, ch);
+    }
+
+    return g_utf8_casefold (stripped->str, stripped->len);
+}
+
+/* Find the first entry not less than key */
+static guint
+find_prefix_entry (GArray *prefix_index, const gchar *key)
+{
+    guint start = 0, end = prefix_index->len;
+    while (start < end)
+    {
+        guint middle = start + (end - start) / 2;
+        if (strcmp (g_array_index (prefix_index, PrefixEntry, middle).key, key) < 0)
+            start = middle + 1;
+        else
+            end = middle;
+    }
+
+    return start;
+}
+
+static void
+add_prefix_entry (GArray *prefix_index, LightDMUser *user, const gchar *key)
+{
+    LightDMUserPrivate *user_priv = lightdm_user_get_instance_private (user);
+
+    if (key[0] == '\0')
+        return;
+
+    PrefixEntry entry;
+    entry.key = g_strdup (key);
+    entry.user = user;
+    g_array_insert_val (prefix_index, find_prefix_entry (prefix_index, entry.key), entry);
+    g_ptr_array_add (user_priv->prefix_keys, g_strdup (entry.key));
+}
+
+/* Index the login name and the real name from the start of each word in it.
+ * Words are split on any Unicode space, as QLightDM::UsersFilterModel does */
+static void
+index_user (LightDMUserList *user_list, LightDMUser *user)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    if (!priv->prefix_index)
+        return;
+
+    const gchar *name = lightdm_user_get_name (user);
+    if (name)
+    {
+        g_autofree gchar *key = normalize_text (name);
+        add_prefix_entry (priv->prefix_index, user, key);
+    }
+    const gchar *real_name = lightdm_user_get_real_name (user);
+    if (real_name)
+    {
+        g_autofree gchar *key = normalize_text (real_name);
+        gboolean after_space = TRUE;
+        for (const gchar *c = key; *c; c = g_utf8_next_char (c))
+        {
+            gboolean is_space = g_unichar_isspace (g_utf8_get_char (c));
+            if (!is_space && after_space)
+                add_prefix_entry (priv->prefix_index, user, c);
+            after_space = is_space;
+        }
+    }
+}
+
+static void
+unindex_user (LightDMUserList *user_list, LightDMUser *user)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    LightDMUserPrivate *user_priv = lightdm_user_get_instance_private (user);
+
+    if (!priv->prefix_index)
+        return;
+
+    /* Entries with the same key are next to each other */
+    for (guint i = 0; i < user_priv->prefix_keys->len; i++)
+    {
+        const gchar *key = g_ptr_array_index (user_priv->prefix_keys, i);
+        for (guint j = find_prefix_entry (priv->prefix_index, key); j < priv->prefix_index->len; j++)
+        {
+            PrefixEntry *entry = &g_array_index (priv->prefix_index, PrefixEntry, j);
+            if (strcmp (entry->key, key) != 0)
+                break;
+            if (entry->user == user)
+            {
+                g_array_remove_index (priv->prefix_index, j);
+                break;
+            }
+        }
+    }
+    g_ptr_array_set_size (user_priv->prefix_keys, 0);
+}
+
+static void
+clear_prefix_entry (gpointer data)
+{
+    PrefixEntry *entry = data;
+    g_free (entry->key);
+}
+
+static void
+build_prefix_index (LightDMUserList *user_list)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    if (priv->prefix_index)
+        return;
+
+    priv->prefix_index = g_array_new (FALSE, FALSE, sizeof (PrefixEntry));
+    g_array_set_clear_func (priv->prefix_index, clear_prefix_entry);
+    for (guint i = 0; i < priv->lightdm_users->len; i++)
+        index_user (user_list, g_ptr_array_index (priv->lightdm_users, i));
+}
+
+static const gchar *
+get_sort_key (LightDMUser *user)
+{
+    LightDMUserPrivate *priv = lightdm_user_get_instance_private (user);
+    return priv->sort_key;
+}
+
+static void
+update_sort_key (LightDMUser *user)
+{
+    LightDMUserPrivate *priv = lightdm_user_get_instance_private (user);
+    g_free (priv->sort_key);
+    priv->sort_key = g_strdup (common_user_get_display_name (priv->common_user));
+}
+
+/* Find the position of a user in the list or -1 if not in the list */
+static gint
+find_user_position (LightDMUserList *user_list, LightDMUser *user)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+    const gchar *key = get_sort_key (user);
+
+    guint start = 0, end = priv->lightdm_users->len;
+    while (start < end)
+    {
+        guint middle = start + (end - start) / 2;
+        if (g_strcmp0 (get_sort_key (g_ptr_array_index (priv->lightdm_users, middle)), key) < 0)
+            start = middle + 1;
+        else
+            end = middle;
+    }
+
+    /* Users with the same display name are next to each other */
+    for (guint i = start; i < priv->lightdm_users->len; i++)
+    {
+        LightDMUser *u = g_ptr_array_index (priv->lightdm_users, i);
+        if (u == user)
+            return i;
+        if (g_strcmp0 (get_sort_key (u), key) != 0)
+            break;
+    }
+
+    return -1;
+}
+
+/* Place a user at the same position as in the common list */
+static void
+insert_user (LightDMUserList *user_list, LightDMUser *user, gint index)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    if (index < 0 || index > priv->lightdm_users->len)
+        index = priv->lightdm_users->len;
+    update_sort_key (user);
+    g_ptr_array_insert (priv->lightdm_users, index, user);
+    g_clear_pointer (&priv->lightdm_list, g_list_free);
+}
+
+static void
+remove_user (LightDMUserList *user_list, guint index)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    g_ptr_array_remove_index (priv->lightdm_users, index);
+    g_clear_pointer (&priv->lightdm_list, g_list_free);
+}
+
 static void
 user_list_added_cb (CommonUserList *common_list, CommonUser *common_user, LightDMUserList *user_list)
 {
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
-    GList *common_users = common_user_list_get_users (common_list);
     LightDMUser *lightdm_user = wrap_common_user (common_user);
-    priv->lightdm_list = g_list_insert (priv->lightdm_list, lightdm_user, g_list_index (common_users, common_user));
-    g_signal_emit (user_list, list_signals[USER_ADDED], 0, lightdm_user);
+    insert_user (user_list, lightdm_user, common_user_list_get_user_index (common_list, common_user));
+    g_hash_table_insert (priv->users_by_common, common_user, lightdm_user);
+    index_user (user_list, lightdm_user);
+
+    /* Users found while blocking on the initial load are not announced */
+    if (priv->initialized || priv->loading)
+        g_signal_emit (user_list, list_signals[USER_ADDED], 0, lightdm_user);
 }
 
 static void
 user_list_changed_cb (CommonUserList *common_list, CommonUser *common_user, LightDMUserList *user_list)
 {
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
-    GList *common_users = common_user_list_get_users (common_list);
-    LightDMUser *lightdm_user = g_list_nth_data (priv->lightdm_list, g_list_index (common_users, common_user));
+
+    LightDMUser *lightdm_user = g_hash_table_lookup (priv->users_by_common, common_user);
+    if (!lightdm_user)
+        return;
+
+    /* Follow any change in position */
+    gint old_index = find_user_position (user_list, lightdm_user);
+    gint new_index = common_user_list_get_user_index (common_list, common_user);
+    if (old_index >= 0 && old_index != new_index)
+    {
+        remove_user (user_list, old_index);
+        insert_user (user_list, lightdm_user, new_index);
+    }
+    else
+        update_sort_key (lightdm_user);
+
+    /* Re-index as the names may have changed */
+    unindex_user (user_list, lightdm_user);
+    index_user (user_list, lightdm_user);
+
     g_signal_emit (user_list, list_signals[USER_CHANGED], 0, lightdm_user);
 }
 
@@ -171,45 +431,204 @@ user_list_removed_cb (CommonUserList *common_list, CommonUser *common_user, Ligh
 {
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
 
-    for (GList *link = priv->lightdm_list; link; link = link->next)
+    LightDMUser *lightdm_user = g_hash_table_lookup (priv->users_by_common, common_user);
+    if (lightdm_user)
     {
-        LightDMUser *lightdm_user = link->data;
-        LightDMUserPrivate *user_priv = lightdm_user_get_instance_private (lightdm_user);
-        if (user_priv->common_user == common_user)
-        {
-            priv->lightdm_list = g_list_delete_link (priv->lightdm_list, link);
-            g_signal_emit (user_list, list_signals[USER_REMOVED], 0, lightdm_user);
-            g_object_unref (lightdm_user);
-            break;
-        }
+        gint index = find_user_position (user_list, lightdm_user);
+        if (index >= 0)
+            remove_user (user_list, index);
+        g_hash_table_remove (priv->users_by_common, common_user);
+        unindex_user (user_list, lightdm_user);
+        g_signal_emit (user_list, list_signals[USER_REMOVED], 0, lightdm_user);
+
+        /* Keep until reported in users-changed */
+        priv->removed_users = g_list_prepend (priv->removed_users, lightdm_user);
     }
 }
 
+static GList *
+wrap_common_users (LightDMUserList *user_list, GList *common_users)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    GList *users = NULL;
+    for (GList *link = common_users; link; link = link->next)
+    {
+        LightDMUser *lightdm_user = g_hash_table_lookup (priv->users_by_common, link->data);
+        if (lightdm_user)
+            users = g_list_prepend (users, lightdm_user);
+    }
+
+    return g_list_reverse (users);
+}
+
 static void
-initialize_user_list_if_needed (LightDMUserList *user_list)
+user_list_users_changed_cb (CommonUserList *common_list, GList *added, GList *removed, GList *changed, LightDMUserList *user_list)
 {
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
 
-    if (priv->initialized)
-        return;
+    GList *removed_users = g_list_reverse (g_steal_pointer (&priv->removed_users));
+
+    /* Users found while blocking on the initial load are not announced */
+    if (priv->initialized || priv->loading)
+    {
+        GList *added_users = wrap_common_users (user_list, added);
+        GList *changed_users = wrap_common_users (user_list, changed);
+        g_signal_emit (user_list, list_signals[USERS_CHANGED], 0, added_users, removed_users, changed_users);
+        g_list_free (added_users);
+        g_list_free (changed_users);
+    }
+
+    g_list_free_full (removed_users, g_object_unref);
+}
+
+/* Wrap users already in the list, in the same order */
+static void
+wrap_users (LightDMUserList *user_list, GList *common_users)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
 
-    GList *common_users = common_user_list_get_users (common_user_list_get_instance ());
     for (GList *link = common_users; link; link = link->next)
     {
         CommonUser *user = link->data;
         LightDMUser *lightdm_user = wrap_common_user (user);
-        priv->lightdm_list = g_list_prepend (priv->lightdm_list, lightdm_user);
+        update_sort_key (lightdm_user);
+        g_ptr_array_add (priv->lightdm_users, lightdm_user);
+        g_hash_table_insert (priv->users_by_common, user, lightdm_user);
+        index_user (user_list, lightdm_user);
     }
-    priv->lightdm_list = g_list_reverse (priv->lightdm_list);
+    g_clear_pointer (&priv->lightdm_list, g_list_free);
+}
+
+static void
+user_list_loaded_cb (CommonUserList *common_list, LightDMUserList *user_list)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    /* Already announced if started from a snapshot */
+    if (priv->initialized && !priv->loading)
+        return;
+
+    /* The first users loaded are not added one at a time */
+    if (!priv->initialized)
+        wrap_users (user_list, common_user_list_get_users (common_list));
+
+    priv->initialized = TRUE;
+    priv->loading = FALSE;
+    g_signal_emit (user_list, list_signals[LOADED], 0);
+}
+
+static void
+connect_user_list (LightDMUserList *user_list)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    if (priv->connected)
+        return;
 
     CommonUserList *common_list = common_user_list_get_instance ();
     g_signal_connect (common_list, USER_LIST_SIGNAL_USER_ADDED, G_CALLBACK (user_list_added_cb), user_list);
     g_signal_connect (common_list, USER_LIST_SIGNAL_USER_CHANGED, G_CALLBACK (user_list_changed_cb), user_list);
     g_signal_connect (common_list, USER_LIST_SIGNAL_USER_REMOVED, G_CALLBACK (user_list_removed_cb), user_list);
+    g_signal_connect (common_list, USER_LIST_SIGNAL_USERS_CHANGED, G_CALLBACK (user_list_users_changed_cb), user_list);
+    g_signal_connect (common_list, USER_LIST_SIGNAL_LOADED, G_CALLBACK (user_list_loaded_cb), user_list);
+
+    priv->connected = TRUE;
+}
+
+/* Use the snapshot of the user list provided by the daemon, if any */
+static void
+load_snapshot (CommonUserList *common_list)
+{
+    const gchar *path = g_getenv ("LIGHTDM_USER_LIST_SNAPSHOT");
+    if (!path)
+        return;
+
+    guint64 generation = 0;
+    const gchar *generation_value = g_getenv ("LIGHTDM_USER_LIST_GENERATION");
+    if (generation_value)
+        generation = g_ascii_strtoull (generation_value, NULL, 10);
+
+    /* Users from the snapshot are checked in the background, so check sessions too */
+    if (common_user_list_load_snapshot (common_list, path, generation))
+        common_user_list_start_loading_sessions (common_list);
+}
+
+static void
+initialize_user_list_if_needed (LightDMUserList *user_list)
+{
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    if (priv->initialized)
+        return;
+
+    CommonUserList *common_list = common_user_list_get_instance ();
+    load_snapshot (common_list);
+
+    /* Blocks until the users are loaded */
+    GList *common_users = common_user_list_get_users (common_list);
+
+    /* Already wrapped if the load started with lightdm_user_list_start_loading() completed */
+    if (priv->initialized)
+        return;
+
+    wrap_users (user_list, common_users);
+    connect_user_list (user_list);
 
     priv->initialized = TRUE;
 }
 
+/**
+ * lightdm_user_list_start_loading:
+ * @user_list: A #LightDMUserList
+ *
+ * Start loading users without blocking.  The #LightDMUserList::loaded signal
+ * is emitted once all users are available, the users loaded are not reported
+ * with #LightDMUserList::user-added.  Calling any other user list function before then
+ * will block until loading is complete.
+ **/
+void
+lightdm_user_list_start_loading (LightDMUserList *user_list)
+{
+    g_return_if_fail (LIGHTDM_IS_USER_LIST (user_list));
+
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+
+    if (priv->initialized || priv->loading)
+        return;
+
+    CommonUserList *common_list = common_user_list_get_instance ();
+    load_snapshot (common_list);
+    if (common_user_list_get_is_loaded (common_list))
+    {
+        initialize_user_list_if_needed (user_list);
+        g_signal_emit (user_list, list_signals[LOADED], 0);
+        return;
+    }
+
+    priv->loading = TRUE;
+    connect_user_list (user_list);
+    common_user_list_start_loading (common_list);
+    common_user_list_start_loading_sessions (common_list);
+}
+
+/**
+ * lightdm_user_list_get_is_loaded:
+ * @user_list: A #LightDMUserList
+ *
+ * Check if all users have been loaded.  This does not block.
+ *
+ * Return value: #TRUE if the user list is complete.
+ **/
+gboolean
+lightdm_user_list_get_is_loaded (LightDMUserList *user_list)
+{
+    g_return_val_if_fail (LIGHTDM_IS_USER_LIST (user_list), FALSE);
+
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+    return priv->initialized;
+}
+
 /**
  * lightdm_user_list_get_length:
  * @user_list: a #LightDMUserList
@@ -223,7 +642,7 @@ lightdm_user_list_get_length (LightDMUserList *user_list)
 
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
     initialize_user_list_if_needed (user_list);
-    return g_list_length (priv->lightdm_list);
+    return priv->lightdm_users->len;
 }
 
 /**
@@ -242,9 +661,85 @@ lightdm_user_list_get_users (LightDMUserList *user_list)
 
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
     initialize_user_list_if_needed (user_list);
+
+    if (!priv->lightdm_list)
+    {
+        for (guint i = priv->lightdm_users->len; i > 0; i--)
+            priv->lightdm_list = g_list_prepend (priv->lightdm_list, g_ptr_array_index (priv->lightdm_users, i - 1));
+    }
+
     return priv->lightdm_list;
 }
 
+/**
+ * lightdm_user_list_get_range:
+ * @user_list: A #LightDMUserList
+ * @offset: Position of the first user to get
+ * @count: Maximum number of users to get
+ *
+ * Get part of the list returned by lightdm_user_list_get_users().  This allows
+ * greeters to only look at the users they are showing.
+ *
+ * Return value: (element-type LightDMUser) (transfer container): A list of #LightDMUser, which may be shorter than @count if the end of the list is reached.
+ **/
+GList *
+lightdm_user_list_get_range (LightDMUserList *user_list, guint offset, guint count)
+{
+    g_return_val_if_fail (LIGHTDM_IS_USER_LIST (user_list), NULL);
+
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+    initialize_user_list_if_needed (user_list);
+
+    GList *users = NULL;
+    if (offset >= priv->lightdm_users->len)
+        return NULL;
+    guint end = offset + MIN (count, priv->lightdm_users->len - offset);
+    for (guint i = end; i > offset; i--)
+        users = g_list_prepend (users, g_ptr_array_index (priv->lightdm_users, i - 1));
+
+    return users;
+}
+
+/**
+ * lightdm_user_list_find_prefix:
+ * @user_list: A #LightDMUserList
+ * @prefix: Text to search for.
+ *
+ * Find the users whose login name, real name or any word of their real name
+ * starts with @prefix.  Matching ignores case and accents.
+ *
+ * Return value: (element-type LightDMUser) (transfer container): A list of #LightDMUser ordered by the name that matched.
+ **/
+GList *
+lightdm_user_list_find_prefix (LightDMUserList *user_list, const gchar *prefix)
+{
+    g_return_val_if_fail (LIGHTDM_IS_USER_LIST (user_list), NULL);
+    g_return_val_if_fail (prefix != NULL, NULL);
+
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+    initialize_user_list_if_needed (user_list);
+    build_prefix_index (user_list);
+
+    g_autofree gchar *key = normalize_text (prefix);
+    gsize key_length = strlen (key);
+    g_autoptr(GHashTable) found = g_hash_table_new (g_direct_hash, g_direct_equal);
+    GList *users = NULL;
+    for (guint i = find_prefix_entry (priv->prefix_index, key); i < priv->prefix_index->len; i++)
+    {
+        PrefixEntry *entry = &g_array_index (priv->prefix_index, PrefixEntry, i);
+        if (strncmp (entry->key, key, key_length) != 0)
+            break;
+
+        /* A user can match on more than one name */
+        if (g_hash_table_contains (found, entry->user))
+            continue;
+        g_hash_table_add (found, entry->user);
+        users = g_list_prepend (users, entry->user);
+    }
+
+    return g_list_reverse (users);
+}
+
 /**
  * lightdm_user_list_get_user_by_name:
  * @user_list: A #LightDMUserList
@@ -264,9 +759,9 @@ lightdm_user_list_get_user_by_name (LightDMUserList *user_list, const gchar *use
 
     initialize_user_list_if_needed (user_list);
 
-    for (GList *link = priv->lightdm_list; link; link = link->next)
+    for (guint i = 0; i < priv->lightdm_users->len; i++)
     {
-        LightDMUser *user = link->data;
+        LightDMUser *user = g_ptr_array_index (priv->lightdm_users, i);
         if (g_strcmp0 (lightdm_user_get_name (user), username) == 0)
             return user;
     }
@@ -277,6 +772,9 @@ lightdm_user_list_get_user_by_name (LightDMUserList *user_list, const gchar *use
 static void
 lightdm_user_list_init (LightDMUserList *user_list)
 {
+    LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (user_list);
+    priv->lightdm_users = g_ptr_array_new ();
+    priv->users_by_common = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 static void
@@ -314,7 +812,13 @@ lightdm_user_list_finalize (GObject *object)
     LightDMUserList *self = LIGHTDM_USER_LIST (object);
     LightDMUserListPrivate *priv = lightdm_user_list_get_instance_private (self);
 
-    g_list_free_full (priv->lightdm_list, g_object_unref);
+    g_list_free (priv->lightdm_list);
+    g_ptr_array_foreach (priv->lightdm_users, (GFunc) g_object_unref, NULL);
+    g_ptr_array_unref (priv->lightdm_users);
+    g_hash_table_unref (priv->users_by_common);
+    g_list_free_full (priv->removed_users, g_object_unref);
+    if (priv->prefix_index)
+        g_array_unref (priv->prefix_index);
 
     G_OBJECT_CLASS (lightdm_user_list_parent_class)->finalize (object);
 }
@@ -398,6 +902,43 @@ lightdm_user_list_class_init (LightDMUserListClass *klass)
                       NULL, NULL,
                       NULL,
                       G_TYPE_NONE, 1, LIGHTDM_TYPE_USER);
+
+    /**
+     * LightDMUserList::users-changed:
+     * @user_list: A #LightDMUserList
+     * @added: (element-type LightDMUser): The users that have been added.
+     * @removed: (element-type LightDMUser): The users that have been removed.
+     * @changed: (element-type LightDMUser): The users that have been changed.
+     *
+     * The ::users-changed signal gets emitted after the ::user-added,
+     * ::user-removed and ::user-changed signals for a change to the list.
+     * Changes that happen together, such as from a reload of the password
+     * file, are reported in a single signal so they can be applied at once.
+     **/
+    list_signals[USERS_CHANGED] =
+        g_signal_new (LIGHTDM_USER_LIST_SIGNAL_USERS_CHANGED,
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (LightDMUserListClass, users_changed),
+                      NULL, NULL,
+                      NULL,
+                      G_TYPE_NONE, 3, G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_POINTER);
+
+    /**
+     * LightDMUserList::loaded:
+     * @user_list: A #LightDMUserList
+     *
+     * The ::loaded signal gets emitted once all users have been loaded after
+     * calling lightdm_user_list_start_loading().
+     **/
+    list_signals[LOADED] =
+        g_signal_new (LIGHTDM_USER_LIST_SIGNAL_LOADED,
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (LightDMUserListClass, loaded),
+                      NULL, NULL,
+                      NULL,
+                      G_TYPE_NONE, 0);
 }
 
 /**
@@ -485,11 +1026,67 @@ lightdm_user_get_image (LightDMUser *user)
     return common_user_get_image (priv->common_user);
 }
 
+/* Get the local copy of an image made by the daemon */
+static const gchar *
+get_cached_image (const gchar *image)
+{
+    static UserImageIndex *index = NULL;
+    static ino_t index_inode = 0;
+    static time_t index_mtime = 0;
+
+    const gchar *directory = g_getenv ("LIGHTDM_USER_IMAGE_CACHE");
+    if (!image || !directory)
+        return image;
+
+    /* The daemon replaces the index when the cached images change */
+    g_autofree gchar *path = g_build_filename (directory, "index", NULL);
+    struct stat buf;
+    if (stat (path, &buf) < 0)
+    {
+        buf.st_ino = 0;
+        buf.st_mtime = 0;
+    }
+    if (buf.st_ino != index_inode || buf.st_mtime != index_mtime)
+    {
+        g_clear_pointer (&index, user_image_index_free);
+        index_inode = buf.st_ino;
+        index_mtime = buf.st_mtime;
+        if (index_inode != 0)
+            index = user_image_index_open (path);
+    }
+
+    /* Use the original if the copy has been removed since the index was written */
+    const gchar *cached_image = index ? user_image_index_lookup (index, image) : NULL;
+    if (!cached_image || !g_file_test (cached_image, G_FILE_TEST_EXISTS))
+        return image;
+
+    /* Interned as the index may be replaced while callers still hold this */
+    return g_intern_string (cached_image);
+}
+
+/**
+ * lightdm_user_get_cached_image:
+ * @user: A #LightDMUser
+ *
+ * Get the path to a copy of the image for a user that is quick to load.  The
+ * daemon keeps copies of user images in its cache directory, so greeters
+ * don't need to read them from possibly slow home directories.
+ *
+ * Return value: (nullable): The path to a copy of the image, the image itself if it has not been copied or #NULL if no image
+ **/
+const gchar *
+lightdm_user_get_cached_image (LightDMUser *user)
+{
+    g_return_val_if_fail (LIGHTDM_IS_USER (user), NULL);
+    return get_cached_image (lightdm_user_get_image (user));
+}
+
 /**
  * lightdm_user_get_background:
  * @user: A #LightDMUser
  *
- * Get the background file path for a user.
+ * Get the background file path for a user.  This is loaded in the background
+ * the first time it is used, #LightDMUser::changed is emitted when it is known.
  *
  * Return value: (nullable): The background file path for the given user or #NULL if no path
  **/
@@ -502,6 +1099,22 @@ lightdm_user_get_background (LightDMUser *user)
     return common_user_get_background (priv->common_user);
 }
 
+/**
+ * lightdm_user_get_cached_background:
+ * @user: A #LightDMUser
+ *
+ * Get the path to a copy of the background for a user that is quick to load.
+ * See lightdm_user_get_cached_image().
+ *
+ * Return value: (nullable): The path to a copy of the background, the background itself if it has not been copied or #NULL if no background
+ **/
+const gchar *
+lightdm_user_get_cached_background (LightDMUser *user)
+{
+    g_return_val_if_fail (LIGHTDM_IS_USER (user), NULL);
+    return get_cached_image (lightdm_user_get_background (user));
+}
+
 /**
  * lightdm_user_get_language:
  * @user: A #LightDMUser
@@ -540,7 +1153,9 @@ lightdm_user_get_layout (LightDMUser *user)
  * lightdm_user_get_layouts:
  * @user: A #LightDMUser
  *
- * Get the configured keyboard layouts for a user.
+ * Get the configured keyboard layouts for a user.  These are loaded in the
+ * background the first time they are used, #LightDMUser::changed is emitted
+ * when they are known.
  *
  * Return value: (transfer none) (array zero-terminated=1): A NULL-terminated array of keyboard layouts for the given user.  Copy the values if you want to use them long term.
  **/
@@ -591,7 +1206,8 @@ lightdm_user_get_logged_in (LightDMUser *user)
  * lightdm_user_get_has_messages:
  * @user: A #LightDMUser
  *
- * Check if a user has waiting messages.
+ * Check if a user has waiting messages.  This is loaded in the background
+ * the first time it is used, #LightDMUser::changed is emitted when it is known.
  *
  * Return value: #TRUE if the user has waiting messages.
  **/
@@ -641,6 +1257,8 @@ lightdm_user_get_is_locked (LightDMUser *user)
 static void
 lightdm_user_init (LightDMUser *user)
 {
+    LightDMUserPrivate *priv = lightdm_user_get_instance_private (user);
+    priv->prefix_keys = g_ptr_array_new_with_free_func (g_free);
 }
 
 static void
@@ -727,6 +1345,8 @@ lightdm_user_finalize (GObject *object)
     LightDMUserPrivate *priv = lightdm_user_get_instance_private (self);
 
     g_object_unref (priv->common_user);
+    g_free (priv->sort_key);
+    g_ptr_array_unref (priv->prefix_keys);
 
     G_OBJECT_CLASS (lightdm_user_parent_class)->finalize (object);
 }
@@ -82,6 +82,7 @@ public:
     QString motd() const;
 
 public Q_SLOTS:
+    void connectToDaemon();
     bool connectToDaemonSync();
     bool connectSync();
     void authenticate(const QString &username=QString());
@@ -93,6 +94,7 @@ public Q_SLOTS:
     void cancelAutologin();
     void setLanguage (const QString &language);
     void setResettable (bool resettable);
+    void startSession(const QString &session=QString());
     bool startSessionSync(const QString &session=QString());
     QString ensureSharedDataDirSync(const QString &username);
 
@@ -103,6 +105,8 @@ Q_SIGNALS:
     void autologinTimerExpired();
     void idle();
     void reset();
+    void connectToDaemonFinished(bool success);
+    void startSessionFinished(bool success);
 
 private:
     GreeterPrivate *d_ptr;
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+#ifndef QLIGHTDM_USERS_FILTER_MODEL_H
+#define QLIGHTDM_USERS_FILTER_MODEL_H
+
+#include <QtCore/QAbstractProxyModel>
+#include <QtCore/QString>
+
+#include "usersmodel.h"
+
+namespace QLightDM
+{
+class UsersFilterModelPrivate;
+
+/* Shows the users in a UsersModel whose name, real name or a word of their
+ * real name starts with the filter text, ignoring case and accents.  Typing
+ * more of a name only checks the users that already matched. */
+class Q_DECL_EXPORT UsersFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString filterText READ filterText WRITE setFilterText NOTIFY filterTextChanged)
+
+    Q_ENUMS(UsersFilterModelRoles)
+
+public:
+    explicit UsersFilterModel(QObject *parent = 0);
+    ~UsersFilterModel();
+
+    enum UsersFilterModelRoles {
+        //display text with the matched part in <b></b>, for a Text with StyledText
+        MatchHighlightRole = UsersModel::IsLockedRole + 1
+    };
+
+    QString filterText() const;
+    void setFilterText(const QString &text);
+
+    void setSourceModel(QAbstractItemModel *sourceModel);
+
+    QHash<int, QByteArray> roleNames() const;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &child) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const;
+
+Q_SIGNALS:
+    void filterTextChanged(const QString &text);
+
+private:
+    UsersFilterModelPrivate * const d_ptr;
+
+    Q_DECLARE_PRIVATE(UsersFilterModel)
+};
+
+}
+
+#endif // QLIGHTDM_USERS_FILTER_MODEL_H
@@ -0,0 +1,1083 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+/* Greeter implementation that talks to the daemon itself from the Qt event
+ * loop, used instead of greeter.cpp when configured with
+ * --enable-liblightdm-qt5-native-greeter */
+
+#include <config.h>
+
+#include "QLightDM/greeter.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QEvent>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
+#include <functional>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <security/pam_appl.h>
+
+#include <lightdm.h>
+
+#include "greeter-protocol.h"
+
+#define API_VERSION 4
+
+using namespace QLightDM;
+
+namespace
+{
+
+/* A call waiting for a reply from the daemon */
+struct Request
+{
+    Request(const char *finishedSignal) :
+        finishedSignal(finishedSignal),
+        complete(false),
+        result(false)
+    {
+    }
+
+    /* Signal to emit when complete, or NULL if the caller is waiting for the reply */
+    const char *finishedSignal;
+    bool complete;
+    bool result;
+    QString dir;
+};
+
+/* Calls a function when a descriptor is ready.  This handles the event rather
+ * than connecting to activated(), as that signal is overloaded in newer Qt */
+class Notifier : public QSocketNotifier
+{
+public:
+    Notifier(int fd, Type type, std::function<void()> callback) :
+        QSocketNotifier(fd, type),
+        callback(callback)
+    {
+    }
+
+protected:
+    bool event(QEvent *event) override
+    {
+        if (event->type() != QEvent::SockAct)
+            return QSocketNotifier::event(event);
+        callback();
+        return true;
+    }
+
+private:
+    std::function<void()> callback;
+};
+
+}
+
+class QLightDM::GreeterPrivate
+{
+public:
+    GreeterPrivate(Greeter *parent);
+    ~GreeterPrivate();
+
+    bool connectToDaemon();
+    bool flushMessages();
+    bool sendMessage();
+    bool waitForDaemon();
+    bool readMessages();
+    void dispatchMessages();
+    bool waitForRequest(Request *request);
+    void completeRequest(Request *request);
+    void connectionFailed();
+
+    bool sendConnect();
+    bool sendStartSession(const QString &session);
+    bool sendEnsureSharedDir(const QString &username);
+    void startAuthentication(const QString &username);
+    bool getBooleanHint(const QString &name) const;
+
+    void handleMessage(guint32 id, const guint8 *payload, gsize payloadLength);
+    void handleConnected(guint32 apiVersion, GHashTable *hints);
+    void handlePromptAuthentication(const GreeterProtocolPromptAuthentication &message);
+    void handleEndAuthentication(const GreeterProtocolEndAuthentication &message);
+    void handleReset(GHashTable *hints);
+    void handleSessionResult(guint32 result);
+    void handleSharedDirResult(const gchar *dir);
+
+    /* Connection to the daemon */
+    int toServerFd;
+    int fromServerFd;
+    bool ownsSocket;
+    QSocketNotifier *readNotifier;
+    QSocketNotifier *writeNotifier;
+
+    /* Data read from the daemon, messages before readOffset have been handled */
+    QByteArray readBuffer;
+    int readOffset;
+
+    /* Messages waiting to be written to the daemon */
+    GByteArray *writeBuffer;
+
+    bool resettable;
+    bool connected;
+    bool connecting;
+    guint32 apiVersion;
+    QHash<QString, QString> hints;
+    QTimer *autologinTimer;
+
+    QString authenticationUser;
+    bool inAuthentication;
+    bool isAuthenticated;
+    bool cancellingAuthentication;
+    guint32 authenticateSequenceNumber;
+
+    /* Sequence number of an autologin authentication sent before connected, or 0 */
+    guint32 pipelinedAutologinSequenceNumber;
+
+    int responsesWaiting;
+    QList<QByteArray> responsesReceived;
+
+    QList<Request *> connectRequests;
+    QList<Request *> startSessionRequests;
+    QList<Request *> sharedDirRequests;
+
+protected:
+    Greeter* q_ptr;
+
+private:
+    Q_DECLARE_PUBLIC(Greeter)
+};
+
+GreeterPrivate::GreeterPrivate(Greeter *parent) :
+    toServerFd(-1),
+    fromServerFd(-1),
+    ownsSocket(false),
+    readNotifier(NULL),
+    writeNotifier(NULL),
+    readOffset(0),
+    writeBuffer(g_byte_array_new()),
+    resettable(false),
+    connected(false),
+    connecting(false),
+    apiVersion(0),
+    autologinTimer(new QTimer()),
+    inAuthentication(false),
+    isAuthenticated(false),
+    cancellingAuthentication(false),
+    authenticateSequenceNumber(0),
+    pipelinedAutologinSequenceNumber(0),
+    responsesWaiting(0),
+    q_ptr(parent)
+{
+    autologinTimer->setSingleShot(true);
+    QObject::connect(autologinTimer, &QTimer::timeout, [this]() {
+        Q_EMIT q_func()->autologinTimerExpired();
+    });
+}
+
+GreeterPrivate::~GreeterPrivate()
+{
+    delete autologinTimer;
+    delete readNotifier;
+    delete writeNotifier;
+    if (ownsSocket)
+        close(fromServerFd);
+
+    /* Don't leave responses to prompts lying around */
+    memset(writeBuffer->data, 0, writeBuffer->len);
+    g_byte_array_unref(writeBuffer);
+    for (QByteArray &response : responsesReceived)
+        response.fill('\0');
+
+    /* Replies to these will never arrive */
+    qDeleteAll(connectRequests);
+    qDeleteAll(startSessionRequests);
+    qDeleteAll(sharedDirRequests);
+}
+
+bool GreeterPrivate::connectToDaemon()
+{
+    if (toServerFd >= 0)
+        return true;
+
+    /* Use private connection if one exists */
+    QByteArray toServerFdEnv = qgetenv("LIGHTDM_TO_SERVER_FD");
+    QByteArray fromServerFdEnv = qgetenv("LIGHTDM_FROM_SERVER_FD");
+    QByteArray pipePath = qgetenv("LIGHTDM_GREETER_PIPE");
+    if (!toServerFdEnv.isEmpty() && !fromServerFdEnv.isEmpty())
+    {
+        toServerFd = toServerFdEnv.toInt();
+        fromServerFd = fromServerFdEnv.toInt();
+    }
+    else if (!pipePath.isEmpty())
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            qWarning() << "Failed to create socket to daemon:" << strerror(errno);
+            return false;
+        }
+
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, pipePath.constData(), sizeof(address.sun_path) - 1);
+        if (::connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            qWarning() << "Failed to connect to daemon:" << strerror(errno);
+            close(fd);
+            return false;
+        }
+
+        toServerFd = fromServerFd = fd;
+        ownsSocket = true;
+    }
+    else
+    {
+        qWarning() << "Unable to determine socket to daemon";
+        return false;
+    }
+
+    /* Never block on the daemon, only the sync functions wait for it */
+    fcntl(toServerFd, F_SETFL, fcntl(toServerFd, F_GETFL) | O_NONBLOCK);
+    fcntl(fromServerFd, F_SETFL, fcntl(fromServerFd, F_GETFL) | O_NONBLOCK);
+
+    readNotifier = new Notifier(fromServerFd, QSocketNotifier::Read, [this]() {
+        if (readMessages())
+            dispatchMessages();
+    });
+    writeNotifier = new Notifier(toServerFd, QSocketNotifier::Write, [this]() {
+        flushMessages();
+    });
+    writeNotifier->setEnabled(false);
+
+    return true;
+}
+
+/* Write as much of the write buffer as the daemon will take */
+bool GreeterPrivate::flushMessages()
+{
+    guint offset = 0;
+    bool result = true;
+    while (offset < writeBuffer->len)
+    {
+        ssize_t nWritten = write(toServerFd, writeBuffer->data + offset, writeBuffer->len - offset);
+        if (nWritten < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            qWarning() << "Failed to write to daemon:" << strerror(errno);
+            result = false;
+
+            /* Drop the messages, the connection is broken */
+            offset = writeBuffer->len;
+            break;
+        }
+        offset += nWritten;
+    }
+
+    /* Don't leave responses to prompts lying around */
+    guint nRemaining = writeBuffer->len - offset;
+    memmove(writeBuffer->data, writeBuffer->data + offset, nRemaining);
+    memset(writeBuffer->data + nRemaining, 0, offset);
+    g_byte_array_set_size(writeBuffer, nRemaining);
+
+    /* Write the rest when the daemon is ready for it */
+    writeNotifier->setEnabled(nRemaining > 0);
+
+    return result;
+}
+
+/* Send the messages encoded in the write buffer, queueing what the daemon
+ * can't take yet */
+bool GreeterPrivate::sendMessage()
+{
+    if (!connectToDaemon())
+    {
+        memset(writeBuffer->data, 0, writeBuffer->len);
+        g_byte_array_set_size(writeBuffer, 0);
+        return false;
+    }
+
+    return flushMessages();
+}
+
+/* Block until the daemon has sent something, writing queued messages while waiting */
+bool GreeterPrivate::waitForDaemon()
+{
+    struct pollfd fds[2];
+    nfds_t nFds = 1;
+    fds[0].fd = fromServerFd;
+    fds[0].events = POLLIN;
+    if (writeBuffer->len > 0)
+    {
+        if (toServerFd == fromServerFd)
+            fds[0].events |= POLLOUT;
+        else
+        {
+            fds[1].fd = toServerFd;
+            fds[1].events = POLLOUT;
+            nFds++;
+        }
+    }
+
+    if (poll(fds, nFds, -1) < 0 && errno != EINTR)
+    {
+        qWarning() << "Failed to wait for daemon:" << strerror(errno);
+        return false;
+    }
+
+    if (writeBuffer->len > 0)
+        return flushMessages();
+
+    return true;
+}
+
+/* Read what the daemon has sent without blocking */
+bool GreeterPrivate::readMessages()
+{
+    /* Start from the beginning again once everything has been handled */
+    if (readOffset == readBuffer.size())
+    {
+        readBuffer.resize(0);
+        readOffset = 0;
+    }
+
+    const int chunkSize = 65536;
+    int nRead = readBuffer.size();
+    readBuffer.resize(nRead + chunkSize);
+    ssize_t n;
+    do
+        n = read(fromServerFd, readBuffer.data() + nRead, chunkSize);
+    while (n < 0 && errno == EINTR);
+    readBuffer.resize(nRead + (n > 0 ? n : 0));
+
+    if (n < 0 && errno == EAGAIN)
+        return true;
+    if (n <= 0)
+    {
+        if (n == 0)
+            qWarning() << "Failed to read from daemon: Connection closed";
+        else
+            qWarning() << "Failed to read from daemon:" << strerror(errno);
+        connectionFailed();
+        return false;
+    }
+
+    return true;
+}
+
+/* Handle all the complete messages that have been read */
+void GreeterPrivate::dispatchMessages()
+{
+    while (true)
+    {
+        const guint8 *data = reinterpret_cast<const guint8 *>(readBuffer.constData()) + readOffset;
+        gsize nUnread = readBuffer.size() - readOffset;
+        guint32 id;
+        gsize messageLength;
+        if (!greeter_protocol_read_header(data, nUnread, &id, &messageLength) || nUnread < messageLength)
+            return;
+
+        /* Copy the message, handlers may read more into the buffer */
+        QByteArray message(reinterpret_cast<const char *>(data), messageLength);
+        readOffset += messageLength;
+        handleMessage(id, reinterpret_cast<const guint8 *>(message.constData()) + GREETER_PROTOCOL_HEADER_SIZE, messageLength - GREETER_PROTOCOL_HEADER_SIZE);
+    }
+}
+
+/* Handle messages until the daemon replies to @request */
+bool GreeterPrivate::waitForRequest(Request *request)
+{
+    while (!request->complete)
+    {
+        if (!waitForDaemon())
+        {
+            connectionFailed();
+            return false;
+        }
+        if (readMessages())
+            dispatchMessages();
+    }
+
+    return true;
+}
+
+void GreeterPrivate::completeRequest(Request *request)
+{
+    Q_Q(Greeter);
+
+    request->complete = true;
+    if (!request->finishedSignal)
+        return;
+
+    /* Report the result from the event loop, as the GObject greeter does */
+    QMetaObject::invokeMethod(q, request->finishedSignal, Qt::QueuedConnection, Q_ARG(bool, request->result));
+    delete request;
+}
+
+/* Fail everything waiting for the daemon, as it will never reply */
+void GreeterPrivate::connectionFailed()
+{
+    if (readNotifier)
+        readNotifier->setEnabled(false);
+
+    QList<Request *> requests = connectRequests + startSessionRequests + sharedDirRequests;
+    connectRequests.clear();
+    startSessionRequests.clear();
+    sharedDirRequests.clear();
+    for (Request *request : requests)
+        completeRequest(request);
+}
+
+bool GreeterPrivate::sendConnect()
+{
+    GreeterProtocolConnect message = { 0 };
+    message.version = VERSION;
+    message.resettable = resettable ? 1 : 0;
+    message.api_version = API_VERSION;
+    // Not asking for the user list, UsersModel loads the users itself
+    message.capabilities = 0;
+    greeter_protocol_write_connect(writeBuffer, &message);
+    if (!sendMessage())
+        return false;
+
+    connecting = true;
+    return true;
+}
+
+bool GreeterPrivate::sendStartSession(const QString &session)
+{
+    QByteArray sessionData = session.toLocal8Bit();
+    GreeterProtocolStartSession message = { 0 };
+    message.session = session.isNull() ? NULL : sessionData.constData();
+    greeter_protocol_write_start_session(writeBuffer, &message);
+    return sendMessage();
+}
+
+bool GreeterPrivate::sendEnsureSharedDir(const QString &username)
+{
+    QByteArray usernameData = username.toLocal8Bit();
+    GreeterProtocolEnsureSharedDir message = { 0 };
+    message.username = usernameData.constData();
+    greeter_protocol_write_ensure_shared_dir(writeBuffer, &message);
+    return sendMessage();
+}
+
+void GreeterPrivate::startAuthentication(const QString &username)
+{
+    cancellingAuthentication = false;
+    authenticateSequenceNumber++;
+    inAuthentication = true;
+    isAuthenticated = false;
+    authenticationUser = username;
+}
+
+bool GreeterPrivate::getBooleanHint(const QString &name) const
+{
+    return hints.value(name) == QLatin1String("true");
+}
+
+static void addHints(QHash<QString, QString> &hints, GHashTable *table)
+{
+    GHashTableIter iter;
+    g_hash_table_iter_init(&iter, table);
+    gpointer name, value;
+    while (g_hash_table_iter_next(&iter, &name, &value))
+        hints.insert(QString::fromUtf8(static_cast<const gchar *>(name)), QString::fromUtf8(static_cast<const gchar *>(value)));
+}
+
+void GreeterPrivate::handleConnected(guint32 apiVersion, GHashTable *hints)
+{
+    Q_Q(Greeter);
+
+    this->apiVersion = apiVersion;
+    addHints(this->hints, hints);
+    connected = true;
+    connecting = false;
+
+    /* Daemons before API version 4 ignore autologin requests, so now we have the hints authenticate the way they understand */
+    guint32 autologinSequenceNumber = pipelinedAutologinSequenceNumber;
+    pipelinedAutologinSequenceNumber = 0;
+    if (apiVersion < 4 && autologinSequenceNumber != 0 &&
+        autologinSequenceNumber == authenticateSequenceNumber && inAuthentication)
+    {
+        if (!q->autologinGuestHint() && q->autologinUserHint().isEmpty())
+        {
+            inAuthentication = false;
+            isAuthenticated = false;
+            Q_EMIT q->authenticationComplete();
+        }
+        else
+            q->authenticateAutologin();
+    }
+
+    /* Set timeout for default login */
+    int timeout = q->autologinTimeoutHint();
+    if (timeout)
+        autologinTimer->start(timeout * 1000);
+
+    if (!connectRequests.isEmpty())
+    {
+        Request *request = connectRequests.takeFirst();
+        request->result = true;
+        completeRequest(request);
+    }
+}
+
+void GreeterPrivate::handlePromptAuthentication(const GreeterProtocolPromptAuthentication &message)
+{
+    Q_Q(Greeter);
+
+    if (message.sequence_number != authenticateSequenceNumber || cancellingAuthentication)
+        return;
+
+    /* Update username */
+    authenticationUser = QString::fromUtf8(message.username);
+
+    responsesReceived.clear();
+    responsesWaiting = 0;
+
+    for (gsize i = 0; i < message.n_prompts; i++)
+    {
+        QString text = QString::fromUtf8(message.prompts[i].text);
+
+        switch (message.prompts[i].style)
+        {
+        case PAM_PROMPT_ECHO_OFF:
+            responsesWaiting++;
+            Q_EMIT q->showPrompt(text, Greeter::PromptTypeSecret);
+            break;
+        case PAM_PROMPT_ECHO_ON:
+            responsesWaiting++;
+            Q_EMIT q->showPrompt(text, Greeter::PromptTypeQuestion);
+            break;
+        case PAM_ERROR_MSG:
+            Q_EMIT q->showMessage(text, Greeter::MessageTypeError);
+            break;
+        case PAM_TEXT_INFO:
+            Q_EMIT q->showMessage(text, Greeter::MessageTypeInfo);
+            break;
+        }
+    }
+}
+
+void GreeterPrivate::handleEndAuthentication(const GreeterProtocolEndAuthentication &message)
+{
+    Q_Q(Greeter);
+
+    if (message.sequence_number != authenticateSequenceNumber)
+        return;
+
+    /* Update username */
+    authenticationUser = QString::fromUtf8(message.username);
+
+    cancellingAuthentication = false;
+    isAuthenticated = (message.result == 0);
+
+    inAuthentication = false;
+    Q_EMIT q->authenticationComplete();
+}
+
+void GreeterPrivate::handleReset(GHashTable *hints)
+{
+    Q_Q(Greeter);
+
+    this->hints.clear();
+    addHints(this->hints, hints);
+
+    Q_EMIT q->reset();
+}
+
+void GreeterPrivate::handleSessionResult(guint32 result)
+{
+    if (startSessionRequests.isEmpty())
+        return;
+
+    Request *request = startSessionRequests.takeFirst();
+    request->result = result == 0;
+    completeRequest(request);
+}
+
+void GreeterPrivate::handleSharedDirResult(const gchar *dir)
+{
+    if (sharedDirRequests.isEmpty())
+        return;
+
+    /* Blank data dir means invalid user */
+    Request *request = sharedDirRequests.takeFirst();
+    request->dir = QString::fromUtf8(dir);
+    request->result = !request->dir.isEmpty();
+    completeRequest(request);
+}
+
+void GreeterPrivate::handleMessage(guint32 id, const guint8 *payload, gsize payloadLength)
+{
+    Q_Q(Greeter);
+
+    bool valid = true;
+    switch (id)
+    {
+    case SERVER_MESSAGE_CONNECTED:
+        {
+            g_auto(GreeterProtocolConnected) message = { 0 };
+            valid = greeter_protocol_read_connected(payload, payloadLength, &message);
+            if (valid)
+                handleConnected(0, message.hints);
+        }
+        break;
+    case SERVER_MESSAGE_PROMPT_AUTHENTICATION:
+        {
+            g_auto(GreeterProtocolPromptAuthentication) message = { 0 };
+            valid = greeter_protocol_read_prompt_authentication(payload, payloadLength, &message);
+            if (valid)
+                handlePromptAuthentication(message);
+        }
+        break;
+    case SERVER_MESSAGE_END_AUTHENTICATION:
+        {
+            g_auto(GreeterProtocolEndAuthentication) message = { 0 };
+            valid = greeter_protocol_read_end_authentication(payload, payloadLength, &message);
+            if (valid)
+                handleEndAuthentication(message);
+        }
+        break;
+    case SERVER_MESSAGE_SESSION_RESULT:
+        {
+            g_auto(GreeterProtocolSessionResult) message = { 0 };
+            valid = greeter_protocol_read_session_result(payload, payloadLength, &message);
+            if (valid)
+                handleSessionResult(message.result);
+        }
+        break;
+    case SERVER_MESSAGE_SHARED_DIR_RESULT:
+        {
+            g_auto(GreeterProtocolSharedDirResult) message = { 0 };
+            valid = greeter_protocol_read_shared_dir_result(payload, payloadLength, &message);
+            if (valid)
+                handleSharedDirResult(message.dir);
+        }
+        break;
+    case SERVER_MESSAGE_IDLE:
+        Q_EMIT q->idle();
+        break;
+    case SERVER_MESSAGE_RESET:
+        {
+            g_auto(GreeterProtocolReset) message = { 0 };
+            valid = greeter_protocol_read_reset(payload, payloadLength, &message);
+            if (valid)
+                handleReset(message.hints);
+        }
+        break;
+    case SERVER_MESSAGE_CONNECTED_V2:
+        {
+            g_auto(GreeterProtocolConnectedV2) message = { 0 };
+            valid = greeter_protocol_read_connected_v2(payload, payloadLength, &message);
+            if (valid)
+                handleConnected(message.api_version, message.hints);
+        }
+        break;
+    /* QLightDM::UsersModel gets users from liblightdm-gobject, and user images are never requested */
+    case SERVER_MESSAGE_USER_IMAGE_RESULT:
+    case SERVER_MESSAGE_USER_UPDATED:
+    case SERVER_MESSAGE_USER_REMOVED:
+    case SERVER_MESSAGE_USERS_UPDATED:
+        break;
+    default:
+        qWarning() << "Unknown message from server:" << id;
+        break;
+    }
+
+    if (!valid)
+        qWarning() << "Ignoring invalid message" << id << "from server";
+}
+
+Greeter::Greeter(QObject *parent) :
+    QObject(parent),
+    d_ptr(new GreeterPrivate(this))
+{
+}
+
+Greeter::~Greeter()
+{
+    delete d_ptr;
+}
+
+
+void Greeter::connectToDaemon()
+{
+    Q_D(Greeter);
+
+    Request *request = new Request("connectToDaemonFinished");
+    if (d->sendConnect())
+        d->connectRequests.append(request);
+    else
+        d->completeRequest(request);
+}
+
+bool Greeter::connectToDaemonSync()
+{
+    Q_D(Greeter);
+
+    if (!d->sendConnect())
+        return false;
+
+    Request request(NULL);
+    d->connectRequests.append(&request);
+    return d->waitForRequest(&request) && request.result;
+}
+
+bool Greeter::connectSync()
+{
+    return connectToDaemonSync();
+}
+
+void Greeter::authenticate(const QString &username)
+{
+    Q_D(Greeter);
+
+    if (!d->connected && !d->connecting)
+    {
+        qWarning() << "Can't authenticate, not connected to daemon";
+        return;
+    }
+
+    d->startAuthentication(username);
+
+    QByteArray usernameData = username.toLocal8Bit();
+    GreeterProtocolAuthenticate message = { 0 };
+    message.sequence_number = d->authenticateSequenceNumber;
+    message.username = username.isNull() ? NULL : usernameData.constData();
+    greeter_protocol_write_authenticate(d->writeBuffer, &message);
+    d->sendMessage();
+}
+
+void Greeter::authenticateAsGuest()
+{
+    Q_D(Greeter);
+
+    if (!d->connected && !d->connecting)
+    {
+        qWarning() << "Can't authenticate, not connected to daemon";
+        return;
+    }
+
+    d->startAuthentication(QString());
+
+    GreeterProtocolAuthenticateAsGuest message = { 0 };
+    message.sequence_number = d->authenticateSequenceNumber;
+    greeter_protocol_write_authenticate_as_guest(d->writeBuffer, &message);
+    d->sendMessage();
+}
+
+void Greeter::authenticateAutologin()
+{
+    Q_D(Greeter);
+
+    /* Let the daemon pick the user if we don't have the hints yet */
+    if (!d->connected && d->connecting)
+    {
+        d->startAuthentication(QString());
+        d->pipelinedAutologinSequenceNumber = d->authenticateSequenceNumber;
+
+        GreeterProtocolAuthenticateAutologin message = { 0 };
+        message.sequence_number = d->authenticateSequenceNumber;
+        greeter_protocol_write_authenticate_autologin(d->writeBuffer, &message);
+        d->sendMessage();
+    }
+    else if (autologinGuestHint())
+        authenticateAsGuest();
+    else if (!autologinUserHint().isEmpty())
+        authenticate(autologinUserHint());
+    else
+        qWarning() << "Can't authenticate autologin; autologin not configured";
+}
+
+void Greeter::authenticateRemote(const QString &session, const QString &username)
+{
+    Q_D(Greeter);
+
+    if (!d->connected)
+    {
+        qWarning() << "Can't authenticate, not connected to daemon";
+        return;
+    }
+
+    d->startAuthentication(QString());
+
+    QByteArray sessionData = session.toLocal8Bit();
+    QByteArray usernameData = username.toLocal8Bit();
+    GreeterProtocolAuthenticateRemote message = { 0 };
+    message.sequence_number = d->authenticateSequenceNumber;
+    message.session = sessionData.constData();
+    message.username = username.isNull() ? NULL : usernameData.constData();
+    greeter_protocol_write_authenticate_remote(d->writeBuffer, &message);
+    d->sendMessage();
+}
+
+void Greeter::respond(const QString &response)
+{
+    Q_D(Greeter);
+
+    if (!d->connected || d->responsesWaiting <= 0)
+    {
+        qWarning() << "Can't respond, not waiting for a response";
+        return;
+    }
+
+    d->responsesWaiting--;
+    d->responsesReceived.append(response.toLocal8Bit());
+
+    if (d->responsesWaiting == 0)
+    {
+        QVector<const gchar *> secrets;
+        for (const QByteArray &received : d->responsesReceived)
+            secrets.append(received.constData());
+        secrets.append(NULL);
+
+        GreeterProtocolContinueAuthentication message = { 0 };
+        message.secrets.values = secrets.constData();
+        greeter_protocol_write_continue_authentication(d->writeBuffer, &message);
+        d->sendMessage();
+
+        for (QByteArray &received : d->responsesReceived)
+            received.fill('\0');
+        d->responsesReceived.clear();
+    }
+}
+
+void Greeter::cancelAuthentication()
+{
+    Q_D(Greeter);
+
+    if (!d->connected)
+    {
+        qWarning() << "Can't cancel authentication, not connected to daemon";
+        return;
+    }
+
+    d->cancellingAuthentication = true;
+    GreeterProtocolCancelAuthentication message = { 0 };
+    greeter_protocol_write_cancel_authentication(d->writeBuffer, &message);
+    d->sendMessage();
+}
+
+void Greeter::cancelAutologin()
+{
+    Q_D(Greeter);
+    d->autologinTimer->stop();
+}
+
+bool Greeter::inAuthentication() const
+{
+    Q_D(const Greeter);
+    return d->inAuthentication;
+}
+
+bool Greeter::isAuthenticated() const
+{
+    Q_D(const Greeter);
+    return d->isAuthenticated;
+}
+
+QString Greeter::authenticationUser() const
+{
+    Q_D(const Greeter);
+    return d->authenticationUser;
+}
+
+void Greeter::setLanguage (const QString &language)
+{
+    Q_D(Greeter);
+
+    if (!d->connected)
+    {
+        qWarning() << "Can't set language, not connected to daemon";
+        return;
+    }
+
+    QByteArray languageData = language.toLocal8Bit();
+    GreeterProtocolSetLanguage message = { 0 };
+    message.language = languageData.constData();
+    greeter_protocol_write_set_language(d->writeBuffer, &message);
+    d->sendMessage();
+}
+
+void Greeter::setResettable (bool resettable)
+{
+    Q_D(Greeter);
+
+    if (d->connected)
+    {
+        qWarning() << "Can't change resettable after connecting to daemon";
+        return;
+    }
+
+    d->resettable = resettable;
+}
+
+void Greeter::startSession(const QString &session)
+{
+    Q_D(Greeter);
+
+    Request *request = new Request("startSessionFinished");
+    if (d->connected && d->sendStartSession(session))
+        d->startSessionRequests.append(request);
+    else
+        d->completeRequest(request);
+}
+
+bool Greeter::startSessionSync(const QString &session)
+{
+    Q_D(Greeter);
+
+    if (!d->connected || !d->sendStartSession(session))
+        return false;
+
+    Request request(NULL);
+    d->startSessionRequests.append(&request);
+    return d->waitForRequest(&request) && request.result;
+}
+
+QString Greeter::ensureSharedDataDirSync(const QString &username)
+{
+    Q_D(Greeter);
+
+    if (!d->connected || !d->sendEnsureSharedDir(username))
+        return QString();
+
+    Request request(NULL);
+    d->sharedDirRequests.append(&request);
+    if (!d->waitForRequest(&request))
+        return QString();
+    return request.dir;
+}
+
+
+QString Greeter::getHint(const QString &name) const
+{
+    Q_D(const Greeter);
+    return d->hints.value(name);
+}
+
+QString Greeter::defaultSessionHint() const
+{
+    return getHint(QStringLiteral("default-session"));
+}
+
+bool Greeter::hideUsersHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("hide-users"));
+}
+
+bool Greeter::showManualLoginHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("show-manual-login"));
+}
+
+bool Greeter::showRemoteLoginHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("show-remote-login"));
+}
+
+bool Greeter::lockHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("lock-screen"));
+}
+
+bool Greeter::hasGuestAccountHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("has-guest-account"));
+}
+
+QString Greeter::selectUserHint() const
+{
+    return getHint(QStringLiteral("select-user"));
+}
+
+bool Greeter::selectGuestHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("select-guest"));
+}
+
+QString Greeter::autologinUserHint() const
+{
+    return getHint(QStringLiteral("autologin-user"));
+}
+
+QString Greeter::autologinSessionHint() const
+{
+    return getHint(QStringLiteral("autologin-session"));
+}
+
+bool Greeter::autologinGuestHint() const
+{
+    Q_D(const Greeter);
+    return d->getBooleanHint(QStringLiteral("autologin-guest"));
+}
+
+int Greeter::autologinTimeoutHint() const
+{
+    int timeout = getHint(QStringLiteral("autologin-timeout")).toInt();
+    return timeout > 0 ? timeout : 0;
+}
+
+QString Greeter::hostname() const
+{
+    return QString::fromUtf8(lightdm_get_hostname());
+}
+
+QString Greeter::osName() const
+{
+    return QString::fromUtf8(lightdm_get_os_name());
+}
+
+QString Greeter::osId() const
+{
+    return QString::fromUtf8(lightdm_get_os_id());
+}
+
+QString Greeter::osPrettyName() const
+{
+    return QString::fromUtf8(lightdm_get_os_pretty_name());
+}
+
+QString Greeter::osVersion() const
+{
+    return QString::fromUtf8(lightdm_get_os_version());
+}
+
+QString Greeter::osVersionId() const
+{
+    return QString::fromUtf8(lightdm_get_os_version_id());
+}
+
+QString Greeter::motd() const
+{
+    return QString::fromUtf8(lightdm_get_motd());
+}
+
+#include "greeter_moc5.cpp"
@@ -25,10 +25,17 @@ class QLightDM::GreeterPrivate
 {
 public:
     GreeterPrivate(Greeter *parent);
+    ~GreeterPrivate();
     LightDMGreeter *ldmGreeter;
+
+    /* Cancelled when the greeter is destroyed so replies don't reach it */
+    GCancellable *cancellable;
 protected:
     Greeter* q_ptr;
 
+    static void cb_connectToDaemon(GObject *object, GAsyncResult *result, gpointer data);
+    static void cb_startSession(GObject *object, GAsyncResult *result, gpointer data);
+
     static void cb_showPrompt(LightDMGreeter *greeter, const gchar *text, LightDMPromptType type, gpointer data);
     static void cb_showMessage(LightDMGreeter *greeter, const gchar *text, LightDMMessageType type, gpointer data);
     static void cb_authenticationComplete(LightDMGreeter *greeter, gpointer data);
@@ -47,6 +54,7 @@ GreeterPrivate::GreeterPrivate(Greeter *parent) :
     g_type_init();
 #endif
     ldmGreeter = lightdm_greeter_new();
+    cancellable = g_cancellable_new();
 
     g_signal_connect (ldmGreeter, LIGHTDM_GREETER_SIGNAL_SHOW_PROMPT, G_CALLBACK (cb_showPrompt), this);
     g_signal_connect (ldmGreeter, LIGHTDM_GREETER_SIGNAL_SHOW_MESSAGE, G_CALLBACK (cb_showMessage), this);
@@ -56,6 +64,42 @@ GreeterPrivate::GreeterPrivate(Greeter *parent) :
     g_signal_connect (ldmGreeter, LIGHTDM_GREETER_SIGNAL_RESET, G_CALLBACK (cb_reset), this);
 }
 
+GreeterPrivate::~GreeterPrivate()
+{
+    g_cancellable_cancel(cancellable);
+    g_object_unref(cancellable);
+}
+
+void GreeterPrivate::cb_connectToDaemon(GObject *object, GAsyncResult *result, gpointer data)
+{
+    GError *error = NULL;
+    bool success = lightdm_greeter_connect_to_daemon_finish(LIGHTDM_GREETER(object), result, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+        g_error_free(error);
+        return;
+    }
+    g_clear_error(&error);
+
+    GreeterPrivate *that = static_cast<GreeterPrivate*>(data);
+    Q_EMIT that->q_func()->connectToDaemonFinished(success);
+}
+
+void GreeterPrivate::cb_startSession(GObject *object, GAsyncResult *result, gpointer data)
+{
+    GError *error = NULL;
+    bool success = lightdm_greeter_start_session_finish(LIGHTDM_GREETER(object), result, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+        g_error_free(error);
+        return;
+    }
+    g_clear_error(&error);
+
+    GreeterPrivate *that = static_cast<GreeterPrivate*>(data);
+    Q_EMIT that->q_func()->startSessionFinished(success);
+}
+
 void GreeterPrivate::cb_showPrompt(LightDMGreeter *greeter, const gchar *text, LightDMPromptType type, gpointer data)
 {
     Q_UNUSED(greeter);
@@ -118,6 +162,12 @@ Greeter::~Greeter()
 }
 
 
+void Greeter::connectToDaemon()
+{
+    Q_D(Greeter);
+    lightdm_greeter_connect_to_daemon(d->ldmGreeter, d->cancellable, GreeterPrivate::cb_connectToDaemon, d);
+}
+
 bool Greeter::connectToDaemonSync()
 {
     Q_D(Greeter);
@@ -202,6 +252,12 @@ void Greeter::setResettable (bool resettable)
     lightdm_greeter_set_resettable(d->ldmGreeter, resettable);
 }
 
+void Greeter::startSession(const QString &session)
+{
+    Q_D(Greeter);
+    lightdm_greeter_start_session(d->ldmGreeter, session.toLocal8Bit().constData(), d->cancellable, GreeterPrivate::cb_startSession, d);
+}
+
 bool Greeter::startSessionSync(const QString &session)
 {
     Q_D(Greeter);
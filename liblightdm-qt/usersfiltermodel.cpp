@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 or version 3 of the License.
+ * See http://www.gnu.org/copyleft/lgpl.html the full text of the license.
+ */
+
+#include "QLightDM/usersfiltermodel.h"
+
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include <algorithm>
+
+using namespace QLightDM;
+
+/* Fold case and drop accents so "jose" finds "José" */
+static QString normalise(const QString &text)
+{
+    QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString key;
+    key.reserve(decomposed.size());
+    for (int i = 0; i < decomposed.size(); i++) {
+        switch (decomposed[i].category()) {
+        case QChar::Mark_NonSpacing:
+        case QChar::Mark_SpacingCombining:
+        case QChar::Mark_Enclosing:
+            break;
+        default:
+            key.append(decomposed[i]);
+            break;
+        }
+    }
+
+    return key.toCaseFolded();
+}
+
+/* Offsets of the start of each word in text */
+static QList<int> wordStarts(const QString &text)
+{
+    QList<int> starts;
+    for (int i = 0; i < text.size(); i++) {
+        if (!text[i].isSpace() && (i == 0 || text[i - 1].isSpace()))
+            starts.append(i);
+    }
+
+    return starts;
+}
+
+namespace QLightDM {
+class UsersFilterModelPrivate {
+public:
+    UsersFilterModelPrivate(UsersFilterModel *parent);
+
+    QString filterText;
+
+    /* filterText as it is compared with the keys */
+    QString query;
+
+    /* Normalised name, real name and words of the real name for each source row */
+    QVector<QStringList> keys;
+
+    /* Source rows that match, in order */
+    QVector<int> matches;
+
+    QList<QMetaObject::Connection> connections;
+
+    QStringList makeKeys(int sourceRow) const;
+    bool isMatch(int sourceRow) const;
+    int proxyRow(int sourceRow) const;
+    void setMatches(const QVector<int> &newMatches);
+    QString highlight(const QString &text) const;
+
+    void reset();
+    void rowsInserted(int first, int last);
+    void rowsAboutToBeRemoved(int first, int last);
+    void rowsRemoved(int first, int last);
+    void dataChanged(int first, int last, const QVector<int> &roles);
+
+protected:
+    UsersFilterModel * const q_ptr;
+
+private:
+    Q_DECLARE_PUBLIC(UsersFilterModel)
+};
+}
+
+UsersFilterModelPrivate::UsersFilterModelPrivate(UsersFilterModel *parent) :
+    q_ptr(parent)
+{
+}
+
+QStringList UsersFilterModelPrivate::makeKeys(int sourceRow) const
+{
+    Q_Q(const UsersFilterModel);
+
+    QAbstractItemModel *source = q->sourceModel();
+    QModelIndex index = source->index(sourceRow, 0);
+    QString name = normalise(source->data(index, UsersModel::NameRole).toString());
+    QString realName = normalise(source->data(index, UsersModel::RealNameRole).toString());
+
+    QStringList keys;
+    keys.append(name);
+    Q_FOREACH (int start, wordStarts(realName))
+        keys.append(realName.mid(start));
+
+    return keys;
+}
+
+bool UsersFilterModelPrivate::isMatch(int sourceRow) const
+{
+    if (query.isEmpty())
+        return true;
+
+    Q_FOREACH (const QString &key, keys[sourceRow]) {
+        if (key.startsWith(query))
+            return true;
+    }
+
+    return false;
+}
+
+/* Position sourceRow has or would have in the matches */
+int UsersFilterModelPrivate::proxyRow(int sourceRow) const
+{
+    return std::lower_bound(matches.constBegin(), matches.constEnd(), sourceRow) - matches.constBegin();
+}
+
+/* Change the matches, removing and inserting as few row ranges as possible */
+void UsersFilterModelPrivate::setMatches(const QVector<int> &newMatches)
+{
+    Q_Q(UsersFilterModel);
+
+    // Remove from the end so earlier rows keep their position
+    int i = matches.size() - 1;
+    while (i >= 0) {
+        if (std::binary_search(newMatches.constBegin(), newMatches.constEnd(), matches[i])) {
+            i--;
+            continue;
+        }
+
+        int end = i;
+        while (i > 0 && !std::binary_search(newMatches.constBegin(), newMatches.constEnd(), matches[i - 1]))
+            i--;
+        q->beginRemoveRows(QModelIndex(), i, end);
+        matches.remove(i, end - i + 1);
+        q->endRemoveRows();
+        i--;
+    }
+
+    // What's left is a subset of the new matches, insert the rest in runs
+    i = 0;
+    while (i < newMatches.size()) {
+        int row = proxyRow(newMatches[i]);
+        if (row < matches.size() && matches[row] == newMatches[i]) {
+            i++;
+            continue;
+        }
+
+        int start = i;
+        while (i < newMatches.size() && (row >= matches.size() || newMatches[i] < matches[row]))
+            i++;
+        q->beginInsertRows(QModelIndex(), row, row + i - start - 1);
+        matches.insert(row, i - start, 0);
+        std::copy(newMatches.constBegin() + start, newMatches.constBegin() + i, matches.begin() + row);
+        q->endInsertRows();
+    }
+}
+
+/* Mark the part of text the query matched */
+QString UsersFilterModelPrivate::highlight(const QString &text) const
+{
+    if (query.isEmpty())
+        return text.toHtmlEscaped();
+
+    Q_FOREACH (int start, wordStarts(text)) {
+        QString word = text.mid(start);
+        if (!normalise(word).startsWith(query))
+            continue;
+
+        // Normalising can change the length, so find how much of the original matched
+        int length = 1;
+        while (length < word.size() && normalise(word.left(length)).size() < query.size())
+            length++;
+
+        return text.left(start).toHtmlEscaped() +
+               QStringLiteral("<b>") + word.left(length).toHtmlEscaped() + QStringLiteral("</b>") +
+               word.mid(length).toHtmlEscaped();
+    }
+
+    // Matched on something other than the displayed text
+    return text.toHtmlEscaped();
+}
+
+void UsersFilterModelPrivate::reset()
+{
+    Q_Q(UsersFilterModel);
+
+    keys.clear();
+    matches.clear();
+    int count = q->sourceModel() ? q->sourceModel()->rowCount(QModelIndex()) : 0;
+    keys.reserve(count);
+    for (int i = 0; i < count; i++) {
+        keys.append(makeKeys(i));
+        if (isMatch(i))
+            matches.append(i);
+    }
+}
+
+void UsersFilterModelPrivate::rowsInserted(int first, int last)
+{
+    Q_Q(UsersFilterModel);
+
+    int count = last - first + 1;
+    int row = proxyRow(first);
+    for (int i = row; i < matches.size(); i++)
+        matches[i] += count;
+
+    QVector<int> inserted;
+    for (int i = first; i <= last; i++) {
+        keys.insert(i, makeKeys(i));
+        if (isMatch(i))
+            inserted.append(i);
+    }
+
+    if (inserted.isEmpty())
+        return;
+    q->beginInsertRows(QModelIndex(), row, row + inserted.size() - 1);
+    matches.insert(row, inserted.size(), 0);
+    std::copy(inserted.constBegin(), inserted.constEnd(), matches.begin() + row);
+    q->endInsertRows();
+}
+
+void UsersFilterModelPrivate::rowsAboutToBeRemoved(int first, int last)
+{
+    Q_Q(UsersFilterModel);
+
+    int start = proxyRow(first);
+    int end = proxyRow(last + 1);
+    if (start == end)
+        return;
+
+    q->beginRemoveRows(QModelIndex(), start, end - 1);
+    matches.remove(start, end - start);
+    q->endRemoveRows();
+}
+
+void UsersFilterModelPrivate::rowsRemoved(int first, int last)
+{
+    int count = last - first + 1;
+    keys.remove(first, count);
+    for (int i = proxyRow(first); i < matches.size(); i++)
+        matches[i] -= count;
+}
+
+void UsersFilterModelPrivate::dataChanged(int first, int last, const QVector<int> &roles)
+{
+    Q_Q(UsersFilterModel);
+
+    bool namesChanged = roles.isEmpty() ||
+                        roles.contains(Qt::DisplayRole) ||
+                        roles.contains(UsersModel::NameRole) ||
+                        roles.contains(UsersModel::RealNameRole);
+    if (namesChanged) {
+        QVector<int> newMatches;
+        newMatches.reserve(matches.size());
+        newMatches += matches.mid(0, proxyRow(first));
+        for (int i = first; i <= last; i++) {
+            keys[i] = makeKeys(i);
+            if (isMatch(i))
+                newMatches.append(i);
+        }
+        newMatches += matches.mid(proxyRow(last + 1));
+        setMatches(newMatches);
+    }
+
+    int start = proxyRow(first);
+    int end = proxyRow(last + 1);
+    if (start == end)
+        return;
+
+    QVector<int> proxyRoles = roles;
+    if (namesChanged && !proxyRoles.isEmpty())
+        proxyRoles.append(UsersFilterModel::MatchHighlightRole);
+    Q_EMIT q->dataChanged(q->index(start, 0), q->index(end - 1, 0), proxyRoles);
+}
+
+UsersFilterModel::UsersFilterModel(QObject *parent) :
+    QAbstractProxyModel(parent),
+    d_ptr(new UsersFilterModelPrivate(this))
+{
+}
+
+UsersFilterModel::~UsersFilterModel()
+{
+    delete d_ptr;
+}
+
+QString UsersFilterModel::filterText() const
+{
+    Q_D(const UsersFilterModel);
+    return d->filterText;
+}
+
+void UsersFilterModel::setFilterText(const QString &text)
+{
+    Q_D(UsersFilterModel);
+
+    if (text == d->filterText)
+        return;
+    d->filterText = text;
+
+    QString query = normalise(text.trimmed());
+    if (query != d->query) {
+        // Anything that matches a longer query matched the shorter one, so only check those
+        bool narrowing = query.startsWith(d->query);
+        d->query = query;
+
+        QVector<int> newMatches;
+        if (narrowing) {
+            Q_FOREACH (int row, d->matches) {
+                if (d->isMatch(row))
+                    newMatches.append(row);
+            }
+        } else {
+            for (int row = 0; row < d->keys.size(); row++) {
+                if (d->isMatch(row))
+                    newMatches.append(row);
+            }
+        }
+        d->setMatches(newMatches);
+
+        if (!d->matches.isEmpty())
+            Q_EMIT dataChanged(index(0, 0), index(d->matches.size() - 1, 0), QVector<int>() << MatchHighlightRole);
+    }
+
+    Q_EMIT filterTextChanged(text);
+}
+
+void UsersFilterModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    Q_D(UsersFilterModel);
+
+    beginResetModel();
+
+    Q_FOREACH (const QMetaObject::Connection &connection, d->connections)
+        disconnect(connection);
+    d->connections.clear();
+
+    QAbstractProxyModel::setSourceModel(sourceModel);
+
+    if (sourceModel) {
+        d->connections
+            << connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset, this, [this]() { beginResetModel(); })
+            << connect(sourceModel, &QAbstractItemModel::modelReset, this, [this, d]() { d->reset(); endResetModel(); })
+            << connect(sourceModel, &QAbstractItemModel::layoutChanged, this, [this, d]() { beginResetModel(); d->reset(); endResetModel(); })
+            << connect(sourceModel, &QAbstractItemModel::rowsMoved, this, [this, d]() { beginResetModel(); d->reset(); endResetModel(); })
+            << connect(sourceModel, &QAbstractItemModel::rowsInserted, this,
+                       [d](const QModelIndex &parent, int first, int last) { if (!parent.isValid()) d->rowsInserted(first, last); })
+            << connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+                       [d](const QModelIndex &parent, int first, int last) { if (!parent.isValid()) d->rowsAboutToBeRemoved(first, last); })
+            << connect(sourceModel, &QAbstractItemModel::rowsRemoved, this,
+                       [d](const QModelIndex &parent, int first, int last) { if (!parent.isValid()) d->rowsRemoved(first, last); })
+            << connect(sourceModel, &QAbstractItemModel::dataChanged, this,
+                       [d](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) { d->dataChanged(topLeft.row(), bottomRight.row(), roles); });
+    }
+
+    d->reset();
+
+    endResetModel();
+}
+
+QHash<int, QByteArray> UsersFilterModel::roleNames() const
+{
+    QHash<int, QByteArray> roles = sourceModel() ? sourceModel()->roleNames() : QHash<int, QByteArray>();
+    roles[MatchHighlightRole] = "matchHighlight";
+
+    return roles;
+}
+
+QModelIndex UsersFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    Q_D(const UsersFilterModel);
+
+    if (parent.isValid() || column != 0 || row < 0 || row >= d->matches.size())
+        return QModelIndex();
+
+    return createIndex(row, column);
+}
+
+QModelIndex UsersFilterModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child)
+    return QModelIndex();
+}
+
+int UsersFilterModel::rowCount(const QModelIndex &parent) const
+{
+    Q_D(const UsersFilterModel);
+
+    if (parent.isValid())
+        return 0;
+
+    return d->matches.size();
+}
+
+int UsersFilterModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return 1;
+}
+
+QVariant UsersFilterModel::data(const QModelIndex &index, int role) const
+{
+    Q_D(const UsersFilterModel);
+
+    if (!index.isValid() || !sourceModel())
+        return QVariant();
+
+    if (role == MatchHighlightRole)
+        return d->highlight(sourceModel()->data(mapToSource(index), Qt::DisplayRole).toString());
+
+    return sourceModel()->data(mapToSource(index), role);
+}
+
+QModelIndex UsersFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    Q_D(const UsersFilterModel);
+
+    if (!proxyIndex.isValid() || !sourceModel() || proxyIndex.row() >= d->matches.size())
+        return QModelIndex();
+
+    return sourceModel()->index(d->matches[proxyIndex.row()], proxyIndex.column());
+}
+
+QModelIndex UsersFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    Q_D(const UsersFilterModel);
+
+    if (!sourceIndex.isValid())
+        return QModelIndex();
+
+    int row = d->proxyRow(sourceIndex.row());
+    if (row >= d->matches.size() || d->matches[row] != sourceIndex.row())
+        return QModelIndex();
+
+    return createIndex(row, sourceIndex.column());
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+#include "usersfiltermodel_moc5.cpp"
+#else
+#include "usersfiltermodel_moc4.cpp"
+#endif
@@ -11,8 +11,23 @@
 #include "QLightDM/usersmodel.h"
 
 #include <QtCore/QString>
+#include <QtCore/QCache>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
+#include <QtCore/QEvent>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtCore/qmath.h>
 #include <QtGui/QIcon>
+#include <QtGui/QImage>
+#include <QtGui/QPixmap>
 
 #include <lightdm.h>
 
@@ -21,11 +36,14 @@ using namespace QLightDM;
 class UserItem
 {
 public:
+    LightDMUser *ldmUser;
     QString name;
     QString realName;
     QString homeDirectory;
     QString image;
+    QString cachedImage;
     QString background;
+    QString cachedBackground;
     QString session;
     bool isLoggedIn;
     bool hasMessages;
@@ -43,6 +61,105 @@ QString UserItem::displayName() const {
     }
 }
 
+namespace QLightDM {
+class UsersModelPrivate;
+}
+
+namespace
+{
+
+/* Total size of the decoded images to keep, in KiB */
+const int IMAGE_CACHE_SIZE = 32 * 1024;
+
+const QEvent::Type ImageLoadedEventType = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+/* Sent from the thread pool when an image has been decoded */
+class ImageLoadedEvent : public QEvent
+{
+public:
+    ImageLoadedEvent(const QString &path, const QImage &image) :
+        QEvent(ImageLoadedEventType),
+        path(path),
+        image(image)
+    {
+    }
+
+    QString path;
+    QImage image;
+};
+
+/* Where decoded images are sent.  This is cleared when the cache is destroyed
+ * so images that finish loading afterwards are dropped */
+struct ImageReceiver
+{
+    QMutex mutex;
+    QObject *object;
+};
+
+/* Decodes an image off the GUI thread.  Only QImage can be used here, it is
+ * converted to a pixmap once it reaches the cache */
+class ImageLoader : public QRunnable
+{
+public:
+    ImageLoader(const QSharedPointer<ImageReceiver> &receiver, const QString &path) :
+        receiver(receiver),
+        path(path)
+    {
+    }
+
+    void run() override
+    {
+        QImage image(path);
+
+        QMutexLocker locker(&receiver->mutex);
+        if (receiver->object)
+            QCoreApplication::postEvent(receiver->object, new ImageLoadedEvent(path, image));
+    }
+
+private:
+    QSharedPointer<ImageReceiver> receiver;
+    QString path;
+};
+
+/* Pixmaps of the user images and backgrounds, shared by all the models so
+ * each file is only decoded once.  Exists while there are models */
+class ImageCache : public QObject
+{
+public:
+    static ImageCache *ref();
+    static void unref();
+
+    void addModel(QLightDM::UsersModelPrivate *model);
+    void removeModel(QLightDM::UsersModelPrivate *model);
+    bool lookup(const QString &path, QPixmap &pixmap);
+    void invalidate(const QString &path);
+
+protected:
+    bool event(QEvent *event) override;
+
+private:
+    ImageCache();
+    ~ImageCache();
+    void load(const QString &path);
+
+    static ImageCache *instance;
+    static int refCount;
+
+    QCache<QString, QPixmap> pixmaps;
+
+    /* Images being decoded, and those that changed while being decoded */
+    QSet<QString> loading;
+    QSet<QString> stale;
+
+    /* Images that couldn't be cached, these aren't decoded again until they change */
+    QSet<QString> failed;
+
+    QSharedPointer<ImageReceiver> receiver;
+    QList<QLightDM::UsersModelPrivate *> models;
+};
+
+}
+
 namespace QLightDM {
 class UsersModelPrivate {
 public:
@@ -50,30 +167,224 @@ public:
     virtual ~UsersModelPrivate();
     QList<UserItem> users;
 
+    /* Row of each user in users.  Found by the user rather than the name, so
+     * a renamed user keeps its row */
+    QHash<LightDMUser*, int> rows;
+
+    /* Users that have changed since the model was last updated, in the order
+     * they were reported.  These are applied together once control returns
+     * to the event loop, a reference is held until then */
+    QList<LightDMUser*> pendingUsers;
+    QSet<LightDMUser*> pendingSet;
+    QTimer flushTimer;
+
+    ImageCache *imageCache;
+
+    void imageLoaded(const QString &path);
+
     protected:
         UsersModel * const q_ptr;
 
         void loadUsers();
+        void indexRows(int first);
+        void queueUser(LightDMUser *ldmUser);
+        void flushUsers();
+        void emitDataChanged(int first, int last, const QVector<int> &roles);
 
-        static void cb_userAdded(LightDMUserList *user_list, LightDMUser *user, gpointer data);
-        static void cb_userChanged(LightDMUserList *user_list, LightDMUser *user, gpointer data);
-        static void cb_userRemoved(LightDMUserList *user_list, LightDMUser *user, gpointer data);
+        static QVector<int> updateUser(UserItem &user, LightDMUser *ldmUser);
+        static void cb_usersChanged(LightDMUserList *user_list, GList *added, GList *removed, GList *changed, gpointer data);
     private:
         Q_DECLARE_PUBLIC(UsersModel)
 };
 }
 
+ImageCache *ImageCache::instance = 0;
+int ImageCache::refCount = 0;
+
+ImageCache::ImageCache() :
+    pixmaps(IMAGE_CACHE_SIZE),
+    receiver(new ImageReceiver)
+{
+    receiver->object = this;
+}
+
+ImageCache::~ImageCache()
+{
+    QMutexLocker locker(&receiver->mutex);
+    receiver->object = 0;
+}
+
+ImageCache *ImageCache::ref()
+{
+    if (!instance)
+        instance = new ImageCache();
+    refCount++;
+    return instance;
+}
+
+void ImageCache::unref()
+{
+    refCount--;
+    if (refCount == 0) {
+        delete instance;
+        instance = 0;
+    }
+}
+
+void ImageCache::addModel(UsersModelPrivate *model)
+{
+    models.append(model);
+}
+
+void ImageCache::removeModel(UsersModelPrivate *model)
+{
+    models.removeAll(model);
+}
+
+/* Get the pixmap for an image.  Returns false and starts decoding it if it
+ * isn't ready, the models are told when it is */
+bool ImageCache::lookup(const QString &path, QPixmap &pixmap)
+{
+    if (path.isEmpty() || failed.contains(path))
+        return false;
+
+    QPixmap *cached = pixmaps.object(path);
+    if (cached) {
+        pixmap = *cached;
+        return true;
+    }
+
+    load(path);
+    return false;
+}
+
+/* Decode an image again as the file may have changed.  The old pixmap is
+ * used until the new one is ready so views don't flicker */
+void ImageCache::invalidate(const QString &path)
+{
+    if (loading.contains(path))
+        stale.insert(path);
+    else if (pixmaps.contains(path) || failed.remove(path))
+        load(path);
+}
+
+void ImageCache::load(const QString &path)
+{
+    if (loading.contains(path))
+        return;
+
+    loading.insert(path);
+    QThreadPool::globalInstance()->start(new ImageLoader(receiver, path));
+}
+
+bool ImageCache::event(QEvent *event)
+{
+    if (event->type() != ImageLoadedEventType)
+        return QObject::event(event);
+
+    ImageLoadedEvent *loaded = static_cast<ImageLoadedEvent*>(event);
+    loading.remove(loaded->path);
+
+    // The file changed while it was being decoded
+    if (stale.remove(loaded->path)) {
+        load(loaded->path);
+        return true;
+    }
+
+    // Scale down images larger than the whole cache, QCache won't keep them
+    QImage image = loaded->image;
+    int cost = qMax(1, image.width() * image.height() * image.depth() / 8 / 1024);
+    if (cost > pixmaps.maxCost()) {
+        qreal scale = qSqrt(qreal(pixmaps.maxCost()) / cost);
+        image = image.scaled(image.size() * scale, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    // Images that failed to load are kept as empty pixmaps so they aren't retried
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(image));
+    cost = qMax(1, pixmap->width() * pixmap->height() * pixmap->depth() / 8 / 1024);
+    if (!pixmaps.insert(loaded->path, pixmap, cost)) {
+        // The pixmap has been deleted, telling the models would only decode it again
+        failed.insert(loaded->path);
+        return true;
+    }
+
+    Q_FOREACH (UsersModelPrivate *model, models)
+        model->imageLoaded(loaded->path);
+
+    return true;
+}
+
 UsersModelPrivate::UsersModelPrivate(UsersModel* parent) :
+    imageCache(ImageCache::ref()),
     q_ptr(parent)
 {
 #if !defined(GLIB_VERSION_2_36)
     g_type_init();
 #endif
+    imageCache->addModel(this);
+
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(0);
+    QObject::connect(&flushTimer, &QTimer::timeout, [this]() { flushUsers(); });
 }
 
 UsersModelPrivate::~UsersModelPrivate()
 {
     g_signal_handlers_disconnect_by_data(lightdm_user_list_get_instance(), this);
+    Q_FOREACH (LightDMUser *ldmUser, pendingUsers)
+        g_object_unref(ldmUser);
+    Q_FOREACH (const UserItem &user, users)
+        g_object_unref(user.ldmUser);
+    imageCache->removeModel(this);
+    ImageCache::unref();
+}
+
+/* Update the rows showing an image that has finished decoding */
+void UsersModelPrivate::imageLoaded(const QString &path)
+{
+    Q_Q(UsersModel);
+
+    for (int i = 0; i < users.size(); i++) {
+        if (users[i].cachedImage != path && users[i].cachedBackground != path)
+            continue;
+        QModelIndex index = q->createIndex(i, 0);
+        if (users[i].cachedImage == path)
+            Q_EMIT q->dataChanged(index, index, QVector<int>() << Qt::DecorationRole);
+        if (users[i].cachedBackground == path)
+            Q_EMIT q->dataChanged(index, index, QVector<int>() << UsersModel::BackgroundRole);
+    }
+}
+
+template <typename T>
+static void updateField(T &field, const T &value, QVector<int> &roles, int role, int otherRole = -1)
+{
+    if (field == value)
+        return;
+
+    field = value;
+    if (!roles.contains(role))
+        roles.append(role);
+    if (otherRole >= 0 && !roles.contains(otherRole))
+        roles.append(otherRole);
+}
+
+/* Copy the user into the item, returning the roles that changed */
+QVector<int> UsersModelPrivate::updateUser(UserItem &user, LightDMUser *ldmUser)
+{
+    QVector<int> roles;
+    updateField(user.name, QString::fromUtf8(lightdm_user_get_name(ldmUser)), roles, UsersModel::NameRole, Qt::DisplayRole);
+    user.homeDirectory = QString::fromUtf8(lightdm_user_get_home_directory(ldmUser));
+    updateField(user.realName, QString::fromUtf8(lightdm_user_get_real_name(ldmUser)), roles, UsersModel::RealNameRole, Qt::DisplayRole);
+    updateField(user.image, QString::fromUtf8(lightdm_user_get_image(ldmUser)), roles, UsersModel::ImagePathRole);
+    updateField(user.cachedImage, QString::fromUtf8(lightdm_user_get_cached_image(ldmUser)), roles, Qt::DecorationRole);
+    updateField(user.background, QString::fromUtf8(lightdm_user_get_background(ldmUser)), roles, UsersModel::BackgroundPathRole);
+    updateField(user.cachedBackground, QString::fromUtf8(lightdm_user_get_cached_background(ldmUser)), roles, UsersModel::BackgroundRole);
+    updateField(user.session, QString::fromUtf8(lightdm_user_get_session(ldmUser)), roles, UsersModel::SessionRole);
+    updateField(user.isLoggedIn, (bool) lightdm_user_get_logged_in(ldmUser), roles, UsersModel::LoggedInRole);
+    updateField(user.hasMessages, (bool) lightdm_user_get_has_messages(ldmUser), roles, UsersModel::HasMessagesRole);
+    updateField(user.uid, (quint64) lightdm_user_get_uid(ldmUser), roles, UsersModel::UidRole);
+    updateField(user.isLocked, (bool) lightdm_user_get_is_locked(ldmUser), roles, UsersModel::IsLockedRole);
+    return roles;
 }
 
 void UsersModelPrivate::loadUsers()
@@ -92,92 +403,150 @@ void UsersModelPrivate::loadUsers()
         for (item = items; item; item = item->next) {
             LightDMUser *ldmUser = static_cast<LightDMUser*>(item->data);
 
-            UserItem user;
-            user.name = QString::fromUtf8(lightdm_user_get_name(ldmUser));
-            user.homeDirectory = QString::fromUtf8(lightdm_user_get_home_directory(ldmUser));
-            user.realName = QString::fromUtf8(lightdm_user_get_real_name(ldmUser));
-            user.image = QString::fromUtf8(lightdm_user_get_image(ldmUser));
-            user.background = QString::fromUtf8(lightdm_user_get_background(ldmUser));
-            user.session = QString::fromUtf8(lightdm_user_get_session(ldmUser));
-            user.isLoggedIn = lightdm_user_get_logged_in(ldmUser);
-            user.hasMessages = lightdm_user_get_has_messages(ldmUser);
-            user.uid = (quint64)lightdm_user_get_uid(ldmUser);
-            user.isLocked = lightdm_user_get_is_locked(ldmUser);
+            UserItem user = UserItem();
+            user.ldmUser = static_cast<LightDMUser*>(g_object_ref(ldmUser));
+            updateUser(user, ldmUser);
             users.append(user);
         }
+        indexRows(0);
 
         q->endInsertRows();
     }
-    g_signal_connect(lightdm_user_list_get_instance(), LIGHTDM_USER_LIST_SIGNAL_USER_ADDED, G_CALLBACK (cb_userAdded), this);
-    g_signal_connect(lightdm_user_list_get_instance(), LIGHTDM_USER_LIST_SIGNAL_USER_CHANGED, G_CALLBACK (cb_userChanged), this);
-    g_signal_connect(lightdm_user_list_get_instance(), LIGHTDM_USER_LIST_SIGNAL_USER_REMOVED, G_CALLBACK (cb_userRemoved), this);
+    g_signal_connect(lightdm_user_list_get_instance(), LIGHTDM_USER_LIST_SIGNAL_USERS_CHANGED, G_CALLBACK (cb_usersChanged), this);
 }
 
-void UsersModelPrivate::cb_userAdded(LightDMUserList *user_list, LightDMUser *ldmUser, gpointer data)
+/* Update the index for the rows from first onwards after they have moved */
+void UsersModelPrivate::indexRows(int first)
 {
-    Q_UNUSED(user_list)
-    UsersModelPrivate *that = static_cast<UsersModelPrivate*>(data);
-
-    that->q_func()->beginInsertRows(QModelIndex(), that->users.size(), that->users.size());
-
-    UserItem user;
-    user.name = QString::fromUtf8(lightdm_user_get_name(ldmUser));
-    user.homeDirectory = QString::fromUtf8(lightdm_user_get_home_directory(ldmUser));
-    user.realName = QString::fromUtf8(lightdm_user_get_real_name(ldmUser));
-    user.image = QString::fromUtf8(lightdm_user_get_image(ldmUser));
-    user.background = QString::fromUtf8(lightdm_user_get_background(ldmUser));
-    user.isLoggedIn = lightdm_user_get_logged_in(ldmUser);
-    user.hasMessages = lightdm_user_get_has_messages(ldmUser);
-    user.uid = (quint64)lightdm_user_get_uid(ldmUser);
-    user.isLocked = lightdm_user_get_is_locked(ldmUser);
-    that->users.append(user);
+    for (int i = first; i < users.size(); i++)
+        rows.insert(users[i].ldmUser, i);
+}
 
-    that->q_func()->endInsertRows();
+void UsersModelPrivate::queueUser(LightDMUser *ldmUser)
+{
+    if (pendingSet.contains(ldmUser))
+        return;
 
+    pendingSet.insert(ldmUser);
+    pendingUsers.append(static_cast<LightDMUser*>(g_object_ref(ldmUser)));
+    flushTimer.start();
 }
 
-void UsersModelPrivate::cb_userChanged(LightDMUserList *user_list, LightDMUser *ldmUser, gpointer data)
+void UsersModelPrivate::cb_usersChanged(LightDMUserList *user_list, GList *added, GList *removed, GList *changed, gpointer data)
 {
     Q_UNUSED(user_list)
     UsersModelPrivate *that = static_cast<UsersModelPrivate*>(data);
 
-    QString userToChange = QString::fromUtf8(lightdm_user_get_name(ldmUser));
+    // Only note who changed, the user list is checked when the changes are applied
+    for (GList *link = removed; link; link = link->next)
+        that->queueUser(static_cast<LightDMUser*>(link->data));
+    for (GList *link = changed; link; link = link->next)
+        that->queueUser(static_cast<LightDMUser*>(link->data));
+    for (GList *link = added; link; link = link->next)
+        that->queueUser(static_cast<LightDMUser*>(link->data));
+}
+
+void UsersModelPrivate::emitDataChanged(int first, int last, const QVector<int> &roles)
+{
+    Q_Q(UsersModel);
+    Q_EMIT q->dataChanged(q->createIndex(first, 0), q->createIndex(last, 0), roles);
+}
+
+/* Bring the rows up to date with the users that changed since the last update,
+ * using as few row ranges as possible so views don't have to do more work */
+void UsersModelPrivate::flushUsers()
+{
+    Q_Q(UsersModel);
 
-    for (int i=0;i<that->users.size();i++) {
-        if (that->users[i].name == userToChange) {
+    LightDMUserList *userList = lightdm_user_list_get_instance();
 
-            that->users[i].homeDirectory = QString::fromUtf8(lightdm_user_get_home_directory(ldmUser));
-            that->users[i].realName = QString::fromUtf8(lightdm_user_get_real_name(ldmUser));
-            that->users[i].image = QString::fromUtf8(lightdm_user_get_image(ldmUser));
-            that->users[i].background = QString::fromUtf8(lightdm_user_get_background(ldmUser));
-            that->users[i].isLoggedIn = lightdm_user_get_logged_in(ldmUser);
-            that->users[i].hasMessages = lightdm_user_get_has_messages(ldmUser);
-            that->users[i].uid = (quint64)lightdm_user_get_uid(ldmUser);
-            that->users[i].isLocked = lightdm_user_get_is_locked(ldmUser);
+    QSet<int> removedRows;
+    QMap<int, QVector<int> > changedRows;
+    QList<LightDMUser*> addedUsers;
+    Q_FOREACH (LightDMUser *ldmUser, pendingUsers) {
+        int row = rows.value(ldmUser, -1);
 
-            QModelIndex index = that->q_ptr->createIndex(i, 0);
-            that->q_ptr->dataChanged(index, index);
-            break;
+        // Removed users are no longer in the list, though a new user may have their name
+        if (lightdm_user_list_get_user_by_name(userList, lightdm_user_get_name(ldmUser)) != ldmUser) {
+            if (row >= 0)
+                removedRows.insert(row);
+            continue;
         }
-    }
-}
 
+        if (row < 0) {
+            addedUsers.append(ldmUser);
+            continue;
+        }
 
-void UsersModelPrivate::cb_userRemoved(LightDMUserList *user_list, LightDMUser *ldmUser, gpointer data)
-{
-    Q_UNUSED(user_list)
+        // A new image can be copied to the same cached path, so decode it again
+        QVector<int> roles = updateUser(users[row], ldmUser);
+        if (roles.contains(UsersModel::ImagePathRole) || roles.contains(Qt::DecorationRole))
+            imageCache->invalidate(users[row].cachedImage);
+        if (roles.contains(UsersModel::BackgroundPathRole) || roles.contains(UsersModel::BackgroundRole))
+            imageCache->invalidate(users[row].cachedBackground);
+        if (!roles.isEmpty())
+            changedRows.insert(row, roles);
+    }
+    QList<LightDMUser*> doneUsers = pendingUsers;
+    pendingUsers.clear();
+    pendingSet.clear();
+
+    // Report changes before removing rows so the row numbers are still correct,
+    // joining neighbouring rows where the same roles changed
+    int first = -1, last = -1;
+    QVector<int> roles;
+    for (QMap<int, QVector<int> >::const_iterator i = changedRows.constBegin(); i != changedRows.constEnd(); ++i) {
+        if (first >= 0 && i.key() == last + 1 && i.value() == roles) {
+            last = i.key();
+            continue;
+        }
+        if (first >= 0)
+            emitDataChanged(first, last, roles);
+        first = last = i.key();
+        roles = i.value();
+    }
+    if (first >= 0)
+        emitDataChanged(first, last, roles);
+
+    // Remove rows from the end so earlier rows keep their position, one range at a time
+    int firstMoved = users.size();
+    int i = users.size() - 1;
+    while (!removedRows.isEmpty() && i >= 0) {
+        if (!removedRows.contains(i)) {
+            i--;
+            continue;
+        }
 
-    UsersModelPrivate *that = static_cast<UsersModelPrivate*>(data);
-    QString userToRemove = QString::fromUtf8(lightdm_user_get_name(ldmUser));
-
-    for (int i=0;i<that->users.size();i++) {
-        if (that->users[i].name == userToRemove) {
-            that->q_ptr->beginRemoveRows(QModelIndex(), i, i);
-            that->users.removeAt(i);
-            that->q_ptr->endRemoveRows();
-            break;
+        int end = i;
+        while (i > 0 && removedRows.contains(i - 1))
+            i--;
+        q->beginRemoveRows(QModelIndex(), i, end);
+        for (int j = end; j >= i; j--) {
+            rows.remove(users[j].ldmUser);
+            g_object_unref(users[j].ldmUser);
+            users.removeAt(j);
+        }
+        q->endRemoveRows();
+        firstMoved = i;
+        i--;
+    }
+    indexRows(firstMoved);
+
+    if (!addedUsers.isEmpty()) {
+        int start = users.size();
+        q->beginInsertRows(QModelIndex(), start, start + addedUsers.size() - 1);
+        Q_FOREACH (LightDMUser *ldmUser, addedUsers) {
+            UserItem user = UserItem();
+            user.ldmUser = static_cast<LightDMUser*>(g_object_ref(ldmUser));
+            updateUser(user, ldmUser);
+            users.append(user);
         }
+        indexRows(start);
+        q->endInsertRows();
     }
+
+    Q_FOREACH (LightDMUser *ldmUser, doneUsers)
+        g_object_unref(ldmUser);
 }
 
 UsersModel::UsersModel(QObject *parent) :
@@ -235,8 +604,13 @@ QVariant UsersModel::data(const QModelIndex &index, int role) const
     switch (role) {
     case Qt::DisplayRole:
         return d->users[row].displayName();
-    case Qt::DecorationRole:
-        return QIcon(d->users[row].image);
+    case Qt::DecorationRole: {
+        // Empty until the image has been decoded
+        QPixmap image;
+        if (d->imageCache->lookup(d->users[row].cachedImage, image))
+            return QIcon(image);
+        return QIcon();
+    }
     case UsersModel::NameRole:
         return d->users[row].name;
     case UsersModel::RealNameRole:
@@ -245,8 +619,11 @@ QVariant UsersModel::data(const QModelIndex &index, int role) const
         return d->users[row].session;
     case UsersModel::LoggedInRole:
         return d->users[row].isLoggedIn;
-    case UsersModel::BackgroundRole:
-        return QPixmap(d->users[row].background);
+    case UsersModel::BackgroundRole: {
+        QPixmap background;
+        d->imageCache->lookup(d->users[row].cachedBackground, background);
+        return background;
+    }
     case UsersModel::BackgroundPathRole:
         return d->users[row].background;
     case UsersModel::HasMessagesRole:
@@ -11,6 +11,8 @@
 #include <config.h>
 
 #include "display-manager-service.h"
+#include "greeter-latency.h"
+#include "user-list.h"
 
 enum {
     READY,
@@ -208,6 +210,24 @@ handle_display_manager_get_property (GDBusConnection       *connection,
         return get_seat_list (service);
     else if (g_strcmp0 (property_name, "Sessions") == 0)
         return get_session_list (service, NULL);
+    else if (g_strcmp0 (property_name, "GreeterLatencyBuckets") == 0)
+        return greeter_latency_get_buckets ();
+    else if (g_strcmp0 (property_name, "GreeterMessageLatencies") == 0)
+        return greeter_latency_get_messages ();
+    else if (g_strcmp0 (property_name, "GreeterPromptResponseLatency") == 0)
+        return greeter_latency_get_prompt_response ();
+    else if (g_strcmp0 (property_name, "UserListReloads") == 0)
+    {
+        guint n_reloads;
+        common_user_list_get_reload_counts (common_user_list_get_instance (), &n_reloads, NULL);
+        return g_variant_new_uint32 (n_reloads);
+    }
+    else if (g_strcmp0 (property_name, "UserListSkippedReloads") == 0)
+    {
+        guint n_skipped_reloads;
+        common_user_list_get_reload_counts (common_user_list_get_instance (), NULL, &n_skipped_reloads);
+        return g_variant_new_uint32 (n_skipped_reloads);
+    }
 
     return NULL;
 }
@@ -542,6 +562,21 @@ bus_acquired_cb (GDBusConnection *connection,
         "  <interface name='org.freedesktop.DisplayManager'>"
         "    <property name='Seats' type='ao' access='read'/>"
         "    <property name='Sessions' type='ao' access='read'/>"
+        "    <property name='GreeterLatencyBuckets' type='at' access='read'>"
+        "      <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal' value='const'/>"
+        "    </property>"
+        "    <property name='GreeterMessageLatencies' type='a{s(ttat)}' access='read'>"
+        "      <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal' value='false'/>"
+        "    </property>"
+        "    <property name='GreeterPromptResponseLatency' type='(ttat)' access='read'>"
+        "      <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal' value='false'/>"
+        "    </property>"
+        "    <property name='UserListReloads' type='u' access='read'>"
+        "      <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal' value='false'/>"
+        "    </property>"
+        "    <property name='UserListSkippedReloads' type='u' access='read'>"
+        "      <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal' value='false'/>"
+        "    </property>"
         "    <method name='AddSeat'>"
         "      <arg name='type' direction='in' type='s'/>"
         "      <arg name='properties' direction='in' type='a(ss)'/>"
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include "greeter-latency.h"
+#include "greeter-protocol.h"
+
+/* Histograms of how long the greeter protocol takes, for monitoring login
+ * latency.  Each histogram counts durations in fixed buckets so recording
+ * a value never allocates, and is shared by all the greeters. */
+
+/* Upper bound of each bucket in microseconds, from the time taken to handle
+ * a message to the time a user takes to type a password.  There is one more
+ * bucket for anything longer. */
+static const guint64 bucket_bounds[] =
+{
+    100, 250, 500,
+    1000, 2500, 5000,
+    10000, 25000, 50000,
+    100000, 250000, 500000,
+    1000000, 2500000, 5000000,
+    10000000, 30000000, 60000000
+};
+#define N_BUCKETS (G_N_ELEMENTS (bucket_bounds) + 1)
+
+typedef struct
+{
+    guint64 count;
+    guint64 total;
+    guint64 buckets[N_BUCKETS];
+} Histogram;
+
+#define MESSAGE_NAME(id, value, name, TypeName, fields) [value] = #name,
+static const gchar *message_names[] =
+{
+    GREETER_PROTOCOL_GREETER_MESSAGES (MESSAGE_NAME, )
+};
+#undef MESSAGE_NAME
+
+static Histogram message_histograms[G_N_ELEMENTS (message_names)];
+static Histogram prompt_response_histogram;
+
+static void
+histogram_add (Histogram *histogram, gint64 duration)
+{
+    guint64 value = MAX (duration, 0);
+
+    gsize bucket = 0;
+    while (bucket < G_N_ELEMENTS (bucket_bounds) && value > bucket_bounds[bucket])
+        bucket++;
+
+    histogram->count++;
+    histogram->total += value;
+    histogram->buckets[bucket]++;
+}
+
+static GVariant *
+histogram_to_variant (const Histogram *histogram)
+{
+    GVariant *buckets = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, histogram->buckets, N_BUCKETS, sizeof (guint64));
+    return g_variant_new ("(tt@at)", histogram->count, histogram->total, buckets);
+}
+
+/**
+ * greeter_latency_add_message:
+ * @id: ID of the message from the greeter
+ * @duration: Microseconds taken to handle the message
+ *
+ * Record the time taken to handle a greeter message.
+ **/
+void
+greeter_latency_add_message (guint32 id, gint64 duration)
+{
+    if (id >= G_N_ELEMENTS (message_names) || message_names[id] == NULL)
+        return;
+
+    histogram_add (&message_histograms[id], duration);
+}
+
+/**
+ * greeter_latency_add_prompt_response:
+ * @duration: Microseconds from sending a PAM prompt to the greeter responding
+ *
+ * Record the time taken for the greeter to respond to an authentication prompt.
+ **/
+void
+greeter_latency_add_prompt_response (gint64 duration)
+{
+    histogram_add (&prompt_response_histogram, duration);
+}
+
+/**
+ * greeter_latency_get_buckets:
+ *
+ * Get the upper bound of each bucket in microseconds.  Histograms have one
+ * more bucket than this for longer durations.
+ *
+ * Return value: A floating #GVariant of type "at"
+ **/
+GVariant *
+greeter_latency_get_buckets (void)
+{
+    return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, bucket_bounds, G_N_ELEMENTS (bucket_bounds), sizeof (guint64));
+}
+
+/**
+ * greeter_latency_get_messages:
+ *
+ * Get the histograms of the time taken to handle each greeter message, keyed
+ * by the message name.  Each is the number of messages, the total time in
+ * microseconds and the count in each bucket.
+ *
+ * Return value: A floating #GVariant of type "a{s(ttat)}"
+ **/
+GVariant *
+greeter_latency_get_messages (void)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(ttat)}"));
+    for (gsize i = 0; i < G_N_ELEMENTS (message_names); i++)
+    {
+        if (message_names[i])
+            g_variant_builder_add (&builder, "{s@(ttat)}", message_names[i], histogram_to_variant (&message_histograms[i]));
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+/**
+ * greeter_latency_get_prompt_response:
+ *
+ * Get the histogram of the time from prompting the greeter for authentication
+ * to it responding.
+ *
+ * Return value: A floating #GVariant of type "(ttat)"
+ **/
+GVariant *
+greeter_latency_get_prompt_response (void)
+{
+    return histogram_to_variant (&prompt_response_histogram);
+}
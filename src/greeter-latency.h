@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef GREETER_LATENCY_H_
+#define GREETER_LATENCY_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void greeter_latency_add_message (guint32 id, gint64 duration);
+
+void greeter_latency_add_prompt_response (gint64 duration);
+
+GVariant *greeter_latency_get_buckets (void);
+
+GVariant *greeter_latency_get_messages (void);
+
+GVariant *greeter_latency_get_prompt_response (void);
+
+G_END_DECLS
+
+#endif /* GREETER_LATENCY_H_ */
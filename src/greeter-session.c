@@ -14,8 +14,11 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 
 #include "greeter-session.h"
+#include "user-image-cache.h"
+#include "user-list-cache.h"
 
 typedef struct
 {
@@ -44,9 +47,10 @@ greeter_session_start (Session *session)
 {
     GreeterSessionPrivate *priv = greeter_session_get_instance_private (GREETER_SESSION (session));
 
-    /* Create a pipe to talk with the greeter */
+    /* Create a pipe to talk with the greeter.
+     * Data to the greeter goes over a socket so file descriptors can be passed with it */
     int to_greeter_pipe[2], from_greeter_pipe[2];
-    if (pipe (to_greeter_pipe) != 0 || pipe (from_greeter_pipe) != 0)
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, to_greeter_pipe) != 0 || pipe (from_greeter_pipe) != 0)
     {
         g_warning ("Failed to create pipes: %s", strerror (errno));
         return FALSE;
@@ -62,12 +66,33 @@ greeter_session_start (Session *session)
     fcntl (to_greeter_input, F_SETFD, FD_CLOEXEC);
     fcntl (from_greeter_output, F_SETFD, FD_CLOEXEC);
 
+    /* Never block the daemon on a greeter that isn't reading */
+    fcntl (to_greeter_input, F_SETFL, O_NONBLOCK);
+
     /* Let the greeter session know how to communicate with the daemon */
     g_autofree gchar *to_server_value = g_strdup_printf ("%d", from_greeter_input);
     session_set_env (session, "LIGHTDM_TO_SERVER_FD", to_server_value);
     g_autofree gchar *from_server_value = g_strdup_printf ("%d", to_greeter_output);
     session_set_env (session, "LIGHTDM_FROM_SERVER_FD", from_server_value);
 
+    /* Let the greeter start with the last snapshot, it is kept up to date in the background */
+    UserListCache *user_list_cache = user_list_cache_get_instance ();
+    if (user_list_cache_get_path (user_list_cache))
+    {
+        session_set_env (session, "LIGHTDM_USER_LIST_SNAPSHOT", user_list_cache_get_path (user_list_cache));
+        guint64 generation = user_list_cache_get_generation (user_list_cache);
+        if (generation != 0)
+        {
+            g_autofree gchar *generation_value = g_strdup_printf ("%" G_GUINT64_FORMAT, generation);
+            session_set_env (session, "LIGHTDM_USER_LIST_GENERATION", generation_value);
+        }
+    }
+
+    /* Let the greeter use local copies of user images */
+    const gchar *image_cache_dir = user_image_cache_get_directory (user_image_cache_get_instance ());
+    if (image_cache_dir)
+        session_set_env (session, "LIGHTDM_USER_IMAGE_CACHE", image_cache_dir);
+
     gboolean result = SESSION_CLASS (greeter_session_parent_class)->start (session);
 
     /* Close the session ends of the pipe */
@@ -10,13 +10,22 @@
 
 #include <config.h>
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
-#include <gcrypt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "greeter.h"
 #include "configuration.h"
+#include "greeter-latency.h"
+#include "greeter-protocol.h"
+#include "greeter-trace.h"
+#include "secret-arena.h"
 #include "shared-data-manager.h"
+#include "user-image-cache.h"
+#include "user-list.h"
 
 enum {
     PROP_ACTIVE_USERNAME = 1,
@@ -37,10 +46,10 @@ typedef struct
     gchar *pam_service;
     gchar *autologin_pam_service;
 
-    /* Buffer for data read from greeter */
+    /* Buffer for data read from greeter, reused for every message */
     guint8 *read_buffer;
+    gsize read_buffer_size;
     gsize n_read;
-    gboolean use_secure_memory;
 
     /* Hints for the greeter */
     GHashTable *hints;
@@ -51,6 +60,9 @@ typedef struct
     /* Sequence number of current PAM session */
     guint32 authentication_sequence_number;
 
+    /* Time the greeter was last prompted for authentication, or 0 if it has responded */
+    gint64 prompt_time;
+
     /* Remote session name */
     gchar *remote_session;
 
@@ -86,44 +98,38 @@ typedef struct
      */
     gboolean have_sent_end_authentication;
 
+    /* User list being sent to the greeter */
+    CommonUserList *user_list;
+
+    /* Users sent to the greeter and the name they were sent with */
+    GHashTable *sent_users;
+
     /* Communication channels to communicate with */
     int to_greeter_input;
-    int from_greeter_output;
+    gboolean to_greeter_is_socket;
     GIOChannel *to_greeter_channel;
+    guint to_greeter_watch;
+    int from_greeter_output;
     GIOChannel *from_greeter_channel;
     guint from_greeter_watch;
+
+    /* Messages waiting to be written to the greeter */
+    GByteArray *write_buffer;
+    guint write_idle;
+
+    /* Length of the start of the write buffer already recorded in the trace */
+    gsize n_traced;
+
+    /* File descriptors to send with messages in the write buffer */
+    GQueue pending_fds;
+
+    /* Trace the messages are recorded to, if enabled */
+    GreeterTraceWriter *trace;
 } GreeterPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (Greeter, greeter, G_TYPE_OBJECT)
 
-#define API_VERSION 1
-
-/* Messages from the greeter to the server */
-typedef enum
-{
-    GREETER_MESSAGE_CONNECT = 0,
-    GREETER_MESSAGE_AUTHENTICATE,
-    GREETER_MESSAGE_AUTHENTICATE_AS_GUEST,
-    GREETER_MESSAGE_CONTINUE_AUTHENTICATION,
-    GREETER_MESSAGE_START_SESSION,
-    GREETER_MESSAGE_CANCEL_AUTHENTICATION,
-    GREETER_MESSAGE_SET_LANGUAGE,
-    GREETER_MESSAGE_AUTHENTICATE_REMOTE,
-    GREETER_MESSAGE_ENSURE_SHARED_DIR,
-} GreeterMessage;
-
-/* Messages from the server to the greeter */
-typedef enum
-{
-    SERVER_MESSAGE_CONNECTED = 0,
-    SERVER_MESSAGE_PROMPT_AUTHENTICATION,
-    SERVER_MESSAGE_END_AUTHENTICATION,
-    SERVER_MESSAGE_SESSION_RESULT,
-    SERVER_MESSAGE_SHARED_DIR_RESULT,
-    SERVER_MESSAGE_IDLE,
-    SERVER_MESSAGE_RESET,
-    SERVER_MESSAGE_CONNECTED_V2,
-} ServerMessage;
+#define API_VERSION 4
 
 static gboolean read_cb (GIOChannel *source, GIOCondition condition, gpointer data);
 
@@ -133,6 +139,56 @@ greeter_new (void)
     return g_object_new (GREETER_TYPE, NULL);
 }
 
+/* Record messages to a file for replaying with test-replay-greeter */
+static void
+start_trace (Greeter *greeter)
+{
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+    static guint trace_count = 0;
+
+    g_autofree gchar *trace_dir = config_get_string (config_get_instance (), "LightDM", "greeter-trace-directory");
+    if (!trace_dir || trace_dir[0] == '\0')
+        return;
+
+    /* Never reuse a file, skip any left from an earlier daemon with the same PID */
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = NULL;
+    do
+    {
+        g_clear_error (&error);
+        g_free (path);
+        g_autofree gchar *filename = g_strdup_printf ("greeter-%d-%u.trace", getpid (), trace_count);
+        trace_count++;
+        path = g_build_filename (trace_dir, filename, NULL);
+        priv->trace = greeter_trace_writer_new (path, &error);
+    } while (!priv->trace && g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_EXIST));
+    if (priv->trace)
+        g_debug ("Recording greeter messages to %s", path);
+    else
+        g_warning ("Failed to start greeter trace: %s", error->message);
+}
+
+/* Record each message in @data, which may contain several */
+static void
+add_to_trace (Greeter *greeter, GreeterTraceDirection direction, const guint8 *data, gsize length)
+{
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    if (!priv->trace)
+        return;
+
+    gint64 now = g_get_monotonic_time ();
+    gsize offset = 0;
+    guint32 id;
+    gsize message_length;
+    while (greeter_protocol_read_header (data + offset, length - offset, &id, &message_length) &&
+           length - offset >= message_length)
+    {
+        greeter_trace_writer_add (priv->trace, direction, now, data + offset, message_length);
+        offset += message_length;
+    }
+}
+
 void
 greeter_set_file_descriptors (Greeter *greeter, int to_greeter_fd, int from_greeter_fd)
 {
@@ -143,11 +199,9 @@ greeter_set_file_descriptors (Greeter *greeter, int to_greeter_fd, int from_gree
     g_return_if_fail (priv->from_greeter_output < 0);
 
     priv->to_greeter_input = to_greeter_fd;
+    struct stat info;
+    priv->to_greeter_is_socket = fstat (to_greeter_fd, &info) == 0 && S_ISSOCK (info.st_mode);
     priv->to_greeter_channel = g_io_channel_unix_new (priv->to_greeter_input);
-    g_autoptr(GError) to_error = NULL;
-    g_io_channel_set_encoding (priv->to_greeter_channel, NULL, &to_error);
-    if (to_error)
-        g_warning ("Failed to set encoding on to greeter channel to binary: %s\n", to_error->message);
 
     priv->from_greeter_output = from_greeter_fd;
     priv->from_greeter_channel = g_io_channel_unix_new (priv->from_greeter_output);
@@ -158,6 +212,8 @@ greeter_set_file_descriptors (Greeter *greeter, int to_greeter_fd, int from_gree
     g_io_channel_set_buffered (priv->from_greeter_channel, FALSE);
 
     priv->from_greeter_watch = g_io_add_watch (priv->from_greeter_channel, G_IO_IN | G_IO_HUP, read_cb, greeter);
+
+    start_trace (greeter);
 }
 
 void
@@ -205,171 +261,322 @@ greeter_set_hint (Greeter *greeter, const gchar *name, const gchar *value)
     g_hash_table_insert (priv->hints, g_strdup (name), g_strdup (value));
 }
 
-static void *
-secure_malloc (Greeter *greeter, size_t n)
+#define MAX_MESSAGE_LENGTH 1024
+
+/* A file descriptor to send with the message at @offset in the write buffer */
+typedef struct
+{
+    gsize offset;
+    int fd;
+} PendingFd;
+
+static void
+pending_fd_free (PendingFd *pending)
+{
+    close (pending->fd);
+    g_free (pending);
+}
+
+static gboolean to_greeter_cb (GIOChannel *source, GIOCondition condition, gpointer data);
+
+/* Write @data with @fd attached to its first byte */
+static ssize_t
+send_with_fd (int socket_fd, const guint8 *data, gsize data_length, int fd)
+{
+    struct iovec iov = { (void *) data, data_length };
+    union
+    {
+        struct cmsghdr header;
+        guint8 data[CMSG_SPACE (sizeof (int))];
+    } control;
+    memset (&control, 0, sizeof (control));
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof (control.data);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+    memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+    return sendmsg (socket_fd, &msg, MSG_NOSIGNAL);
+}
+
+/* Write as much of the queued messages as the greeter will take */
+static void
+flush_messages (Greeter *greeter)
 {
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
-    if (priv->use_secure_memory)
-        return gcry_malloc_secure (n);
-    else
-        return g_malloc (n);
+
+    if (priv->write_idle)
+        g_source_remove (priv->write_idle);
+    priv->write_idle = 0;
+
+    /* Anything left from the last write has already been recorded */
+    add_to_trace (greeter, GREETER_TRACE_TO_GREETER, priv->write_buffer->data + priv->n_traced, priv->write_buffer->len - priv->n_traced);
+
+    gsize offset = 0;
+    while (priv->to_greeter_input >= 0 && offset < priv->write_buffer->len)
+    {
+        /* A descriptor is attached to the first byte of its message, so stop before the next one */
+        PendingFd *pending = g_queue_peek_head (&priv->pending_fds);
+        gboolean send_fd = pending && pending->offset == offset;
+        PendingFd *next = send_fd ? g_queue_peek_nth (&priv->pending_fds, 1) : pending;
+        gsize end = next ? next->offset : priv->write_buffer->len;
+
+        ssize_t n_written;
+        if (send_fd)
+            n_written = send_with_fd (priv->to_greeter_input, priv->write_buffer->data + offset, end - offset, pending->fd);
+        else
+            n_written = write (priv->to_greeter_input, priv->write_buffer->data + offset, end - offset);
+        if (n_written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            g_warning ("Error writing to greeter: %s", strerror (errno));
+
+            /* Drop the messages, the connection is broken */
+            offset = priv->write_buffer->len;
+            break;
+        }
+        if (send_fd)
+            pending_fd_free (g_queue_pop_head (&priv->pending_fds));
+        offset += n_written;
+    }
+
+    /* Keep what the greeter hasn't taken yet */
+    gsize n_remaining = priv->write_buffer->len - offset;
+    memmove (priv->write_buffer->data, priv->write_buffer->data + offset, n_remaining);
+    g_byte_array_set_size (priv->write_buffer, n_remaining);
+    priv->n_traced = n_remaining;
+    if (n_remaining == 0)
+    {
+        g_queue_foreach (&priv->pending_fds, (GFunc) pending_fd_free, NULL);
+        g_queue_clear (&priv->pending_fds);
+    }
+    for (GList *link = priv->pending_fds.head; link; link = link->next)
+    {
+        PendingFd *pending = link->data;
+        pending->offset -= offset;
+    }
+
+    /* Write the rest when the greeter is ready for it */
+    if (n_remaining > 0 && priv->to_greeter_watch == 0 && priv->to_greeter_channel)
+        priv->to_greeter_watch = g_io_add_watch (priv->to_greeter_channel, G_IO_OUT | G_IO_ERR | G_IO_HUP, to_greeter_cb, greeter);
+    else if (n_remaining == 0 && priv->to_greeter_watch != 0)
+    {
+        g_source_remove (priv->to_greeter_watch);
+        priv->to_greeter_watch = 0;
+    }
 }
 
-static void *
-secure_realloc (Greeter *greeter, void *ptr, size_t n)
+static gboolean
+to_greeter_cb (GIOChannel *source, GIOCondition condition, gpointer data)
 {
+    Greeter *greeter = data;
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
-    if (priv->use_secure_memory)
-        return gcry_realloc (ptr, n);
-    else
-        return g_realloc (ptr, n);
+
+    priv->to_greeter_watch = 0;
+    flush_messages (greeter);
+
+    return G_SOURCE_REMOVE;
 }
 
-static void
-secure_free (Greeter *greeter, void *ptr)
+static gboolean
+write_idle_cb (gpointer data)
 {
+    Greeter *greeter = data;
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
-    if (priv->use_secure_memory)
-        return gcry_free (ptr);
-    else
-        return g_free (ptr);
+
+    priv->write_idle = 0;
+    flush_messages (greeter);
+
+    return G_SOURCE_REMOVE;
 }
 
+/* Write the messages added to the write buffer once we return to the main loop */
 static void
-secure_freev (Greeter *greeter, gchar **v)
+queue_write (Greeter *greeter)
 {
-    for (int i = 0; v[i]; i++)
-        secure_free (greeter, v[i]);
-    g_free (v);
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    /* Already waiting for the greeter to take the rest */
+    if (priv->to_greeter_watch)
+        return;
+
+    if (!priv->write_idle)
+        priv->write_idle = g_idle_add_full (G_PRIORITY_DEFAULT, write_idle_cb, greeter, NULL);
 }
 
-static guint32
-int_length (void)
+/* Queue a message with @fd attached to its first byte. The descriptor is
+ * closed once sent.
+ * Returns FALSE if it can't be sent, e.g. the greeter is not connected by a socket */
+static gboolean
+queue_message_with_fd (Greeter *greeter, const guint8 *message, gsize message_length, int fd)
 {
-    return 4;
-}
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
 
-#define HEADER_SIZE (sizeof (guint32) * 2)
-#define MAX_MESSAGE_LENGTH 1024
+    if (!priv->to_greeter_is_socket)
+        return FALSE;
+
+    PendingFd *pending = g_new0 (PendingFd, 1);
+    pending->offset = priv->write_buffer->len;
+    pending->fd = fd;
+    g_queue_push_tail (&priv->pending_fds, pending);
+    g_byte_array_append (priv->write_buffer, message, message_length);
+    queue_write (greeter);
+
+    return TRUE;
+}
 
 static void
-write_message (Greeter *greeter, guint8 *message, gsize message_length)
+send_user (Greeter *greeter, CommonUser *user)
 {
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
 
-    gchar *data = (gchar *) message;
-    gsize data_length = message_length;
-    while (data_length > 0)
-    {
-        GIOStatus status;
-        gsize n_written;
-
-        g_autoptr(GError) error = NULL;
-        status = g_io_channel_write_chars (priv->to_greeter_channel, data, data_length, &n_written, &error);
-        if (error)
-            g_warning ("Error writing to greeter: %s", error->message);
-        if (status != G_IO_STATUS_NORMAL)
-            return;
-        data_length -= n_written;
-        data += n_written;
-    }
+    g_autoptr(GVariant) properties = common_user_to_variant (user);
+    GreeterProtocolUserUpdated message = { 0 };
+    message.properties = g_variant_get_data (properties);
+    message.properties_length = g_variant_get_size (properties);
+    greeter_protocol_write_user_updated (priv->write_buffer, &message);
+    queue_write (greeter);
 
-    g_autoptr(GError) error = NULL;
-    g_io_channel_flush (priv->to_greeter_channel, &error);
-    if (error)
-        g_warning ("Failed to flush data to greeter: %s", error->message);
+    g_hash_table_insert (priv->sent_users, g_object_ref (user), g_strdup (common_user_get_name (user)));
+
+    /* Properties not sent yet follow as changes once loaded */
+    common_user_load_in_background (user);
 }
 
 static void
-write_int (guint8 *buffer, gint buffer_length, guint32 value, gsize *offset)
+send_user_removed (Greeter *greeter, const gchar *username)
 {
-    if (*offset + 4 >= buffer_length)
-        return;
-    buffer[*offset] = value >> 24;
-    buffer[*offset+1] = (value >> 16) & 0xFF;
-    buffer[*offset+2] = (value >> 8) & 0xFF;
-    buffer[*offset+3] = value & 0xFF;
-    *offset += 4;
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+    GreeterProtocolUserRemoved message = { 0 };
+    message.username = username;
+    greeter_protocol_write_user_removed (priv->write_buffer, &message);
+    queue_write (greeter);
 }
 
+/* Tell the greeter to apply the users sent since the last update */
 static void
-write_string (guint8 *buffer, gint buffer_length, const gchar *value, gsize *offset)
+send_users_updated (Greeter *greeter, gboolean complete)
 {
-    gint length;
-    if (value)
-        length = strlen (value);
-    else
-        length = 0;
-    write_int (buffer, buffer_length, length, offset);
-    if (*offset + length >= buffer_length)
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+    GreeterProtocolUsersUpdated message = { 0 };
+    message.complete = complete ? 1 : 0;
+    greeter_protocol_write_users_updated (priv->write_buffer, &message);
+    queue_write (greeter);
+}
+
+static void
+send_user_list (Greeter *greeter)
+{
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    priv->sent_users = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, g_free);
+    for (GList *link = common_user_list_get_users (priv->user_list); link; link = link->next)
+        send_user (greeter, link->data);
+    send_users_updated (greeter, TRUE);
+
+    g_debug ("Sent %u users to greeter", g_hash_table_size (priv->sent_users));
+}
+
+static void
+users_changed_cb (CommonUserList *user_list, GList *added, GList *removed, GList *changed, Greeter *greeter)
+{
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    /* Changes are included when the list is sent */
+    if (!priv->sent_users)
         return;
-    if (length > 0)
+
+    for (GList *link = removed; link; link = link->next)
+    {
+        CommonUser *user = link->data;
+        const gchar *username = g_hash_table_lookup (priv->sent_users, user);
+        if (username)
+        {
+            send_user_removed (greeter, username);
+            g_hash_table_remove (priv->sent_users, user);
+        }
+    }
+    for (GList *link = changed; link; link = link->next)
     {
-        memcpy (buffer + *offset, value, length);
-        *offset += length;
+        CommonUser *user = link->data;
+
+        /* Renamed users replace the old user */
+        const gchar *username = g_hash_table_lookup (priv->sent_users, user);
+        if (username && g_strcmp0 (username, common_user_get_name (user)) != 0)
+            send_user_removed (greeter, username);
+
+        send_user (greeter, user);
     }
+    for (GList *link = added; link; link = link->next)
+        send_user (greeter, link->data);
+    send_users_updated (greeter, FALSE);
 }
 
 static void
-write_header (guint8 *buffer, gint buffer_length, guint32 id, guint32 length, gsize *offset)
+user_list_loaded_cb (CommonUserList *user_list, Greeter *greeter)
 {
-    write_int (buffer, buffer_length, id, offset);
-    write_int (buffer, buffer_length, length, offset);
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    if (!priv->sent_users)
+        send_user_list (greeter);
 }
 
-static guint32
-string_length (const gchar *value)
+/* Provide the user list to the greeter, so it doesn't have to load it itself */
+static void
+start_sending_users (Greeter *greeter)
 {
-    if (value == NULL)
-        return int_length ();
-    else
-        return int_length () + strlen (value);
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    if (priv->user_list)
+        return;
+
+    priv->user_list = g_object_ref (common_user_list_get_instance ());
+    g_signal_connect (priv->user_list, USER_LIST_SIGNAL_USERS_CHANGED, G_CALLBACK (users_changed_cb), greeter);
+    g_signal_connect (priv->user_list, USER_LIST_SIGNAL_LOADED, G_CALLBACK (user_list_loaded_cb), greeter);
+
+    /* Don't block waiting for the users, they are sent once loaded */
+    if (common_user_list_get_is_loaded (priv->user_list))
+        send_user_list (greeter);
 }
 
 static void
-handle_connect (Greeter *greeter, const gchar *version, gboolean resettable, guint32 api_version)
+handle_connect (Greeter *greeter, const gchar *version, gboolean resettable, guint32 api_version, guint32 capabilities)
 {
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
 
-    g_debug ("Greeter connected version=%s api=%u resettable=%s", version, api_version, resettable ? "true" : "false");
+    g_debug ("Greeter connected version=%s api=%u capabilities=%u resettable=%s", version, api_version, capabilities, resettable ? "true" : "false");
 
     priv->api_version = api_version;
     priv->resettable = resettable;
 
-    guint32 env_length = 0;
-    GHashTableIter iter;
-    g_hash_table_iter_init (&iter, priv->hints);
-    gpointer key, value;
-    while (g_hash_table_iter_next (&iter, &key, &value))
-        env_length += string_length (key) + string_length (value);
+    /* Send the users before connecting, so they are available as soon as the greeter is connected */
+    if (capabilities & GREETER_CAPABILITY_USER_LIST)
+        start_sending_users (greeter);
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
     if (api_version == 0)
     {
-        write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_CONNECTED, string_length (VERSION) + env_length, &offset);
-        write_string (message, MAX_MESSAGE_LENGTH, VERSION, &offset);
-        g_hash_table_iter_init (&iter, priv->hints);
-        while (g_hash_table_iter_next (&iter, &key, &value))
-        {
-            write_string (message, MAX_MESSAGE_LENGTH, key, &offset);
-            write_string (message, MAX_MESSAGE_LENGTH, value, &offset);
-        }
+        GreeterProtocolConnected message = { 0 };
+        message.version = VERSION;
+        message.hints = priv->hints;
+        greeter_protocol_write_connected (priv->write_buffer, &message);
     }
     else
     {
-        write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_CONNECTED_V2, string_length (VERSION) + int_length () * 2 + env_length, &offset);
-        write_int (message, MAX_MESSAGE_LENGTH, api_version <= API_VERSION ? api_version : API_VERSION, &offset);
-        write_string (message, MAX_MESSAGE_LENGTH, VERSION, &offset);
-        write_int (message, MAX_MESSAGE_LENGTH, g_hash_table_size (priv->hints), &offset);
-        g_hash_table_iter_init (&iter, priv->hints);
-        while (g_hash_table_iter_next (&iter, &key, &value))
-        {
-            write_string (message, MAX_MESSAGE_LENGTH, key, &offset);
-            write_string (message, MAX_MESSAGE_LENGTH, value, &offset);
-        }
+        GreeterProtocolConnectedV2 message = { 0 };
+        message.api_version = api_version <= API_VERSION ? api_version : API_VERSION;
+        message.version = VERSION;
+        message.hints = priv->hints;
+        greeter_protocol_write_connected_v2 (priv->write_buffer, &message);
     }
-    write_message (greeter, message, offset);
+    queue_write (greeter);
 
     g_signal_emit (greeter, signals[CONNECTED], 0);
 }
@@ -384,26 +591,24 @@ pam_messages_cb (Session *session, Greeter *greeter)
 
     /* Respond to d-bus query with messages */
     g_debug ("Prompt greeter with %zi message(s)", messages_length);
-    guint32 size = int_length () + string_length (session_get_username (session)) + int_length ();
-    for (int i = 0; i < messages_length; i++)
-        size += int_length () + string_length (messages[i].msg);
-
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_PROMPT_AUTHENTICATION, size, &offset);
-    write_int (message, MAX_MESSAGE_LENGTH, priv->authentication_sequence_number, &offset);
-    write_string (message, MAX_MESSAGE_LENGTH, session_get_username (session), &offset);
-    write_int (message, MAX_MESSAGE_LENGTH, messages_length, &offset);
+    GreeterProtocolPrompt *prompts = g_newa (GreeterProtocolPrompt, messages_length);
     int n_prompts = 0;
     for (int i = 0; i < messages_length; i++)
     {
-        write_int (message, MAX_MESSAGE_LENGTH, messages[i].msg_style, &offset);
-        write_string (message, MAX_MESSAGE_LENGTH, messages[i].msg, &offset);
+        prompts[i].style = messages[i].msg_style;
+        prompts[i].text = messages[i].msg;
 
         if (messages[i].msg_style == PAM_PROMPT_ECHO_OFF || messages[i].msg_style == PAM_PROMPT_ECHO_ON)
             n_prompts++;
     }
-    write_message (greeter, message, offset);
+    GreeterProtocolPromptAuthentication message = { 0 };
+    message.sequence_number = priv->authentication_sequence_number;
+    message.username = session_get_username (session);
+    message.prompts = prompts;
+    message.n_prompts = messages_length;
+    greeter_protocol_write_prompt_authentication (priv->write_buffer, &message);
+    queue_write (greeter);
+    priv->prompt_time = n_prompts > 0 ? g_get_monotonic_time () : 0;
 
     /* Continue immediately if nothing to respond with */
     // FIXME: Should probably give the greeter a chance to ack the message
@@ -419,24 +624,23 @@ pam_messages_cb (Session *session, Greeter *greeter)
 static void
 send_end_authentication (Greeter *greeter, guint32 sequence_number, const gchar *username, int result)
 {
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
-    write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_END_AUTHENTICATION, int_length () + string_length (username) + int_length (), &offset);
-    write_int (message, MAX_MESSAGE_LENGTH, sequence_number, &offset);
-    write_string (message, MAX_MESSAGE_LENGTH, username, &offset);
-    write_int (message, MAX_MESSAGE_LENGTH, result, &offset);
-    write_message (greeter, message, offset);
+    GreeterProtocolEndAuthentication message = { 0 };
+    message.sequence_number = sequence_number;
+    message.username = username;
+    message.result = result;
+    greeter_protocol_write_end_authentication (priv->write_buffer, &message);
+    queue_write (greeter);
     priv->have_sent_end_authentication = TRUE;
 }
 
 void
 greeter_idle (Greeter *greeter)
 {
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_IDLE, 0, &offset);
-    write_message (greeter, message, offset);
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+    GreeterProtocolIdle message = { 0 };
+    greeter_protocol_write_idle (priv->write_buffer, &message);
+    queue_write (greeter);
 }
 
 void
@@ -446,23 +650,10 @@ greeter_reset (Greeter *greeter)
 
     g_return_if_fail (greeter != NULL);
 
-    GHashTableIter iter;
-    g_hash_table_iter_init (&iter, priv->hints);
-    gpointer key, value;
-    guint32 length = 0;
-    while (g_hash_table_iter_next (&iter, &key, &value))
-        length += string_length (key) + string_length (value);
-
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_RESET, length, &offset);
-    g_hash_table_iter_init (&iter, priv->hints);
-    while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-        write_string (message, MAX_MESSAGE_LENGTH, key, &offset);
-        write_string (message, MAX_MESSAGE_LENGTH, value, &offset);
-    }
-    write_message (greeter, message, offset);
+    GreeterProtocolReset message = { 0 };
+    message.hints = priv->hints;
+    greeter_protocol_write_reset (priv->write_buffer, &message);
+    queue_write (greeter);
 }
 
 static void reset_session (Greeter *greeter);
@@ -587,6 +778,26 @@ handle_authenticate_as_guest (Greeter *greeter, guint32 sequence_number)
     send_end_authentication (greeter, sequence_number, "", PAM_SUCCESS);
 }
 
+/* Sent by greeters straight after connecting, so they can start authenticating
+ * before they have the hints */
+static void
+handle_authenticate_autologin (Greeter *greeter, guint32 sequence_number)
+{
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
+    const gchar *autologin_username = g_hash_table_lookup (priv->hints, "autologin-user");
+    if (g_strcmp0 (g_hash_table_lookup (priv->hints, "autologin-guest"), "true") == 0)
+        handle_authenticate_as_guest (greeter, sequence_number);
+    else if (autologin_username != NULL)
+        handle_authenticate (greeter, sequence_number, autologin_username);
+    else
+    {
+        g_debug ("Greeter start authentication for autologin user, but no autologin user configured");
+        reset_session (greeter);
+        send_end_authentication (greeter, sequence_number, "", PAM_USER_UNKNOWN);
+    }
+}
+
 static gchar *
 get_remote_session_service (const gchar *session_name)
 {
@@ -692,6 +903,10 @@ handle_continue_authentication (Greeter *greeter, gchar **secrets)
 
     g_debug ("Continue authentication");
 
+    if (priv->prompt_time != 0)
+        greeter_latency_add_prompt_response (g_get_monotonic_time () - priv->prompt_time);
+    priv->prompt_time = 0;
+
     /* Build response */
     struct pam_response *response = calloc (messages_length, sizeof (struct pam_response));
     for (int i = 0, j = 0; i < messages_length; i++)
@@ -700,7 +915,7 @@ handle_continue_authentication (Greeter *greeter, gchar **secrets)
         if (msg_style == PAM_PROMPT_ECHO_OFF || msg_style == PAM_PROMPT_ECHO_ON)
         {
             size_t secret_length = strlen (secrets[j]) + 1;
-            response[i].resp = secure_malloc (greeter, secret_length);
+            response[i].resp = secret_arena_alloc (secret_length);
             memcpy (response[i].resp, secrets[j], secret_length); // FIXME: Need to convert from UTF-8
             j++;
         }
@@ -709,7 +924,7 @@ handle_continue_authentication (Greeter *greeter, gchar **secrets)
     session_respond (priv->authentication_session, response);
 
     for (int i = 0; i < messages_length; i++)
-        secure_free (greeter, response[i].resp);
+        secret_arena_free (response[i].resp);
     free (response);
 }
 
@@ -759,11 +974,10 @@ handle_start_session (Greeter *greeter, const gchar *session)
         result = FALSE;
     }
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_SESSION_RESULT, int_length (), &offset);
-    write_int (message, MAX_MESSAGE_LENGTH, result ? 0 : 1, &offset);
-    write_message (greeter, message, offset);
+    GreeterProtocolSessionResult message = { 0 };
+    message.result = result ? 0 : 1;
+    greeter_protocol_write_session_result (priv->write_buffer, &message);
+    queue_write (greeter);
 }
 
 static void
@@ -792,85 +1006,156 @@ handle_set_language (Greeter *greeter, const gchar *language)
 static void
 handle_ensure_shared_dir (Greeter *greeter, const gchar *username)
 {
+    GreeterPrivate *priv = greeter_get_instance_private (greeter);
+
     g_debug ("Greeter requests data directory for user %s", username);
 
     g_autofree gchar *dir = shared_data_manager_ensure_user_dir (shared_data_manager_get_instance (), username);
 
-    guint8 message[MAX_MESSAGE_LENGTH];
-    gsize offset = 0;
-    write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_SHARED_DIR_RESULT, string_length (dir), &offset);
-    write_string (message, MAX_MESSAGE_LENGTH, dir, &offset);
-    write_message (greeter, message, offset);
+    GreeterProtocolSharedDirResult message = { 0 };
+    message.dir = dir;
+    greeter_protocol_write_shared_dir_result (priv->write_buffer, &message);
+    queue_write (greeter);
 }
 
-static guint32
-read_int (Greeter *greeter, gsize *offset)
+static void
+handle_get_user_image (Greeter *greeter, const gchar *username, gboolean background)
 {
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
 
-    if (priv->n_read - *offset < sizeof (guint32))
-    {
-        g_warning ("Not enough space for int, need %zu, got %zu", sizeof (guint32), priv->n_read - *offset);
-        return 0;
-    }
-    guint8 *buffer = priv->read_buffer + *offset;
-    guint32 value = buffer[0] << 24 | buffer[1] << 16 | buffer[2] << 8 | buffer[3];
-    *offset += int_length ();
-    return value;
-}
+    g_debug ("Greeter requests %s for user %s", background ? "background" : "image", username);
 
-static int
-get_message_length (Greeter *greeter)
-{
-    gsize offset;
-    int payload_length;
+    /* Only copies in the image cache are given out, these have already been read as the user */
+    int fd = user_image_cache_open (user_image_cache_get_instance (), username, background);
 
-    offset = int_length ();
-    payload_length = read_int (greeter, &offset);
-
-    if (HEADER_SIZE + payload_length < HEADER_SIZE)
+    GreeterProtocolUserImageResult message = { 0 };
+    message.username = username;
+    message.background = background ? 1 : 0;
+    if (fd >= 0)
     {
-        g_warning ("Payload length of %u octets too long", payload_length);
-        return HEADER_SIZE;
+        message.has_fd = 1;
+        g_autoptr(GByteArray) buffer = g_byte_array_new ();
+        greeter_protocol_write_user_image_result (buffer, &message);
+        if (queue_message_with_fd (greeter, buffer->data, buffer->len, fd))
+            return;
+        close (fd);
     }
 
-    return HEADER_SIZE + payload_length;
+    /* Tell the greeter there is no image */
+    message.has_fd = 0;
+    greeter_protocol_write_user_image_result (priv->write_buffer, &message);
+    queue_write (greeter);
 }
 
-static gchar *
-read_string_full (Greeter *greeter, gsize *offset, void* (*alloc_fn)(size_t n))
+static void
+handle_message (Greeter *greeter, const guint8 *message, gsize message_length)
 {
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
 
-    guint32 length = read_int (greeter, offset);
-    if (priv->n_read - *offset < length)
+    guint32 id;
+    gsize length;
+    greeter_protocol_read_header (message, message_length, &id, &length);
+    const guint8 *payload = message + GREETER_PROTOCOL_HEADER_SIZE;
+    gsize payload_length = message_length - GREETER_PROTOCOL_HEADER_SIZE;
+
+    gboolean valid = TRUE;
+    switch (id)
     {
-        g_warning ("Not enough space for string, need %u, got %zu", length, priv->n_read - *offset);
-        return g_strdup ("");
+    case GREETER_MESSAGE_CONNECT:
+        {
+            g_auto(GreeterProtocolConnect) request = { 0 };
+            valid = greeter_protocol_read_connect (payload, payload_length, &request);
+            if (valid)
+                handle_connect (greeter, request.version, request.resettable != 0, request.api_version, request.capabilities);
+        }
+        break;
+    case GREETER_MESSAGE_AUTHENTICATE:
+        {
+            g_auto(GreeterProtocolAuthenticate) request = { 0 };
+            valid = greeter_protocol_read_authenticate (payload, payload_length, &request);
+            if (valid)
+                handle_authenticate (greeter, request.sequence_number, request.username);
+        }
+        break;
+    case GREETER_MESSAGE_AUTHENTICATE_AS_GUEST:
+        {
+            g_auto(GreeterProtocolAuthenticateAsGuest) request = { 0 };
+            valid = greeter_protocol_read_authenticate_as_guest (payload, payload_length, &request);
+            if (valid)
+                handle_authenticate_as_guest (greeter, request.sequence_number);
+        }
+        break;
+    case GREETER_MESSAGE_AUTHENTICATE_REMOTE:
+        {
+            g_auto(GreeterProtocolAuthenticateRemote) request = { 0 };
+            valid = greeter_protocol_read_authenticate_remote (payload, payload_length, &request);
+            if (valid)
+                handle_authenticate_remote (greeter, request.session, request.username, request.sequence_number);
+        }
+        break;
+    case GREETER_MESSAGE_CONTINUE_AUTHENTICATION:
+        {
+            g_auto(GreeterProtocolContinueAuthentication) request = { 0 };
+            valid = greeter_protocol_read_continue_authentication (payload, payload_length, &request);
+            if (valid)
+            {
+                /* Secrets are only copied out of the read buffer into secret memory */
+                gchar **secrets = greeter_protocol_strings_dup (&request.secrets, secret_arena_alloc);
+                handle_continue_authentication (greeter, secrets);
+                secret_arena_freev (secrets);
+            }
+        }
+        break;
+    case GREETER_MESSAGE_CANCEL_AUTHENTICATION:
+        handle_cancel_authentication (greeter);
+        break;
+    case GREETER_MESSAGE_START_SESSION:
+        {
+            g_auto(GreeterProtocolStartSession) request = { 0 };
+            valid = greeter_protocol_read_start_session (payload, payload_length, &request);
+            if (valid)
+                handle_start_session (greeter, request.session);
+        }
+        break;
+    case GREETER_MESSAGE_SET_LANGUAGE:
+        {
+            g_auto(GreeterProtocolSetLanguage) request = { 0 };
+            valid = greeter_protocol_read_set_language (payload, payload_length, &request);
+            if (valid)
+                handle_set_language (greeter, request.language);
+        }
+        break;
+    case GREETER_MESSAGE_ENSURE_SHARED_DIR:
+        {
+            g_auto(GreeterProtocolEnsureSharedDir) request = { 0 };
+            valid = greeter_protocol_read_ensure_shared_dir (payload, payload_length, &request);
+            if (valid)
+                handle_ensure_shared_dir (greeter, request.username);
+        }
+        break;
+    case GREETER_MESSAGE_GET_USER_IMAGE:
+        {
+            g_auto(GreeterProtocolGetUserImage) request = { 0 };
+            valid = greeter_protocol_read_get_user_image (payload, payload_length, &request);
+            if (valid)
+                handle_get_user_image (greeter, request.username, request.background != 0);
+        }
+        break;
+    case GREETER_MESSAGE_AUTHENTICATE_AUTOLOGIN:
+        {
+            g_auto(GreeterProtocolAuthenticateAutologin) request = { 0 };
+            valid = greeter_protocol_read_authenticate_autologin (payload, payload_length, &request);
+            if (valid)
+                handle_authenticate_autologin (greeter, request.sequence_number);
+        }
+        break;
+    default:
+        g_warning ("Unknown message from greeter: %d", id);
+        break;
     }
 
-    gchar *value = (*alloc_fn) (sizeof (gchar) * (length + 1));
-    memcpy (value, priv->read_buffer + *offset, length);
-    value[length] = '\0';
-    *offset += length;
-
-    return value;
-}
-
-static gchar *
-read_string (Greeter *greeter, gsize *offset)
-{
-    return read_string_full (greeter, offset, g_malloc);
-}
-
-static gchar *
-read_secret (Greeter *greeter, gsize *offset)
-{
-    GreeterPrivate *priv = greeter_get_instance_private (greeter);
-    if (priv->use_secure_memory)
-        return read_string_full (greeter, offset, gcry_malloc_secure);
-    else
-        return read_string_full (greeter, offset, g_malloc);
+    if (!valid)
+        g_warning ("Ignoring malformed message %d from greeter", id);
 }
 
 static gboolean
@@ -887,22 +1172,12 @@ read_cb (GIOChannel *source, GIOCondition condition, gpointer data)
         return FALSE;
     }
 
-    gsize n_to_read = HEADER_SIZE;
-    if (priv->n_read >= HEADER_SIZE)
-    {
-        n_to_read = get_message_length (greeter);
-        if (n_to_read <= HEADER_SIZE)
-        {
-            priv->from_greeter_watch = 0;
-            return FALSE;
-        }
-    }
-
+    /* Read as much as is available, this may contain several messages */
     gsize n_read;
     g_autoptr(GError) error = NULL;
     GIOStatus status = g_io_channel_read_chars (priv->from_greeter_channel,
                                                 (gchar *) priv->read_buffer + priv->n_read,
-                                                n_to_read - priv->n_read,
+                                                priv->read_buffer_size - priv->n_read,
                                                 &n_read,
                                                 &error);
     if (error)
@@ -918,106 +1193,40 @@ read_cb (GIOChannel *source, GIOCondition condition, gpointer data)
         return TRUE;
 
     priv->n_read += n_read;
-    if (priv->n_read != n_to_read)
-        return TRUE;
 
-    /* If have header, rerun for content */
-    if (priv->n_read == HEADER_SIZE)
+    add_to_trace (greeter, GREETER_TRACE_FROM_GREETER, priv->read_buffer, priv->n_read);
+
+    /* Handle every complete message */
+    gsize offset = 0;
+    guint32 id;
+    gsize message_length;
+    while (greeter_protocol_read_header (priv->read_buffer + offset, priv->n_read - offset, &id, &message_length) &&
+           priv->n_read - offset >= message_length)
     {
-        n_to_read = get_message_length (greeter);
-        if (n_to_read > HEADER_SIZE)
-        {
-            priv->read_buffer = secure_realloc (greeter, priv->read_buffer, n_to_read);
-            read_cb (source, condition, greeter);
-            return TRUE;
-        }
+        gint64 start_time = g_get_monotonic_time ();
+        handle_message (greeter, priv->read_buffer + offset, message_length);
+        greeter_latency_add_message (id, g_get_monotonic_time () - start_time);
+        offset += message_length;
     }
 
-    gsize offset = 0;
-    int id = read_int (greeter, &offset);
-    int length = HEADER_SIZE + read_int (greeter, &offset);
-    switch (id)
+    /* Keep any partial message for the next read, and don't leave handled secrets in the buffer */
+    if (offset > 0)
     {
-    case GREETER_MESSAGE_CONNECT:
-        {
-            g_autofree gchar *version = read_string (greeter, &offset);
-            gboolean resettable = FALSE;
-            if (offset < length)
-                resettable = read_int (greeter, &offset) != 0;
-            guint32 api_version = 0;
-            if (offset < length)
-                api_version = read_int (greeter, &offset);
-            handle_connect (greeter, version, resettable, api_version);
-        }
-        break;
-    case GREETER_MESSAGE_AUTHENTICATE:
-        {
-            guint32 sequence_number = read_int (greeter, &offset);
-            g_autofree gchar *username = read_string (greeter, &offset);
-            handle_authenticate (greeter, sequence_number, username);
-        }
-        break;
-    case GREETER_MESSAGE_AUTHENTICATE_AS_GUEST:
-        {
-            guint32 sequence_number = read_int (greeter, &offset);
-            handle_authenticate_as_guest (greeter, sequence_number);
-        }
-        break;
-    case GREETER_MESSAGE_AUTHENTICATE_REMOTE:
-        {
-            guint32 sequence_number = read_int (greeter, &offset);
-            g_autofree gchar *session_name = read_string (greeter, &offset);
-            g_autofree gchar *username = read_string (greeter, &offset);
-            handle_authenticate_remote (greeter, session_name, username, sequence_number);
-        }
-        break;
-    case GREETER_MESSAGE_CONTINUE_AUTHENTICATION:
-        {
-            guint32 n_secrets = read_int (greeter, &offset);
-            guint32 max_secrets = (G_MAXUINT32 - 1) / sizeof (gchar *);
-            if (n_secrets > max_secrets)
-            {
-                g_warning ("Array length of %u elements too long", n_secrets);
-                priv->from_greeter_watch = 0;
-                return FALSE;
-            }
-            gchar **secrets = g_malloc (sizeof (gchar *) * (n_secrets + 1));
-            guint32 i;
-            for (i = 0; i < n_secrets; i++)
-                secrets[i] = read_secret (greeter, &offset);
-            secrets[i] = NULL;
-            handle_continue_authentication (greeter, secrets);
-            secure_freev (greeter, secrets);
-        }
-        break;
-    case GREETER_MESSAGE_CANCEL_AUTHENTICATION:
-        handle_cancel_authentication (greeter);
-        break;
-    case GREETER_MESSAGE_START_SESSION:
-        {
-            g_autofree gchar *session_name = read_string (greeter, &offset);
-            handle_start_session (greeter, session_name);
-        }
-        break;
-    case GREETER_MESSAGE_SET_LANGUAGE:
-        {
-            g_autofree gchar *language = read_string (greeter, &offset);
-            handle_set_language (greeter, language);
-        }
-        break;
-    case GREETER_MESSAGE_ENSURE_SHARED_DIR:
+        memmove (priv->read_buffer, priv->read_buffer + offset, priv->n_read - offset);
+        memset (priv->read_buffer + priv->n_read - offset, 0, offset);
+        priv->n_read -= offset;
+    }
+
+    /* Grow the buffer if the next message won't fit */
+    if (greeter_protocol_read_header (priv->read_buffer, priv->n_read, &id, &message_length))
+    {
+        if (message_length > priv->read_buffer_size)
         {
-            g_autofree gchar *username = read_string (greeter, &offset);
-            handle_ensure_shared_dir (greeter, username);
+            priv->read_buffer = secret_arena_realloc (priv->read_buffer, message_length);
+            priv->read_buffer_size = message_length;
         }
-        break;
-    default:
-        g_warning ("Unknown message from greeter: %d", id);
-        break;
     }
 
-    priv->n_read = 0;
-
     return TRUE;
 }
 
@@ -1085,9 +1294,10 @@ greeter_init (Greeter *greeter)
 {
     GreeterPrivate *priv = greeter_get_instance_private (greeter);
 
-    priv->read_buffer = secure_malloc (greeter, HEADER_SIZE);
+    priv->read_buffer_size = MAX_MESSAGE_LENGTH;
+    priv->read_buffer = secret_arena_alloc (priv->read_buffer_size);
+    priv->write_buffer = g_byte_array_sized_new (MAX_MESSAGE_LENGTH);
     priv->hints = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-    priv->use_secure_memory = config_get_boolean (config_get_instance (), "LightDM", "lock-memory");
     priv->to_greeter_input = -1;
     priv->from_greeter_output = -1;
     priv->cancelling = FALSE;
@@ -1101,7 +1311,7 @@ greeter_finalize (GObject *object)
 
     g_clear_pointer (&priv->pam_service, g_free);
     g_clear_pointer (&priv->autologin_pam_service, g_free);
-    secure_free (self, priv->read_buffer);
+    secret_arena_free (priv->read_buffer);
     g_hash_table_unref (priv->hints);
     g_clear_pointer (&priv->remote_session, g_free);
     g_clear_pointer (&priv->active_username, g_free);
@@ -1110,10 +1320,21 @@ greeter_finalize (GObject *object)
         g_signal_handlers_disconnect_matched (priv->authentication_session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
         g_object_unref (priv->authentication_session);
     }
-    close (priv->to_greeter_input);
-    close (priv->from_greeter_output);
+    if (priv->user_list)
+        g_signal_handlers_disconnect_by_data (priv->user_list, self);
+    g_clear_object (&priv->user_list);
+    g_clear_pointer (&priv->sent_users, g_hash_table_unref);
+    flush_messages (self);
+    if (priv->to_greeter_watch)
+        g_source_remove (priv->to_greeter_watch);
     if (priv->to_greeter_channel)
         g_io_channel_unref (priv->to_greeter_channel);
+    g_queue_foreach (&priv->pending_fds, (GFunc) pending_fd_free, NULL);
+    g_queue_clear (&priv->pending_fds);
+    g_byte_array_unref (priv->write_buffer);
+    g_clear_pointer (&priv->trace, greeter_trace_writer_free);
+    close (priv->to_greeter_input);
+    close (priv->from_greeter_output);
     if (priv->from_greeter_channel)
         g_io_channel_unref (priv->from_greeter_channel);
     if (priv->from_greeter_watch)
@@ -30,9 +30,12 @@
 #include "seat-xvnc.h"
 #include "x-server.h"
 #include "process.h"
+#include "secret-arena.h"
 #include "session-child.h"
 #include "shared-data-manager.h"
 #include "user-list.h"
+#include "user-image-cache.h"
+#include "user-list-cache.h"
 #include "login1.h"
 #include "log-file.h"
 
@@ -769,6 +772,8 @@ main (int argc, char **argv)
         config_set_string (config_get_instance (), "LightDM", "greeter-user", GREETER_USER);
     if (!config_has_key (config_get_instance (), "LightDM", "lock-memory"))
         config_set_boolean (config_get_instance (), "LightDM", "lock-memory", TRUE);
+    if (!config_has_key (config_get_instance (), "LightDM", "secret-memory-size"))
+        config_set_integer (config_get_instance (), "LightDM", "secret-memory-size", 65536);
     if (!config_has_key (config_get_instance (), "LightDM", "backup-logs"))
         config_set_boolean (config_get_instance (), "LightDM", "backup-logs", TRUE);
     if (!config_has_key (config_get_instance (), "LightDM", "dbus-service"))
@@ -861,6 +866,10 @@ main (int argc, char **argv)
 
     if (getuid () != 0)
         g_debug ("Running in user mode");
+
+    /* Keep passwords in memory that isn't paged to disk */
+    secret_arena_init (config_get_integer (config_get_instance (), "LightDM", "secret-memory-size"),
+                       config_get_boolean (config_get_instance (), "LightDM", "lock-memory"));
     if (getenv ("DISPLAY"))
         g_debug ("Using Xephyr for X servers");
 
@@ -880,6 +889,8 @@ main (int argc, char **argv)
         start_display_manager ();
 
     shared_data_manager_start (shared_data_manager_get_instance ());
+    user_list_cache_start (user_list_cache_get_instance (), display_manager);
+    user_image_cache_start (user_image_cache_get_instance ());
 
     /* Connect to logind */
     if (login1_service_connect (login1_service_get_instance ()))
@@ -934,6 +945,12 @@ main (int argc, char **argv)
     /* Clean up shared data manager */
     shared_data_manager_cleanup ();
 
+    /* Clean up user list snapshot */
+    user_list_cache_cleanup ();
+
+    /* Clean up user image cache */
+    user_image_cache_cleanup ();
+
     /* Clean up user list */
     common_user_list_cleanup ();
 
@@ -943,6 +960,9 @@ main (int argc, char **argv)
     /* Clean up display manager */
     g_clear_object (&display_manager);
 
+    /* Clean up secrets */
+    secret_arena_cleanup ();
+
     g_debug ("Exiting with return value %d", exit_code);
     return exit_code;
 }
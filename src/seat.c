@@ -9,6 +9,7 @@
  * license.
  */
 
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
@@ -71,6 +72,15 @@ typedef struct
 
     /* The greeter to be started to replace the current one */
     GreeterSession *replacement_greeter;
+
+    /* Greeters started in the background, ready to be switched to */
+    GList *standby_greeters;
+
+    /* TRUE if greeters can't be kept on standby */
+    gboolean standby_disabled;
+
+    /* Hook scripts that are currently running */
+    GList *scripts;
 } SeatPrivate;
 
 static void seat_logger_iface_init (LoggerInterface *iface);
@@ -92,6 +102,7 @@ static DisplayServer *create_display_server (Seat *seat, Session *session);
 static gboolean start_display_server (Seat *seat, DisplayServer *display_server);
 static GreeterSession *create_greeter_session (Seat *seat);
 static void start_session (Seat *seat, Session *session);
+static void start_standby_greeters (Seat *seat);
 
 static void
 free_seat_module (gpointer data)
@@ -261,7 +272,7 @@ seat_set_active_session (Seat *seat, Session *session)
     {
         Session *s = link->data;
 
-        if (s == session || session_get_is_stopping (s))
+        if (s == session || session_get_is_stopping (s) || g_list_find (priv->standby_greeters, s))
             continue;
 
         if (IS_GREETER_SESSION (s))
@@ -294,6 +305,10 @@ seat_set_active_session (Seat *seat, Session *session)
     session_activate (session);
     g_clear_object (&priv->active_session);
     priv->active_session = g_object_ref (session);
+
+    /* Replace a greeter taken from standby */
+    priv->standby_greeters = g_list_remove (priv->standby_greeters, session);
+    start_standby_greeters (seat);
 }
 
 Session *
@@ -383,53 +398,148 @@ seat_get_allow_guest (Seat *seat)
     return seat_get_boolean_property (seat, "allow-guest") && guest_account_is_installed ();
 }
 
+typedef void (*ScriptCallback)(Seat *seat, gboolean success, gpointer user_data);
+
+typedef struct
+{
+    Seat *seat;
+
+    /* Running script */
+    Process *process;
+
+    /* Display server the script is running on */
+    DisplayServer *display_server;
+
+    /* Timeout to stop the script */
+    guint timeout;
+
+    /* Function to call when the script completes */
+    ScriptCallback callback;
+    gpointer callback_data;
+    GDestroyNotify callback_data_destroy;
+} Script;
+
+static void check_stopped (Seat *seat);
+
+static void
+script_free (Script *script)
+{
+    g_signal_handlers_disconnect_matched (script->process, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, script);
+    if (script->timeout)
+        g_source_remove (script->timeout);
+    g_clear_object (&script->process);
+    g_clear_object (&script->display_server);
+    if (script->callback_data_destroy)
+        script->callback_data_destroy (script->callback_data);
+    g_free (script);
+}
+
 static gboolean
-run_script (Seat *seat, DisplayServer *display_server, const gchar *script_name, User *user, const gchar *home_directory)
+script_timeout_cb (gpointer data)
+{
+    Script *script = data;
+
+    script->timeout = 0;
+    l_warning (script->seat, "Script %s did not complete in time, stopping it", process_get_command (script->process));
+    process_stop (script->process);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+script_stopped_cb (Process *process, Script *script)
+{
+    Seat *seat = script->seat;
+    SeatPrivate *priv = seat_get_instance_private (seat);
+
+    gboolean result = FALSE;
+    int exit_status = process_get_exit_status (process);
+    if (WIFEXITED (exit_status))
+    {
+        l_debug (seat, "Exit status of %s: %d", process_get_command (process), WEXITSTATUS (exit_status));
+        result = WEXITSTATUS (exit_status) == EXIT_SUCCESS;
+    }
+
+    priv->scripts = g_list_remove (priv->scripts, script);
+
+    if (script->callback)
+        script->callback (seat, result, script->callback_data);
+
+    /* Stop the display server if the script was the last thing using it */
+    DisplayServer *display_server = script->display_server;
+    if (display_server && !priv->stopping &&
+        g_list_find (priv->display_servers, display_server) &&
+        !display_server_get_is_stopping (display_server) &&
+        !SEAT_GET_CLASS (seat)->display_server_is_used (seat, display_server))
+    {
+        l_debug (seat, "Stopping display server, no sessions require it");
+        display_server_stop (display_server);
+    }
+
+    script_free (script);
+
+    check_stopped (seat);
+}
+
+/* Runs a hook script without blocking the main loop, callback is called with the result once it completes */
+static void
+run_script (Seat *seat, DisplayServer *display_server, const gchar *script_name, User *user, const gchar *home_directory,
+            ScriptCallback callback, gpointer callback_data, GDestroyNotify callback_data_destroy)
 {
-    g_autoptr(Process) script = process_new (NULL, NULL);
+    SeatPrivate *priv = seat_get_instance_private (seat);
+
+    Script *script = g_malloc0 (sizeof (Script));
+    script->seat = seat;
+    script->process = process_new (NULL, NULL);
+    script->display_server = display_server ? g_object_ref (display_server) : NULL;
+    script->callback = callback;
+    script->callback_data = callback_data;
+    script->callback_data_destroy = callback_data_destroy;
 
-    process_set_command (script, script_name);
+    process_set_command (script->process, script_name);
 
     /* Set POSIX variables */
-    process_set_clear_environment (script, TRUE);
-    process_set_env (script, "SHELL", "/bin/sh");
+    process_set_clear_environment (script->process, TRUE);
+    process_set_env (script->process, "SHELL", "/bin/sh");
 
     if (g_getenv ("LD_PRELOAD"))
-        process_set_env (script, "LD_PRELOAD", g_getenv ("LD_PRELOAD"));
+        process_set_env (script->process, "LD_PRELOAD", g_getenv ("LD_PRELOAD"));
     if (g_getenv ("LD_LIBRARY_PATH"))
-        process_set_env (script, "LD_LIBRARY_PATH", g_getenv ("LD_LIBRARY_PATH"));
+        process_set_env (script->process, "LD_LIBRARY_PATH", g_getenv ("LD_LIBRARY_PATH"));
     if (g_getenv ("PATH"))
-        process_set_env (script, "PATH", g_getenv ("PATH"));
+        process_set_env (script->process, "PATH", g_getenv ("PATH"));
 
     /* Variables required for regression tests */
     if (g_getenv ("LIGHTDM_TEST_ROOT"))
-        process_set_env (script, "LIGHTDM_TEST_ROOT", g_getenv ("LIGHTDM_TEST_ROOT"));
+        process_set_env (script->process, "LIGHTDM_TEST_ROOT", g_getenv ("LIGHTDM_TEST_ROOT"));
 
-    process_set_env (script, "XDG_SEAT", seat_get_name (seat));
+    process_set_env (script->process, "XDG_SEAT", seat_get_name (seat));
 
     if (user)
     {
-        process_set_env (script, "USER", user_get_name (user));
-        process_set_env (script, "LOGNAME", user_get_name (user));
-        process_set_env (script, "HOME", home_directory ? home_directory : user_get_home_directory (user));
+        process_set_env (script->process, "USER", user_get_name (user));
+        process_set_env (script->process, "LOGNAME", user_get_name (user));
+        process_set_env (script->process, "HOME", home_directory ? home_directory : user_get_home_directory (user));
     }
     else
-        process_set_env (script, "HOME", "/");
+        process_set_env (script->process, "HOME", "/");
 
-    SEAT_GET_CLASS (seat)->run_script (seat, display_server, script);
+    SEAT_GET_CLASS (seat)->run_script (seat, display_server, script->process);
 
-    gboolean result = FALSE;
-    if (process_start (script, TRUE))
+    g_signal_connect (script->process, PROCESS_SIGNAL_STOPPED, G_CALLBACK (script_stopped_cb), script);
+    if (!process_start (script->process, FALSE))
     {
-        int exit_status = process_get_exit_status (script);
-        if (WIFEXITED (exit_status))
-        {
-            l_debug (seat, "Exit status of %s: %d", script_name, WEXITSTATUS (exit_status));
-            result = WEXITSTATUS (exit_status) == EXIT_SUCCESS;
-        }
+        if (callback)
+            callback (seat, FALSE, callback_data);
+        script_free (script);
+        return;
     }
 
-    return result;
+    priv->scripts = g_list_append (priv->scripts, script);
+
+    gint timeout = seat_get_integer_property (seat, "script-timeout");
+    if (timeout > 0)
+        script->timeout = g_timeout_add_seconds (timeout, script_timeout_cb, script);
 }
 
 static void
@@ -458,7 +568,8 @@ check_stopped (Seat *seat)
     if (priv->stopping &&
         !priv->stopped &&
         g_list_length (priv->display_servers) == 0 &&
-        g_list_length (priv->sessions) == 0)
+        g_list_length (priv->sessions) == 0 &&
+        g_list_length (priv->scripts) == 0)
     {
         priv->stopped = TRUE;
         l_debug (seat, "Stopped");
@@ -476,7 +587,7 @@ display_server_stopped_cb (DisplayServer *display_server, Seat *seat)
     /* Run a script right after stopping the display server */
     const gchar *script = seat_get_string_property (seat, "display-stopped-script");
     if (script)
-        run_script (seat, NULL, script, NULL, NULL);
+        run_script (seat, NULL, script, NULL, NULL, NULL, NULL, NULL);
 
     g_signal_handlers_disconnect_matched (display_server, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, seat);
     priv->display_servers = g_list_remove (priv->display_servers, display_server);
@@ -544,13 +655,25 @@ find_greeter_session (Seat *seat)
 {
     SeatPrivate *priv = seat_get_instance_private (seat);
 
-    for (GList *link = priv->sessions; link; link = link->next)
+    /* Use a greeter kept on standby first, as that is what they are for.
+     * They can't be used until they have connected */
+    for (GList *link = priv->standby_greeters; link; link = link->next)
     {
         Session *session = link->data;
-        if (!session_get_is_stopping (session) && IS_GREETER_SESSION (session))
+        if (!session_get_is_stopping (session) &&
+            greeter_get_resettable (greeter_session_get_greeter (GREETER_SESSION (session))))
             return GREETER_SESSION (session);
     }
 
+    for (GList *link = priv->sessions; link; link = link->next)
+    {
+        Session *session = link->data;
+        if (session_get_is_stopping (session) || !IS_GREETER_SESSION (session) || g_list_find (priv->standby_greeters, session))
+            continue;
+
+        return GREETER_SESSION (session);
+    }
+
     return NULL;
 }
 
@@ -664,16 +787,16 @@ start_session (Seat *seat, Session *session)
 }
 
 static void
-run_session (Seat *seat, Session *session)
+session_setup_script_cb (Seat *seat, gboolean success, gpointer user_data)
 {
     SeatPrivate *priv = seat_get_instance_private (seat);
+    Session *session = user_data;
 
-    const gchar *script;
-    if (IS_GREETER_SESSION (session))
-        script = seat_get_string_property (seat, "greeter-setup-script");
-    else
-        script = seat_get_string_property (seat, "session-setup-script");
-    if (script && !run_script (seat, session_get_display_server (session), script, session_get_user (session), session_get_home_directory (session)))
+    /* Session may have been stopped while the script was running */
+    if (priv->stopping || session_get_is_stopping (session))
+        return;
+
+    if (!success)
     {
         l_debug (seat, "Switching to greeter due to failed setup script");
         switch_to_greeter_from_failed_session (seat, session);
@@ -708,6 +831,21 @@ run_session (Seat *seat, Session *session)
     }
 }
 
+static void
+run_session (Seat *seat, Session *session)
+{
+    const gchar *script;
+    if (IS_GREETER_SESSION (session))
+        script = seat_get_string_property (seat, "greeter-setup-script");
+    else
+        script = seat_get_string_property (seat, "session-setup-script");
+    if (script)
+        run_script (seat, session_get_display_server (session), script, session_get_user (session), session_get_home_directory (session),
+                    session_setup_script_cb, g_object_ref (session), g_object_unref);
+    else
+        session_setup_script_cb (seat, TRUE, session);
+}
+
 static Session *
 find_user_session (Seat *seat, const gchar *username, Session *ignore_session)
 {
@@ -720,7 +858,8 @@ find_user_session (Seat *seat, const gchar *username, Session *ignore_session)
     {
         Session *session = link->data;
 
-        if (session == ignore_session)
+        /* Greeters all run as the greeter user, they are never a user's session */
+        if (session == ignore_session || IS_GREETER_SESSION (session))
             continue;
 
         if (!session_get_is_stopping (session) && g_strcmp0 (session_get_username (session), username) == 0)
@@ -747,7 +886,8 @@ session_authentication_complete_cb (Session *session, Seat *seat)
 {
     if (session_get_is_authenticated (session))
     {
-        Session *s = find_user_session (seat, session_get_username (session), session);
+        /* Greeters never replace a user's session, even if run as that user */
+        Session *s = IS_GREETER_SESSION (session) ? NULL : find_user_session (seat, session_get_username (session), session);
         if (s)
         {
             l_debug (seat, "Session authenticated, switching to existing user session");
@@ -789,6 +929,8 @@ session_stopped_cb (Session *session, Seat *seat)
     // FIXME: Start a greeter on this?
     if (session == priv->session_to_activate)
         g_clear_object (&priv->session_to_activate);
+    /* Standby greeters are only replaced when used, so a failing greeter isn't restarted */
+    priv->standby_greeters = g_list_remove (priv->standby_greeters, session);
 
     DisplayServer *display_server = session_get_display_server (session);
 
@@ -797,7 +939,7 @@ session_stopped_cb (Session *session, Seat *seat)
     {
         const gchar *script = seat_get_string_property (seat, "session-cleanup-script");
         if (script)
-            run_script (seat, display_server, script, session_get_user (session), session_get_home_directory (session));
+            run_script (seat, display_server, script, session_get_user (session), session_get_home_directory (session), NULL, NULL, NULL);
     }
 
     if (priv->stopping)
@@ -1339,11 +1481,18 @@ find_session_for_display_server (Seat *seat, DisplayServer *display_server)
 }
 
 static void
-display_server_ready_cb (DisplayServer *display_server, Seat *seat)
+display_setup_script_cb (Seat *seat, gboolean success, gpointer user_data)
 {
-    /* Run setup script */
-    const gchar *script = seat_get_string_property (seat, "display-setup-script");
-    if (script && !run_script (seat, display_server, script, NULL, NULL))
+    SeatPrivate *priv = seat_get_instance_private (seat);
+    DisplayServer *display_server = user_data;
+
+    /* Display server may have been stopped while the script was running */
+    if (priv->stopping ||
+        !g_list_find (priv->display_servers, display_server) ||
+        display_server_get_is_stopping (display_server))
+        return;
+
+    if (!success)
     {
         l_debug (seat, "Stopping display server due to failed setup script");
         display_server_stop (display_server);
@@ -1374,6 +1523,18 @@ display_server_ready_cb (DisplayServer *display_server, Seat *seat)
     }
 }
 
+static void
+display_server_ready_cb (DisplayServer *display_server, Seat *seat)
+{
+    /* Run setup script */
+    const gchar *script = seat_get_string_property (seat, "display-setup-script");
+    if (script)
+        run_script (seat, display_server, script, NULL, NULL,
+                    display_setup_script_cb, g_object_ref (display_server), g_object_unref);
+    else
+        display_setup_script_cb (seat, TRUE, display_server);
+}
+
 static DisplayServer *
 create_display_server (Seat *seat, Session *session)
 {
@@ -1414,6 +1575,82 @@ start_display_server (Seat *seat, DisplayServer *display_server)
     }
 }
 
+static void
+standby_greeter_connected_cb (Greeter *greeter, Seat *seat)
+{
+    SeatPrivate *priv = seat_get_instance_private (seat);
+
+    GreeterSession *greeter_session = NULL;
+    for (GList *link = priv->standby_greeters; link; link = link->next)
+    {
+        if (greeter_session_get_greeter (GREETER_SESSION (link->data)) == greeter)
+            greeter_session = link->data;
+    }
+    if (!greeter_session)
+        return;
+
+    if (!greeter_get_resettable (greeter))
+    {
+        l_warning (seat, "Greeter can't be reset, not keeping greeters on standby");
+        priv->standby_disabled = TRUE;
+        priv->standby_greeters = g_list_remove (priv->standby_greeters, greeter_session);
+        session_stop (SESSION (greeter_session));
+        return;
+    }
+
+    /* Keep hidden until switched to */
+    l_debug (seat, "Greeter ready on standby");
+    greeter_idle (greeter);
+}
+
+/* Start greeters in the background so switching to a greeter doesn't have
+ * to wait for one to start */
+static void
+start_standby_greeters (Seat *seat)
+{
+    SeatPrivate *priv = seat_get_instance_private (seat);
+
+    int n_standby = seat_get_integer_property (seat, "greeter-standby-count");
+    if (n_standby <= 0 || priv->standby_disabled || priv->stopping || !seat_get_can_switch (seat))
+        return;
+
+    /* Any greeter that isn't being shown can be switched to */
+    int n_greeters = 0;
+    for (GList *link = priv->sessions; link; link = link->next)
+    {
+        Session *session = link->data;
+        if (IS_GREETER_SESSION (session) && !session_get_is_stopping (session) &&
+            session != priv->active_session && session != priv->session_to_activate)
+            n_greeters++;
+    }
+
+    for (; n_greeters < n_standby; n_greeters++)
+    {
+        l_debug (seat, "Starting greeter on standby");
+
+        GreeterSession *greeter_session = create_greeter_session (seat);
+        if (!greeter_session)
+            return;
+        priv->standby_greeters = g_list_append (priv->standby_greeters, greeter_session);
+        g_signal_connect (greeter_session_get_greeter (greeter_session), GREETER_SIGNAL_CONNECTED, G_CALLBACK (standby_greeter_connected_cb), seat);
+
+        DisplayServer *display_server = create_display_server (seat, SESSION (greeter_session));
+        if (!display_server)
+        {
+            l_debug (seat, "Failed to create a display server for standby greeter");
+            session_stop (SESSION (greeter_session));
+            return;
+        }
+        session_set_display_server (SESSION (greeter_session), display_server);
+        if (!start_display_server (seat, display_server))
+        {
+            l_debug (seat, "Failed to start display server for standby greeter");
+            session_stop (SESSION (greeter_session));
+            return;
+        }
+    }
+}
+
 gboolean
 seat_switch_to_greeter (Seat *seat)
 {
@@ -1425,7 +1662,16 @@ seat_switch_to_greeter (Seat *seat)
     GreeterSession *greeter_session = find_greeter_session (seat);
     if (greeter_session)
     {
-        l_debug (seat, "Switching to existing greeter");
+        /* Standby greeters were idled when they started, so need to be reset to be shown */
+        if (g_list_find (priv->standby_greeters, greeter_session))
+        {
+            l_debug (seat, "Switching to standby greeter");
+            Greeter *greeter = greeter_session_get_greeter (greeter_session);
+            set_greeter_hints (seat, greeter);
+            greeter_reset (greeter);
+        }
+        else
+            l_debug (seat, "Switching to existing greeter");
         seat_set_active_session (seat, SESSION (greeter_session));
         return TRUE;
     }
@@ -1816,6 +2062,14 @@ seat_real_display_server_is_used (Seat *seat, DisplayServer *display_server)
             return TRUE;
     }
 
+    /* Scripts may still be using this display server */
+    for (GList *link = priv->scripts; link; link = link->next)
+    {
+        Script *script = link->data;
+        if (script->display_server == display_server)
+            return TRUE;
+    }
+
     return FALSE;
 }
 
@@ -1942,10 +2196,12 @@ seat_finalize (GObject *object)
         g_signal_handlers_disconnect_matched (session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
     }
     g_list_free_full (priv->sessions, g_object_unref);
+    g_list_free_full (priv->scripts, (GDestroyNotify) script_free);
     g_clear_object (&priv->active_session);
     g_clear_object (&priv->next_session);
     g_clear_object (&priv->session_to_activate);
     g_clear_object (&priv->replacement_greeter);
+    g_list_free (priv->standby_greeters);
 
     G_OBJECT_CLASS (seat_parent_class)->finalize (object);
 }
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "secret-arena.h"
+
+/* Memory for passwords and the greeter messages that carry them.  A fixed
+ * region is mapped at startup and locked so it is never written to swap.
+ * It is split into blocks with power of two sizes that are kept on a free
+ * list for each size, so allocating a secret doesn't use the heap.  Blocks
+ * are zeroed when they are freed.  Allocations that don't fit in the arena
+ * use the heap, and are still zeroed when freed. */
+
+#define ARENA_PAGE_SIZE 4096
+
+/* Blocks are 32 bytes to 64KiB */
+#define MIN_BLOCK_SHIFT 5
+#define N_SIZE_CLASSES 12
+
+/* Allocations on the heap are preceded by their size, so they can be zeroed */
+#define FALLBACK_HEADER_SIZE 16
+
+typedef struct FreeBlock
+{
+    struct FreeBlock *next;
+} FreeBlock;
+
+static guint8 *arena = NULL;
+static gsize arena_size = 0;
+static gboolean arena_locked = FALSE;
+
+/* Amount of the arena that has been split into blocks */
+static gsize arena_split = 0;
+
+/* Size class of the blocks in each page */
+static guint8 *page_size_classes = NULL;
+
+static FreeBlock *free_blocks[N_SIZE_CLASSES];
+
+static gsize used = 0;
+static gsize peak_used = 0;
+static guint n_fallbacks = 0;
+
+static gsize
+get_block_size (gint size_class)
+{
+    return (gsize) 1 << (MIN_BLOCK_SHIFT + size_class);
+}
+
+static gint
+get_size_class (gsize n_bytes)
+{
+    for (gint size_class = 0; size_class < N_SIZE_CLASSES; size_class++)
+    {
+        if (n_bytes <= get_block_size (size_class))
+            return size_class;
+    }
+
+    return -1;
+}
+
+static gboolean
+is_in_arena (gconstpointer ptr)
+{
+    return arena != NULL && (const guint8 *) ptr >= arena && (const guint8 *) ptr < arena + arena_size;
+}
+
+/* Split the next unused part of the arena into blocks of @size_class */
+static gboolean
+add_blocks (gint size_class)
+{
+    gsize block_size = get_block_size (size_class);
+    gsize chunk_size = MAX (block_size, ARENA_PAGE_SIZE);
+    if (arena_split + chunk_size > arena_size)
+        return FALSE;
+
+    guint8 *chunk = arena + arena_split;
+    for (gsize offset = 0; offset < chunk_size; offset += ARENA_PAGE_SIZE)
+        page_size_classes[(arena_split + offset) / ARENA_PAGE_SIZE] = size_class;
+    arena_split += chunk_size;
+
+    /* Add in reverse so the blocks are used in address order */
+    for (gsize offset = chunk_size; offset > 0; offset -= block_size)
+    {
+        FreeBlock *block = (FreeBlock *) (chunk + offset - block_size);
+        block->next = free_blocks[size_class];
+        free_blocks[size_class] = block;
+    }
+
+    return TRUE;
+}
+
+static gsize
+get_allocation_size (gpointer ptr)
+{
+    if (is_in_arena (ptr))
+    {
+        gsize page = ((guint8 *) ptr - arena) / ARENA_PAGE_SIZE;
+        return get_block_size (page_size_classes[page]);
+    }
+
+    gsize n_bytes;
+    memcpy (&n_bytes, (guint8 *) ptr - FALLBACK_HEADER_SIZE, sizeof (n_bytes));
+    return n_bytes;
+}
+
+/**
+ * secret_arena_init:
+ * @size: Number of bytes to reserve for secrets, or 0 to keep them on the heap
+ * @lock: %TRUE to lock the memory so it is never swapped
+ *
+ * Reserve the memory secrets are kept in.
+ **/
+void
+secret_arena_init (gsize size, gboolean lock)
+{
+    g_return_if_fail (arena == NULL);
+
+    size = (size + ARENA_PAGE_SIZE - 1) / ARENA_PAGE_SIZE * ARENA_PAGE_SIZE;
+    if (size == 0)
+        return;
+
+    void *region = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        g_warning ("Failed to reserve %zu bytes of memory for secrets: %s", size, strerror (errno));
+        return;
+    }
+
+    if (lock)
+    {
+        if (mlock (region, size) == 0)
+            arena_locked = TRUE;
+        else
+            g_warning ("Failed to lock memory for secrets: %s", strerror (errno));
+    }
+#ifdef MADV_DONTDUMP
+    madvise (region, size, MADV_DONTDUMP);
+#endif
+
+    arena = region;
+    arena_size = size;
+    page_size_classes = g_malloc0 (size / ARENA_PAGE_SIZE);
+
+    g_debug ("Reserved %zu bytes of %s memory for secrets", size, arena_locked ? "locked" : "unlocked");
+}
+
+/**
+ * secret_arena_alloc:
+ * @n_bytes: Number of bytes to allocate
+ *
+ * Allocate memory for a secret, free it with secret_arena_free().
+ *
+ * Return value: Zeroed memory of at least @n_bytes
+ **/
+gpointer
+secret_arena_alloc (gsize n_bytes)
+{
+    gint size_class = arena ? get_size_class (n_bytes) : -1;
+    if (size_class >= 0 && (free_blocks[size_class] || add_blocks (size_class)))
+    {
+        /* Free blocks are zeroed apart from the link */
+        FreeBlock *block = free_blocks[size_class];
+        free_blocks[size_class] = block->next;
+        block->next = NULL;
+
+        used += get_block_size (size_class);
+        peak_used = MAX (peak_used, used);
+
+        return block;
+    }
+
+    if (arena)
+    {
+        if (n_fallbacks == 0)
+            g_warning ("No memory reserved for a %zu byte secret, using the heap", n_bytes);
+        n_fallbacks++;
+    }
+
+    guint8 *data = g_malloc0 (FALLBACK_HEADER_SIZE + n_bytes);
+    memcpy (data, &n_bytes, sizeof (n_bytes));
+    return data + FALLBACK_HEADER_SIZE;
+}
+
+/**
+ * secret_arena_realloc:
+ * @ptr: (allow-none): Memory from secret_arena_alloc() or %NULL
+ * @n_bytes: Number of bytes needed
+ *
+ * Make an allocation larger.  The old memory is zeroed if it is replaced.
+ *
+ * Return value: Memory of at least @n_bytes with the contents of @ptr
+ **/
+gpointer
+secret_arena_realloc (gpointer ptr, gsize n_bytes)
+{
+    if (ptr == NULL)
+        return secret_arena_alloc (n_bytes);
+
+    gsize size = get_allocation_size (ptr);
+    if (n_bytes <= size)
+        return ptr;
+
+    gpointer new_ptr = secret_arena_alloc (n_bytes);
+    memcpy (new_ptr, ptr, size);
+    secret_arena_free (ptr);
+
+    return new_ptr;
+}
+
+/**
+ * secret_arena_free:
+ * @ptr: (allow-none): Memory from secret_arena_alloc() or %NULL
+ *
+ * Zero and free memory used for a secret.
+ **/
+void
+secret_arena_free (gpointer ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    gsize size = get_allocation_size (ptr);
+    memset (ptr, 0, size);
+
+    if (is_in_arena (ptr))
+    {
+        gint size_class = page_size_classes[((guint8 *) ptr - arena) / ARENA_PAGE_SIZE];
+        FreeBlock *block = ptr;
+        block->next = free_blocks[size_class];
+        free_blocks[size_class] = block;
+        used -= size;
+    }
+    else
+        g_free ((guint8 *) ptr - FALLBACK_HEADER_SIZE);
+}
+
+/**
+ * secret_arena_freev:
+ * @values: (allow-none): A %NULL terminated array of secrets from secret_arena_alloc()
+ *
+ * Free an array of secrets, the array itself is allocated with g_malloc().
+ **/
+void
+secret_arena_freev (gchar **values)
+{
+    if (values == NULL)
+        return;
+
+    for (int i = 0; values[i]; i++)
+        secret_arena_free (values[i]);
+    g_free (values);
+}
+
+gsize
+secret_arena_get_size (void)
+{
+    return arena_size;
+}
+
+gsize
+secret_arena_get_used (void)
+{
+    return used;
+}
+
+/**
+ * secret_arena_get_peak_used:
+ *
+ * Get the most memory that has been used from the arena at once, to help
+ * choose the secret-memory-size setting.
+ *
+ * Return value: The number of bytes
+ **/
+gsize
+secret_arena_get_peak_used (void)
+{
+    return peak_used;
+}
+
+/**
+ * secret_arena_get_n_fallbacks:
+ *
+ * Get the number of allocations that didn't fit in the arena.
+ *
+ * Return value: The number of allocations on the heap
+ **/
+guint
+secret_arena_get_n_fallbacks (void)
+{
+    return n_fallbacks;
+}
+
+void
+secret_arena_cleanup (void)
+{
+    if (arena == NULL)
+        return;
+
+    g_debug ("Secret memory used at most %zu of %zu bytes, %u allocations didn't fit", peak_used, arena_size, n_fallbacks);
+
+    memset (arena, 0, arena_split);
+    munmap (arena, arena_size);
+    arena = NULL;
+    arena_size = 0;
+    arena_split = 0;
+    arena_locked = FALSE;
+    g_clear_pointer (&page_size_classes, g_free);
+    memset (free_blocks, 0, sizeof (free_blocks));
+    used = 0;
+    peak_used = 0;
+    n_fallbacks = 0;
+}
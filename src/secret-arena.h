@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef SECRET_ARENA_H_
+#define SECRET_ARENA_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void secret_arena_init (gsize size, gboolean lock);
+
+gpointer secret_arena_alloc (gsize n_bytes);
+
+gpointer secret_arena_realloc (gpointer ptr, gsize n_bytes);
+
+void secret_arena_free (gpointer ptr);
+
+void secret_arena_freev (gchar **values);
+
+gsize secret_arena_get_size (void);
+
+gsize secret_arena_get_used (void);
+
+gsize secret_arena_get_peak_used (void);
+
+guint secret_arena_get_n_fallbacks (void);
+
+void secret_arena_cleanup (void);
+
+G_END_DECLS
+
+#endif /* SECRET_ARENA_H_ */
@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "user-image-cache.h"
+#include "configuration.h"
+#include "privileges.h"
+#include "user-image-index.h"
+#include "user-list.h"
+
+/* Seconds to wait for more changes before updating the cache */
+#define UPDATE_DELAY 1
+
+/* Images larger than this are not cached */
+#define MAX_IMAGE_SIZE (32 * 1024 * 1024)
+
+#define INDEX_FILENAME "index"
+
+typedef struct
+{
+    /* Directory cached images are stored in */
+    gchar *directory;
+
+    /* Timeout to update the cache after the user list changes */
+    guint update_timeout;
+
+    /* TRUE if an update is running and if another is required after it */
+    gboolean updating;
+    gboolean update_pending;
+
+    /* Cancellable for updates */
+    GCancellable *cancellable;
+
+    /* Cached images and backgrounds keyed by username */
+    GHashTable *user_images;
+    GHashTable *user_backgrounds;
+} UserImageCachePrivate;
+
+/* Information about a user, copied so it can be used in the update thread */
+typedef struct
+{
+    gchar *name;
+    uid_t uid;
+    gid_t gid;
+    gchar *home_directory;
+
+    /* AccountsService path or NULL if from the password file */
+    gchar *path;
+
+    /* Image provided by AccountsService */
+    gchar *image;
+} ImageUser;
+
+typedef struct
+{
+    gchar *directory;
+    GPtrArray *users;
+
+    /* Cached images and backgrounds found for each user */
+    GHashTable *user_images;
+    GHashTable *user_backgrounds;
+} ImageUpdate;
+
+G_DEFINE_TYPE_WITH_PRIVATE (UserImageCache, user_image_cache, G_TYPE_OBJECT)
+
+static UserImageCache *singleton = NULL;
+
+UserImageCache *
+user_image_cache_get_instance (void)
+{
+    if (!singleton)
+        singleton = g_object_new (USER_IMAGE_CACHE_TYPE, NULL);
+    return singleton;
+}
+
+void
+user_image_cache_cleanup (void)
+{
+    g_clear_object (&singleton);
+}
+
+static void
+image_user_free (gpointer data)
+{
+    ImageUser *user = data;
+    g_free (user->name);
+    g_free (user->home_directory);
+    g_free (user->path);
+    g_free (user->image);
+    g_free (user);
+}
+
+static void
+image_update_free (gpointer data)
+{
+    ImageUpdate *update = data;
+    g_free (update->directory);
+    g_ptr_array_unref (update->users);
+    g_clear_pointer (&update->user_images, g_hash_table_unref);
+    g_clear_pointer (&update->user_backgrounds, g_hash_table_unref);
+    g_free (update);
+}
+
+/* Read files as the user so they can't make us copy files they can't read */
+static gboolean
+become_user (ImageUser *user)
+{
+    if (geteuid () != 0)
+        return FALSE;
+#ifdef HAVE_SETFSUID
+    privileges_drop_thread (user->uid, user->gid);
+#endif
+    return TRUE;
+}
+
+static void
+become_root (void)
+{
+#ifdef HAVE_SETFSUID
+    privileges_reclaim_thread ();
+#endif
+}
+
+/* Get the background from AccountsService, called from the update thread */
+static gchar *
+get_accounts_background (GDBusConnection *bus, const gchar *path)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) result = g_dbus_connection_call_sync (bus,
+                                                              "org.freedesktop.Accounts",
+                                                              path,
+                                                              "org.freedesktop.DBus.Properties",
+                                                              "Get",
+                                                              g_variant_new ("(ss)", "org.freedesktop.DisplayManager.AccountsService", "BackgroundFile"),
+                                                              G_VARIANT_TYPE ("(v)"),
+                                                              G_DBUS_CALL_FLAGS_NONE,
+                                                              -1,
+                                                              NULL,
+                                                              &error);
+    if (!result)
+        return NULL;
+
+    g_autoptr(GVariant) value = NULL;
+    g_variant_get (result, "(v)", &value);
+    if (!g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+        return NULL;
+
+    return g_variant_dup_string (value, NULL);
+}
+
+/* Find the image for a user from the password file, called as the user */
+static gchar *
+get_passwd_image (ImageUser *user)
+{
+    if (!user->home_directory)
+        return NULL;
+
+    const gchar *names[] = { ".face", ".face.icon" };
+    for (gsize i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        g_autofree gchar *image = g_build_filename (user->home_directory, names[i], NULL);
+        if (g_file_test (image, G_FILE_TEST_EXISTS))
+            return g_steal_pointer (&image);
+    }
+
+    return NULL;
+}
+
+/* Read up to @size bytes from an image */
+static gchar *
+read_image (int fd, gsize size, gsize *length)
+{
+    g_autofree gchar *data = g_malloc (size + 1);
+    gsize n_read = 0;
+    while (n_read < size)
+    {
+        ssize_t n = read (fd, data + n_read, size - n_read);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return NULL;
+        if (n == 0)
+            break;
+        n_read += n;
+    }
+    data[n_read] = '\0';
+
+    *length = n_read;
+    return g_steal_pointer (&data);
+}
+
+/* Copy an image into the cache if not already there, called as the user.
+ * The checks are made on the opened file so it can't be swapped for a link
+ * or special file after being checked */
+static gchar *
+cache_image (const gchar *directory, const gchar *image, gboolean changed_user)
+{
+    int fd = open (image, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    if (fstat (fd, &info) < 0 || !S_ISREG (info.st_mode) || info.st_size > MAX_IMAGE_SIZE)
+    {
+        close (fd);
+        return NULL;
+    }
+
+    /* Name the copy after the image so changed images get a new copy */
+    g_autofree gchar *key = g_strdup_printf ("%s\n%" G_GINT64_FORMAT "\n%" G_GUINT64_FORMAT, image, (gint64) info.st_mtime, (guint64) info.st_size);
+    g_autofree gchar *filename = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+    g_autofree gchar *cached_image = g_build_filename (directory, filename, NULL);
+    if (g_file_test (cached_image, G_FILE_TEST_EXISTS))
+    {
+        close (fd);
+        return g_steal_pointer (&cached_image);
+    }
+
+    gsize length;
+    g_autofree gchar *data = read_image (fd, info.st_size, &length);
+    if (!data)
+        g_debug ("Failed to read user image %s: %s", image, strerror (errno));
+    close (fd);
+    if (!data)
+        return NULL;
+
+    /* Write the copy as ourself */
+    if (changed_user)
+        become_root ();
+    g_autoptr(GError) error = NULL;
+    gboolean result = user_image_index_write_file (cached_image, data, length, &error);
+    if (!result)
+        g_warning ("Failed to write cached user image: %s", error->message);
+
+    return result ? g_steal_pointer (&cached_image) : NULL;
+}
+
+/* Returns the cached copy of an image or NULL if it could not be cached */
+static const gchar *
+add_image (ImageUpdate *update, ImageUser *user, GHashTable *images, const gchar *image)
+{
+    gboolean changed_user = become_user (user);
+    g_autofree gchar *passwd_image = NULL;
+    if (!image && !user->path)
+        image = passwd_image = get_passwd_image (user);
+    g_autofree gchar *cached_image = NULL;
+    if (image && image[0] != '\0' && !g_hash_table_contains (images, image))
+        cached_image = cache_image (update->directory, image, changed_user);
+    if (changed_user)
+        become_root ();
+
+    if (cached_image)
+        g_hash_table_insert (images, g_strdup (image), g_steal_pointer (&cached_image));
+
+    return image ? g_hash_table_lookup (images, image) : NULL;
+}
+
+/* Remove copies of images that are no longer used */
+static void
+remove_unused_images (const gchar *directory, GHashTable *images)
+{
+    g_autoptr(GHashTable) used = g_hash_table_new (g_str_hash, g_str_equal);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init (&iter, images);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        g_hash_table_add (used, (gpointer) strrchr (value, '/') + 1);
+
+    g_autoptr(GDir) dir = g_dir_open (directory, 0, NULL);
+    if (!dir)
+        return;
+    const gchar *filename;
+    while ((filename = g_dir_read_name (dir)))
+    {
+        if (strcmp (filename, INDEX_FILENAME) == 0 || g_hash_table_contains (used, filename))
+            continue;
+
+        g_autofree gchar *path = g_build_filename (directory, filename, NULL);
+        g_debug ("Removing unused user image %s", path);
+        g_unlink (path);
+    }
+}
+
+static void
+update_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    ImageUpdate *update = task_data;
+
+    if (g_mkdir_with_parents (update->directory, 0755) < 0)
+    {
+        g_task_return_new_error (task, G_FILE_ERROR, g_file_error_from_errno (errno),
+                                 "Failed to make user image cache directory %s: %s", update->directory, strerror (errno));
+        return;
+    }
+
+    g_autoptr(GDBusConnection) bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+    g_autoptr(GHashTable) images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    for (guint i = 0; i < update->users->len; i++)
+    {
+        ImageUser *user = g_ptr_array_index (update->users, i);
+
+        if (g_cancellable_is_cancelled (cancellable))
+            break;
+
+        const gchar *cached_image = add_image (update, user, images, user->image);
+        if (cached_image)
+            g_hash_table_insert (update->user_images, g_strdup (user->name), g_strdup (cached_image));
+        if (user->path && bus)
+        {
+            g_autofree gchar *background = get_accounts_background (bus, user->path);
+            const gchar *cached_background = background ? add_image (update, user, images, background) : NULL;
+            if (cached_background)
+                g_hash_table_insert (update->user_backgrounds, g_strdup (user->name), g_strdup (cached_background));
+        }
+    }
+
+    if (g_task_return_error_if_cancelled (task))
+        return;
+
+    remove_unused_images (update->directory, images);
+
+    g_autofree gchar *index_path = g_build_filename (update->directory, INDEX_FILENAME, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!user_image_index_write (index_path, images, &error))
+    {
+        g_task_return_error (task, g_steal_pointer (&error));
+        return;
+    }
+
+    g_debug ("Cached %u user images", g_hash_table_size (images));
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+update_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    UserImageCache *cache = USER_IMAGE_CACHE (object);
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+
+    g_autoptr(GError) error = NULL;
+    if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            return;
+        g_warning ("Failed to update user image cache: %s", error->message);
+    }
+    else
+    {
+        ImageUpdate *update = g_task_get_task_data (G_TASK (result));
+        g_clear_pointer (&priv->user_images, g_hash_table_unref);
+        g_clear_pointer (&priv->user_backgrounds, g_hash_table_unref);
+        priv->user_images = g_steal_pointer (&update->user_images);
+        priv->user_backgrounds = g_steal_pointer (&update->user_backgrounds);
+    }
+
+    priv->updating = FALSE;
+    if (priv->update_pending)
+    {
+        priv->update_pending = FALSE;
+        user_image_cache_update (cache);
+    }
+}
+
+void
+user_image_cache_update (UserImageCache *cache)
+{
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+
+    g_return_if_fail (cache != NULL);
+
+    if (priv->update_timeout)
+    {
+        g_source_remove (priv->update_timeout);
+        priv->update_timeout = 0;
+    }
+
+    /* Images are read from a thread, which can only be done safely if it can
+     * access files as each user without affecting the rest of the daemon */
+#ifndef HAVE_SETFSUID
+    if (geteuid () == 0)
+        return;
+#endif
+
+    CommonUserList *user_list = common_user_list_get_instance ();
+    if (!priv->directory || !common_user_list_get_is_loaded (user_list))
+        return;
+
+    /* Only run one update at a time */
+    if (priv->updating)
+    {
+        priv->update_pending = TRUE;
+        return;
+    }
+
+    ImageUpdate *update = g_malloc0 (sizeof (ImageUpdate));
+    update->directory = g_strdup (priv->directory);
+    update->users = g_ptr_array_new_with_free_func (image_user_free);
+    update->user_images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    update->user_backgrounds = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    for (GList *link = common_user_list_get_users (user_list); link; link = link->next)
+    {
+        CommonUser *common_user = link->data;
+        ImageUser *user = g_malloc0 (sizeof (ImageUser));
+        user->name = g_strdup (common_user_get_name (common_user));
+        user->uid = common_user_get_uid (common_user);
+        user->gid = common_user_get_gid (common_user);
+        user->home_directory = g_strdup (common_user_get_home_directory (common_user));
+        user->path = g_strdup (common_user_get_path (common_user));
+        /* Only AccountsService users have their image without accessing the home directory */
+        if (user->path)
+            user->image = g_strdup (common_user_get_image (common_user));
+        g_ptr_array_add (update->users, user);
+    }
+
+    priv->updating = TRUE;
+    g_autoptr(GTask) task = g_task_new (cache, priv->cancellable, update_cb, NULL);
+    g_task_set_task_data (task, update, image_update_free);
+    g_task_run_in_thread (task, update_thread);
+}
+
+const gchar *
+user_image_cache_get_directory (UserImageCache *cache)
+{
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+    g_return_val_if_fail (cache != NULL, NULL);
+    return priv->directory;
+}
+
+/* Open the cached copy of a user's image, returns -1 if not in the cache */
+int
+user_image_cache_open (UserImageCache *cache, const gchar *username, gboolean background)
+{
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+
+    g_return_val_if_fail (cache != NULL, -1);
+    g_return_val_if_fail (username != NULL, -1);
+
+    GHashTable *images = background ? priv->user_backgrounds : priv->user_images;
+    const gchar *cached_image = images ? g_hash_table_lookup (images, username) : NULL;
+    if (!cached_image)
+        return -1;
+
+    int fd = open (cached_image, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        g_debug ("Failed to open cached user image %s: %s", cached_image, strerror (errno));
+
+    return fd;
+}
+
+static gboolean
+update_timeout_cb (gpointer data)
+{
+    UserImageCache *cache = data;
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+
+    priv->update_timeout = 0;
+    user_image_cache_update (cache);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_update (UserImageCache *cache)
+{
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+
+    if (priv->update_timeout == 0)
+        priv->update_timeout = g_timeout_add_seconds (UPDATE_DELAY, update_timeout_cb, cache);
+}
+
+static void
+users_changed_cb (CommonUserList *user_list, GList *added, GList *removed, GList *changed, UserImageCache *cache)
+{
+    queue_update (cache);
+}
+
+static void
+user_list_loaded_cb (CommonUserList *user_list, UserImageCache *cache)
+{
+    queue_update (cache);
+}
+
+void
+user_image_cache_start (UserImageCache *cache)
+{
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+
+    g_return_if_fail (cache != NULL);
+
+    g_autofree gchar *cache_dir = config_get_string (config_get_instance (), "LightDM", "cache-directory");
+    priv->directory = g_build_filename (cache_dir, "images", NULL);
+
+    CommonUserList *user_list = common_user_list_get_instance ();
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USERS_CHANGED, G_CALLBACK (users_changed_cb), cache);
+    g_signal_connect (user_list, USER_LIST_SIGNAL_LOADED, G_CALLBACK (user_list_loaded_cb), cache);
+    if (common_user_list_get_is_loaded (user_list))
+        queue_update (cache);
+}
+
+static void
+user_image_cache_init (UserImageCache *cache)
+{
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (cache);
+    priv->cancellable = g_cancellable_new ();
+}
+
+static void
+user_image_cache_finalize (GObject *object)
+{
+    UserImageCache *self = USER_IMAGE_CACHE (object);
+    UserImageCachePrivate *priv = user_image_cache_get_instance_private (self);
+
+    g_signal_handlers_disconnect_by_data (common_user_list_get_instance (), self);
+
+    if (priv->update_timeout)
+        g_source_remove (priv->update_timeout);
+    g_cancellable_cancel (priv->cancellable);
+    g_clear_object (&priv->cancellable);
+    g_clear_pointer (&priv->directory, g_free);
+    g_clear_pointer (&priv->user_images, g_hash_table_unref);
+    g_clear_pointer (&priv->user_backgrounds, g_hash_table_unref);
+
+    G_OBJECT_CLASS (user_image_cache_parent_class)->finalize (object);
+}
+
+static void
+user_image_cache_class_init (UserImageCacheClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = user_image_cache_finalize;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef USER_IMAGE_CACHE_H_
+#define USER_IMAGE_CACHE_H_
+
+#include <glib-object.h>
+
+typedef struct UserImageCache UserImageCache;
+
+G_BEGIN_DECLS
+
+#define USER_IMAGE_CACHE_TYPE (user_image_cache_get_type())
+#define USER_IMAGE_CACHE(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), USER_IMAGE_CACHE_TYPE, UserImageCache))
+#define USER_IMAGE_CACHE_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST ((klass), USER_IMAGE_CACHE_TYPE, UserImageCacheClass))
+#define USER_IMAGE_CACHE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), USER_IMAGE_CACHE_TYPE, UserImageCacheClass))
+
+struct UserImageCache
+{
+    GObject parent_instance;
+};
+
+typedef struct
+{
+    GObjectClass parent_class;
+} UserImageCacheClass;
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UserImageCache, g_object_unref)
+
+GType user_image_cache_get_type (void);
+
+UserImageCache *user_image_cache_get_instance (void);
+
+void user_image_cache_start (UserImageCache *cache);
+
+void user_image_cache_cleanup (void);
+
+void user_image_cache_update (UserImageCache *cache);
+
+const gchar *user_image_cache_get_directory (UserImageCache *cache);
+
+int user_image_cache_open (UserImageCache *cache, const gchar *username, gboolean background);
+
+G_END_DECLS
+
+#endif /* USER_IMAGE_CACHE_H_ */
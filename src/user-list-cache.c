@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include <config.h>
+
+#include "user-list-cache.h"
+#include "configuration.h"
+#include "greeter-session.h"
+#include "seat.h"
+#include "user-list.h"
+#include "user-list-snapshot.h"
+
+/* Seconds to wait for more changes before writing the snapshot */
+#define WRITE_DELAY 1
+
+typedef struct
+{
+    /* Display manager to get sessions from */
+    DisplayManager *display_manager;
+
+    /* Path to snapshot */
+    gchar *path;
+
+    /* Generation of the last snapshot written */
+    guint64 generation;
+
+    /* TRUE if a snapshot has been written by this daemon */
+    gboolean have_written;
+
+    /* Timeout to write the snapshot after the user list changes */
+    guint write_timeout;
+} UserListCachePrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE (UserListCache, user_list_cache, G_TYPE_OBJECT)
+
+static UserListCache *singleton = NULL;
+
+UserListCache *
+user_list_cache_get_instance (void)
+{
+    if (!singleton)
+        singleton = g_object_new (USER_LIST_CACHE_TYPE, NULL);
+    return singleton;
+}
+
+void
+user_list_cache_cleanup (void)
+{
+    g_clear_object (&singleton);
+}
+
+/* Get the names of all users with running sessions */
+static GHashTable *
+get_logged_in_users (UserListCache *cache)
+{
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+
+    GHashTable *users = g_hash_table_new (g_str_hash, g_str_equal);
+    if (!priv->display_manager)
+        return users;
+
+    for (GList *seat_link = display_manager_get_seats (priv->display_manager); seat_link; seat_link = seat_link->next)
+    {
+        Seat *seat = seat_link->data;
+        for (GList *session_link = seat_get_sessions (seat); session_link; session_link = session_link->next)
+        {
+            Session *session = session_link->data;
+            if (IS_GREETER_SESSION (session) || !session_get_is_run (session) || !session_get_username (session))
+                continue;
+            g_hash_table_add (users, (gpointer) session_get_username (session));
+        }
+    }
+
+    return users;
+}
+
+void
+user_list_cache_update (UserListCache *cache)
+{
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+
+    g_return_if_fail (cache != NULL);
+
+    if (priv->write_timeout)
+    {
+        g_source_remove (priv->write_timeout);
+        priv->write_timeout = 0;
+    }
+
+    /* Don't block waiting for the user list, the greeter will load it itself */
+    CommonUserList *user_list = common_user_list_get_instance ();
+    if (!priv->path || !common_user_list_get_is_loaded (user_list))
+        return;
+
+    g_autoptr(GHashTable) logged_in_users = get_logged_in_users (cache);
+    g_autoptr(GError) error = NULL;
+    if (!user_list_snapshot_write (priv->path, common_user_list_get_users (user_list), logged_in_users, priv->generation + 1, &error))
+    {
+        g_warning ("Failed to write user list snapshot: %s", error->message);
+        return;
+    }
+
+    priv->generation++;
+    priv->have_written = TRUE;
+    g_debug ("Wrote user list snapshot %s generation %" G_GUINT64_FORMAT, priv->path, priv->generation);
+}
+
+const gchar *
+user_list_cache_get_path (UserListCache *cache)
+{
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+    g_return_val_if_fail (cache != NULL, NULL);
+    return priv->path;
+}
+
+/* Returns 0 if the snapshot was not written by this daemon and needs to be checked by the reader */
+guint64
+user_list_cache_get_generation (UserListCache *cache)
+{
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+    g_return_val_if_fail (cache != NULL, 0);
+    return priv->have_written ? priv->generation : 0;
+}
+
+static gboolean
+write_timeout_cb (gpointer data)
+{
+    UserListCache *cache = data;
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+
+    priv->write_timeout = 0;
+    user_list_cache_update (cache);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_write (UserListCache *cache)
+{
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+
+    if (priv->write_timeout == 0)
+        priv->write_timeout = g_timeout_add_seconds (WRITE_DELAY, write_timeout_cb, cache);
+}
+
+static void
+user_list_changed_cb (CommonUserList *user_list, CommonUser *user, UserListCache *cache)
+{
+    queue_write (cache);
+}
+
+static void
+user_list_loaded_cb (CommonUserList *user_list, UserListCache *cache)
+{
+    queue_write (cache);
+}
+
+static void
+session_changed_cb (Seat *seat, Session *session, UserListCache *cache)
+{
+    if (!IS_GREETER_SESSION (session))
+        queue_write (cache);
+}
+
+static void
+watch_seat (UserListCache *cache, Seat *seat)
+{
+    g_signal_connect (seat, SEAT_SIGNAL_RUNNING_USER_SESSION, G_CALLBACK (session_changed_cb), cache);
+    g_signal_connect (seat, SEAT_SIGNAL_SESSION_REMOVED, G_CALLBACK (session_changed_cb), cache);
+}
+
+static void
+seat_added_cb (DisplayManager *display_manager, Seat *seat, UserListCache *cache)
+{
+    watch_seat (cache, seat);
+}
+
+void
+user_list_cache_start (UserListCache *cache, DisplayManager *display_manager)
+{
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (cache);
+
+    g_return_if_fail (cache != NULL);
+
+    priv->display_manager = g_object_ref (display_manager);
+
+    g_autofree gchar *cache_dir = config_get_string (config_get_instance (), "LightDM", "cache-directory");
+    priv->path = g_build_filename (cache_dir, "user-list", NULL);
+
+    /* Continue from the previous generation so greeters never accept an old snapshot */
+    priv->generation = user_list_snapshot_read_generation (priv->path);
+
+    /* Logged in users are part of the snapshot */
+    g_signal_connect (display_manager, DISPLAY_MANAGER_SIGNAL_SEAT_ADDED, G_CALLBACK (seat_added_cb), cache);
+    for (GList *link = display_manager_get_seats (display_manager); link; link = link->next)
+        watch_seat (cache, link->data);
+
+    CommonUserList *user_list = common_user_list_get_instance ();
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USER_ADDED, G_CALLBACK (user_list_changed_cb), cache);
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USER_CHANGED, G_CALLBACK (user_list_changed_cb), cache);
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USER_REMOVED, G_CALLBACK (user_list_changed_cb), cache);
+    g_signal_connect (user_list, USER_LIST_SIGNAL_LOADED, G_CALLBACK (user_list_loaded_cb), cache);
+    common_user_list_start_loading (user_list);
+}
+
+static void
+user_list_cache_init (UserListCache *cache)
+{
+}
+
+static void
+user_list_cache_finalize (GObject *object)
+{
+    UserListCache *self = USER_LIST_CACHE (object);
+    UserListCachePrivate *priv = user_list_cache_get_instance_private (self);
+
+    g_signal_handlers_disconnect_by_data (common_user_list_get_instance (), self);
+    if (priv->display_manager)
+    {
+        g_signal_handlers_disconnect_by_data (priv->display_manager, self);
+        for (GList *link = display_manager_get_seats (priv->display_manager); link; link = link->next)
+            g_signal_handlers_disconnect_by_data (link->data, self);
+    }
+
+    if (priv->write_timeout)
+        g_source_remove (priv->write_timeout);
+    g_clear_object (&priv->display_manager);
+    g_clear_pointer (&priv->path, g_free);
+
+    G_OBJECT_CLASS (user_list_cache_parent_class)->finalize (object);
+}
+
+static void
+user_list_cache_class_init (UserListCacheClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = user_list_cache_finalize;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef USER_LIST_CACHE_H_
+#define USER_LIST_CACHE_H_
+
+#include <glib-object.h>
+
+#include "display-manager.h"
+
+typedef struct UserListCache UserListCache;
+
+G_BEGIN_DECLS
+
+#define USER_LIST_CACHE_TYPE (user_list_cache_get_type())
+#define USER_LIST_CACHE(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), USER_LIST_CACHE_TYPE, UserListCache))
+#define USER_LIST_CACHE_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST ((klass), USER_LIST_CACHE_TYPE, UserListCacheClass))
+#define USER_LIST_CACHE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), USER_LIST_CACHE_TYPE, UserListCacheClass))
+
+struct UserListCache
+{
+    GObject parent_instance;
+};
+
+typedef struct
+{
+    GObjectClass parent_class;
+} UserListCacheClass;
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UserListCache, g_object_unref)
+
+GType user_list_cache_get_type (void);
+
+UserListCache *user_list_cache_get_instance (void);
+
+void user_list_cache_start (UserListCache *cache, DisplayManager *display_manager);
+
+void user_list_cache_cleanup (void);
+
+void user_list_cache_update (UserListCache *cache);
+
+const gchar *user_list_cache_get_path (UserListCache *cache);
+
+guint64 user_list_cache_get_generation (UserListCache *cache);
+
+G_END_DECLS
+
+#endif /* USER_LIST_CACHE_H_ */
@@ -0,0 +1,164 @@
+/* Encodes and decodes a typical mix of greeter protocol messages and
+ * reports the throughput of each. */
+
+#include <stdlib.h>
+#include <glib.h>
+
+#include "greeter-protocol.h"
+
+static gdouble
+elapsed (gint64 start_time)
+{
+    return (g_get_monotonic_time () - start_time) / 1000000.0;
+}
+
+static void
+encode_messages (GByteArray *buffer, GHashTable *hints, guint n_messages)
+{
+    const gchar *secrets[] = { "password", NULL };
+    GreeterProtocolPrompt prompts[] = { { 1, "Password:" } };
+    guint8 properties[256] = { 0 };
+
+    for (guint i = 0; i < n_messages; i++)
+    {
+        switch (i % 5)
+        {
+        case 0:
+            {
+                GreeterProtocolConnectedV2 message = { 0 };
+                message.api_version = 3;
+                message.version = "1.32.0";
+                message.hints = hints;
+                greeter_protocol_write_connected_v2 (buffer, &message);
+            }
+            break;
+        case 1:
+            {
+                GreeterProtocolPromptAuthentication message = { 0 };
+                message.sequence_number = i;
+                message.username = "alice";
+                message.prompts = prompts;
+                message.n_prompts = G_N_ELEMENTS (prompts);
+                greeter_protocol_write_prompt_authentication (buffer, &message);
+            }
+            break;
+        case 2:
+            {
+                GreeterProtocolContinueAuthentication message = { 0 };
+                message.secrets.values = secrets;
+                greeter_protocol_write_continue_authentication (buffer, &message);
+            }
+            break;
+        case 3:
+            {
+                GreeterProtocolUserUpdated message = { 0 };
+                message.properties = properties;
+                message.properties_length = sizeof (properties);
+                greeter_protocol_write_user_updated (buffer, &message);
+            }
+            break;
+        case 4:
+            {
+                GreeterProtocolUserImageResult message = { 0 };
+                message.username = "alice";
+                message.background = 0;
+                message.has_fd = 1;
+                greeter_protocol_write_user_image_result (buffer, &message);
+            }
+            break;
+        }
+    }
+}
+
+static guint
+decode_messages (GByteArray *buffer)
+{
+    guint n_decoded = 0;
+
+    gsize offset = 0;
+    guint32 id;
+    gsize message_length;
+    while (greeter_protocol_read_header (buffer->data + offset, buffer->len - offset, &id, &message_length))
+    {
+        const guint8 *payload = buffer->data + offset + GREETER_PROTOCOL_HEADER_SIZE;
+        gsize payload_length = message_length - GREETER_PROTOCOL_HEADER_SIZE;
+        gboolean valid = FALSE;
+
+        /* The client and the server message IDs overlap, these don't */
+        switch (id)
+        {
+        case SERVER_MESSAGE_CONNECTED_V2:
+            {
+                g_auto(GreeterProtocolConnectedV2) message = { 0 };
+                valid = greeter_protocol_read_connected_v2 (payload, payload_length, &message);
+            }
+            break;
+        case SERVER_MESSAGE_PROMPT_AUTHENTICATION:
+            {
+                g_auto(GreeterProtocolPromptAuthentication) message = { 0 };
+                valid = greeter_protocol_read_prompt_authentication (payload, payload_length, &message);
+            }
+            break;
+        case GREETER_MESSAGE_CONTINUE_AUTHENTICATION:
+            {
+                g_auto(GreeterProtocolContinueAuthentication) message = { 0 };
+                valid = greeter_protocol_read_continue_authentication (payload, payload_length, &message);
+                if (valid)
+                    g_strfreev (greeter_protocol_strings_dup (&message.secrets, g_malloc));
+            }
+            break;
+        case SERVER_MESSAGE_USER_UPDATED:
+            {
+                g_auto(GreeterProtocolUserUpdated) message = { 0 };
+                valid = greeter_protocol_read_user_updated (payload, payload_length, &message);
+            }
+            break;
+        case SERVER_MESSAGE_USER_IMAGE_RESULT:
+            {
+                g_auto(GreeterProtocolUserImageResult) message = { 0 };
+                valid = greeter_protocol_read_user_image_result (payload, payload_length, &message);
+            }
+            break;
+        }
+        if (!valid)
+        {
+            g_printerr ("Failed to decode message %u at offset %zu\n", id, offset);
+            exit (EXIT_FAILURE);
+        }
+
+        n_decoded++;
+        offset += message_length;
+    }
+
+    return n_decoded;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint n_messages = 1000000;
+    if (argc > 1)
+        n_messages = atoi (argv[1]);
+
+    g_autoptr(GHashTable) hints = g_hash_table_new (g_str_hash, g_str_equal);
+    g_hash_table_insert (hints, "default-session", "ubuntu");
+    g_hash_table_insert (hints, "hide-users", "false");
+    g_hash_table_insert (hints, "show-manual-login", "true");
+    g_hash_table_insert (hints, "has-guest-account", "true");
+
+    g_autoptr(GByteArray) buffer = g_byte_array_new ();
+
+    gint64 start_time = g_get_monotonic_time ();
+    encode_messages (buffer, hints, n_messages);
+    gdouble encode_time = elapsed (start_time);
+    g_print ("Encoded %u messages (%u bytes) in %.3fs, %.0f messages/s, %.1f MB/s\n",
+             n_messages, buffer->len, encode_time, n_messages / encode_time, buffer->len / encode_time / 1000000);
+
+    start_time = g_get_monotonic_time ();
+    guint n_decoded = decode_messages (buffer);
+    gdouble decode_time = elapsed (start_time);
+    g_print ("Decoded %u messages (%u bytes) in %.3fs, %.0f messages/s, %.1f MB/s\n",
+             n_decoded, buffer->len, decode_time, n_decoded / decode_time, buffer->len / decode_time / 1000000);
+
+    return EXIT_SUCCESS;
+}
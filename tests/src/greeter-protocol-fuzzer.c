@@ -0,0 +1,167 @@
+/* Feeds data to the greeter protocol decoders.  Build with
+ * -fsanitize=fuzzer,address to use it as a libFuzzer target, otherwise it
+ * decodes the files given on the command line or, with no arguments, random
+ * corruptions of valid messages.  Use --iterations N to set how many
+ * corruptions are tried. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "greeter-protocol.h"
+
+int LLVMFuzzerTestOneInput (const guint8 *data, size_t size);
+
+#define DECODE_MESSAGE(id, value, name, TypeName, fields) \
+    case value: \
+        { \
+            g_auto(GreeterProtocol##TypeName) message = { 0 }; \
+            greeter_protocol_read_##name (payload, payload_length, &message); \
+        } \
+        break;
+
+static void
+decode_greeter_message (guint32 id, const guint8 *payload, gsize payload_length)
+{
+    switch (id)
+    {
+    GREETER_PROTOCOL_GREETER_MESSAGES (DECODE_MESSAGE, )
+    }
+
+    /* Secrets are copied out of the message separately */
+    if (id == GREETER_MESSAGE_CONTINUE_AUTHENTICATION)
+    {
+        g_auto(GreeterProtocolContinueAuthentication) message = { 0 };
+        if (greeter_protocol_read_continue_authentication (payload, payload_length, &message))
+        {
+            g_auto(GStrv) secrets = greeter_protocol_strings_dup (&message.secrets, g_malloc);
+            g_assert (g_strv_length (secrets) == message.secrets.length);
+        }
+    }
+}
+
+static void
+decode_server_message (guint32 id, const guint8 *payload, gsize payload_length)
+{
+    switch (id)
+    {
+    GREETER_PROTOCOL_SERVER_MESSAGES (DECODE_MESSAGE, )
+    }
+}
+
+int
+LLVMFuzzerTestOneInput (const guint8 *data, size_t size)
+{
+    gsize offset = 0;
+    guint32 id;
+    gsize message_length;
+    while (greeter_protocol_read_header (data + offset, size - offset, &id, &message_length) &&
+           size - offset >= message_length)
+    {
+        /* Copy the payload so reading past it is detected */
+        gsize payload_length = message_length - GREETER_PROTOCOL_HEADER_SIZE;
+        g_autofree guint8 *payload = g_malloc (payload_length);
+        if (payload_length > 0)
+            memcpy (payload, data + offset + GREETER_PROTOCOL_HEADER_SIZE, payload_length);
+        decode_greeter_message (id, payload, payload_length);
+        decode_server_message (id, payload, payload_length);
+        offset += message_length;
+    }
+
+    return 0;
+}
+
+#ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+
+static GByteArray *
+make_seed (void)
+{
+    GByteArray *buffer = g_byte_array_new ();
+
+    GreeterProtocolConnect connect = { 0 };
+    connect.version = "1.0";
+    connect.resettable = 1;
+    connect.api_version = 3;
+    connect.capabilities = GREETER_CAPABILITY_USER_LIST;
+    greeter_protocol_write_connect (buffer, &connect);
+
+    const gchar *secrets[] = { "password", "", "123456", NULL };
+    GreeterProtocolContinueAuthentication continue_authentication = { 0 };
+    continue_authentication.secrets.values = secrets;
+    greeter_protocol_write_continue_authentication (buffer, &continue_authentication);
+
+    g_autoptr(GHashTable) hints = g_hash_table_new (g_str_hash, g_str_equal);
+    g_hash_table_insert (hints, "default-session", "ubuntu");
+    g_hash_table_insert (hints, "has-guest-account", "true");
+    GreeterProtocolConnectedV2 connected = { 0 };
+    connected.api_version = 3;
+    connected.version = "1.0";
+    connected.hints = hints;
+    greeter_protocol_write_connected_v2 (buffer, &connected);
+
+    GreeterProtocolReset reset = { 0 };
+    reset.hints = hints;
+    greeter_protocol_write_reset (buffer, &reset);
+
+    GreeterProtocolPrompt prompts[] = { { 1, "Password:" }, { 4, "Welcome" } };
+    GreeterProtocolPromptAuthentication prompt = { 0 };
+    prompt.sequence_number = 1;
+    prompt.username = "alice";
+    prompt.prompts = prompts;
+    prompt.n_prompts = G_N_ELEMENTS (prompts);
+    greeter_protocol_write_prompt_authentication (buffer, &prompt);
+
+    guint8 properties[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    GreeterProtocolUserUpdated user_updated = { 0 };
+    user_updated.properties = properties;
+    user_updated.properties_length = sizeof (properties);
+    greeter_protocol_write_user_updated (buffer, &user_updated);
+
+    return buffer;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint n_iterations = 100000;
+    if (argc == 3 && strcmp (argv[1], "--iterations") == 0)
+    {
+        n_iterations = strtoul (argv[2], NULL, 10);
+        argc = 1;
+    }
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            g_autofree gchar *data = NULL;
+            gsize data_length;
+            g_autoptr(GError) error = NULL;
+            if (!g_file_get_contents (argv[i], &data, &data_length, &error))
+            {
+                g_printerr ("Failed to read %s: %s\n", argv[i], error->message);
+                return EXIT_FAILURE;
+            }
+            LLVMFuzzerTestOneInput ((const guint8 *) data, data_length);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    g_autoptr(GByteArray) seed = make_seed ();
+    LLVMFuzzerTestOneInput (seed->data, seed->len);
+
+    /* Corrupt a few bytes of the seed and truncate it at random */
+    g_autofree guint8 *data = g_malloc (seed->len);
+    for (guint i = 0; i < n_iterations; i++)
+    {
+        memcpy (data, seed->data, seed->len);
+        guint n_changes = g_random_int_range (1, 8);
+        for (guint j = 0; j < n_changes; j++)
+            data[g_random_int_range (0, seed->len)] = g_random_int_range (0, 256);
+        LLVMFuzzerTestOneInput (data, g_random_int_range (0, seed->len + 1));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#endif
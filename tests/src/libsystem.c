@@ -24,6 +24,7 @@
 #include <utmpx.h>
 #ifdef __linux__
 #include <linux/vt.h>
+#include <sys/inotify.h>
 #endif
 #include <glib.h>
 #include <xcb/xcb.h>
@@ -187,6 +188,18 @@ setresuid (uid_t ruid, uid_t uuid, uid_t suid)
     return 0;
 }
 
+int
+setfsuid (uid_t fsuid)
+{
+    return 0;
+}
+
+int
+setfsgid (gid_t fsgid)
+{
+    return 0;
+}
+
 static gchar *
 redirect_path (const gchar *path)
 {
@@ -237,6 +250,9 @@ redirect_path (const gchar *path)
     if (g_str_has_prefix (path, "/run"))
         return g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "run", path + strlen ("/run"), NULL);
 
+    if (strcmp (path, "/etc/passwd") == 0)
+        return g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "etc", "passwd", NULL);
+
     if (g_str_has_prefix (path, "/etc/xdg"))
         return g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "etc", "xdg", path + strlen ("/etc/xdg"), NULL);
 
@@ -444,6 +460,24 @@ chmod (const char *path, mode_t mode)
     return _chmod (new_path, mode);
 }
 
+#ifdef __linux__
+int
+inotify_add_watch (int fd, const char *pathname, uint32_t mask)
+{
+    int (*_inotify_add_watch) (int fd, const char *pathname, uint32_t mask) = dlsym (RTLD_NEXT, "inotify_add_watch");
+
+    /* The passwd file is monitored by watching the directory it is in */
+    if (strcmp (pathname, "/etc") == 0)
+    {
+        g_autofree gchar *new_path = g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "etc", NULL);
+        return _inotify_add_watch (fd, new_path, mask);
+    }
+
+    g_autofree gchar *new_path = redirect_path (pathname);
+    return _inotify_add_watch (fd, new_path, mask);
+}
+#endif
+
 int
 ioctl (int d, unsigned long request, ...)
 {
@@ -740,9 +774,10 @@ load_passwd_file (void)
             entry->pw_gecos = g_strdup (fields[4]);
             entry->pw_dir = g_strdup (fields[5]);
             entry->pw_shell = g_strdup (fields[6]);
-            user_entries = g_list_append (user_entries, entry);
+            user_entries = g_list_prepend (user_entries, entry);
         }
     }
+    user_entries = g_list_reverse (user_entries);
 }
 
 struct passwd *
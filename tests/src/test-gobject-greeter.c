@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <xcb/xcb.h>
 #include <lightdm.h>
 #include <glib-unix.h>
@@ -17,6 +19,8 @@ static LightDMGreeter *greeter;
 static xcb_connection_t *connection = NULL;
 static GKeyFile *config;
 
+static gchar *get_user_names (GList *users);
+
 static void
 show_message_cb (LightDMGreeter *greeter, const gchar *text, LightDMMessageType type)
 {
@@ -166,6 +170,46 @@ read_shared_data_finished (GObject *object, GAsyncResult *result, gpointer data)
         status_notify ("%s READ-SHARED-DATA ERROR=%s", greeter_id, error->message);
 }
 
+static void
+read_user_image_finished (GObject *object, GAsyncResult *result, gpointer data)
+{
+    LightDMGreeter *greeter = LIGHTDM_GREETER (object);
+    g_autofree gchar *username = data;
+
+    g_autoptr(GError) error = NULL;
+    int fd = lightdm_greeter_open_user_image_finish (greeter, result, &error);
+    if (error)
+    {
+        status_notify ("%s READ-USER-IMAGE USERNAME=%s ERROR=%s", greeter_id, username, error->message);
+        return;
+    }
+    if (fd < 0)
+    {
+        status_notify ("%s READ-USER-IMAGE USERNAME=%s RESULT=NONE", greeter_id, username);
+        return;
+    }
+
+    struct stat info;
+    gboolean result_ok = fstat (fd, &info) == 0 && S_ISREG (info.st_mode);
+    close (fd);
+    status_notify ("%s READ-USER-IMAGE USERNAME=%s RESULT=%s", greeter_id, username, result_ok ? "TRUE" : "FALSE");
+}
+
+/* Report once the daemon has made a copy of the user's image */
+static gboolean
+check_user_image_cached_cb (gpointer data)
+{
+    const gchar *username = data;
+
+    LightDMUser *user = lightdm_user_list_get_user_by_name (lightdm_user_list_get_instance (), username);
+    const gchar *image = user ? lightdm_user_get_image (user) : NULL;
+    if (!image || g_strcmp0 (lightdm_user_get_cached_image (user), image) == 0)
+        return G_SOURCE_CONTINUE;
+
+    status_notify ("%s USER-IMAGE-CACHED USERNAME=%s", greeter_id, username);
+    return G_SOURCE_REMOVE;
+}
+
 static int
 compare_session (gconstpointer a, gconstpointer b)
 {
@@ -244,6 +288,16 @@ request_cb (const gchar *name, GHashTable *params)
     else if (strcmp (name, "READ-SHARED-DATA") == 0)
         lightdm_greeter_ensure_shared_data_dir (greeter, g_hash_table_lookup (params, "USERNAME"), NULL, read_shared_data_finished, NULL);
 
+    else if (strcmp (name, "READ-USER-IMAGE") == 0)
+    {
+        const gchar *username = g_hash_table_lookup (params, "USERNAME");
+        gboolean background = g_strcmp0 (g_hash_table_lookup (params, "BACKGROUND"), "TRUE") == 0;
+        lightdm_greeter_open_user_image (greeter, username, background, NULL, read_user_image_finished, g_strdup (username));
+    }
+
+    else if (strcmp (name, "WAIT-USER-IMAGE-CACHED") == 0)
+        g_timeout_add_full (G_PRIORITY_DEFAULT, 50, check_user_image_cached_cb, g_strdup (g_hash_table_lookup (params, "USERNAME")), g_free);
+
     else if (strcmp (name, "WATCH-USER") == 0)
     {
         const gchar *username = g_hash_table_lookup (params, "USERNAME");
@@ -315,6 +369,23 @@ request_cb (const gchar *name, GHashTable *params)
         }
     }
 
+    else if (strcmp (name, "LOG-USER-RANGE") == 0)
+    {
+        guint offset = atoi (g_hash_table_lookup (params, "OFFSET"));
+        guint count = atoi (g_hash_table_lookup (params, "COUNT"));
+        g_autoptr(GList) users = lightdm_user_list_get_range (lightdm_user_list_get_instance (), offset, count);
+        g_autofree gchar *names = get_user_names (users);
+        status_notify ("%s LOG-USER-RANGE OFFSET=%u COUNT=%u USERS=%s", greeter_id, offset, count, names);
+    }
+
+    else if (strcmp (name, "FIND-USER-PREFIX") == 0)
+    {
+        const gchar *prefix = g_hash_table_lookup (params, "PREFIX");
+        g_autoptr(GList) users = lightdm_user_list_find_prefix (lightdm_user_list_get_instance (), prefix);
+        g_autofree gchar *names = get_user_names (users);
+        status_notify ("%s FIND-USER-PREFIX PREFIX=%s USERS=%s", greeter_id, prefix, names);
+    }
+
     else if (strcmp (name, "LOG-SESSIONS") == 0)
     {
         GList *sessions = lightdm_get_sessions ();
@@ -391,6 +462,28 @@ user_removed_cb (LightDMUserList *user_list, LightDMUser *user)
     status_notify ("%s USER-REMOVED USERNAME=%s", greeter_id, lightdm_user_get_name (user));
 }
 
+static gchar *
+get_user_names (GList *users)
+{
+    g_autoptr(GString) names = g_string_new ("");
+    for (GList *link = users; link; link = link->next)
+    {
+        if (link != users)
+            g_string_append_c (names, ',');
+        g_string_append (names, lightdm_user_get_name (link->data));
+    }
+    return g_strdup (names->str);
+}
+
+static void
+users_changed_cb (LightDMUserList *user_list, GList *added, GList *removed, GList *changed)
+{
+    g_autofree gchar *added_names = get_user_names (added);
+    g_autofree gchar *removed_names = get_user_names (removed);
+    g_autofree gchar *changed_names = get_user_names (changed);
+    status_notify ("%s USERS-CHANGED ADDED=%s REMOVED=%s CHANGED=%s", greeter_id, added_names, removed_names, changed_names);
+}
+
 static void
 connect_finished (GObject *object, GAsyncResult *result, gpointer data)
 {
@@ -496,16 +589,29 @@ main (int argc, char **argv)
         g_signal_connect (greeter, LIGHTDM_GREETER_SIGNAL_IDLE, G_CALLBACK (idle_cb), NULL);
         g_signal_connect (greeter, LIGHTDM_GREETER_SIGNAL_RESET, G_CALLBACK (reset_cb), NULL);
     }
+    if (g_key_file_get_boolean (config, "test-greeter-config", "load-users", NULL))
+        lightdm_greeter_set_load_users (greeter, TRUE);
 
     if (g_key_file_get_boolean (config, "test-greeter-config", "log-user-changes", NULL))
     {
         g_signal_connect (lightdm_user_list_get_instance (), LIGHTDM_USER_LIST_SIGNAL_USER_ADDED, G_CALLBACK (user_added_cb), NULL);
         g_signal_connect (lightdm_user_list_get_instance (), LIGHTDM_USER_LIST_SIGNAL_USER_REMOVED, G_CALLBACK (user_removed_cb), NULL);
     }
+    if (g_key_file_get_boolean (config, "test-greeter-config", "log-users-changed", NULL))
+        g_signal_connect (lightdm_user_list_get_instance (), LIGHTDM_USER_LIST_SIGNAL_USERS_CHANGED, G_CALLBACK (users_changed_cb), NULL);
 
     status_notify ("%s CONNECT-TO-DAEMON", greeter_id);
     lightdm_greeter_connect_to_daemon (greeter, NULL, connect_finished, NULL);
 
+    /* Start authenticating without waiting to be connected */
+    if (g_key_file_get_boolean (config, "test-greeter-config", "authenticate-autologin-on-connect", NULL))
+    {
+        status_notify ("%s AUTHENTICATE-AUTOLOGIN", greeter_id);
+        g_autoptr(GError) error = NULL;
+        if (!lightdm_greeter_authenticate_autologin (greeter, &error))
+            status_notify ("%s FAIL-AUTHENTICATE-AUTOLOGIN ERROR=%s", greeter_id, error->message);
+    }
+
     g_main_loop_run (loop);
 
     if (g_key_file_has_key (config, "test-greeter-config", "return-value", NULL))
@@ -7,6 +7,7 @@
 #include <QLightDM/Greeter>
 #include <QLightDM/Power>
 #include <QLightDM/UsersModel>
+#include <QLightDM/UsersFilterModel>
 #include <QLightDM/SessionsModel>
 #include <QtCore/QSettings>
 #include <QtCore/QDebug>
@@ -22,6 +23,8 @@ static QSettings *config = NULL;
 static QLightDM::PowerInterface *power = NULL;
 static TestGreeter *greeter = NULL;
 static QLightDM::UsersModel *users_model = NULL;
+static QLightDM::UsersFilterModel *users_filter_model = NULL;
+static QStringList watched_users;
 static QLightDM::SessionsModel *sessions_model = NULL;
 
 TestGreeter::TestGreeter ()
@@ -30,6 +33,7 @@ TestGreeter::TestGreeter ()
     connect (this, SIGNAL(showPrompt(QString, QLightDM::Greeter::PromptType)), SLOT(showPrompt(QString, QLightDM::Greeter::PromptType)));
     connect (this, SIGNAL(authenticationComplete()), SLOT(authenticationComplete()));
     connect (this, SIGNAL(autologinTimerExpired()), SLOT(autologinTimerExpired()));
+    connect (this, SIGNAL(startSessionFinished(bool)), SLOT(startSessionFinished(bool)));
 }
 
 void TestGreeter::showMessage (QString text, QLightDM::Greeter::MessageType type)
@@ -56,6 +60,12 @@ void TestGreeter::autologinTimerExpired ()
 {
 }
 
+void TestGreeter::startSessionFinished (bool success)
+{
+    if (!success)
+        status_notify ("%s SESSION-FAILED ERROR=%s", greeter_id, "FIXME: Exceptions in Qt");
+}
+
 void TestGreeter::printHints ()
 {
     if (selectUserHint() != "")
@@ -111,6 +121,16 @@ void TestGreeter::userRowsRemoved (const QModelIndex & parent, int start, int en
     }
 }
 
+void TestGreeter::userDataChanged (const QModelIndex & topLeft, const QModelIndex & bottomRight)
+{
+    for (int i = topLeft.row (); i <= bottomRight.row (); i++)
+    {
+        QString name = users_model->data (users_model->index (i, 0), QLightDM::UsersModel::NameRole).toString ();
+        if (watched_users.contains (name))
+            status_notify ("%s USER-CHANGED USERNAME=%s", greeter_id, qPrintable (name));
+    }
+}
+
 static void
 signal_cb (int signum)
 {
@@ -166,6 +186,14 @@ request_cb (const gchar *name, GHashTable *params)
         }
     }
 
+    else if (strcmp (name, "START-SESSION-ASYNC") == 0)
+    {
+        if (g_hash_table_lookup (params, "SESSION"))
+            greeter->startSession ((const gchar *) g_hash_table_lookup (params, "SESSION"));
+        else
+            greeter->startSession ();
+    }
+
     else if (strcmp (name, "LOG-USER-LIST-LENGTH") == 0)
         status_notify ("%s LOG-USER-LIST-LENGTH N=%d", greeter_id, users_model->rowCount (QModelIndex ()));
 
@@ -189,6 +217,24 @@ request_cb (const gchar *name, GHashTable *params)
         }
     }
 
+    else if (strcmp (name, "WATCH-USER") == 0)
+    {
+        const gchar *username = (const gchar *) g_hash_table_lookup (params, "USERNAME");
+        watched_users.append (username);
+        status_notify ("%s WATCH-USER USERNAME=%s", greeter_id, username);
+    }
+
+    else if (strcmp (name, "FILTER-USERS") == 0)
+    {
+        if (g_hash_table_lookup (params, "TEXT"))
+            users_filter_model->setFilterText ((const gchar *) g_hash_table_lookup (params, "TEXT"));
+
+        QStringList names;
+        for (int i = 0; i < users_filter_model->rowCount (QModelIndex ()); i++)
+            names.append (users_filter_model->data (users_filter_model->index (i, 0), QLightDM::UsersModel::NameRole).toString ());
+        status_notify ("%s FILTER-USERS TEXT=%s USERS=%s", greeter_id, qPrintable (users_filter_model->filterText ()), qPrintable (names.join (",")));
+    }
+
     else if (strcmp (name, "LOG-SESSIONS") == 0)
     {
         QStringList names;
@@ -326,6 +372,9 @@ main(int argc, char *argv[])
         QObject::connect (users_model, SIGNAL(rowsInserted(const QModelIndex&, int, int)), greeter, SLOT(userRowsInserted(const QModelIndex&, int, int)));
         QObject::connect (users_model, SIGNAL(rowsAboutToBeRemoved(const QModelIndex&, int, int)), greeter, SLOT(userRowsRemoved(const QModelIndex&, int, int)));
     }
+    QObject::connect (users_model, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)), greeter, SLOT(userDataChanged(const QModelIndex&, const QModelIndex&)));
+    users_filter_model = new QLightDM::UsersFilterModel ();
+    users_filter_model->setSourceModel (users_model);
 
     sessions_model = new QLightDM::SessionsModel();
 
@@ -15,8 +15,10 @@ private Q_SLOTS:
     void showPrompt(QString text, QLightDM::Greeter::PromptType type);
     void authenticationComplete();
     void autologinTimerExpired();
+    void startSessionFinished(bool success);
     void userRowsInserted(const QModelIndex & parent, int start, int end);
     void userRowsRemoved(const QModelIndex & parent, int start, int end);
+    void userDataChanged(const QModelIndex & topLeft, const QModelIndex & bottomRight);
     void idle();
     void reset();
 };
@@ -0,0 +1,256 @@
+/* -*- Mode: C; indent-tabs-mode: nil; tab-width: 4 -*- */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib-unix.h>
+
+#include "greeter-protocol.h"
+#include "greeter-trace.h"
+#include "status.h"
+
+/* Replays the greeter side of a trace recorded with greeter-trace-directory
+ * and reports how long the daemon takes to reply to each message. */
+
+/* Time to wait for the daemon to reply before giving up */
+#define REPLY_TIMEOUT (5 * G_USEC_PER_SEC)
+
+static gchar *greeter_id;
+static GMainLoop *loop;
+
+static int to_server_fd = -1;
+static int from_server_fd = -1;
+static GByteArray *read_buffer;
+
+static gboolean
+sigint_cb (gpointer user_data)
+{
+    status_notify ("%s TERMINATE SIGNAL=%d", greeter_id, SIGINT);
+    g_main_loop_quit (loop);
+    return TRUE;
+}
+
+static gboolean
+sigterm_cb (gpointer user_data)
+{
+    status_notify ("%s TERMINATE SIGNAL=%d", greeter_id, SIGTERM);
+    g_main_loop_quit (loop);
+    return TRUE;
+}
+
+static void
+request_cb (const gchar *name, GHashTable *params)
+{
+}
+
+static gboolean
+write_message (const guint8 *message, gsize message_length)
+{
+    gsize offset = 0;
+    while (offset < message_length)
+    {
+        ssize_t n_written = write (to_server_fd, message + offset, message_length - offset);
+        if (n_written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        offset += n_written;
+    }
+
+    return TRUE;
+}
+
+/* Wait until @deadline for a message from the daemon and return its ID */
+static gboolean
+read_message (gint64 deadline, guint32 *id)
+{
+    while (TRUE)
+    {
+        gsize message_length;
+        if (greeter_protocol_read_header (read_buffer->data, read_buffer->len, id, &message_length) &&
+            read_buffer->len >= message_length)
+        {
+            g_byte_array_remove_range (read_buffer, 0, message_length);
+            return TRUE;
+        }
+
+        gint64 timeout = deadline - g_get_monotonic_time ();
+        if (timeout <= 0)
+            return FALSE;
+        struct pollfd fds = { from_server_fd, POLLIN, 0 };
+        int result = poll (&fds, 1, (timeout + 999) / 1000);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return FALSE;
+
+        guint8 data[1024];
+        ssize_t n_read = read (from_server_fd, data, sizeof (data));
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read <= 0)
+            return FALSE;
+        g_byte_array_append (read_buffer, data, n_read);
+    }
+}
+
+/* Find the first message the daemon sent in reply to the greeter message at @offset */
+static gboolean
+find_reply (const guint8 *data, gsize length, gsize offset, guint32 *reply_id)
+{
+    GreeterTraceRecord record;
+    while (greeter_trace_read_record (data, length, &offset, &record) && record.direction != GREETER_TRACE_FROM_GREETER)
+    {
+        if (record.direction == GREETER_TRACE_TO_GREETER)
+        {
+            *reply_id = record.id;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+replay (const guint8 *data, gsize length, gdouble speed)
+{
+    gsize offset;
+    if (!greeter_trace_read_header (data, length, &offset))
+    {
+        status_notify ("%s REPLAY-FAILED ERROR=Not a trace", greeter_id);
+        return FALSE;
+    }
+
+    guint n_messages = 0, n_replies = 0;
+    gint64 total_latency = 0, max_latency = 0;
+    gint64 last_timestamp = -1, last_sent = 0;
+    GreeterTraceRecord record;
+    while (greeter_trace_read_record (data, length, &offset, &record))
+    {
+        if (record.direction != GREETER_TRACE_FROM_GREETER)
+            continue;
+
+        /* Keep the gaps between messages, as the user took to type them */
+        if (last_timestamp >= 0 && speed > 0)
+        {
+            gint64 delay = (record.timestamp - last_timestamp) / speed;
+            gint64 remaining = last_sent + delay - g_get_monotonic_time ();
+            if (remaining > 0)
+                g_usleep (remaining);
+        }
+        last_timestamp = record.timestamp;
+
+        last_sent = g_get_monotonic_time ();
+        if (!write_message (record.message, record.message_length))
+        {
+            status_notify ("%s REPLAY-FAILED ERROR=%s", greeter_id, strerror (errno));
+            return FALSE;
+        }
+        n_messages++;
+
+        guint32 reply_id;
+        if (!find_reply (data, length, offset, &reply_id))
+        {
+            status_notify ("%s REPLAY MESSAGE=%u", greeter_id, record.id);
+            continue;
+        }
+
+        /* Skip anything else the daemon sends, e.g. users that weren't in the trace */
+        guint32 id;
+        gboolean have_reply = FALSE;
+        while (read_message (last_sent + REPLY_TIMEOUT, &id))
+        {
+            if (id == reply_id)
+            {
+                have_reply = TRUE;
+                break;
+            }
+        }
+        if (!have_reply)
+        {
+            status_notify ("%s REPLAY MESSAGE=%u REPLY=%u TIMEOUT", greeter_id, record.id, reply_id);
+            continue;
+        }
+
+        gint64 latency = g_get_monotonic_time () - last_sent;
+        status_notify ("%s REPLAY MESSAGE=%u REPLY=%u LATENCY=%" G_GINT64_FORMAT, greeter_id, record.id, reply_id, latency);
+        n_replies++;
+        total_latency += latency;
+        max_latency = MAX (max_latency, latency);
+    }
+
+    status_notify ("%s REPLAY-COMPLETE MESSAGES=%u REPLIES=%u MEAN-LATENCY=%" G_GINT64_FORMAT " MAX-LATENCY=%" G_GINT64_FORMAT,
+                   greeter_id, n_messages, n_replies, n_replies > 0 ? total_latency / n_replies : 0, max_latency);
+
+    return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+    const gchar *display = getenv ("DISPLAY");
+    if (display)
+        greeter_id = g_strdup_printf ("GREETER-X-%s", display[0] == ':' ? display + 1 : display);
+    else
+        greeter_id = g_strdup ("GREETER-?");
+
+    loop = g_main_loop_new (NULL, FALSE);
+
+    g_unix_signal_add (SIGINT, sigint_cb, NULL);
+    g_unix_signal_add (SIGTERM, sigterm_cb, NULL);
+
+    status_connect (request_cb, greeter_id);
+
+    status_notify ("%s START", greeter_id);
+
+    g_autoptr(GKeyFile) config = g_key_file_new ();
+    g_autofree gchar *path = g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "script", NULL);
+    g_key_file_load_from_file (config, path, G_KEY_FILE_NONE, NULL);
+
+    /* Traces are relative to the test directory */
+    g_autofree gchar *trace_name = g_key_file_get_string (config, "test-greeter-config", "replay-trace", NULL);
+    if (!trace_name)
+    {
+        status_notify ("%s REPLAY-FAILED ERROR=No trace", greeter_id);
+        return EXIT_FAILURE;
+    }
+    g_autofree gchar *trace_path = g_path_is_absolute (trace_name) ? g_strdup (trace_name) : g_build_filename (SRCDIR, "tests", trace_name, NULL);
+
+    /* Speed to replay at, 1 for the original timing or 0 to send each message as soon as the last is answered */
+    gdouble speed = 1.0;
+    if (g_key_file_has_key (config, "test-greeter-config", "replay-speed", NULL))
+        speed = g_key_file_get_double (config, "test-greeter-config", "replay-speed", NULL);
+
+    g_autofree gchar *trace = NULL;
+    gsize trace_length;
+    g_autoptr(GError) error = NULL;
+    if (!g_file_get_contents (trace_path, &trace, &trace_length, &error))
+    {
+        status_notify ("%s REPLAY-FAILED ERROR=%s", greeter_id, error->message);
+        return EXIT_FAILURE;
+    }
+
+    const gchar *fd = g_getenv ("LIGHTDM_TO_SERVER_FD");
+    if (fd)
+        to_server_fd = atoi (fd);
+    fd = g_getenv ("LIGHTDM_FROM_SERVER_FD");
+    if (fd)
+        from_server_fd = atoi (fd);
+    if (to_server_fd < 0 || from_server_fd < 0)
+    {
+        status_notify ("%s REPLAY-FAILED ERROR=Not started by the daemon", greeter_id);
+        return EXIT_FAILURE;
+    }
+    read_buffer = g_byte_array_new ();
+
+    if (!replay ((const guint8 *) trace, trace_length, speed))
+        return EXIT_FAILURE;
+
+    g_main_loop_run (loop);
+
+    return EXIT_SUCCESS;
+}
@@ -12,6 +12,8 @@
 #include <pwd.h>
 
 #include "../../config.h"
+#include "greeter-protocol.h"
+#include "greeter-trace.h"
 
 /* Timeout in ms waiting for the status we expect */
 static int status_timeout_ms = 4000;
@@ -695,6 +697,162 @@ handle_command (const gchar *command)
 
         check_status (status->str);
     }
+    else if (strcmp (name, "GREETER-LATENCIES") == 0)
+    {
+        g_autoptr(GError) error = NULL;
+        g_autoptr(GVariant) messages_result = g_dbus_connection_call_sync (dbus_conn,
+                                                                           "org.freedesktop.DisplayManager",
+                                                                           "/org/freedesktop/DisplayManager",
+                                                                           "org.freedesktop.DBus.Properties",
+                                                                           "Get",
+                                                                           g_variant_new ("(ss)", "org.freedesktop.DisplayManager", "GreeterMessageLatencies"),
+                                                                           G_VARIANT_TYPE ("(v)"),
+                                                                           G_DBUS_CALL_FLAGS_NONE,
+                                                                           G_MAXINT,
+                                                                           NULL,
+                                                                           &error);
+        g_autoptr(GVariant) prompt_result = NULL;
+        if (messages_result)
+            prompt_result = g_dbus_connection_call_sync (dbus_conn,
+                                                         "org.freedesktop.DisplayManager",
+                                                         "/org/freedesktop/DisplayManager",
+                                                         "org.freedesktop.DBus.Properties",
+                                                         "Get",
+                                                         g_variant_new ("(ss)", "org.freedesktop.DisplayManager", "GreeterPromptResponseLatency"),
+                                                         G_VARIANT_TYPE ("(v)"),
+                                                         G_DBUS_CALL_FLAGS_NONE,
+                                                         G_MAXINT,
+                                                         NULL,
+                                                         &error);
+
+        /* Only the counts are reported as the times vary */
+        g_autoptr(GString) status = g_string_new ("RUNNER GREETER-LATENCIES");
+        if (messages_result && prompt_result)
+        {
+            g_string_append (status, " MESSAGES=");
+
+            g_autoptr(GVariant) messages = NULL;
+            g_variant_get (messages_result, "(v)", &messages);
+
+            GVariantIter iter;
+            g_variant_iter_init (&iter, messages);
+            const gchar *message_name;
+            guint64 count;
+            int i = 0;
+            while (g_variant_iter_next (&iter, "{&s(tt@at)}", &message_name, &count, NULL, NULL))
+            {
+                if (count == 0)
+                    continue;
+                if (i != 0)
+                    g_string_append (status, ",");
+                g_string_append_printf (status, "%s:%" G_GUINT64_FORMAT, message_name, count);
+                i++;
+            }
+
+            g_autoptr(GVariant) prompt = NULL;
+            g_variant_get (prompt_result, "(v)", &prompt);
+            g_variant_get (prompt, "(tt@at)", &count, NULL, NULL);
+            g_string_append_printf (status, " PROMPT-RESPONSES=%" G_GUINT64_FORMAT, count);
+        }
+        else
+        {
+            if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN))
+                g_string_append_printf (status, " ERROR=SERVICE_UNKNOWN");
+            else
+                g_string_append_printf (status, " ERROR=%s", error->message);
+        }
+
+        check_status (status->str);
+    }
+    else if (strcmp (name, "LOG-GREETER-TRACES") == 0)
+    {
+        /* Traces are recorded to /tmp in the test root */
+        g_autofree gchar *dir_path = g_build_filename (temp_dir, "tmp", NULL);
+        g_autoptr(GDir) dir = g_dir_open (dir_path, 0, NULL);
+        const gchar *filename;
+        int n_traces = 0;
+        while (dir && (filename = g_dir_read_name (dir)))
+        {
+            if (!g_str_has_suffix (filename, ".trace"))
+                continue;
+            n_traces++;
+
+            g_autofree gchar *path = g_build_filename (dir_path, filename, NULL);
+            GStatBuf info;
+            g_autofree gchar *data = NULL;
+            gsize length;
+            gsize offset;
+            if (g_stat (path, &info) < 0 ||
+                !g_file_get_contents (path, &data, &length, NULL) ||
+                !greeter_trace_read_header ((const guint8 *) data, length, &offset))
+            {
+                check_status ("RUNNER GREETER-TRACE ERROR=Invalid trace");
+                continue;
+            }
+
+            /* Count the responses to prompts and any secrets left in them */
+            guint n_responses = 0, n_secrets = 0;
+            GreeterTraceRecord record;
+            while (greeter_trace_read_record ((const guint8 *) data, length, &offset, &record))
+            {
+                if (record.direction != GREETER_TRACE_FROM_GREETER || record.id != GREETER_MESSAGE_CONTINUE_AUTHENTICATION)
+                    continue;
+
+                g_auto(GreeterProtocolContinueAuthentication) request = { 0 };
+                if (!greeter_protocol_read_continue_authentication (record.message + GREETER_PROTOCOL_HEADER_SIZE,
+                                                                    record.message_length - GREETER_PROTOCOL_HEADER_SIZE,
+                                                                    &request))
+                    continue;
+                n_responses++;
+
+                g_auto(GStrv) secrets = greeter_protocol_strings_dup (&request.secrets, g_malloc);
+                for (int i = 0; secrets[i]; i++)
+                    if (secrets[i][0] != '\0')
+                        n_secrets++;
+            }
+
+            g_autofree gchar *status_text = g_strdup_printf ("RUNNER GREETER-TRACE MODE=%03o RESPONSES=%u SECRETS=%u", info.st_mode & 0777, n_responses, n_secrets);
+            check_status (status_text);
+        }
+
+        if (n_traces == 0)
+            check_status ("RUNNER GREETER-TRACE ERROR=No traces");
+    }
+    else if (strcmp (name, "USER-LIST-RELOADS") == 0)
+    {
+        g_autoptr(GString) status = g_string_new ("RUNNER USER-LIST-RELOADS");
+        const gchar *properties[] = { "UserListReloads", "UserListSkippedReloads", NULL };
+        const gchar *fields[] = { "RELOADS", "SKIPPED", NULL };
+        for (int i = 0; properties[i]; i++)
+        {
+            g_autoptr(GError) error = NULL;
+            g_autoptr(GVariant) result = g_dbus_connection_call_sync (dbus_conn,
+                                                                      "org.freedesktop.DisplayManager",
+                                                                      "/org/freedesktop/DisplayManager",
+                                                                      "org.freedesktop.DBus.Properties",
+                                                                      "Get",
+                                                                      g_variant_new ("(ss)", "org.freedesktop.DisplayManager", properties[i]),
+                                                                      G_VARIANT_TYPE ("(v)"),
+                                                                      G_DBUS_CALL_FLAGS_NONE,
+                                                                      G_MAXINT,
+                                                                      NULL,
+                                                                      &error);
+            if (!result)
+            {
+                if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN))
+                    g_string_append_printf (status, " ERROR=SERVICE_UNKNOWN");
+                else
+                    g_string_append_printf (status, " ERROR=%s", error->message);
+                break;
+            }
+
+            g_autoptr(GVariant) value = NULL;
+            g_variant_get (result, "(v)", &value);
+            g_string_append_printf (status, " %s=%u", fields[i], g_variant_get_uint32 (value));
+        }
+
+        check_status (status->str);
+    }
     else if (strcmp (name, "SEAT-CAN-SWITCH") == 0)
     {
         const gchar *path = g_hash_table_lookup (params, "PATH");
@@ -867,6 +1025,25 @@ handle_command (const gchar *command)
         g_autofree gchar *status_text = g_strdup_printf ("RUNNER ADD-USER USERNAME=%s", username);
         check_status (status_text);
     }
+    else if (strcmp (name, "ADD-PASSWD-USER") == 0)
+    {
+        const gchar *username = g_hash_table_lookup (params, "USERNAME");
+        const gchar *uid = g_hash_table_lookup (params, "UID");
+
+        /* Append in place so the change is seen as a modification of the file */
+        g_autofree gchar *path = g_build_filename (temp_dir, "etc", "passwd", NULL);
+        FILE *passwd_file = fopen (path, "a");
+        if (passwd_file)
+        {
+            fprintf (passwd_file, "%s:password:%s:%s:%s:%s/home/%s:/bin/sh\n", username, uid, uid, username, temp_dir, username);
+            fclose (passwd_file);
+        }
+        else
+            g_warning ("Failed to open %s: %s", path, strerror (errno));
+
+        g_autofree gchar *status_text = g_strdup_printf ("RUNNER ADD-PASSWD-USER USERNAME=%s", username);
+        check_status (status_text);
+    }
     else if (strcmp (name, "UPDATE-USER") == 0)
     {
         g_autoptr(GString) status_text = g_string_new ("RUNNER UPDATE-USER USERNAME=");
@@ -2617,6 +2794,7 @@ main (int argc, char **argv)
     g_mkdir_with_parents (g_strdup_printf ("%s/usr/share/lightdm/sessions", temp_dir), 0755);
     g_mkdir_with_parents (g_strdup_printf ("%s/usr/share/lightdm/remote-sessions", temp_dir), 0755);
     g_mkdir_with_parents (g_strdup_printf ("%s/usr/share/lightdm/greeters", temp_dir), 0755);
+    g_mkdir_with_parents (g_strdup_printf ("%s/usr/share/lightdm/images", temp_dir), 0755);
     g_mkdir_with_parents (g_strdup_printf ("%s/tmp", temp_dir), 0755);
     g_mkdir_with_parents (g_strdup_printf ("%s/var/lib/lightdm-data", temp_dir), 0755);
     g_mkdir_with_parents (g_strdup_printf ("%s/var/run", temp_dir), 0755);
@@ -2685,6 +2863,8 @@ main (int argc, char **argv)
         g_file_new_build_filename (temp_dir, "usr/share/lightdm/remote-sessions", NULL));
     cp (g_file_new_build_filename (DATADIR, "greeters/*", NULL),
         g_file_new_build_filename (temp_dir, "usr/share/lightdm/greeters", NULL));
+    cp (g_file_new_build_filename (DATADIR, "images/*", NULL),
+        g_file_new_build_filename (temp_dir, "usr/share/lightdm/images", NULL));
 
     /* Set up the default greeter */
     g_autofree gchar *greeter_session = g_strdup_printf ("%s.desktop", DEFAULT_GREETER_SESSION);
@@ -1,4 +1,7 @@
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib-object.h>
 
@@ -20,7 +23,7 @@ main (int argc, char **argv)
 
     if (argc < 2)
     {
-        g_printerr ("Usage: %s text [return-value]\n", argv[0]);
+        g_printerr ("Usage: %s text [return-value] [delay] [ignore-term]\n", argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -32,6 +35,13 @@ main (int argc, char **argv)
         g_string_append_printf (status_text, " USER=%s", g_getenv ("USER"));
     status_notify ("%s", status_text->str);
 
+    /* Check we are killed if we don't respond to being stopped */
+    if (argc > 4 && strcmp (argv[4], "ignore-term") == 0)
+        signal (SIGTERM, SIG_IGN);
+
+    if (argc > 3)
+        sleep (atoi (argv[3]));
+
     if (argc > 2)
         return atoi (argv[2]);
     else
@@ -0,0 +1,127 @@
+/* Loads a large synthetic password database through the getpwent ()
+ * implementation in libsystem and reports how long the user list takes to
+ * load, look up and reload it. */
+
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "user-list.h"
+
+static gchar *passwd_path = NULL;
+
+static guint n_added = 0;
+static guint n_changed = 0;
+static guint n_removed = 0;
+
+static void
+write_passwd (guint n_users, gboolean modified)
+{
+    g_autoptr(GString) data = g_string_new ("");
+
+    for (guint i = 0; i < n_users; i++)
+    {
+        /* Remove one in every 1000 users */
+        if (modified && i % 1000 == 0)
+            continue;
+
+        /* Change the real name of one in every 100 users */
+        const gchar *suffix = modified && i % 100 == 1 ? " (changed)" : "";
+        g_string_append_printf (data, "user%06u::%u:%u:User %u%s:/home/user%06u:/bin/sh\n", i, 1000 + i, 1000 + i, i, suffix, i);
+    }
+
+    /* Add one new user for every 1000 users */
+    if (modified)
+        for (guint i = 0; i < n_users / 1000; i++)
+            g_string_append_printf (data, "new%06u::%u:%u:New %u:/home/new%06u:/bin/sh\n", i, 1000 + n_users + i, 1000 + n_users + i, i, i);
+
+    g_autoptr(GError) error = NULL;
+    if (!g_file_set_contents (passwd_path, data->str, data->len, &error))
+    {
+        g_printerr ("Failed to write %s: %s\n", passwd_path, error->message);
+        exit (EXIT_FAILURE);
+    }
+}
+
+static void
+user_added_cb (CommonUserList *user_list, CommonUser *user)
+{
+    n_added++;
+}
+
+static void
+user_changed_cb (CommonUserList *user_list, CommonUser *user)
+{
+    n_changed++;
+}
+
+static void
+user_removed_cb (CommonUserList *user_list, CommonUser *user)
+{
+    n_removed++;
+}
+
+static gdouble
+elapsed (gint64 start_time)
+{
+    return (g_get_monotonic_time () - start_time) / 1000000.0;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint n_users = 100000;
+    if (argc > 1)
+        n_users = atoi (argv[1]);
+
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *root = g_dir_make_tmp ("lightdm-benchmark-XXXXXX", &error);
+    if (!root)
+    {
+        g_printerr ("Failed to make temporary directory: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    g_setenv ("LIGHTDM_TEST_ROOT", root, TRUE);
+    g_autofree gchar *etc_dir = g_build_filename (root, "etc", NULL);
+    g_mkdir_with_parents (etc_dir, 0755);
+    passwd_path = g_build_filename (etc_dir, "passwd", NULL);
+
+    write_passwd (n_users, FALSE);
+
+    CommonUserList *user_list = common_user_list_get_instance ();
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USER_ADDED, G_CALLBACK (user_added_cb), NULL);
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USER_CHANGED, G_CALLBACK (user_changed_cb), NULL);
+    g_signal_connect (user_list, USER_LIST_SIGNAL_USER_REMOVED, G_CALLBACK (user_removed_cb), NULL);
+
+    gint64 start_time = g_get_monotonic_time ();
+    gint length = common_user_list_get_length (user_list);
+    g_print ("Loaded %d users in %.3fs\n", length, elapsed (start_time));
+
+    start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_users; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("user%06u", i);
+        CommonUser *user = common_user_list_get_user_by_name (user_list, name);
+        if (user)
+            g_object_unref (user);
+    }
+    g_print ("Looked up %u users in %.3fs\n", n_users, elapsed (start_time));
+
+    start_time = g_get_monotonic_time ();
+    common_user_list_reload (user_list);
+    g_print ("Reloaded unchanged users in %.3fs (%u added, %u changed, %u removed)\n", elapsed (start_time), n_added, n_changed, n_removed);
+
+    write_passwd (n_users, TRUE);
+    n_added = n_changed = n_removed = 0;
+    start_time = g_get_monotonic_time ();
+    common_user_list_reload (user_list);
+    g_print ("Reloaded changed users in %.3fs (%u added, %u changed, %u removed)\n", elapsed (start_time), n_added, n_changed, n_removed);
+
+    common_user_list_cleanup ();
+
+    g_unlink (passwd_path);
+    g_rmdir (etc_dir);
+    g_rmdir (root);
+
+    return EXIT_SUCCESS;
+}